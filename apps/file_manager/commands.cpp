@@ -176,6 +176,17 @@ struct PasteOperation {
 	String source, destination;
 };
 
+// Files are copied on the work queue, a few at a time, so that reading one file overlaps with writing another,
+// and the directory walk continues while the copies are in progress.
+#define PASTE_PIPELINE_DEPTH (4)
+
+struct PasteCopyJob {
+	String source, destination;
+	struct PasteTask *task;
+	EsFileOffset lastBytesCopied;
+	uintptr_t item; // The index of the pasted item that the file is part of.
+};
+
 struct PasteTask {
 	// Input:
 	String destinationBase;
@@ -188,18 +199,31 @@ struct PasteTask {
 	EsFileOffset totalDataToProcess, totalDataProcessed;
 	size_t sourceItemCount, sourceItemsProcessed;
 	EsUserTask *userTask;
-	EsFileOffset lastBytesCopied, cumulativeSecondBytesCopied;
+	EsFileOffset cumulativeSecondBytesCopied;
 	EsFileOffsetDifference bytesPerSecond;
 	double cumulativeSecondTimeStampMs;
+
+	// Pipeline:
+	EsMutex pipelineMutex; // Protects the progress state too, since it's updated by the copy jobs.
+	EsConditionVariable pipelineChanged;
+	size_t pipelineJobs;
+	EsError pipelineError;
+	Array<PasteCopyJob *> completedCopies; // Reported by the task's thread, so that the work queue threads don't wait for the message mutex.
+	bool *failedItems; // Set for each pasted item that had a copy fail.
+	size_t itemCount;
 };
 
 bool CommandPasteCopyCallback(EsFileOffset bytesCopied, EsFileOffset totalBytes, EsGeneric data) {
 	(void) totalBytes;
 
-	PasteTask *task = (PasteTask *) data.p;
-	EsFileOffset delta = bytesCopied - task->lastBytesCopied;
+	PasteCopyJob *job = (PasteCopyJob *) data.p;
+	PasteTask *task = job->task;
+	EsFileOffset delta = bytesCopied - job->lastBytesCopied;
+	job->lastBytesCopied = bytesCopied;
+
+	EsMutexAcquire(&task->pipelineMutex);
+	EsDefer(EsMutexRelease(&task->pipelineMutex));
 	task->totalDataProcessed += delta;
-	task->lastBytesCopied = bytesCopied;
 
 	if (task->progressByData) {
 		double timeStampMs = EsTimeStampMs();
@@ -221,7 +245,113 @@ bool CommandPasteCopyCallback(EsFileOffset bytesCopied, EsFileOffset totalBytes,
 	return EsUserTaskIsRunning(task->userTask);
 }
 
-EsError CommandPasteFile(String source, String destinationBase, void **copyBuffer, PasteTask *task, String *_destination) {
+void CommandPasteCopyJob(EsGeneric context) {
+	PasteCopyJob *job = (PasteCopyJob *) context.p;
+	PasteTask *task = job->task;
+	EsError error = EsFileCopy(STRING(job->source), STRING(job->destination), nullptr, CommandPasteCopyCallback, job);
+	bool report = false;
+
+	EsMutexAcquire(&task->pipelineMutex);
+
+	if (error == ES_SUCCESS) {
+		report = task->completedCopies.Add(job);
+	} else {
+		if (task->pipelineError == ES_SUCCESS) task->pipelineError = error;
+		if (job->item < task->itemCount) task->failedItems[job->item] = true;
+	}
+
+	task->pipelineJobs--;
+	EsConditionVariableBroadcast(&task->pipelineChanged);
+	EsMutexRelease(&task->pipelineMutex);
+
+	if (!report) {
+		StringDestroy(&job->source);
+		StringDestroy(&job->destination);
+		EsHeapFree(job);
+	}
+}
+
+void CommandPasteReportCopies(PasteTask *task) {
+	EsMutexAcquire(&task->pipelineMutex);
+	Array<PasteCopyJob *> completedCopies = task->completedCopies;
+	task->completedCopies = {};
+	EsMutexRelease(&task->pipelineMutex);
+
+	if (!completedCopies.Length()) {
+		return;
+	}
+
+	EsMessageMutexAcquire();
+
+	for (uintptr_t i = 0; i < completedCopies.Length(); i++) {
+		if (task->move) FolderFileUpdatedAtPath(completedCopies[i]->source, nullptr);
+		FolderFileUpdatedAtPath(completedCopies[i]->destination, nullptr);
+	}
+
+	EsMessageMutexRelease();
+
+	for (uintptr_t i = 0; i < completedCopies.Length(); i++) {
+		StringDestroy(&completedCopies[i]->source);
+		StringDestroy(&completedCopies[i]->destination);
+		EsHeapFree(completedCopies[i]);
+	}
+
+	completedCopies.Free();
+}
+
+EsError CommandPasteQueueCopy(String source, String destination, PasteTask *task) {
+	CommandPasteReportCopies(task);
+	EsMutexAcquire(&task->pipelineMutex);
+
+	while (task->pipelineJobs == PASTE_PIPELINE_DEPTH) {
+		EsConditionVariableWait(&task->pipelineChanged, &task->pipelineMutex, ES_WAIT_NO_TIMEOUT);
+	}
+
+	EsError error = task->pipelineError; // Stop queueing copies after one fails.
+	if (error == ES_SUCCESS) task->pipelineJobs++;
+	EsMutexRelease(&task->pipelineMutex);
+	if (error != ES_SUCCESS) return error;
+
+	PasteCopyJob *job = (PasteCopyJob *) EsHeapAllocate(sizeof(PasteCopyJob), true);
+
+	if (job) {
+		job->source = StringDuplicate(source);
+		job->destination = StringDuplicate(destination);
+		job->task = task;
+		job->item = task->sourceItemsProcessed;
+		error = EsWorkQueueTask(CommandPasteCopyJob, job, ES_WORK_PRIORITY_LOW, nullptr, nullptr);
+	} else {
+		error = ES_ERROR_INSUFFICIENT_RESOURCES;
+	}
+
+	if (error != ES_SUCCESS) {
+		if (job) {
+			StringDestroy(&job->source);
+			StringDestroy(&job->destination);
+			EsHeapFree(job);
+		}
+
+		EsMutexAcquire(&task->pipelineMutex);
+		task->pipelineJobs--;
+		EsMutexRelease(&task->pipelineMutex);
+	}
+
+	return error;
+}
+
+EsError CommandPasteWaitForCopies(PasteTask *task) {
+	EsMutexAcquire(&task->pipelineMutex);
+
+	while (task->pipelineJobs) {
+		EsConditionVariableWait(&task->pipelineChanged, &task->pipelineMutex, ES_WAIT_NO_TIMEOUT);
+	}
+
+	EsError error = task->pipelineError;
+	EsMutexRelease(&task->pipelineMutex);
+	return error;
+}
+
+EsError CommandPasteFile(String source, String destinationBase, PasteTask *task, String *_destination) {
 	if (!EsUserTaskIsRunning(task->userTask)) {
 		return ES_ERROR_CANCELLED;
 	}
@@ -233,6 +363,7 @@ EsError CommandPasteFile(String source, String destinationBase, void **copyBuffe
 	String name = PathGetName(source);
 	String destination = StringAllocateAndFormat("%s%z%s", STRFMT(destinationBase), PathHasTrailingSlash(destinationBase) ? "" : "/", STRFMT(name));
 	EsError error;
+	bool queued = false;
 
 	if (StringEquals(PathGetParent(source), destinationBase)) {
 		if (task->move) {
@@ -265,8 +396,16 @@ EsError CommandPasteFile(String source, String destinationBase, void **copyBuffe
 		}
 	} else {
 		copy:;
-		task->lastBytesCopied = 0;
-		error = EsFileCopy(STRING(source), STRING(destination), copyBuffer, CommandPasteCopyCallback, task);
+		EsNodeType type;
+
+		if (!EsPathExists(STRING(source), &type)) {
+			error = ES_ERROR_FILE_DOES_NOT_EXIST;
+		} else if (type == ES_NODE_DIRECTORY) {
+			error = ES_ERROR_INCORRECT_NODE_TYPE; // Copy the contents of the directory below.
+		} else {
+			error = CommandPasteQueueCopy(source, destination, task);
+			queued = true; // The copy job will report the updated files.
+		}
 	}
 
 	if (error == ES_ERROR_INCORRECT_NODE_TYPE) {
@@ -280,7 +419,7 @@ EsError CommandPasteFile(String source, String destinationBase, void **copyBuffe
 				for (uintptr_t i = 0; i < childCount && error == ES_SUCCESS; i++) {
 					String childSourcePath = StringAllocateAndFormat("%s%z%s", STRFMT(source), 
 							PathHasTrailingSlash(source) ? "" : "/", buffer[i].nameBytes, buffer[i].name);
-					error = CommandPasteFile(childSourcePath, destination, copyBuffer, task, nullptr);
+					error = CommandPasteFile(childSourcePath, destination, task, nullptr);
 					StringDestroy(&childSourcePath);
 				}
 			}
@@ -289,7 +428,7 @@ EsError CommandPasteFile(String source, String destinationBase, void **copyBuffe
 		}
 	}
 
-	if (error == ES_SUCCESS) {
+	if (error == ES_SUCCESS && !queued) {
 		EsMessageMutexAcquire();
 		if (task->move) FolderFileUpdatedAtPath(source, nullptr);
 		FolderFileUpdatedAtPath(destination, nullptr);
@@ -318,8 +457,6 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 	EsError error = ES_SUCCESS;
 	task->userTask = userTask;
 
-	void *copyBuffer = nullptr;
-
 	const char *position = task->pathList;
 	size_t remainingBytes = task->pathListBytes;
 
@@ -328,6 +465,7 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 		if (!newline) break;
 
 		String source = StringFromLiteralWithSize(position, newline - position);
+		task->itemCount++;
 
 		if (!task->move || !StringEquals(PathGetDrive(source), PathGetDrive(task->destinationBase))) {
 			// Files are actually being copied, so report progress by the amount of data copied,
@@ -355,6 +493,8 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 
 	position = task->pathList;
 	remainingBytes = task->pathListBytes;
+	task->failedItems = (bool *) EsHeapAllocate(task->itemCount * sizeof(bool), true);
+	if (!task->failedItems && task->itemCount) error = ES_ERROR_INSUFFICIENT_RESOURCES, remainingBytes = 0;
 
 	while (remainingBytes && EsUserTaskIsRunning(task->userTask)) {
 		const char *newline = (const char *) EsCRTmemchr(position, '\n', remainingBytes); 
@@ -362,11 +502,17 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 
 		String source = StringFromLiteralWithSize(position, newline - position);
 		String destination;
-		error = CommandPasteFile(source, task->destinationBase, &copyBuffer, task, &destination);
+		error = CommandPasteFile(source, task->destinationBase, task, &destination);
 		if (error != ES_SUCCESS) break;
 
 		PasteOperation operation = { .source = StringDuplicate(source), .destination = destination };
-		pasteOperations.Add(operation);
+
+		if (!pasteOperations.Add(operation)) {
+			StringDestroy(&operation.source);
+			StringDestroy(&operation.destination);
+			error = ES_ERROR_INSUFFICIENT_RESOURCES;
+			break;
+		}
 
 		position += source.bytes + 1;
 		remainingBytes -= source.bytes + 1;
@@ -378,6 +524,21 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 		}
 	}
 
+	EsError pipelineError = CommandPasteWaitForCopies(task);
+	if (error == ES_SUCCESS) error = pipelineError;
+	CommandPasteReportCopies(task);
+
+	// Only the items that were completely copied were moved or can be selected.
+	// The items are processed in order, so an item's index is its index in pasteOperations.
+
+	for (uintptr_t i = pasteOperations.Length(); i > 0; i--) {
+		if (task->failedItems[i - 1]) {
+			StringDestroy(&pasteOperations[i - 1].source);
+			StringDestroy(&pasteOperations[i - 1].destination);
+			pasteOperations.Delete(i - 1);
+		}
+	}
+
 	EsMessageMutexAcquire();
 
 	size_t pathSectionCount = PathCountSections(task->destinationBase);
@@ -432,7 +593,7 @@ void CommandPasteTask(EsUserTask *userTask, EsGeneric _task) {
 	}
 
 	pasteOperations.Free();
-	EsHeapFree(copyBuffer);
+	EsHeapFree(task->failedItems);
 	EsHeapFree(task->pathList);
 	StringDestroy(&task->destinationBase);
 	EsHeapFree(task);
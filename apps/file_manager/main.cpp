@@ -9,6 +9,15 @@
 #include <shared/array.cpp>
 #include <shared/arena.cpp>
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBI_WRITE_NO_STDIO
+#define STBIW_MEMMOVE EsCRTmemmove
+#define STBIW_MALLOC(sz) EsCRTmalloc(sz)
+#define STBIW_REALLOC(p,newsz) EsCRTrealloc(p,newsz)
+#define STBIW_FREE(p) EsCRTfree(p)
+#define STBIW_ASSERT EsAssert
+#include <shared/stb_image_write.h>
+
 // TODO Possible candidates for moving in the core API:
 // 	- String/paths utils
 // 	- Blocking task systems
@@ -27,7 +36,6 @@
 #define PLACES_VIEW_GROUP_DRIVES (1)
 
 #define MESSAGE_BLOCKING_TASK_COMPLETE ((EsMessageType) (ES_MSG_USER_START + 1))
-#define MESSAGE_NON_BLOCKING_TASK_COMPLETE ((EsMessageType) (ES_MSG_USER_START + 2))
 
 #define VIEW_DETAILS (0)
 #define VIEW_TILES (1)
@@ -250,6 +258,7 @@ Array<String> bookmarks;
 #define FOLDER_VIEW_SETTINGS_MAXIMUM_ENTRIES (10000)
 Array<FolderViewSettingsEntry> folderViewSettings;
 HashStore<uint64_t, Thumbnail> thumbnailCache;
+bool thumbnailStoreEvictionQueued; // Stale entries are removed from the thumbnail store once per session.
 
 Array<String> openDocuments;
 
@@ -362,9 +371,12 @@ void BlockingTaskQueue(Instance *instance, Task task) {
 void NonBlockingTaskWrapper(EsGeneric _task) {
 	Task *task = (Task *) _task.p;
 	task->callback(nullptr, task);
-	EsMessage m = { MESSAGE_NON_BLOCKING_TASK_COMPLETE };
-	m.user.context2.p = task;
-	EsMessagePost(nullptr, &m);
+}
+
+void NonBlockingTaskComplete(EsGeneric _task, bool) {
+	Task *task = (Task *) _task.p;
+	if (task->then) task->then(nullptr, task);
+	EsHeapFree(task);
 }
 
 void NonBlockingTaskQueue(Task _task) {
@@ -372,13 +384,7 @@ void NonBlockingTaskQueue(Task _task) {
 	// because the instances might be destroyed while the task is in progress!
 	Task *task = (Task *) EsHeapAllocate(sizeof(Task), false);
 	EsMemoryCopy(task, &_task, sizeof(Task));
-	EsWorkQueue(NonBlockingTaskWrapper, task);
-}
-
-void NonBlockingTaskComplete(EsMessage *message) {
-	Task *task = (Task *) message->user.context2.p;
-	if (task->then) task->then(nullptr, task);
-	EsHeapFree(task);
+	EsWorkQueueTask(NonBlockingTaskWrapper, task, ES_WORK_PRIORITY_NORMAL, nullptr, NonBlockingTaskComplete);
 }
 
 void ConfigurationSave() {
@@ -673,8 +679,6 @@ void _start() {
 		} else if (message->type == MESSAGE_BLOCKING_TASK_COMPLETE) {
 			Instance *instance = (Instance *) message->user.context1.p;
 			if (message->user.context2.u == instance->blockingTaskID) BlockingTaskComplete(instance);
-		} else if (message->type == MESSAGE_NON_BLOCKING_TASK_COMPLETE) {
-			NonBlockingTaskComplete(message);
 		}
 	}
 }
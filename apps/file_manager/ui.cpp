@@ -554,6 +554,192 @@ void ThumbnailResize(uint32_t *bits, uint32_t originalWidth, uint32_t originalHe
 	}
 }
 
+// TODO Determine the best value for these constants -- maybe base it off the current UI scale factor?
+#define THUMBNAIL_MAXIMUM_WIDTH (143)
+#define THUMBNAIL_MAXIMUM_HEIGHT (80)
+
+// Generated thumbnails are kept on disk, so that they don't need to be regenerated in the next session.
+// Entries are named by the file's identifier, and are valid while its modification time and size are unchanged.
+// Each entry records the path of its file, so that the entries for deleted or modified files can be evicted.
+
+#define THUMBNAIL_STORE_FOLDER "|Settings:/Thumbnails/"
+#define THUMBNAIL_STORE_SIGNATURE (0x4D4E4854) // 'THNM'
+#define THUMBNAIL_STORE_VERSION (2)
+#define THUMBNAIL_STORE_MAXIMUM_ENTRIES (4096)
+
+struct ThumbnailStoreHeader {
+	uint32_t signature, version;
+	uint16_t maximumWidth, maximumHeight;
+	uint16_t width, height;
+	EsUniqueIdentifier identifier;
+	uint64_t modificationTime;
+	EsFileOffset fileSize;
+	uint32_t pathBytes, imageBytes; // Followed by the path of the file, and then the thumbnail as a PNG.
+};
+
+struct ThumbnailStoreEntry {
+	uint64_t modificationTime;
+	uintptr_t child;
+};
+
+bool ThumbnailStoreCanUse(const EsFileInformation *information) {
+	// The file system must give the file an identifier and record when it was last modified.
+	EsUniqueIdentifier zero = {};
+	return information->modificationTime && EsMemoryCompare(&information->identifier, &zero, sizeof(EsUniqueIdentifier));
+}
+
+String ThumbnailStoreGetPath(EsUniqueIdentifier identifier) {
+	const char *hexChars = "0123456789ABCDEF";
+	char name[32];
+
+	for (uintptr_t i = 0; i < 16; i++) {
+		name[i * 2 + 0] = hexChars[identifier.d[i] >> 4];
+		name[i * 2 + 1] = hexChars[identifier.d[i] & 0xF];
+	}
+
+	return StringAllocateAndFormat(THUMBNAIL_STORE_FOLDER "%s.dat", sizeof(name), name);
+}
+
+bool ThumbnailStoreReadHeader(EsHandle handle, EsFileOffset storeBytes, ThumbnailStoreHeader *header) {
+	return storeBytes >= sizeof(ThumbnailStoreHeader)
+		&& EsFileReadSync(handle, 0, sizeof(ThumbnailStoreHeader), header) == sizeof(ThumbnailStoreHeader)
+		&& header->signature == THUMBNAIL_STORE_SIGNATURE && header->version == THUMBNAIL_STORE_VERSION
+		&& header->maximumWidth == THUMBNAIL_MAXIMUM_WIDTH && header->maximumHeight == THUMBNAIL_MAXIMUM_HEIGHT
+		&& header->width && header->height && header->width <= header->maximumWidth && header->height <= header->maximumHeight
+		&& storeBytes - sizeof(ThumbnailStoreHeader) == (EsFileOffset) header->pathBytes + header->imageBytes;
+}
+
+uint32_t *ThumbnailStoreLoad(const EsFileInformation *file, uint32_t *width, uint32_t *height) {
+	String storePath = ThumbnailStoreGetPath(file->identifier);
+	EsFileInformation information = EsFileOpen(STRING(storePath), ES_FILE_READ | ES_NODE_FAIL_IF_NOT_FOUND);
+	StringDestroy(&storePath);
+
+	if (information.error != ES_SUCCESS) {
+		return nullptr; // The thumbnail has not been stored.
+	}
+
+	EsDefer(EsHandleClose(information.handle));
+	ThumbnailStoreHeader header = {};
+
+	if (!ThumbnailStoreReadHeader(information.handle, information.size, &header)
+			|| EsMemoryCompare(&header.identifier, &file->identifier, sizeof(EsUniqueIdentifier))
+			|| header.modificationTime != file->modificationTime || header.fileSize != file->size) {
+		return nullptr; // The stored thumbnail is out of date.
+	}
+
+	uint8_t *image = (uint8_t *) EsHeapAllocate(header.imageBytes, false);
+	if (!image) return nullptr;
+	EsDefer(EsHeapFree(image));
+
+	if (EsFileReadSync(information.handle, sizeof(header) + header.pathBytes, header.imageBytes, image) != header.imageBytes) {
+		return nullptr;
+	}
+
+	uint32_t *bits = (uint32_t *) EsImageLoad(image, header.imageBytes, width, height, 4);
+
+	if (bits && (*width != header.width || *height != header.height)) {
+		EsHeapFree(bits);
+		bits = nullptr;
+	}
+
+	return bits;
+}
+
+void ThumbnailStoreSave(String path, const EsFileInformation *file, uint32_t *bits, uint32_t width, uint32_t height) {
+	// stbi_write expects the red channel first.
+	for (uintptr_t i = 0; i < width * height; i++) bits[i] = (bits[i] & 0xFF00FF00) | ((bits[i] & 0xFF) << 16) | ((bits[i] >> 16) & 0xFF);
+	int imageBytes;
+	uint8_t *image = stbi_write_png_to_mem((const uint8_t *) bits, width * 4, width, height, 4, &imageBytes);
+	for (uintptr_t i = 0; i < width * height; i++) bits[i] = (bits[i] & 0xFF00FF00) | ((bits[i] & 0xFF) << 16) | ((bits[i] >> 16) & 0xFF);
+	if (!image) return;
+
+	ThumbnailStoreHeader header = {};
+	header.signature = THUMBNAIL_STORE_SIGNATURE;
+	header.version = THUMBNAIL_STORE_VERSION;
+	header.maximumWidth = THUMBNAIL_MAXIMUM_WIDTH;
+	header.maximumHeight = THUMBNAIL_MAXIMUM_HEIGHT;
+	header.width = width;
+	header.height = height;
+	header.identifier = file->identifier;
+	header.modificationTime = file->modificationTime;
+	header.fileSize = file->size;
+	header.pathBytes = path.bytes;
+	header.imageBytes = imageBytes;
+
+	const void *data[] = { &header, path.text, image };
+	size_t sizes[] = { sizeof(header), path.bytes, (size_t) imageBytes };
+	String storePath = ThumbnailStoreGetPath(file->identifier);
+	EsFileWriteAllGather(STRING(storePath), data, sizes, 3);
+	StringDestroy(&storePath);
+	STBIW_FREE(image);
+}
+
+bool ThumbnailStoreEntryIsValid(String storePath, uint64_t *modificationTime) {
+	EsFileInformation information = EsFileOpen(STRING(storePath), ES_FILE_READ | ES_NODE_FAIL_IF_NOT_FOUND);
+	if (information.error != ES_SUCCESS) return false;
+	EsDefer(EsHandleClose(information.handle));
+
+	ThumbnailStoreHeader header = {};
+	if (!ThumbnailStoreReadHeader(information.handle, information.size, &header)) return false;
+
+	char *path = (char *) EsHeapAllocate(header.pathBytes, false);
+	if (!path) return false;
+	EsDefer(EsHeapFree(path));
+	if (EsFileReadSync(information.handle, sizeof(header), header.pathBytes, path) != header.pathBytes) return false;
+
+	EsFileInformation file = EsFileOpen(path, header.pathBytes, ES_FILE_READ_SHARED | ES_NODE_FAIL_IF_NOT_FOUND);
+	if (file.error != ES_SUCCESS) return false; // The file no longer exists.
+	EsHandleClose(file.handle);
+
+	*modificationTime = header.modificationTime;
+	return !EsMemoryCompare(&header.identifier, &file.identifier, sizeof(EsUniqueIdentifier))
+		&& header.modificationTime == file.modificationTime && header.fileSize == file.size;
+}
+
+void ThumbnailStoreEvictTask(Instance *, Task *) {
+	// Remove the entries for files that have been deleted, moved or modified since their thumbnail was generated.
+	// If there are still too many entries, remove those for the files that were modified longest ago.
+
+	size_t childCount;
+	EsDirectoryChild *children = EsDirectoryEnumerateChildren(EsLiteral(THUMBNAIL_STORE_FOLDER), &childCount);
+	if (!children) return;
+	EsDefer(EsHeapFree(children));
+
+	Array<ThumbnailStoreEntry> entries = {};
+	EsDefer(entries.Free());
+
+	for (uintptr_t i = 0; i < childCount && !EsWorkIsExiting(); i++) {
+		if (children[i].type != ES_NODE_FILE) continue;
+		String storePath = StringAllocateAndFormat(THUMBNAIL_STORE_FOLDER "%s", children[i].nameBytes, children[i].name);
+		ThumbnailStoreEntry entry = { .child = i };
+
+		if (!ThumbnailStoreEntryIsValid(storePath, &entry.modificationTime)) {
+			EsPathDelete(STRING(storePath));
+		} else if (!entries.Add(entry)) {
+			StringDestroy(&storePath);
+			return;
+		}
+
+		StringDestroy(&storePath);
+	}
+
+	if (entries.Length() <= THUMBNAIL_STORE_MAXIMUM_ENTRIES) {
+		return;
+	}
+
+	EsCRTqsort(entries.array, entries.Length(), sizeof(ThumbnailStoreEntry), [] (const void *_left, const void *_right) {
+		const ThumbnailStoreEntry *left = (const ThumbnailStoreEntry *) _left, *right = (const ThumbnailStoreEntry *) _right;
+		return left->modificationTime < right->modificationTime ? -1 : left->modificationTime > right->modificationTime ? 1 : 0;
+	});
+
+	for (uintptr_t i = 0; i < entries.Length() - THUMBNAIL_STORE_MAXIMUM_ENTRIES; i++) {
+		EsDirectoryChild *child = children + entries[i].child;
+		String storePath = StringAllocateAndFormat(THUMBNAIL_STORE_FOLDER "%s", child->nameBytes, child->name);
+		EsPathDelete(STRING(storePath));
+		StringDestroy(&storePath);
+	}
+}
+
 void ThumbnailGenerateTask(Instance *, Task *task) {
 	EsMessageMutexAcquire();
 	Thumbnail *thumbnail = thumbnailCache.Get(&task->id);
@@ -575,35 +761,53 @@ void ThumbnailGenerateTask(Instance *, Task *task) {
 		return; // The file is too large.
 	}
 
-	size_t fileBytes;
-	void *file = EsFileReadAllFromHandle(information.handle, &fileBytes);
-	EsHandleClose(information.handle);
+	uint32_t targetWidth, targetHeight;
+	uint32_t *targetBits = nullptr;
+	bool modified = task->context.u;
+	bool useStore = ThumbnailStoreCanUse(&information);
 
-	if (!file) {
-		return; // The file could not be loaded.
+	if (!modified && useStore) {
+		targetBits = ThumbnailStoreLoad(&information, &targetWidth, &targetHeight);
 	}
 
-	// TODO Allow applications to register their own thumbnail generators.
-	uint32_t originalWidth, originalHeight;
-	uint32_t *originalBits = (uint32_t *) EsImageLoad(file, fileBytes, &originalWidth, &originalHeight, 4);
-	EsHeapFree(file);
+	if (!targetBits) {
+		size_t fileBytes;
+		void *file = EsFileReadAllFromHandle(information.handle, &fileBytes);
+		EsHandleClose(information.handle);
 
-	if (!originalBits) {
-		return; // The image could not be loaded.
-	}
+		if (!file) {
+			return; // The file could not be loaded.
+		}
+
+		// TODO Allow applications to register their own thumbnail generators.
+		// The decoder may skip work by producing a reduced-resolution image that is still large enough for the thumbnail.
+		uint32_t originalWidth, originalHeight;
+		uint32_t *originalBits = (uint32_t *) EsImageLoadScaled(file, fileBytes, &originalWidth, &originalHeight, 4, 
+				THUMBNAIL_MAXIMUM_WIDTH, THUMBNAIL_MAXIMUM_HEIGHT);
 
-	// TODO Determine the best value for these constants -- maybe base it off the current UI scale factor?
-	uint32_t thumbnailMaximumWidth = 143;
-	uint32_t thumbnailMaximumHeight = 80;
-	EsRectangle targetRectangle = EsRectangleFit(ES_RECT_2S(thumbnailMaximumWidth, thumbnailMaximumHeight), ES_RECT_2S(originalWidth, originalHeight), false);
-	uint32_t targetWidth = ES_RECT_WIDTH(targetRectangle), targetHeight = ES_RECT_HEIGHT(targetRectangle);
-	uint32_t *targetBits;
+		if (!originalBits) {
+			EsHeapFree(file);
+			return; // The image could not be loaded.
+		}
+
+		EsRectangle targetRectangle = EsRectangleFit(ES_RECT_2S(THUMBNAIL_MAXIMUM_WIDTH, THUMBNAIL_MAXIMUM_HEIGHT), 
+				ES_RECT_2S(originalWidth, originalHeight), false);
+		targetWidth = ES_RECT_WIDTH(targetRectangle), targetHeight = ES_RECT_HEIGHT(targetRectangle);
 
-	if (targetWidth == originalWidth && targetHeight == originalHeight) {
-		targetBits = originalBits;
+		if (targetWidth == originalWidth && targetHeight == originalHeight) {
+			targetBits = originalBits;
+		} else {
+			ThumbnailResize(originalBits, originalWidth, originalHeight, targetWidth, targetHeight);
+			targetBits = (uint32_t *) EsHeapReallocate(originalBits, targetWidth * targetHeight * 4, false);
+		}
+
+		EsHeapFree(file);
+
+		if (useStore && targetBits) {
+			ThumbnailStoreSave(task->string, &information, targetBits, targetWidth, targetHeight);
+		}
 	} else {
-		ThumbnailResize(originalBits, originalWidth, originalHeight, targetWidth, targetHeight);
-		targetBits = (uint32_t *) EsHeapReallocate(originalBits, targetWidth * targetHeight * 4, false);
+		EsHandleClose(information.handle);
 	}
 
 	EsMessageMutexAcquire();
@@ -616,6 +820,8 @@ void ThumbnailGenerateTask(Instance *, Task *task) {
 		thumbnail->width = targetWidth;
 		thumbnail->height = targetHeight;
 		// TODO Submit width/height properties.
+	} else {
+		EsHeapFree(targetBits);
 	}
 
 	EsMessageMutexRelease();
@@ -670,9 +876,16 @@ void ThumbnailGenerateIfNeeded(Folder *folder, FolderEntry *entry, bool fromFold
 
 	thumbnail->generatingTasksInProgress++;
 
+	if (!thumbnailStoreEvictionQueued) {
+		thumbnailStoreEvictionQueued = true;
+		Task evictTask = { .callback = ThumbnailStoreEvictTask };
+		NonBlockingTaskQueue(evictTask);
+	}
+
 	String path = StringAllocateAndFormat("%s%s", STRFMT(folder->path), STRFMT(entry->GetInternalName()));
 
 	Task task = {
+		.context = modified,
 		.string = path,
 		.id = entry->id,
 		.callback = ThumbnailGenerateTask,
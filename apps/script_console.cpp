@@ -163,6 +163,19 @@ void *FileLoad(const char *path, size_t *length) {
 	return EsFileReadAll(path, -1, length);
 }
 
+void *FileMap(const char *path, size_t *length) {
+	return EsFileReadAll(path, -1, length);
+}
+
+void FileUnmap(void *data, size_t length) {
+	(void) length;
+	EsHeapFree(data);
+}
+
+bool FileSave(const char *path, const void *data, size_t length) {
+	return ES_SUCCESS == EsFileWriteAll(path, -1, data, length);
+}
+
 #define RETURN_ERROR(error) do { MakeError(context, returnValue, error); return EXTCALL_RETURN_ERR_ERROR; } while (0)
 
 void MakeError(ExecutionContext *context, Value *returnValue, EsError error) {
@@ -24,8 +24,9 @@ load_kernel:
 	jne	error
 
 	; Check the read version.
+	; The kernel's file entry and data stream are the only structures read here, so this can follow ESFS_DRIVER_VERSION.
 	mov	ax,[fs:48]
-	cmp	ax,10
+	cmp	ax,14
 	mov	si,ErrorBadFilesystem
 	jg	error
 
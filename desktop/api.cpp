@@ -85,6 +85,7 @@ struct ThreadLocalStorage {
 
 	EsObjectID id;
 	uint64_t timerAdjustTicks;
+	struct WorkWorker *worker; // Set if this is a work queue thread.
 };
 
 struct Timer {
@@ -97,6 +98,30 @@ struct Timer {
 struct Work {
 	EsWorkCallback callback;
 	EsGeneric context;
+	EsWorkCancellation *cancellation;
+	EsWorkCompleteCallback then;
+};
+
+#define WORK_PRIORITY_COUNT (3)
+
+struct WorkDeque {
+	// A ring buffer of pending work.
+	// The owning thread pushes and pops at the back, so recently queued work runs first while its data is still in the cache;
+	// other threads steal from the front, taking the oldest work.
+
+	Work *items;
+	uintptr_t front, capacity;
+	volatile uintptr_t count;
+	EsMutex mutex;
+
+	bool PushBack(Work work);
+	bool PopBack(Work *work);
+	bool PopFront(Work *work);
+};
+
+struct WorkWorker {
+	WorkDeque deques[WORK_PRIORITY_COUNT];
+	EsHandle thread;
 };
 
 struct EsBundle {
@@ -223,11 +248,12 @@ struct {
 	double performanceTimerStack[PERFORMANCE_TIMER_STACK_SIZE];
 	uintptr_t performanceTimerStackCount;
 
-	EsHandle workAvailable;
-	EsMutex workMutex;
-	Array<Work> workQueue;
-	Array<EsHandle> workThreads;
-	volatile bool workFinish;
+	WorkWorker *workers;
+	size_t workerCount;
+	EsMutex workMutex; // Protects starting the work queue threads.
+	volatile bool workStarted, workFinish;
+	volatile uint32_t workSignal, workSleepers; // Idle threads wait on workSignal, which changes whenever work is queued.
+	volatile uintptr_t workPending, workNextWorker;
 
 	const uint16_t *keyboardLayout;
 	uint16_t keyboardLayoutIdentifier;
@@ -921,12 +947,14 @@ EsMessage *EsMessageReceive() {
 				ApplicationProcessTerminated(DesktopGetApplicationProcessForDesktop());
 			} else {
 				api.workFinish = true;
-				if (api.workAvailable) EsEventSet(api.workAvailable);
+				__sync_fetch_and_add(&api.workSignal, 1);
+				EsFutexWake(&api.workSignal, (size_t) -1);
 				EsMessageMutexRelease();
 
-				for (uintptr_t i = 0; i < api.workThreads.Length(); i++) {
-					EsWaitSingle(api.workThreads[i]);
-					EsHandleClose(api.workThreads[i]);
+				for (uintptr_t i = 0; i < api.workerCount; i++) {
+					if (!api.workers[i].thread) continue;
+					EsWaitSingle(api.workers[i].thread);
+					EsHandleClose(api.workers[i].thread);
 				}
 
 #ifdef DEBUG_BUILD
@@ -944,10 +972,9 @@ EsMessage *EsMessageReceive() {
 				gui.allWindows.Free();
 				calculator.Free();
 				HashTableFree(&gui.keyboardShortcutNames, false);
-				if (api.workAvailable) EsHandleClose(api.workAvailable);
-				EsAssert(!api.workQueue.Length());
-				api.workThreads.Free();
-				api.workQueue.Free();
+				EsAssert(!api.workPending);
+				for (uintptr_t i = 0; i < api.workerCount; i++) for (uintptr_t j = 0; j < WORK_PRIORITY_COUNT; j++) EsHeapFree(api.workers[i].deques[j].items);
+				EsHeapFree(api.workers);
 				api.connectedDevices.Free();
 #ifdef ENABLE_POSIX_SUBSYSTEM
 				POSIXCleanup();
@@ -983,6 +1010,8 @@ EsMessage *EsMessageReceive() {
 			EsMessageSend((EsElement *) message.object, &message.message);
 		} else if (type == ES_MSG_TIMER) {
 			((EsTimerCallback) message.message.user.context1.p)(message.message.user.context2);
+		} else if (type == ES_MSG_WORK_COMPLETE) {
+			((EsWorkCompleteCallback) message.message.user.context1.p)(message.message.user.context2, message.message.user.context3.u);
 		} else if (type >= ES_MSG_WM_START && type <= ES_MSG_WM_END && message.object) {
 #if 0
 			ProcessMessageTiming timing = {};
@@ -1144,6 +1173,7 @@ EsMessage *EsMessageReceive() {
 				theming.scale = api.global->uiScale;
 				gui.accessKeys.hintStyle = nullptr;
 				// TODO Clear old keepAround styles.
+				ThemeFlushSliceCaches();
 
 				for (uintptr_t i = 0; i < gui.allWindows.Length(); i++) {
 					UIScaleChanged(gui.allWindows[i], &message.message);
@@ -1909,52 +1939,309 @@ bool EsWorkIsExiting() {
 	return api.workFinish;
 }
 
-void WorkThread(EsGeneric) {
+bool WorkDeque::PushBack(Work work) {
+	EsMutexAcquire(&mutex);
+
+	if (count == capacity) {
+		size_t newCapacity = capacity ? capacity * 2 : 16;
+		Work *newItems = (Work *) EsHeapAllocate(newCapacity * sizeof(Work), false);
+
+		if (!newItems) {
+			EsMutexRelease(&mutex);
+			return false;
+		}
+
+		for (uintptr_t i = 0; i < count; i++) {
+			newItems[i] = items[(front + i) % capacity];
+		}
+
+		EsHeapFree(items);
+		items = newItems, capacity = newCapacity, front = 0;
+	}
+
+	items[(front + count) % capacity] = work;
+	count++;
+	__sync_fetch_and_add(&api.workPending, 1);
+	EsMutexRelease(&mutex);
+	return true;
+}
+
+bool WorkDeque::PopBack(Work *work) {
+	if (!count) return false; // Avoid taking the mutex of an empty deque.
+	EsMutexAcquire(&mutex);
+	bool found = count;
+
+	if (found) {
+		count--;
+		*work = items[(front + count) % capacity];
+		__sync_fetch_and_sub(&api.workPending, 1);
+	}
+
+	EsMutexRelease(&mutex);
+	return found;
+}
+
+bool WorkDeque::PopFront(Work *work) {
+	if (!count) return false;
+	EsMutexAcquire(&mutex);
+	bool found = count;
+
+	if (found) {
+		*work = items[front];
+		front = (front + 1) % capacity;
+		count--;
+		__sync_fetch_and_sub(&api.workPending, 1);
+	}
+
+	EsMutexRelease(&mutex);
+	return found;
+}
+
+bool WorkTake(WorkWorker *self, Work *work) {
+	// Higher priority work is taken first, even if it has to be stolen from another thread.
+
+	uintptr_t start = self ? self - api.workers : 0;
+
+	for (uintptr_t i = 0; i < WORK_PRIORITY_COUNT; i++) {
+		if (self && self->deques[i].PopBack(work)) {
+			return true;
+		}
+
+		for (uintptr_t j = 1; j <= api.workerCount; j++) {
+			WorkWorker *victim = &api.workers[(start + j) % api.workerCount];
+			if (victim != self && victim->deques[i].PopFront(work)) return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkRun(Work *work) {
+	if (!work->cancellation || !work->cancellation->cancelled) {
+		work->callback(work->context);
+	}
+
+	if (work->then) {
+		EsMessage m = { ES_MSG_WORK_COMPLETE };
+		m.user.context1.p = (void *) work->then;
+		m.user.context2 = work->context;
+		m.user.context3.u = work->cancellation && work->cancellation->cancelled;
+		EsMessagePost(nullptr, &m);
+	}
+}
+
+void WorkThread(EsGeneric _worker) {
+	WorkWorker *worker = (WorkWorker *) _worker.p;
+	GetThreadLocalStorage()->worker = worker;
+
 	while (true) {
-		EsWait(&api.workAvailable, 1, ES_WAIT_NO_TIMEOUT);
+		Work work;
 
-		while (true) {
-			EsMutexAcquire(&api.workMutex);
+		if (WorkTake(worker, &work)) {
+			WorkRun(&work);
+			continue;
+		}
 
-			if (api.workQueue.Length()) {
-				Work work = api.workQueue[0];
-				api.workQueue.Delete(0);
-				EsMutexRelease(&api.workMutex);
-				work.callback(work.context);
-			} else {
-				EsMutexRelease(&api.workMutex);
+		// Read the signal before checking for work; if any work is queued after the check, the signal will have changed,
+		// and the wait will return immediately.
 
-				if (api.workFinish) {
-					EsEventSet(api.workAvailable); // Wake up another thread.
-					return;
-				} else {
-					break;
-				}
-			}
+		uint32_t signal = api.workSignal;
+		__sync_synchronize();
+
+		if (api.workPending) {
+			continue;
+		} else if (api.workFinish) {
+			return;
+		}
+
+		__sync_fetch_and_add(&api.workSleepers, 1);
+
+		if (!api.workPending && !api.workFinish) {
+			EsFutexWait(&api.workSignal, signal, ES_WAIT_NO_TIMEOUT);
 		}
+
+		__sync_fetch_and_sub(&api.workSleepers, 1);
 	}
 }
 
-EsError EsWorkQueue(EsWorkCallback callback, EsGeneric context) {
+EsError WorkStart() {
+	if (api.workStarted) {
+		__sync_synchronize();
+		return ES_SUCCESS;
+	}
+
 	EsMutexAcquire(&api.workMutex);
+	EsDefer(EsMutexRelease(&api.workMutex));
 
-	if (!api.workAvailable) {
-		api.workAvailable = EsEventCreate(true /* autoReset */);
+	if (!api.workers) {
+		size_t count = EsSystemGetOptimalWorkQueueThreadCount();
+		if (!count) count = 1;
+		api.workers = (WorkWorker *) EsHeapAllocate(count * sizeof(WorkWorker), true);
+		if (!api.workers) return ES_ERROR_INSUFFICIENT_RESOURCES;
+		api.workerCount = count;
 	}
 
-	EsThreadInformation thread = {};
+	for (uintptr_t i = 0; i < api.workerCount; i++) {
+		if (api.workers[i].thread) continue;
+		EsThreadInformation thread = {};
+		EsError error = EsThreadCreate(WorkThread, &thread, &api.workers[i]);
+		if (error != ES_SUCCESS) return i ? ES_SUCCESS : error; // Work queued on deques without a thread is stolen by the others.
+		api.workers[i].thread = thread.handle;
+	}
+
+	__sync_synchronize();
+	api.workStarted = true;
+	return ES_SUCCESS;
+}
 
-	while (api.workThreads.Length() < EsSystemGetOptimalWorkQueueThreadCount()) {
-		EsError error = EsThreadCreate(WorkThread, &thread, nullptr);
-		if (error != ES_SUCCESS) return error;
-		api.workThreads.Add(thread.handle);
+EsError EsWorkQueueTask(EsWorkCallback callback, EsGeneric context, EsWorkPriority priority, EsWorkCancellation *cancellation, EsWorkCompleteCallback then) {
+	EsAssert(priority < WORK_PRIORITY_COUNT);
+	EsError error = WorkStart();
+	if (error != ES_SUCCESS) return error;
+
+	// Work queued from a work queue thread goes on its own deque, to be taken by other threads only if they are idle.
+	// Work queued from other threads is spread between the deques.
+
+	WorkWorker *worker = GetThreadLocalStorage()->worker;
+	if (!worker) worker = &api.workers[__sync_fetch_and_add(&api.workNextWorker, 1) % api.workerCount];
+
+	Work work = { callback, context, cancellation, then };
+
+	if (!worker->deques[priority].PushBack(work)) {
+		return ES_ERROR_INSUFFICIENT_RESOURCES;
+	}
+
+	__sync_fetch_and_add(&api.workSignal, 1);
+	if (api.workSleepers) EsFutexWake(&api.workSignal, 1);
+	return ES_SUCCESS;
+}
+
+EsError EsWorkQueue(EsWorkCallback callback, EsGeneric context) {
+	return EsWorkQueueTask(callback, context, ES_WORK_PRIORITY_NORMAL, nullptr, nullptr);
+}
+
+void EsWorkCancel(EsWorkCancellation *cancellation) {
+	cancellation->cancelled = true;
+	__sync_synchronize();
+}
+
+bool EsWorkIsCancelled(EsWorkCancellation *cancellation) {
+	return cancellation->cancelled;
+}
+
+struct ParallelJob {
+	EsParallelForCallback forCallback;
+	EsParallelReduceCallback reduceCallback;
+	EsGeneric context;
+	EsGeneric *results;
+	size_t count, grainSize, chunkCount;
+	volatile uintptr_t nextChunk, chunksDone, references;
+	EsLatch done;
+};
+
+void ParallelJobRun(ParallelJob *job) {
+	// Chunks are claimed one at a time, so the range is balanced between however many threads join in.
+	// The calling thread also claims chunks, so the job completes even if the work queue is busy.
+
+	while (true) {
+		uintptr_t chunk = __sync_fetch_and_add(&job->nextChunk, 1);
+		if (chunk >= job->chunkCount) break;
+		uintptr_t from = chunk * job->grainSize;
+		uintptr_t to = from + job->grainSize > job->count ? job->count : from + job->grainSize;
+
+		if (job->reduceCallback) {
+			job->results[chunk] = job->reduceCallback(job->context, from, to);
+		} else {
+			job->forCallback(job->context, from, to);
+		}
+
+		if (__sync_add_and_fetch(&job->chunksDone, 1) == job->chunkCount) {
+			EsLatchSet(&job->done);
+		}
 	}
+}
+
+void ParallelJobRelease(ParallelJob *job) {
+	if (!__sync_sub_and_fetch(&job->references, 1)) {
+		EsHeapFree(job->results);
+		EsHeapFree(job);
+	}
+}
+
+void ParallelJobWork(EsGeneric context) {
+	ParallelJob *job = (ParallelJob *) context.p;
+	ParallelJobRun(job);
+	ParallelJobRelease(job);
+}
+
+EsGeneric ParallelRun(size_t count, size_t grainSize, EsParallelForCallback forCallback, 
+		EsParallelReduceCallback reduceCallback, EsParallelCombineCallback combine, EsGeneric context) {
+	EsGeneric result = {};
+	if (!count) return result;
+
+	size_t threadCount = WorkStart() == ES_SUCCESS ? api.workerCount : 1;
+
+	if (!grainSize) {
+		grainSize = count / (threadCount * 4);
+		if (!grainSize) grainSize = 1;
+	}
+
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+	ParallelJob *job = chunkCount > 1 && threadCount > 1 ? (ParallelJob *) EsHeapAllocate(sizeof(ParallelJob), true) : nullptr;
+	EsGeneric *results = job && reduceCallback ? (EsGeneric *) EsHeapAllocate(chunkCount * sizeof(EsGeneric), false) : nullptr;
+
+	if (!job || (reduceCallback && !results)) {
+		// Run everything on the calling thread.
+		EsHeapFree(job);
+
+		if (reduceCallback) {
+			result = reduceCallback(context, 0, count);
+		} else {
+			forCallback(context, 0, count);
+		}
+
+		return result;
+	}
+
+	job->forCallback = forCallback;
+	job->reduceCallback = reduceCallback;
+	job->context = context;
+	job->results = results;
+	job->count = count;
+	job->grainSize = grainSize;
+	job->chunkCount = chunkCount;
+	job->references = 1;
+
+	for (uintptr_t i = 0; i < threadCount - 1 && i < chunkCount - 1; i++) {
+		__sync_fetch_and_add(&job->references, 1);
+
+		if (ES_SUCCESS != EsWorkQueueTask(ParallelJobWork, job, ES_WORK_PRIORITY_HIGH, nullptr, nullptr)) {
+			__sync_fetch_and_sub(&job->references, 1);
+			break;
+		}
+	}
+
+	ParallelJobRun(job);
+	EsLatchWait(&job->done, ES_WAIT_NO_TIMEOUT);
+
+	if (reduceCallback) {
+		result = results[0];
+
+		for (uintptr_t i = 1; i < chunkCount; i++) {
+			result = combine(context, result, results[i]);
+		}
+	}
+
+	ParallelJobRelease(job);
+	return result;
+}
+
+void EsParallelFor(size_t count, size_t grainSize, EsParallelForCallback callback, EsGeneric context) {
+	ParallelRun(count, grainSize, callback, nullptr, nullptr, context);
+}
 
-	Work work = { callback, context };
-	bool success = api.workQueue.Add(work);
-	EsMutexRelease(&api.workMutex);
-	EsEventSet(api.workAvailable);
-	return success ? ES_SUCCESS : ES_ERROR_INSUFFICIENT_RESOURCES;
+EsGeneric EsParallelReduce(size_t count, size_t grainSize, EsParallelReduceCallback callback, EsParallelCombineCallback combine, EsGeneric context) {
+	return ParallelRun(count, grainSize, nullptr, callback, combine, context);
 }
 
 #ifndef ENABLE_POSIX_SUBSYSTEM
@@ -11,6 +11,7 @@ typedef struct Test { const char *cName; int timeoutSeconds; } Test;
 #include <shared/array.cpp>
 #include <shared/arena.cpp>
 #include <shared/range_set.cpp>
+#include <shared/hash_table.cpp>
 #undef EsUTF8IsValid
 #include <shared/unicode.cpp>
 
@@ -410,6 +411,94 @@ bool PerformanceTimerDrift() {
 
 //////////////////////////////////////////////////////////////
 
+bool MemoryFunctions() {
+	int checkIndex = 0;
+
+	size_t bufferBytes = 8 * 1024 * 1024 + 256;
+	uint8_t *a = (uint8_t *) EsHeapAllocate(bufferBytes, false);
+	uint8_t *b = (uint8_t *) EsHeapAllocate(bufferBytes, false);
+	EsDefer(EsHeapFree(a));
+	EsDefer(EsHeapFree(b));
+
+	// Check every size tier at different alignments, including overlapping moves in both directions.
+
+	for (uintptr_t i = 0; i < 20000; i++) {
+		size_t bytes = i % 1000 == 0 ? (4 * 1024 * 1024 + EsRandomU8() * 37) : (i % 5 == 0 ? EsRandomU64() % 3000 : EsRandomU8() + EsRandomU8());
+		uintptr_t from = EsRandomU8() & 63, to = EsRandomU8() & 63;
+		for (uintptr_t j = 0; j < bytes + 128; j++) a[j] = j * 7 + i, b[j] = 0xCC;
+
+		EsMemoryCopy(b + to, a + from, bytes);
+		for (uintptr_t j = 0; j < to; j++) CHECK(b[j] == 0xCC);
+		for (uintptr_t j = 0; j < bytes; j++) CHECK(b[to + j] == (uint8_t) ((from + j) * 7 + i));
+		CHECK(b[to + bytes] == 0xCC);
+		CHECK(0 == EsMemoryCompare(b + to, a + from, bytes));
+
+		if (bytes) {
+			uint8_t *last = b + to + bytes - 1;
+			*last ^= 0x10;
+			CHECK(EsMemoryCompare(a + from, b + to, bytes) == ((*last & 0x10) ? -1 : 1));
+		}
+
+		EsMemoryZero(b + to, bytes);
+		for (uintptr_t j = 0; j < bytes; j++) CHECK(b[to + j] == 0);
+		CHECK(b[to + bytes] == 0xCC && (!to || b[to - 1] == 0xCC));
+
+		if (bytes > 5000) continue;
+		intptr_t amount = (intptr_t) (EsRandomU8() & 127) - 64;
+		EsMemoryMove(a + 64, a + 64 + bytes, amount, false);
+		for (uintptr_t j = 0; j < bytes; j++) CHECK(a[64 + amount + j] == (uint8_t) ((64 + j) * 7 + i));
+	}
+
+	// Report the throughput of each size tier.
+
+	size_t sizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024, 8 * 1024 * 1024 };
+
+	for (uintptr_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t repeat = 256 * 1024 * 1024 / sizes[i];
+		EsPerformanceTimerPush();
+		for (uintptr_t j = 0; j < repeat; j++) EsMemoryCopy(b, a + (j & 1), sizes[i]);
+		double copyTime = EsPerformanceTimerPop();
+		EsPerformanceTimerPush();
+		for (uintptr_t j = 0; j < repeat; j++) EsMemoryZero(b + (j & 1), sizes[i]);
+		double zeroTime = EsPerformanceTimerPop();
+		EsPrint("%d bytes: copy %d MB/s, zero %d MB/s.\n", sizes[i], (int) (256 / copyTime), (int) (256 / zeroTime));
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////
+
+bool ChecksumFunctions() {
+	int checkIndex = 0;
+
+	CHECK(CalculateCRC32("123456789", 9, 0) == 0xCBF43926);
+	CHECK(CalculateCRC32C("123456789", 9, 0) == 0xE3069283);
+
+	// Compare the accelerated implementations against the byte-at-a-time definitions, at every alignment and remainder.
+
+	uint8_t buffer[4096 + 64];
+	for (uintptr_t i = 0; i < sizeof(buffer); i++) buffer[i] = EsRandomU8();
+
+	for (uintptr_t i = 0; i < 2000; i++) {
+		uintptr_t offset = EsRandomU8() & 63, length = EsRandomU64() % 4096;
+		uint32_t carry = EsRandomU64(), crc32 = ~carry, crc32c = ~carry;
+
+		for (uintptr_t j = 0; j < length; j++) {
+			crc32 = crc32Table[(crc32 ^ buffer[offset + j]) & 0xFF] ^ (crc32 >> 8);
+			crc32c ^= buffer[offset + j];
+			for (uintptr_t k = 0; k < 8; k++) crc32c = (crc32c >> 1) ^ (0x82F63B78 & (0 - (crc32c & 1)));
+		}
+
+		CHECK(CalculateCRC32(buffer + offset, length, carry) == ~crc32);
+		CHECK(CalculateCRC32C(buffer + offset, length, carry) == ~crc32c);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////
+
 EsTextbox *textbox;
 
 Array<char> master;
@@ -915,6 +1004,60 @@ bool RangeSetTests() {
 
 //////////////////////////////////////////////////////////////
 
+size_t HashStoreMakeKey(char *buffer, size_t bufferBytes, uint32_t key) {
+	return EsStringFormat(buffer, bufferBytes, "%d%z", key, "-variable-length-key" + key % 20);
+}
+
+bool HashStoreVariableLengthKeys() {
+	// Use the store as a least recently used cache with keys of different lengths, like the text shaping cache.
+
+	int checkIndex = 0;
+	HashStore<char, uint32_t> store = {};
+	Array<uint32_t> keys = {};
+	uint32_t nextKey = 0;
+	char buffer[64];
+	EsRandomSeed(20);
+
+	for (uintptr_t i = 0; i < 100000; i++) {
+		if (keys.Length() < 200 || (EsRandomU8() & 1)) {
+			uint32_t key = nextKey++;
+			size_t bytes = HashStoreMakeKey(buffer, sizeof(buffer), key);
+			uint32_t *value = store.Put(buffer, bytes);
+			CHECK(value);
+			*value = key;
+			keys.Add(key);
+		}
+
+		if (keys.Length() > 200) {
+			uint32_t key = keys[0];
+			size_t bytes = HashStoreMakeKey(buffer, sizeof(buffer), key);
+			CHECK(store.Get1(buffer, bytes) == key);
+			CHECK(store.Delete(buffer, bytes));
+			CHECK(!store.Get(buffer, bytes));
+			keys.Delete(0);
+		}
+
+		CHECK(store.Count() == keys.Length());
+	}
+
+	for (uintptr_t i = 0; i < keys.Length(); i++) {
+		size_t bytes = HashStoreMakeKey(buffer, sizeof(buffer), keys[i]);
+		CHECK(store.Get1(buffer, bytes) == keys[i]);
+	}
+
+	while (keys.Length()) {
+		size_t bytes = HashStoreMakeKey(buffer, sizeof(buffer), keys.Pop());
+		CHECK(store.Delete(buffer, bytes));
+		CHECK(store.Count() == keys.Length());
+	}
+
+	store.Free();
+	keys.Free();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////
+
 bool UTF8Tests() {
 	int checkIndex = 0;
 
@@ -1126,6 +1269,77 @@ bool PipeTests() {
 
 //////////////////////////////////////////////////////////////
 
+struct LockTestsState {
+	EsMutex mutex;
+	EsConditionVariable changed;
+	EsWriterLock writerLock;
+	EsLatch start;
+	uintptr_t counter, finished, readersInside, writersInside;
+	bool failed;
+};
+
+LockTestsState lockTestsState;
+
+void LockTestsThread(EsGeneric) {
+	LockTestsState *state = &lockTestsState;
+	EsLatchWait(&state->start, ES_WAIT_NO_TIMEOUT);
+
+	for (uintptr_t i = 0; i < 10000; i++) {
+		EsMutexAcquire(&state->mutex);
+		state->counter++;
+		EsMutexRelease(&state->mutex);
+
+		bool write = (i & 7) == 0;
+		EsWriterLockTake(&state->writerLock, write);
+		if (write) __sync_fetch_and_add(&state->writersInside, 1);
+		else __sync_fetch_and_add(&state->readersInside, 1);
+		if (state->writersInside > 1 || (state->writersInside && state->readersInside)) state->failed = true;
+		if (write) __sync_fetch_and_sub(&state->writersInside, 1);
+		else __sync_fetch_and_sub(&state->readersInside, 1);
+		EsWriterLockReturn(&state->writerLock, write);
+	}
+
+	EsMutexAcquire(&state->mutex);
+	state->finished++;
+	EsConditionVariableSignal(&state->changed);
+	EsMutexRelease(&state->mutex);
+}
+
+bool LockTests() {
+	int checkIndex = 0;
+	LockTestsState *state = &lockTestsState;
+	EsMemoryZero(state, sizeof(LockTestsState));
+
+	EsLatch latch = {};
+	CHECK(!EsLatchWait(&latch, 10));
+	EsLatchSet(&latch);
+	CHECK(EsLatchWait(&latch, 10));
+
+	EsMutexAcquire(&state->mutex);
+	CHECK(!EsConditionVariableWait(&state->changed, &state->mutex, 10));
+	EsMutexRelease(&state->mutex);
+
+	for (uintptr_t i = 0; i < 4; i++) {
+		EsThreadInformation information;
+		CHECK(EsThreadCreate(LockTestsThread, &information, nullptr) == ES_SUCCESS);
+		EsHandleClose(information.handle);
+	}
+
+	EsLatchSet(&state->start);
+
+	EsMutexAcquire(&state->mutex);
+	while (state->finished != 4) EsConditionVariableWait(&state->changed, &state->mutex, ES_WAIT_NO_TIMEOUT);
+	CHECK(state->counter == 40000);
+	EsMutexRelease(&state->mutex);
+
+	CHECK(!state->failed);
+	CHECK(!state->writerLock.state);
+	EsMutexDestroy(&state->mutex);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////
+
 #include <bits/syscall.h>
 
 #define _exit(x)          EsPOSIXSystemCall(SYS_exit_group, (intptr_t) x, 0, 0, 0, 0, 0)
@@ -1313,13 +1527,17 @@ const Test tests[] = {
 	TEST(CRTStringFunctions, 60),
 	TEST(CRTOtherFunctions, 60),
 	TEST(PerformanceTimerDrift, 60),
+	TEST(MemoryFunctions, 120),
+	TEST(ChecksumFunctions, 60),
 	TEST(TextboxEditOperations, 240),
 	TEST(OldTests2018, 60),
 	TEST(HeapReallocate, 60),
 	TEST(ArenaRandomAllocations, 60),
 	TEST(RangeSetTests, 60),
+	TEST(HashStoreVariableLengthKeys, 60),
 	TEST(UTF8Tests, 60),
 	TEST(PipeTests, 60),
+	TEST(LockTests, 60),
 	TEST(POSIXSubsystemTest, 120),
 	TEST(RestartTest, 1200),
 	TEST(ResizeFileTest, 600),
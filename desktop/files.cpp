@@ -167,6 +167,8 @@ EsFileInformation EsFileOpen(const char *path, ptrdiff_t pathLength, uint32_t fl
 	if (result == ES_SUCCESS) {
 		information.handle = node.handle;
 		information.size = node.fileSize;
+		information.identifier = node.identifier;
+		information.modificationTime = node.modificationTime;
 	}
 
 	information.error = result;
@@ -183,6 +185,12 @@ size_t EsFileWriteSync(EsHandle handle, EsFileOffset offset, size_t size, const
 	return result;
 }
 
+size_t EsFileCopyRange(EsHandle destination, EsFileOffset destinationOffset, EsHandle source, EsFileOffset sourceOffset, size_t size) {
+	_EsFileCopyRange range = { .destinationOffset = destinationOffset, .sourceOffset = sourceOffset, .bytes = size };
+	intptr_t result = EsSyscall(ES_SYSCALL_FILE_COPY_RANGE, destination, source, (uintptr_t) &range, 0);
+	return result;
+}
+
 EsFileOffset EsFileGetSize(EsHandle handle) {
 	return EsSyscall(ES_SYSCALL_FILE_GET_SIZE, handle, 0, 0, 0);
 }
@@ -621,13 +629,7 @@ void *EsFileReadAll(const char *filePath, ptrdiff_t filePathLength, size_t *file
 
 EsError EsFileCopy(const char *source, ptrdiff_t sourceBytes, const char *destination, ptrdiff_t destinationBytes, void **_copyBuffer,
 		EsFileCopyCallback callback, EsGeneric callbackData) {
-	const size_t copyBufferBytes = 262144;
-	void *copyBuffer = _copyBuffer && *_copyBuffer ? *_copyBuffer : EsHeapAllocate(copyBufferBytes, false);
-	if (_copyBuffer) *_copyBuffer = copyBuffer;
-
-	if (!copyBuffer) {
-		return ES_ERROR_INSUFFICIENT_RESOURCES;
-	}
+	(void) _copyBuffer; // The data is copied by the kernel, so no buffer is needed.
 
 	EsError error = ES_SUCCESS;
 
@@ -640,24 +642,22 @@ EsError EsFileCopy(const char *source, ptrdiff_t sourceBytes, const char *destin
 			error = EsFileResize(destinationFile.handle, sourceFile.size);
 
 			if (error == ES_SUCCESS) {
-				for (uintptr_t i = 0; i < sourceFile.size; i += copyBufferBytes) {
-					size_t bytesRead = EsFileReadSync(sourceFile.handle, i, copyBufferBytes, copyBuffer);
+				EsFileOffset position = 0;
 
-					if (ES_CHECK_ERROR(bytesRead)) { 
-						error = bytesRead; 
-						break; 
-					}
+				while (position < sourceFile.size) {
+					size_t bytesCopied = EsFileCopyRange(destinationFile.handle, position, sourceFile.handle, position, sourceFile.size - position);
 
-					size_t bytesWritten = EsFileWriteSync(destinationFile.handle, i, bytesRead, copyBuffer);
-
-					if (ES_CHECK_ERROR(bytesWritten)) { 
-						error = bytesWritten; 
+					if (ES_CHECK_ERROR(bytesCopied)) { 
+						error = bytesCopied; 
 						break; 
+					} else if (!bytesCopied) {
+						error = ES_ERROR_ACCESS_NOT_WITHIN_FILE_BOUNDS; // The source was truncated during the copy.
+						break;
 					}
 
-					EsAssert(bytesRead == bytesWritten);
+					position += bytesCopied;
 
-					if (callback && !callback(i + bytesWritten, sourceFile.size, callbackData)) {
+					if (callback && !callback(position, sourceFile.size, callbackData)) {
 						error = ES_ERROR_CANCELLED;
 						break;
 					}
@@ -674,6 +674,5 @@ EsError EsFileCopy(const char *source, ptrdiff_t sourceBytes, const char *destin
 		error = sourceFile.error;
 	}
 
-	if (!_copyBuffer) EsHeapFree(copyBuffer);
 	return error;
 }
@@ -149,6 +149,7 @@ void InspectorNotifyElementContentChanged(EsElement *element);
 #define UI_STATE_MENU_EXITING           (1 << 19)
 #define UI_STATE_INSPECTING		(1 << 20)
 #define UI_STATE_USE_MEASUREMENT_CACHE	(1 << 21)
+#define UI_STATE_OCCLUDED		(1 << 22) // Set by the parent while painting its children.
 
 struct EsElement : EsElementPublic {
 	EsElementCallback messageClass;
@@ -252,6 +253,9 @@ struct EsElement : EsElementPublic {
 #define PAINT_NO_TRANSITION (1 << 2) // Ignore entrance/exit transitions.
 #define PAINT_OVERLAY       (1 << 3) // Paint the overlay layers.
 	void InternalPaint(EsPainter *painter, int flags);
+	void InternalMarkOccludedChildren(EsPainter *painter, EsMessage *zOrder);
+	bool IsRegionCompletelyOpaque(EsRectangle region /* element coordinates */);
+	bool IsCoveredByOpaqueChild(EsRectangle region /* painter coordinates */, EsPainter *painter);
 
 	void InternalMove(int _width, int _height, int _offsetX, int _offsetY); // Non-client offset.
 	void InternalCalculateRepaintRegion(int x, int y, bool forwards, bool overlappedBySibling = false);
@@ -506,6 +510,10 @@ struct EsWindow : EsElement {
 	EsRectangle updateRegion;
 	EsRectangle updateRegionInProgress; // For visualizePaintSteps.
 
+	// Kept between paints so that each frame doesn't need to allocate and fault in a new buffer.
+	void *paintBuffer;
+	size_t paintBufferBytes;
+
 	Array<struct SizeAlternative> sizeAlternatives;
 	Array<struct UpdateAction> updateActions;
 
@@ -803,6 +811,9 @@ void UIWindowDestroy(EsWindow *window) {
 	window->sizeAlternatives.Free();
 	window->updateActions.Free();
 	window->dialogs.Free();
+	EsHeapFree(window->paintBuffer);
+	window->paintBuffer = nullptr;
+	window->paintBufferBytes = 0;
 	window->handle = ES_INVALID_HANDLE;
 }
 
@@ -1409,7 +1420,7 @@ EsDeviceColor EsPainterRealizeColorRGB(EsPainter *painter, float alpha, float re
 #endif
 
 void EsElement::Repaint(bool all, EsRectangle region) {
-	// TODO Optimisation: don't paint if overlapped by an opaque child or sibling.
+	// Elements overlapped by an opaque child or sibling are culled in InternalPaint.
 
 	if (all) {
 		region.l = -style->paintOutsets.l, region.r =  width + style->paintOutsets.r;
@@ -1438,6 +1449,95 @@ void EsElement::Repaint(bool all, EsRectangle region) {
 	}
 }
 
+bool EsElement::IsRegionCompletelyOpaque(EsRectangle region) {
+	if ((flags & ES_ELEMENT_HIDDEN) || (state & (UI_STATE_DESTROYING | UI_STATE_ANIMATING)) || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	if ((parent && (parent->state & UI_STATE_ANIMATING)) || transitionTimeMs < transitionDurationMs || style->appearanceIndex != -1) {
+		// The element might be painted through a transition effect, or with a different appearance to its style.
+		return false;
+	}
+
+	return style->IsRegionCompletelyOpaque(region, width, height);
+}
+
+bool EsElement::IsCoveredByOpaqueChild(EsRectangle region, EsPainter *painter) {
+	EsRectangle clip = painter->clip;
+
+	if (style->metrics->clipEnabled && (~flags & ES_ELEMENT_NO_CLIP)) {
+		// The children are clipped to the content area.
+		Rectangle16 insets = style->metrics->clipInsets;
+		EsRectangle content = ES_RECT_4(painter->offsetX + insets.l, painter->offsetX + width - insets.r, 
+				painter->offsetY + insets.t, painter->offsetY + height - insets.b);
+		if (!EsRectangleContainsAll(content, region)) return false;
+		clip = EsRectangleIntersection(content, clip);
+	}
+
+	// Only the children in the Z-order range will be painted; see InternalPaint.
+
+	EsMessage zOrder = { ES_MSG_BEFORE_Z_ORDER };
+	zOrder.beforeZOrder.nonClient = zOrder.beforeZOrder.end = children.Length();
+	zOrder.beforeZOrder.clip = Translate(clip, -painter->offsetX, -painter->offsetY);
+	EsMessageSend(this, &zOrder);
+
+	uintptr_t clientCount = zOrder.beforeZOrder.end - zOrder.beforeZOrder.start;
+	uintptr_t count = clientCount + children.Length() - zOrder.beforeZOrder.nonClient;
+	bool covered = false;
+
+	for (uintptr_t j = 0; j < count && !covered; j++) {
+		uintptr_t i = j < clientCount ? zOrder.beforeZOrder.start + j : zOrder.beforeZOrder.nonClient + j - clientCount;
+		EsElement *child = GetChildByZ(i);
+
+		if (child && child->IsRegionCompletelyOpaque(Translate(region, -painter->offsetX - child->offsetX, -painter->offsetY - child->offsetY))) {
+			covered = true;
+		}
+	}
+
+	zOrder.type = ES_MSG_AFTER_Z_ORDER;
+	EsMessageSend(this, &zOrder);
+
+	return covered;
+}
+
+void EsElement::InternalMarkOccludedChildren(EsPainter *painter, EsMessage *zOrder) {
+	// Walk the children from the front to the back, keeping the largest opaque child seen so far.
+	// Children painting entirely beneath it are marked as occluded. 
+	// Only a single occluder is tracked, so children covered by the union of several siblings are still painted.
+
+	uintptr_t clientCount = zOrder->beforeZOrder.end - zOrder->beforeZOrder.start;
+	uintptr_t count = clientCount + children.Length() - zOrder->beforeZOrder.nonClient;
+	EsElement *occluder = nullptr;
+	int occluderArea = 0;
+
+	for (uintptr_t j = count; j > 0; j--) {
+		uintptr_t i = j - 1 < clientCount ? zOrder->beforeZOrder.start + j - 1 : zOrder->beforeZOrder.nonClient + j - 1 - clientCount;
+		EsElement *child = GetChildByZ(i);
+		if (!child || (child->flags & ES_ELEMENT_HIDDEN)) continue;
+
+		int x = painter->offsetX + child->offsetX, y = painter->offsetY + child->offsetY;
+		EsRectangle paintOutsets = child->style->paintOutsets;
+		EsRectangle area = ES_RECT_4(x - paintOutsets.l, x + child->width + paintOutsets.r, y - paintOutsets.t, y + child->height + paintOutsets.b);
+		area = EsRectangleIntersection(area, painter->clip);
+		if (!THEME_RECT_VALID(area)) continue;
+
+		// Descendants can only be culled with the child if they are clipped to its bounds.
+		Rectangle16 clipInsets = child->style->metrics->clipInsets;
+		bool descendantsContained = !child->children.Length() || (child->style->metrics->clipEnabled && (~child->flags & ES_ELEMENT_NO_CLIP)
+				&& clipInsets.l >= 0 && clipInsets.r >= 0 && clipInsets.t >= 0 && clipInsets.b >= 0);
+
+		if (occluder && descendantsContained && occluder->IsRegionCompletelyOpaque(Translate(area, 
+						-painter->offsetX - occluder->offsetX, -painter->offsetY - occluder->offsetY))) {
+			// The child won't be painted, so mark it as entered here instead, as InternalPaint would.
+			// Otherwise it would run its entrance transition when it is next uncovered.
+			child->state |= UI_STATE_OCCLUDED | UI_STATE_ENTERED;
+		} else if (child->style->opaqueInsets.l != 0x7F && Width(area) * Height(area) > occluderArea) {
+			occluder = child;
+			occluderArea = Width(area) * Height(area);
+		}
+	}
+}
+
 void EsElement::InternalPaint(EsPainter *painter, int paintFlags) {
 	if (width <= 0 || height <= 0 || (flags & ES_ELEMENT_HIDDEN)) {
 		return;
@@ -1550,8 +1650,13 @@ void EsElement::InternalPaint(EsPainter *painter, int paintFlags) {
 		m.painter = painter;
 
 		if (!EsMessageSend(this, &m)) {
-			// TODO Optimisation: don't paint if overlapped by an opaque child.
-			interpolatedStyle->PaintLayers(painter, ES_RECT_2S(painter->width, painter->height), childType, THEME_LAYER_MODE_BACKGROUND);
+			EsRectangle paintOutsets = interpolatedStyle->paintOutsets;
+			EsRectangle area = ES_RECT_4(pOffsetX - paintOutsets.l, pOffsetX + width + paintOutsets.r, 
+					pOffsetY - paintOutsets.t, pOffsetY + height + paintOutsets.b);
+
+			if (!IsCoveredByOpaqueChild(EsRectangleIntersection(area, painter->clip), painter)) {
+				interpolatedStyle->PaintLayers(painter, ES_RECT_2S(painter->width, painter->height), childType, THEME_LAYER_MODE_BACKGROUND);
+			}
 		}
 		
 		// Apply the clipping insets.
@@ -1596,12 +1701,16 @@ void EsElement::InternalPaint(EsPainter *painter, int paintFlags) {
 				zOrder.beforeZOrder.clip = Translate(painter->clip, -painter->offsetX, -painter->offsetY);
 				EsMessageSend(this, &zOrder);
 
+				InternalMarkOccludedChildren(painter, &zOrder);
+
 				if (isZStack) {
 					// Elements cast shadows on each other.
+					// Occluded children are skipped entirely, since the opaque sibling is painted after their overlay layers.
 
 					for (uintptr_t i = zOrder.beforeZOrder.start; i < zOrder.beforeZOrder.end; i++) {
 						EsElement *child = GetChildByZ(i);
 						if (!child) continue;
+						if (child->state & UI_STATE_OCCLUDED) { child->state &= ~UI_STATE_OCCLUDED; continue; }
 						child->InternalPaint(painter, PAINT_SHADOW);
 						child->InternalPaint(painter, ES_FLAGS_DEFAULT);
 						child->InternalPaint(painter, PAINT_OVERLAY);
@@ -1610,40 +1719,44 @@ void EsElement::InternalPaint(EsPainter *painter, int paintFlags) {
 					for (uintptr_t i = zOrder.beforeZOrder.nonClient; i < children.Length(); i++) {
 						EsElement *child = GetChildByZ(i);
 						if (!child) continue;
+						if (child->state & UI_STATE_OCCLUDED) { child->state &= ~UI_STATE_OCCLUDED; continue; }
 						child->InternalPaint(painter, PAINT_SHADOW);
 						child->InternalPaint(painter, ES_FLAGS_DEFAULT);
 						child->InternalPaint(painter, PAINT_OVERLAY);
 					}
 				} else {
 					// Elements cast shadows on the container.
+					// Occluded children still paint their overlay layers, which go above all their siblings.
 
 					for (uintptr_t i = zOrder.beforeZOrder.start; i < zOrder.beforeZOrder.end; i++) {
 						EsElement *child = GetChildByZ(i);
-						if (child) child->InternalPaint(painter, PAINT_SHADOW);
+						if (child && (~child->state & UI_STATE_OCCLUDED)) child->InternalPaint(painter, PAINT_SHADOW);
 					}
 
 					for (uintptr_t i = zOrder.beforeZOrder.nonClient; i < children.Length(); i++) {
 						EsElement *child = GetChildByZ(i);
-						if (child) child->InternalPaint(painter, PAINT_SHADOW);
+						if (child && (~child->state & UI_STATE_OCCLUDED)) child->InternalPaint(painter, PAINT_SHADOW);
 					}
 
 					for (uintptr_t i = zOrder.beforeZOrder.start; i < zOrder.beforeZOrder.end; i++) {
 						EsElement *child = GetChildByZ(i);
-						if (child) child->InternalPaint(painter, ES_FLAGS_DEFAULT);
+						if (child && (~child->state & UI_STATE_OCCLUDED)) child->InternalPaint(painter, ES_FLAGS_DEFAULT);
 					}
 
 					for (uintptr_t i = zOrder.beforeZOrder.nonClient; i < children.Length(); i++) {
 						EsElement *child = GetChildByZ(i);
-						if (child) child->InternalPaint(painter, ES_FLAGS_DEFAULT);
+						if (child && (~child->state & UI_STATE_OCCLUDED)) child->InternalPaint(painter, ES_FLAGS_DEFAULT);
 					}
 
 					for (uintptr_t i = zOrder.beforeZOrder.start; i < zOrder.beforeZOrder.end; i++) {
 						EsElement *child = GetChildByZ(i);
+						if (child) child->state &= ~UI_STATE_OCCLUDED;
 						if (child) child->InternalPaint(painter, PAINT_OVERLAY);
 					}
 
 					for (uintptr_t i = zOrder.beforeZOrder.nonClient; i < children.Length(); i++) {
 						EsElement *child = GetChildByZ(i);
+						if (child) child->state &= ~UI_STATE_OCCLUDED;
 						if (child) child->InternalPaint(painter, PAINT_OVERLAY);
 					}
 				}
@@ -7611,14 +7724,29 @@ void UIWindowPaintNow(EsWindow *window, ProcessMessageTiming *timing, bool after
 		target.width = Width(updateRegion);
 		target.height = Height(updateRegion);
 		target.stride = target.width * 4;
-		target.bits = EsHeapAllocate(target.stride * target.height, false);
 		target.forWindowManager = true;
 
-		if (!target.bits) {
-			return; // Insufficient memory for painting.
+		size_t bytesNeeded = target.stride * target.height;
+		size_t windowBytes = (size_t) window->windowWidth * window->windowHeight * 4;
+
+		if (window->paintBufferBytes < bytesNeeded || window->paintBufferBytes > windowBytes * 2) {
+			// Grow the buffer to fit the whole window, so that later paints can reuse it.
+			// If the window has shrunk a lot, release the excess.
+			EsHeapFree(window->paintBuffer);
+			window->paintBufferBytes = bytesNeeded > windowBytes ? bytesNeeded : windowBytes;
+			window->paintBuffer = EsHeapAllocate(window->paintBufferBytes, false);
+
+			if (!window->paintBuffer) {
+				window->paintBufferBytes = 0;
+				return; // Insufficient memory for painting.
+			}
+
+			// The kernel reads the bits while holding the window manager's lock,
+			// so make sure they won't page fault. The pages stay committed while the buffer is kept.
+			EsMemoryFaultRange(window->paintBuffer, window->paintBufferBytes);
 		}
 
-		EsMemoryFaultRange(target.bits, target.stride * target.height);
+		target.bits = window->paintBuffer;
 		painter.offsetX -= updateRegion.l;
 		painter.offsetY -= updateRegion.t;
 		painter.clip = ES_RECT_4(0, target.width, 0, target.height);
@@ -7638,8 +7766,6 @@ void UIWindowPaintNow(EsWindow *window, ProcessMessageTiming *timing, bool after
 		EsSyscall(ES_SYSCALL_WINDOW_SET_BITS, window->handle, (uintptr_t) &updateRegion, (uintptr_t) target.bits,
 				afterResize ? WINDOW_SET_BITS_AFTER_RESIZE : WINDOW_SET_BITS_NORMAL);
 		if (timing) timing->endUpdate = EsTimeStampMs();
-
-		EsHeapFree(target.bits);
 	}
 
 	window->updateRegion = ES_RECT_4(window->windowWidth, 0, window->windowHeight, 0);
@@ -30,6 +30,11 @@ struct ListViewGroup {
 	int64_t totalSize;
 	uint32_t flags;
 	bool initialised;
+
+	// For variable-size list views.
+	Array<int32_t> itemSizes;
+	Array<bool> itemSizeEstimated; // Set for items sized from ES_MSG_LIST_VIEW_MEASURE_RANGE that haven't been measured yet.
+	Array<int64_t> sizeTree; // A Fenwick tree over itemSizes; sizeTree[i - 1] is the total size of the items in (i & (i - 1), i].
 };
 
 struct ListViewFixedString {
@@ -198,6 +203,179 @@ struct EsListView : EsElement {
 		return true;
 	}
 
+	// Variable-size list views keep the size of each item in a Fenwick tree.
+	// This lets the list view convert between positions and items in logarithmic time, without measuring any items again.
+	// If the application measures inserted ranges with ES_MSG_LIST_VIEW_MEASURE_RANGE, each item in the range
+	// starts with an even share of its size, and is only measured individually once it becomes visible.
+
+	int64_t SizeIndexPrefix(ListViewGroup *group, uintptr_t count) {
+		// Returns the total size of the first count items in the group.
+		int64_t size = 0;
+
+		for (uintptr_t i = count; i; i &= i - 1) {
+			size += group->sizeTree[i - 1];
+		}
+
+		return size;
+	}
+
+	void SizeIndexUpdate(ListViewGroup *group, uintptr_t index, int64_t delta) {
+		for (uintptr_t i = index + 1; i <= group->sizeTree.Length(); i += i & -i) {
+			group->sizeTree[i - 1] += delta;
+		}
+	}
+
+	void SizeIndexRebuildFrom(ListViewGroup *group, uintptr_t index) {
+		// The nodes before the index only cover items before the index, so they are still valid.
+		// The nodes after it are rebuilt in linear time, by adding each node into its parent once it is complete.
+		uintptr_t count = group->itemSizes.Length();
+		group->sizeTree.SetLength(index);
+
+		for (uintptr_t i = index; i < count; i++) {
+			group->sizeTree.Add(group->itemSizes[i]);
+		}
+
+		for (uintptr_t i = index; i; i &= i - 1) {
+			// The only nodes before the index with a parent after it are those summed for its prefix.
+			uintptr_t parent = i + (i & -i);
+			if (parent <= count) group->sizeTree[parent - 1] += group->sizeTree[i - 1];
+		}
+
+		for (uintptr_t i = index + 1; i <= count; i++) {
+			uintptr_t parent = i + (i & -i);
+			if (parent <= count) group->sizeTree[parent - 1] += group->sizeTree[i - 1];
+		}
+	}
+
+	EsListViewIndex SizeIndexFind(ListViewGroup *group, int64_t limit, int64_t gapBetweenItems) {
+		// Returns the number of items at the start of the group that fit within limit, counting the gap after each item.
+		uintptr_t count = 0, step = 1;
+		while (step * 2 <= group->sizeTree.Length()) step *= 2;
+
+		for (; step; step >>= 1) {
+			if (count + step > group->sizeTree.Length()) continue;
+			int64_t size = group->sizeTree[count + step - 1] + (int64_t) step * gapBetweenItems;
+
+			if (size <= limit) {
+				count += step;
+				limit -= size;
+			}
+		}
+
+		return count;
+	}
+
+	int64_t SizeIndexInsert(EsListViewIndex groupIndex, EsListViewIndex firstIndex, EsListViewIndex count) {
+		// Measures the new items, and returns their total size.
+
+		ListViewGroup *group = &groups[groupIndex];
+		group->itemSizes.InsertMany(firstIndex, count);
+		group->itemSizeEstimated.InsertMany(firstIndex, count);
+
+		EsMessage m = { ES_MSG_LIST_VIEW_MEASURE_RANGE };
+		m.itemRange.group = groupIndex;
+		m.itemRange.firstIndex = firstIndex;
+		m.itemRange.count = count;
+
+		if (count > 1 && ES_HANDLED == EsMessageSend(this, &m)) {
+			// Split the total between the items, so that the group's size is exact before they're measured.
+			group = &groups[groupIndex];
+
+			for (EsListViewIndex i = 0; i < count; i++) {
+				group->itemSizes[firstIndex + i] = m.itemRange.result / count + (i < m.itemRange.result % count ? 1 : 0);
+				group->itemSizeEstimated[firstIndex + i] = true;
+			}
+
+			SizeIndexRebuildFrom(group, firstIndex);
+			return m.itemRange.result;
+		}
+
+		int64_t total = 0;
+
+		for (EsListViewIndex i = firstIndex; i < firstIndex + count; i++) {
+			int32_t size = MeasureItem(groupIndex, i);
+			groups[groupIndex].itemSizes[i] = size;
+			groups[groupIndex].itemSizeEstimated[i] = false;
+			total += size;
+		}
+
+		SizeIndexRebuildFrom(&groups[groupIndex], firstIndex);
+		return total;
+	}
+
+	void SizeIndexSetItemSize(EsListViewIndex groupIndex, EsListViewIndex index, int32_t size) {
+		// Updates the size of an item, and moves the visible items after it.
+
+		ListViewGroup *group = &groups[groupIndex];
+		group->itemSizeEstimated[index] = false;
+		int64_t delta = size - group->itemSizes[index];
+		if (!delta) return;
+
+		group->itemSizes[index] = size;
+		SizeIndexUpdate(group, index, delta);
+		group->totalSize += delta;
+
+		uintptr_t firstVisibleItemToMove = visibleItems.Length();
+
+		for (uintptr_t i = 0; i < visibleItems.Length(); i++) {
+			ListViewItem *item = &visibleItems[i];
+
+			if (item->group == groupIndex && item->index == index) {
+				item->size = size;
+			} else if (item->group > groupIndex || (item->group == groupIndex && item->index > index)) {
+				firstVisibleItemToMove = i;
+				break;
+			}
+		}
+
+		InsertSpace(delta, firstVisibleItemToMove);
+	}
+
+	void SizeIndexMeasureVisibleItems() {
+		// Measure the items with estimated sizes that are about to become visible.
+		// Measuring an item only moves the items after it, but it can also clamp the scroll position, 
+		// so keep going until a pass over the viewport doesn't measure anything.
+
+		if (~flags & ES_LIST_VIEW_VARIABLE_SIZE) {
+			return;
+		}
+
+		bool measured = true;
+
+		while (measured && totalItemCount) {
+			EsRectangle contentBounds = GetListBounds();
+			int64_t contentSize = flags & ES_LIST_VIEW_HORIZONTAL ? Width(contentBounds) : Height(contentBounds);
+			int64_t scroll = EsCRTfloor(flags & ES_LIST_VIEW_HORIZONTAL ? (this->scroll.position[0] - style->insets.l) 
+					: (this->scroll.position[1] - style->insets.t));
+
+			int64_t position = 0;
+			bool noItems = false;
+			EsMessage currentItem = FindFirstVisibleItem(&position, -scroll, &noItems);
+			measured = false;
+
+			while (position < contentSize && !noItems) {
+				EsListViewIndex groupIndex = currentItem.iterateIndex.group, index = currentItem.iterateIndex.index;
+
+				if (groups[groupIndex].itemSizeEstimated[index]) {
+					SizeIndexSetItemSize(groupIndex, index, MeasureItem(groupIndex, index));
+					measured = true;
+				}
+
+				position += groups[groupIndex].itemSizes[index];
+				if (!IterateForwards(&currentItem)) break;
+				position += groupIndex == currentItem.iterateIndex.group ? style->gapMinor : style->gapMajor;
+			}
+		}
+	}
+
+	int32_t MeasureItem(EsListViewIndex groupIndex, EsListViewIndex index) {
+		EsMessage m = { ES_MSG_LIST_VIEW_MEASURE_ITEM };
+		m.measureItem.group = groupIndex;
+		m.measureItem.index = index;
+		EsAssert(ES_HANDLED == EsMessageSend(this, &m)); // Variable height list view must be able to measure items.
+		return m.measureItem.result;
+	}
+
 	int64_t MeasureItems(EsListViewIndex groupIndex, EsListViewIndex firstIndex, EsListViewIndex count) {
 		if (count == 0) return 0;
 		EsAssert(count > 0);
@@ -222,38 +400,9 @@ struct EsListView : EsElement {
 			return additionalSize + normalCount * (flags & ES_LIST_VIEW_HORIZONTAL ? fixedWidth : fixedHeight);
 		}
 
-		if (count > 1) {
-			EsMessage m = { ES_MSG_LIST_VIEW_MEASURE_RANGE };
-			m.itemRange.group = groupIndex;
-			m.itemRange.firstIndex = firstIndex;
-			m.itemRange.count = count;
-
-			if (ES_HANDLED == EsMessageSend(this, &m)) {
-				return m.itemRange.result;
-			}
-		}
-
-		EsMessage m = {};
-		m.iterateIndex.group = groupIndex;
-		m.iterateIndex.index = firstIndex;
-		int64_t total = 0;
-		int64_t _count = 0;
-
-		while (true) {
-			EsMessage m2 = { ES_MSG_LIST_VIEW_MEASURE_ITEM };
-			m2.measureItem.group = groupIndex;
-			m2.measureItem.index = m.iterateIndex.index;
-			EsAssert(ES_HANDLED == EsMessageSend(this, &m2)); // Variable height list view must be able to measure items.
-			total += m2.measureItem.result;
-			_count++;
-
-			if (count == _count) {
-				return total;
-			}
-
-			IterateForwards(&m);
-			EsAssert(groupIndex == m.iterateIndex.group); // Index range did not exist in group.
-		}
+		ListViewGroup *group = &groups[groupIndex];
+		EsAssert(firstIndex + count <= (EsListViewIndex) group->sizeTree.Length()); // Index range did not exist in group.
+		return SizeIndexPrefix(group, firstIndex + count) - SizeIndexPrefix(group, firstIndex);
 	}
 
 	void GetItemPosition(EsListViewIndex groupIndex, EsListViewIndex index, int64_t *_position, int64_t *_itemSize) {
@@ -300,46 +449,8 @@ struct EsListView : EsElement {
 			if (ES_HANDLED == EsMessageSend(this, &index)) {
 				position += index.iterateIndex.position;
 			} else {
-				if (group->flags & ES_LIST_VIEW_GROUP_HAS_HEADER) {
-					position += fixedHeaderSize + gapBetweenItems;
-				}
-
-				bool forwards;
-				ListViewItem *reference = visibleItems.Length() ? visibleItems.array : nullptr;
-
-				bool closerToStartThanReference = reference && targetIndex < reference->index / 2;
-				bool closerToEndThanReference   = reference && targetIndex > reference->index / 2 + (intptr_t) group->itemCount / 2;
-
-				if (reference && reference->group == groupIndex && !closerToStartThanReference && !closerToEndThanReference) {
-					index.iterateIndex.index = reference->index;
-					position = (flags & ES_LIST_VIEW_HORIZONTAL) ? reference->element->offsetX : reference->element->offsetY;
-					forwards = reference->index < targetIndex;
-
-					EsMessage firstIndex = {};
-					firstIndex.iterateIndex.group = groupIndex;
-					GetFirstIndex(&firstIndex);
-
-					if (index.iterateIndex.index == firstIndex.iterateIndex.index) {
-						forwards = true;
-					}
-				} else if (targetIndex > group->itemCount / 2) {
-					GetLastIndex(&index); 
-					position += group->totalSize;
-					position -= MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
-					forwards = false;
-				} else {
-					GetFirstIndex(&index); 
-					forwards = true;
-				}
-
-				while (index.iterateIndex.index != targetIndex) {
-					int64_t size = MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
-					position += forwards ? (size + gapBetweenItems) : -(size + gapBetweenItems);
-					EsAssert((forwards ? IterateForwards(&index) : IterateBackwards(&index)) && index.iterateIndex.group == groupIndex);
-							// Could not find the item in the group.
-				}
-
-				itemSize = MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
+				position += SizeIndexPrefix(group, targetIndex) + targetIndex * gapBetweenItems;
+				itemSize = group->itemSizes[targetIndex];
 			}
 		}
 
@@ -407,7 +518,7 @@ struct EsListView : EsElement {
 		}
 	}
 
-	EsMessage FindFirstVisibleItem(int64_t *_position, int64_t position, ListViewItem *reference, bool *noItems) {
+	EsMessage FindFirstVisibleItem(int64_t *_position, int64_t position, bool *noItems) {
 		int64_t gapBetweenGroup = style->gapMajor,
 			gapBetweenItems = (flags & ES_LIST_VIEW_TILED) ? style->gapWrap : style->gapMinor,
 			fixedSize       = (flags & ES_LIST_VIEW_VARIABLE_SIZE) ? 0 : (flags & ES_LIST_VIEW_HORIZONTAL ? fixedWidth : fixedHeight);
@@ -488,73 +599,15 @@ struct EsListView : EsElement {
 			return index;
 		}
 
-		// Find the item within the group, manually.
-
-		bool forwards;
-
-		if (reference && reference->group == groupIndex) {
-			int64_t referencePosition = (flags & ES_LIST_VIEW_HORIZONTAL) ? reference->element->offsetX : reference->element->offsetY;
-
-			if (AbsoluteInteger64(referencePosition) < AbsoluteInteger64(position)
-					&& AbsoluteInteger64(referencePosition) < AbsoluteInteger64(position + groups[groupIndex].totalSize)) {
-				index.iterateIndex.index = reference->index;
-				position = referencePosition; // Use previous first visible item as reference.
-				forwards = position < 0;
-
-				EsMessage firstIndex = {};
-				firstIndex.iterateIndex.group = groupIndex;
-				GetFirstIndex(&firstIndex);
-
-				if (index.iterateIndex.index == firstIndex.iterateIndex.index) {
-					forwards = true;
-				}
-
-				goto gotReference;
-			}
-		} 
-		
-		if (position + groups[groupIndex].totalSize / 2 >= 0) {
-			GetFirstIndex(&index); // Use start of group as reference.
-			forwards = true;
-		} else {
-			GetLastIndex(&index); // Use end of group as reference
-			position += groups[groupIndex].totalSize;
-			position -= MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
-			forwards = false;
-		}
+		// Find the item within the group, using the size index.
+		// This is the first item that ends after the start of the viewport.
 
-		gotReference:;
-
-		if (forwards) {
-			// Iterate forwards from reference point.
-
-			while (true) {
-				int64_t size = fixedSize ?: MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
-
-				if (position + size > 0) {
-					*_position = position;
-					return index;
-				}
-
-				EsAssert(IterateForwards(&index) && index.iterateIndex.group == groupIndex);
-						// No items in the group are visible. Maybe invalid scroll position?
-				position += size + gapBetweenItems;
-			}
-		} else {
-			// Iterate backwards from reference point.
-
-			while (true) {
-				if (position <= 0 || !IterateBackwards(&index)) {
-					*_position = position;
-					return index;
-				}
-
-				int64_t size = fixedSize ?: MeasureItems(index.iterateIndex.group, index.iterateIndex.index, 1);
-				EsAssert(index.iterateIndex.group == groupIndex);
-						// No items in the group are visible. Maybe invalid scroll position?
-				position -= size + gapBetweenItems;
-			}
-		}
+		ListViewGroup *group = &groups[groupIndex];
+		EsListViewIndex itemsBefore = SizeIndexFind(group, -position + gapBetweenItems, gapBetweenItems);
+		if (itemsBefore >= group->itemCount) itemsBefore = group->itemCount - 1; // Maybe invalid scroll position?
+		index.iterateIndex.index = itemsBefore;
+		*_position = position + SizeIndexPrefix(group, itemsBefore) + itemsBefore * gapBetweenItems;
+		return index;
 	}
 
 	void _Populate() {
@@ -573,7 +626,7 @@ struct EsListView : EsElement {
 
 		int64_t position = 0;
 		bool noItems = false;
-		EsMessage currentItem = FindFirstVisibleItem(&position, -scroll, visibleItems.Length() ? visibleItems.array : nullptr, &noItems);
+		EsMessage currentItem = FindFirstVisibleItem(&position, -scroll, &noItems);
 		uintptr_t visibleIndex = 0;
 
 		int64_t wrapLimit = GetWrapLimit();
@@ -1063,15 +1116,13 @@ struct EsListView : EsElement {
 			}
 		}
 
-		// TODO Use reference for FindFirstVisibleItem.
-
 		bool adjustStart = false, adjustEnd = false;
 		int r1 = (flags & ES_LIST_VIEW_HORIZONTAL) ? style->insets.l - x1 : style->insets.t - y1 + scroll.fixedViewport[1];
 		int r2 = (flags & ES_LIST_VIEW_HORIZONTAL) ? style->insets.l - x2 : style->insets.t - y2 + scroll.fixedViewport[1];
-		start = FindFirstVisibleItem(&offset, r1, nullptr, &noItems);
+		start = FindFirstVisibleItem(&offset, r1, &noItems);
 		if (noItems) return;
 		adjustStart = -offset >= MeasureItems(start.iterateIndex.group, start.iterateIndex.index, 1);
-		end = FindFirstVisibleItem(&offset, r2, nullptr, &noItems);
+		end = FindFirstVisibleItem(&offset, r2, &noItems);
 		adjustEnd = !noItems;
 		if (noItems) { end.iterateIndex.group = groups.Length() - 1; GetLastIndex(&end); }
 
@@ -1755,6 +1806,13 @@ struct EsListView : EsElement {
 			fixedItems.Free();
 			fixedItemIndices.Free();
 			visibleItems.Free();
+
+			for (uintptr_t i = 0; i < groups.Length(); i++) {
+				groups[i].itemSizes.Free();
+				groups[i].itemSizeEstimated.Free();
+				groups[i].sizeTree.Free();
+			}
+
 			groups.Free();
 			activeColumns.Free();
 			registeredColumns.Free();
@@ -2094,6 +2152,7 @@ struct EsListView : EsElement {
 void ListViewPopulateActionCallback(EsElement *element, EsGeneric) {
 	EsListView *view = (EsListView *) element;
 	EsAssert(view->populateQueued);
+	view->SizeIndexMeasureVisibleItems(); // Before clearing populateQueued, since moving items can queue another populate.
 	view->populateQueued = false;
 	view->_Populate();
 	EsAssert(!view->populateQueued);
@@ -2245,7 +2304,15 @@ void EsListViewChangeStyles(EsListView *view, EsStyleID style, EsStyleID itemSty
 	for (uintptr_t i = 0; i < view->groups.Length(); i++) {
 		if (!view->groups[i].itemCount) continue;
 		spaceDelta -= view->groups[i].totalSize;
-		view->groups[i].totalSize = view->MeasureItems(i, 0, view->groups[i].itemCount);
+
+		if (view->flags & ES_LIST_VIEW_VARIABLE_SIZE) {
+			view->groups[i].itemSizes.SetLength(0);
+			view->groups[i].itemSizeEstimated.SetLength(0);
+			view->groups[i].totalSize = view->SizeIndexInsert(i, 0, view->groups[i].itemCount);
+		} else {
+			view->groups[i].totalSize = view->MeasureItems(i, 0, view->groups[i].itemCount);
+		}
+
 		view->groups[i].totalSize += view->style->gapMinor * (view->groups[i].itemCount - 1);
 		spaceDelta += view->groups[i].totalSize;
 	}
@@ -2345,7 +2412,9 @@ void EsListViewInsert(EsListView *view, EsListViewIndex groupIndex, EsListViewIn
 
 	bool addedFirstItemInGroup = !group->itemCount;
 	group->itemCount += count;
-	int64_t totalSizeOfItems = view->MeasureItems(groupIndex, firstIndex, count);
+	int64_t totalSizeOfItems = (view->flags & ES_LIST_VIEW_VARIABLE_SIZE) ? view->SizeIndexInsert(groupIndex, firstIndex, count)
+		: view->MeasureItems(groupIndex, firstIndex, count);
+	group = &view->groups[groupIndex];
 	int64_t sizeToAdd = (count - (addedFirstItemInGroup ? 1 : 0)) * view->style->gapMinor + totalSizeOfItems;
 	group->totalSize += sizeToAdd;
 	view->totalItemCount += count;
@@ -2422,6 +2491,12 @@ void EsListViewRemove(EsListView *view, EsListViewIndex groupIndex, EsListViewIn
 	group->totalSize -= sizeToRemove;
 	view->totalItemCount -= count;
 
+	if (view->flags & ES_LIST_VIEW_VARIABLE_SIZE) {
+		group->itemSizes.DeleteMany(firstIndex, count);
+		group->itemSizeEstimated.DeleteMany(firstIndex, count);
+		view->SizeIndexRebuildFrom(group, firstIndex);
+	}
+
 	// Update indices of visible items,
 	// and remove deleted items.
 
@@ -2675,6 +2750,15 @@ void EsListViewInvalidateContent(EsListView *view, EsListViewIndex group, EsList
 	}
 }
 
+void EsListViewInvalidateSize(EsListView *view, EsListViewIndex groupIndex, EsListViewIndex index) {
+	EsMessageMutexCheck();
+	EsAssert(view->flags & ES_LIST_VIEW_VARIABLE_SIZE); // Only variable-size list views can resize individual items.
+	EsAssert(groupIndex < (EsListViewIndex) view->groups.Length() && index < view->groups[groupIndex].itemCount); // Invalid index.
+
+	view->SizeIndexSetItemSize(groupIndex, index, view->MeasureItem(groupIndex, index));
+	EsElementRelayout(view);
+}
+
 #define LIST_VIEW_SORT_FUNCTION(_name, _line) \
 	ES_MACRO_SORT(_name, EsListViewIndex, { \
 		ListViewFixedItemData *left = (ListViewFixedItemData *) &context->items[*_left]; \
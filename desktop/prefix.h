@@ -359,6 +359,8 @@ struct GlobalData {
 	volatile uint16_t keyboardLayout;
 };
 
+#define GLYPH_ATLAS_BYTES (4194304) // The size of the glyph atlas shared by all processes; see text.cpp.
+
 struct SystemStartupDataHeader {
 	/* TODO Make mount points and devices equal, somehow? */
 	size_t initialMountPointCount;
@@ -425,6 +427,7 @@ extern "C" void *EsBufferWrite(EsBuffer *buffer, const void *source, size_t writ
 #define ES_MSG_PING				((EsMessageType) (ES_MSG_SYSTEM_START + 0x203)) /* Sent by Desktop to check processes are processing messages. */
 #define ES_MSG_WAKEUP				((EsMessageType) (ES_MSG_SYSTEM_START + 0x204)) /* Sent to wakeup the message thread, so that it can process locally posted messages. */
 #define ES_MSG_INSTANCE_OPEN_DELAYED		((EsMessageType) (ES_MSG_SYSTEM_START + 0x205))
+#define ES_MSG_WORK_COMPLETE			((EsMessageType) (ES_MSG_SYSTEM_START + 0x206)) /* Posted by work queue threads to run a task's completion callback on the message thread. */
 
 #endif
 
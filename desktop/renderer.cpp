@@ -140,6 +140,9 @@ typedef struct RastDash {
 #define RAST_ROUND_TOLERANCE (0.25f)
 #define RAST_FLATTEN_TOLERANCE (0.25f)
 #define RAST_GRADIENT_NOISE (0.005f)
+#define RAST_RADIX_SORT_MINIMUM_EDGES (64)
+#define RAST_PARALLEL_MINIMUM_PIXELS (256 * 256)
+#define RAST_PARALLEL_BAND_HEIGHT (32)
 	
 #define RAST_AVERAGE_VERTICES(a, b) { ((a).x + (b).x) * 0.5f, ((a).y + (b).y) * 0.5f }
 
@@ -168,7 +171,71 @@ void RastSurfaceDestroy(RastSurface *surface) {
 }
 
 #ifndef IN_DESIGNER
-ES_MACRO_SORT(RastEdgesSort, RastEdge, { result = _left->yf > _right->yf ? 1 : _left->yf < _right->yf ? -1 : 0; }, void *);
+ES_MACRO_SORT(_RastEdgesSortSmall, RastEdge, { result = _left->yf > _right->yf ? 1 : _left->yf < _right->yf ? -1 : 0; }, void *);
+
+void RastEdgesSort(RastEdge *edges, size_t count, void *context) {
+	if (count <= RAST_RADIX_SORT_MINIMUM_EDGES) {
+		_RastEdgesSortSmall(edges, count, context);
+		return;
+	}
+
+	// Radix sort the edges by yf, 8 bits at a time.
+	// Each item packs the sort key and the edge's index, so the edges themselves are only moved once.
+
+	uint64_t *items = (uint64_t *) EsHeapAllocate(sizeof(uint64_t) * count * 2, false);
+	RastEdge *sorted = (RastEdge *) EsHeapAllocate(sizeof(RastEdge) * count, false);
+
+	if (!items || !sorted) {
+		EsHeapFree(items);
+		EsHeapFree(sorted);
+		_RastEdgesSortSmall(edges, count, context);
+		return;
+	}
+
+	uint64_t *source = items, *destination = items + count;
+
+	for (uintptr_t i = 0; i < count; i++) {
+		// Map the float to an unsigned integer with the same ordering.
+		uint32_t key;
+		EsMemoryCopy(&key, &edges[i].yf, sizeof(uint32_t));
+		key ^= (key & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+		source[i] = ((uint64_t) key << 32) | i;
+	}
+
+	for (uintptr_t shift = 32; shift < 64; shift += 8) {
+		size_t offsets[256] = {};
+
+		for (uintptr_t i = 0; i < count; i++) {
+			offsets[(source[i] >> shift) & 0xFF]++;
+		}
+
+		if (offsets[(source[0] >> shift) & 0xFF] == count) {
+			continue; // Every key has the same byte here.
+		}
+
+		for (uintptr_t i = 0, total = 0; i < 256; i++) {
+			size_t bucket = offsets[i];
+			offsets[i] = total;
+			total += bucket;
+		}
+
+		for (uintptr_t i = 0; i < count; i++) {
+			destination[offsets[(source[i] >> shift) & 0xFF]++] = source[i];
+		}
+
+		uint64_t *swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	for (uintptr_t i = 0; i < count; i++) {
+		sorted[i] = edges[source[i] & 0xFFFFFFFF];
+	}
+
+	EsMemoryCopy(edges, sorted, sizeof(RastEdge) * count);
+	EsHeapFree(items);
+	EsHeapFree(sorted);
+}
 #else
 int _RastEdgeCompare(const void *left, const void *right) {
 	const RastEdge *_left = (const RastEdge *) left;
@@ -200,71 +267,13 @@ void _RastShapeDestroy(RastShape shape) {
 	RAST_ARRAY_FREE(shape.edges);
 }
 
-void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool evenOdd) {
-	if (paint.type == RAST_PAINT_LINEAR_GRADIENT 
-			|| paint.type == RAST_PAINT_RADIAL_GRADIENT
-			|| paint.type == RAST_PAINT_ANGULAR_GRADIENT) {
-		if (!paint.gradient.color || !paint.gradient.alpha) {
-			_RastShapeDestroy(shape);
-			return;
-		}
-	}
-
-	if (RAST_ARRAY_LENGTH(shape.edges) == 0) {
-		return;
-	}
+void _RastSurfaceFillRows(RastSurface surface, RastShape *shape, RastPaint *paint, bool evenOdd, int top, int bottom) {
+	// Rasterise the scanlines from top to bottom. The edges must be sorted, and surface.area and surface.areaFill zeroed.
 
 	RAST_ARRAY(RastEdge) active = { 0 };
 	int edgePosition = 0;
-	
-	if (shape.left < 0) shape.left = 0;
-	if (shape.right > surface.width) shape.right = surface.width;
-	if (shape.top < 0) shape.top = 0;
-	if (shape.bottom > surface.height) shape.bottom = surface.height;
-
-	// Split edges that cross the left side of the shape.
-
-	int initialShapeEdges = RAST_ARRAY_LENGTH(shape.edges);
 
-	for (int i = 0; i < initialShapeEdges; i++) {
-		RastEdge *a = &shape.edges[i];
-
-		float y0 = a->yf;
-		float y1 = a->yt;
-		float x0 = a->xf;
-		float x1 = a->xt;
-		bool flipped = false;
-
-		if (x0 > x1) {
-			float t = x0;
-			x0 = x1, x1 = t;
-			flipped = true;
-		}
-
-		if (x0 < shape.left && x1 >= shape.left) {
-			RastEdge e = *a;
-
-			if (flipped) {
-				y1 += (shape.left - x0) * a->dy;
-				a->xt = e.xf = e.xt = shape.left;
-				e.yf = a->yt = y1;
-				e.dx = 0;
-			} else {
-				y0 += (shape.left - x0) * a->dy;
-				a->xt = e.xf = a->xf = shape.left;
-				e.yf = a->yt = y0;
-				a->dx = 0;
-			}
-
-			RAST_ARRAY_ADD(shape.edges, e);
-		}
-	}
-
-	RastEdgesSort(&shape.edges[0], RAST_ARRAY_LENGTH(shape.edges), NULL);
-	
-	if (paint.type == RAST_PAINT_CHECKERBOARD && paint.checkboard.size < 1) paint.checkboard.size = 1;
-	
-	for (int scanline = shape.top; scanline < shape.bottom; scanline++) {
+	for (int scanline = top; scanline < bottom; scanline++) {
 		// Remove edges above this scanline.
 		
 		for (int i = 0; i < RAST_ARRAY_LENGTH(active); i++) {
@@ -276,11 +285,12 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 		
 		// Add edges that start within this scanline.
 		
-		while (edgePosition < RAST_ARRAY_LENGTH(shape.edges)) {
-			RastEdge *e = &shape.edges[edgePosition];
+		while (edgePosition < RAST_ARRAY_LENGTH(shape->edges)) {
+			RastEdge *e = &shape->edges[edgePosition];
 			
 			if (e->yf < scanline + 1.0f) {
-				RAST_ARRAY_ADD(active, *e);
+				// Skip edges that ended before this scanline. This only happens when starting partway through the shape.
+				if (e->yt >= scanline) RAST_ARRAY_ADD(active, *e);
 				edgePosition++;
 			} else {
 				break;
@@ -320,19 +330,19 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 				flipped = true;
 			}
 
-			if (x1 < shape.left) {
-				x0 = x1 = shape.left;
-			} else if (x0 < shape.left) {
-				y0 += (shape.left - x0) * dy;
-				x0 = shape.left;
+			if (x1 < shape->left) {
+				x0 = x1 = shape->left;
+			} else if (x0 < shape->left) {
+				y0 += (shape->left - x0) * dy;
+				x0 = shape->left;
 			}
 
-			if (x1 >= shape.right) {
-				y1 += (x1 - shape.right + 1) * dy;
-				x1 = shape.right - 1;
+			if (x1 >= shape->right) {
+				y1 += (x1 - shape->right + 1) * dy;
+				x1 = shape->right - 1;
 			}
 
-			if (y1 <= y0 || x0 >= shape.right || x1 < shape.left || EsCRTisnanf(x0) || EsCRTisnanf(x1) || EsCRTisnanf(y0) || EsCRTisnanf(y1)) {
+			if (y1 <= y0 || x0 >= shape->right || x1 < shape->left || EsCRTisnanf(x0) || EsCRTisnanf(x1) || EsCRTisnanf(y0) || EsCRTisnanf(y1)) {
 				continue;
 			}
 			
@@ -373,19 +383,55 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 		// Calculate the final coverage of each pixel.
 		
 		float cumulativeArea = 0;
-		uint32_t *destination = (uint32_t *) ((uint8_t *) surface.buffer + scanline * surface.stride + 4 * shape.left);
+		uint32_t *destination = (uint32_t *) ((uint8_t *) surface.buffer + scanline * surface.stride + 4 * shape->left);
 		
-		float textureDX = paint.gradient.transform[0];
-		float texturePX = shape.left * textureDX + (float) scanline * paint.gradient.transform[1] + paint.gradient.transform[2];
-		float textureDY = paint.gradient.transform[3];
-		float texturePY = shape.left * textureDY + (float) scanline * paint.gradient.transform[4] + paint.gradient.transform[5];
+		float textureDX = paint->gradient.transform[0];
+		float texturePX = shape->left * textureDX + (float) scanline * paint->gradient.transform[1] + paint->gradient.transform[2];
+		float textureDY = paint->gradient.transform[3];
+		float texturePY = shape->left * textureDY + (float) scanline * paint->gradient.transform[4] + paint->gradient.transform[5];
 
-		if (paint.type == RAST_PAINT_NOISE) {
+		if (paint->type == RAST_PAINT_NOISE) {
 			textureDX = 1;
 			texturePX = 0;
 		}
 		
-		for (int i = shape.left; i < shape.right; i++) {
+		int i = shape->left;
+
+#ifndef IN_DESIGNER
+		if (paint->type == RAST_PAINT_SOLID && !evenOdd) {
+			// Convert the coverage of 4 pixels at a time.
+			// The running sum stays scalar, added up in the same order as the loop below, so the result is the same.
+			// Only the clamping, conversion and clearing of the coverage buffers are done with SSE.
+
+			__m128 alpha = _mm_set1_ps(paint->solid.alpha);
+			__m128 scale = _mm_set1_ps(255.0f);
+			__m128 signMask = _mm_set1_ps(-0.0f);
+			__m128 one = _mm_set1_ps(1.0f);
+			uint32_t color = paint->solid.color;
+
+			for (; i + 4 <= shape->right; i += 4, destination += 4) {
+				float runningSums[4];
+				runningSums[0] = cumulativeArea += surface.areaFill[i + 0];
+				runningSums[1] = cumulativeArea += surface.areaFill[i + 1];
+				runningSums[2] = cumulativeArea += surface.areaFill[i + 2];
+				runningSums[3] = cumulativeArea += surface.areaFill[i + 3];
+
+				// NaN coverage converts to 0x80000000, which is skipped below.
+				__m128 a = _mm_min_ps(one, _mm_andnot_ps(signMask, _mm_add_ps(_mm_loadu_ps(surface.area + i), _mm_loadu_ps(runningSums))));
+				uint32_t c[4];
+				_mm_storeu_si128((__m128i *) c, _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(a, alpha), scale)));
+				_mm_storeu_ps(surface.area + i, _mm_setzero_ps());
+				_mm_storeu_ps(surface.areaFill + i, _mm_setzero_ps());
+
+				if ((uint8_t) c[0]) BlendPixel(destination + 0, ((uint32_t) (uint8_t) c[0] << 24) | color, true);
+				if ((uint8_t) c[1]) BlendPixel(destination + 1, ((uint32_t) (uint8_t) c[1] << 24) | color, true);
+				if ((uint8_t) c[2]) BlendPixel(destination + 2, ((uint32_t) (uint8_t) c[2] << 24) | color, true);
+				if ((uint8_t) c[3]) BlendPixel(destination + 3, ((uint32_t) (uint8_t) c[3] << 24) | color, true);
+			}
+		}
+#endif
+
+		for (; i < shape->right; i++) {
 			cumulativeArea += surface.areaFill[i];
 			float a = surface.area[i] + cumulativeArea;
 
@@ -398,34 +444,34 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 			}
 			
 			if (a > 0.0039f) {
-				if (paint.type == RAST_PAINT_SOLID) {
-					uint8_t c = (uint8_t) (a * paint.solid.alpha * 255.0f);
-					if (c) BlendPixel(destination, (c << 24) | paint.solid.color, true);
-				} else if (paint.type == RAST_PAINT_CHECKERBOARD) {
-					if (((i - shape.left) / paint.checkboard.size + (scanline - shape.top) / paint.checkboard.size) & 1) {
-						uint8_t c = (uint8_t) (a * paint.checkboard.alpha2 * 255.0f);
-						if (c) BlendPixel(destination, (c << 24) | paint.checkboard.color2, true);
+				if (paint->type == RAST_PAINT_SOLID) {
+					uint8_t c = (uint8_t) (a * paint->solid.alpha * 255.0f);
+					if (c) BlendPixel(destination, (c << 24) | paint->solid.color, true);
+				} else if (paint->type == RAST_PAINT_CHECKERBOARD) {
+					if (((i - shape->left) / paint->checkboard.size + (scanline - shape->top) / paint->checkboard.size) & 1) {
+						uint8_t c = (uint8_t) (a * paint->checkboard.alpha2 * 255.0f);
+						if (c) BlendPixel(destination, (c << 24) | paint->checkboard.color2, true);
 					} else {
-						uint8_t c = (uint8_t) (a * paint.checkboard.alpha1 * 255.0f);
-						if (c) BlendPixel(destination, (c << 24) | paint.checkboard.color1, true);
+						uint8_t c = (uint8_t) (a * paint->checkboard.alpha1 * 255.0f);
+						if (c) BlendPixel(destination, (c << 24) | paint->checkboard.color1, true);
 					}
-				} else if (paint.type == RAST_PAINT_LINEAR_GRADIENT) {
-					float p = _RastRepeat(paint.gradient.repeatMode, texturePX);
+				} else if (paint->type == RAST_PAINT_LINEAR_GRADIENT) {
+					float p = _RastRepeat(paint->gradient.repeatMode, texturePX);
 					int pi = (int) ((RAST_GRADIENT_COLORS - 1) * p);
 					EsAssert(pi >= 0 && pi < RAST_GRADIENT_COLORS); // Invalid gradient index.
-					uint8_t c = (uint8_t) (a * paint.gradient.alpha[pi] * 255.0f);
-					if (c) BlendPixel(destination, (c << 24) | paint.gradient.color[pi], true);
-				} else if (paint.type == RAST_PAINT_RADIAL_GRADIENT) {
-					float p = _RastRepeat(paint.gradient.repeatMode, EsCRTsqrtf(texturePX * texturePX + texturePY * texturePY));
+					uint8_t c = (uint8_t) (a * paint->gradient.alpha[pi] * 255.0f);
+					if (c) BlendPixel(destination, (c << 24) | paint->gradient.color[pi], true);
+				} else if (paint->type == RAST_PAINT_RADIAL_GRADIENT) {
+					float p = _RastRepeat(paint->gradient.repeatMode, EsCRTsqrtf(texturePX * texturePX + texturePY * texturePY));
 					int pi = (int) ((RAST_GRADIENT_COLORS - 1) * p);
-					uint8_t c = (uint8_t) (a * paint.gradient.alpha[pi] * 255.0f);
-					if (c) BlendPixel(destination, (c << 24) | paint.gradient.color[pi], true);
-				} else if (paint.type == RAST_PAINT_ANGULAR_GRADIENT) {
-					float p = _RastRepeat(paint.gradient.repeatMode, EsCRTatan2f(texturePY, texturePX) * 0.159154943091f + 0.5f);
+					uint8_t c = (uint8_t) (a * paint->gradient.alpha[pi] * 255.0f);
+					if (c) BlendPixel(destination, (c << 24) | paint->gradient.color[pi], true);
+				} else if (paint->type == RAST_PAINT_ANGULAR_GRADIENT) {
+					float p = _RastRepeat(paint->gradient.repeatMode, EsCRTatan2f(texturePY, texturePX) * 0.159154943091f + 0.5f);
 					int pi = (int) ((RAST_GRADIENT_COLORS - 1) * p);
-					uint8_t c = (uint8_t) (a * paint.gradient.alpha[pi] * 255.0f);
-					if (c) BlendPixel(destination, (c << 24) | paint.gradient.color[pi], true);
-				} else if (paint.type == RAST_PAINT_NOISE) {
+					uint8_t c = (uint8_t) (a * paint->gradient.alpha[pi] * 255.0f);
+					if (c) BlendPixel(destination, (c << 24) | paint->gradient.color[pi], true);
+				} else if (paint->type == RAST_PAINT_NOISE) {
 					union { float f; uint32_t u; } noise = { texturePX + texturePY };
 					noise.u += noise.u << 10;
 					noise.u ^= noise.u >> 6;
@@ -435,11 +481,11 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 					noise.u &= 0x7FFFFF;
 					noise.u |= 0x3F800000;
 					noise.f /= 2;
-					noise.f *= paint.noise.maximum - paint.noise.minimum;
-					noise.f += paint.noise.minimum;
+					noise.f *= paint->noise.maximum - paint->noise.minimum;
+					noise.f += paint->noise.minimum;
 					
 					uint8_t c = (uint8_t) (a * noise.f * 255.0f);
-					if (c) BlendPixel(destination, (c << 24) | paint.noise.color, true);
+					if (c) BlendPixel(destination, (c << 24) | paint->noise.color, true);
 				}
 			}
 			
@@ -449,10 +495,177 @@ void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool
 			texturePY += textureDY;
 		}
 
-		surface.areaFill[shape.right] = 0;
+		surface.areaFill[shape->right] = 0;
 	}
 	
 	RAST_ARRAY_FREE(active);
+}
+
+#ifndef IN_DESIGNER
+typedef struct RastFillJob {
+	RastSurface surface;
+	RastShape *shape;
+	RastPaint *paint;
+	bool evenOdd;
+	int bandCount;
+	volatile int nextBand, bandsDone, references;
+	EsHandle doneEvent;
+} RastFillJob;
+
+void _RastFillJobRelease(RastFillJob *job) {
+	if (__sync_sub_and_fetch(&job->references, 1) == 0) {
+		EsHandleClose(job->doneEvent);
+		EsHeapFree(job);
+	}
+}
+
+void _RastFillJobRun(RastFillJob *job, RastSurface surface) {
+	while (true) {
+		int band = __sync_fetch_and_add(&job->nextBand, 1);
+		if (band >= job->bandCount) break;
+
+		int top = job->shape->top + band * RAST_PARALLEL_BAND_HEIGHT;
+		int bottom = top + RAST_PARALLEL_BAND_HEIGHT;
+		if (bottom > job->shape->bottom) bottom = job->shape->bottom;
+		_RastSurfaceFillRows(surface, job->shape, job->paint, job->evenOdd, top, bottom);
+
+		if (__sync_add_and_fetch(&job->bandsDone, 1) == job->bandCount) {
+			EsEventSet(job->doneEvent);
+		}
+	}
+}
+
+void _RastFillJobWork(EsGeneric context) {
+	RastFillJob *job = (RastFillJob *) context.p;
+
+	// Each thread needs its own coverage accumulation buffers.
+	RastSurface surface = job->surface;
+	surface.area = (float *) EsHeapAllocate(sizeof(float) * surface.width, true);
+	surface.areaFill = (float *) EsHeapAllocate(sizeof(float) * (surface.width + 1), true);
+
+	if (surface.area && surface.areaFill) {
+		_RastFillJobRun(job, surface);
+	}
+
+	EsHeapFree(surface.area);
+	EsHeapFree(surface.areaFill);
+	_RastFillJobRelease(job);
+}
+
+bool _RastSurfaceFillParallel(RastSurface surface, RastShape *shape, RastPaint *paint, bool evenOdd) {
+	// Split large shapes into bands of scanlines, and share them with the work queue threads.
+	// The calling thread also takes bands, so the fill completes even if the work queue is busy.
+
+	int bandCount = (shape->bottom - shape->top + RAST_PARALLEL_BAND_HEIGHT - 1) / RAST_PARALLEL_BAND_HEIGHT;
+	uintptr_t threadCount = EsSystemGetOptimalWorkQueueThreadCount();
+
+	if (bandCount < 2 || threadCount < 2 || (shape->right - shape->left) * (shape->bottom - shape->top) < RAST_PARALLEL_MINIMUM_PIXELS) {
+		return false;
+	}
+
+	RastFillJob *job = (RastFillJob *) EsHeapAllocate(sizeof(RastFillJob), true);
+	if (!job) return false;
+	job->doneEvent = EsEventCreate(false);
+
+	if (!job->doneEvent) {
+		EsHeapFree(job);
+		return false;
+	}
+
+	job->surface = surface;
+	job->shape = shape;
+	job->paint = paint;
+	job->evenOdd = evenOdd;
+	job->bandCount = bandCount;
+	job->references = 1;
+
+	for (uintptr_t i = 0; i < threadCount - 1 && (int) i < bandCount - 1; i++) {
+		__sync_fetch_and_add(&job->references, 1);
+
+		if (ES_SUCCESS != EsWorkQueue(_RastFillJobWork, job)) {
+			__sync_fetch_and_sub(&job->references, 1);
+			break;
+		}
+	}
+
+	_RastFillJobRun(job, surface);
+
+	if (job->bandsDone != bandCount) {
+		// Wait for the bands that other threads are still filling.
+		EsWait(&job->doneEvent, 1, ES_WAIT_NO_TIMEOUT);
+	}
+
+	_RastFillJobRelease(job);
+	return true;
+}
+#endif
+
+void RastSurfaceFill(RastSurface surface, RastShape shape, RastPaint paint, bool evenOdd) {
+	if (paint.type == RAST_PAINT_LINEAR_GRADIENT 
+			|| paint.type == RAST_PAINT_RADIAL_GRADIENT
+			|| paint.type == RAST_PAINT_ANGULAR_GRADIENT) {
+		if (!paint.gradient.color || !paint.gradient.alpha) {
+			_RastShapeDestroy(shape);
+			return;
+		}
+	}
+
+	if (RAST_ARRAY_LENGTH(shape.edges) == 0) {
+		return;
+	}
+
+	if (shape.left < 0) shape.left = 0;
+	if (shape.right > surface.width) shape.right = surface.width;
+	if (shape.top < 0) shape.top = 0;
+	if (shape.bottom > surface.height) shape.bottom = surface.height;
+
+	// Split edges that cross the left side of the shape.
+
+	int initialShapeEdges = RAST_ARRAY_LENGTH(shape.edges);
+
+	for (int i = 0; i < initialShapeEdges; i++) {
+		RastEdge *a = &shape.edges[i];
+
+		float y0 = a->yf;
+		float y1 = a->yt;
+		float x0 = a->xf;
+		float x1 = a->xt;
+		bool flipped = false;
+
+		if (x0 > x1) {
+			float t = x0;
+			x0 = x1, x1 = t;
+			flipped = true;
+		}
+
+		if (x0 < shape.left && x1 >= shape.left) {
+			RastEdge e = *a;
+
+			if (flipped) {
+				y1 += (shape.left - x0) * a->dy;
+				a->xt = e.xf = e.xt = shape.left;
+				e.yf = a->yt = y1;
+				e.dx = 0;
+			} else {
+				y0 += (shape.left - x0) * a->dy;
+				a->xt = e.xf = a->xf = shape.left;
+				e.yf = a->yt = y0;
+				a->dx = 0;
+			}
+
+			RAST_ARRAY_ADD(shape.edges, e);
+		}
+	}
+
+	RastEdgesSort(&shape.edges[0], RAST_ARRAY_LENGTH(shape.edges), NULL);
+	
+	if (paint.type == RAST_PAINT_CHECKERBOARD && paint.checkboard.size < 1) paint.checkboard.size = 1;
+
+#ifndef IN_DESIGNER
+	if (!_RastSurfaceFillParallel(surface, &shape, &paint, evenOdd))
+#endif
+	_RastSurfaceFillRows(surface, &shape, &paint, evenOdd, shape.top, shape.bottom);
+
 	_RastShapeDestroy(shape);
 }
 
@@ -98,6 +98,14 @@ void EsEventReset(EsHandle handle) {
 	EsSyscall(ES_SYSCALL_EVENT_RESET, handle, 0, 0, 0);
 }
 
+EsError EsFutexWait(volatile uint32_t *address, uint32_t expected, uintptr_t timeoutMs) {
+	return EsSyscall(ES_SYSCALL_FUTEX_WAIT, (uintptr_t) address, expected, timeoutMs, 0);
+}
+
+size_t EsFutexWake(volatile uint32_t *address, size_t count) {
+	return EsSyscall(ES_SYSCALL_FUTEX_WAKE, (uintptr_t) address, count, 0, 0);
+}
+
 EsError EsHandleClose(EsHandle handle) {
 	return EsSyscall(ES_SYSCALL_HANDLE_CLOSE, handle, 0, 0, 0);
 }
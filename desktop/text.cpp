@@ -31,6 +31,7 @@ struct Font {
 #define FONT_TYPE_BITMAP (1)
 #define FONT_TYPE_FREETYPE_AND_HARFBUZZ (2)
 	uintptr_t type;
+	uintptr_t atlasID; // Identifies the font in the shared glyph atlas, or 0 if it is specific to this process.
 
 	union {
 		const void *bitmapData; // All data has been validated to load the font.
@@ -56,6 +57,7 @@ struct GlyphCacheEntry {
 	size_t dataBytes;
 	int width, height, xoff, yoff;
 	int type;
+	bool shared; // The data is in the shared glyph atlas, rather than owned by this entry.
 
 	LinkedItem<GlyphCacheEntry> itemLRU;
 	GlyphCacheKey key;
@@ -158,6 +160,11 @@ struct EsTextPlan {
 	Array<TextGlyphInfo> glyphInfos;
 	Array<TextGlyphPosition> glyphPositions;
 
+	// Results returned by FontShapeText from the shaping cache.
+	Array<TextGlyphInfo> cachedGlyphInfos;
+	Array<TextGlyphPosition> cachedGlyphPositions;
+	bool shapedFromCache;
+
 	Array<TextPiece> pieces;
 	Array<TextLine> lines;
 
@@ -173,6 +180,7 @@ struct {
 	HashStore<FontSubstitutionKey, EsFontFamily> substitutions;
 	Array<FontDatabaseEntry> database;
 	uintptr_t sans, serif, monospaced, fallback;
+	uintptr_t systemFontCount; // Font families loaded from the system configuration have the same ID in every process.
 	char *sansName, *serifName, *monospacedName, *fallbackName;
 
 	// Rendering.
@@ -186,6 +194,12 @@ struct {
 	HashStore<GlyphCacheKey, GlyphCacheEntry *> glyphCache;
 	LinkedList<GlyphCacheEntry> glyphCacheLRU;
 	size_t glyphCacheBytes;
+	struct GlyphAtlas *glyphAtlas;
+	bool glyphAtlasMapped;
+#define SHAPE_CACHE_MAX_SIZE (1048576)
+	HashStore<char, struct ShapeCacheEntry *> shapeCache;
+	LinkedList<struct ShapeCacheEntry> shapeCacheLRU;
+	size_t shapeCacheBytes;
 } fontManagement;
 
 struct {
@@ -196,6 +210,132 @@ struct {
 	size_t bufferPosition, bufferAllocated;
 } iconManagement;
 
+// --------------------------------- Shared glyph atlas.
+
+// The desktop process copies each glyph it renders into the atlas, which every other process maps read-only.
+// Glyphs are only ever added, so pointers into the atlas stay valid. Once it is full, processes use their own caches.
+
+#define GLYPH_ATLAS_SLOT_COUNT (8192)
+#define GLYPH_ATLAS_MAXIMUM_PROBES (16)
+
+struct GlyphAtlasSlot {
+	volatile uint64_t key; // 0 if the slot is unused.
+	volatile uint32_t offset; // 0 until the glyph's data has been written.
+	uint32_t _unused;
+};
+
+struct GlyphAtlas {
+	volatile uint32_t bytesUsed;
+	uint32_t _unused;
+	GlyphAtlasSlot slots[GLYPH_ATLAS_SLOT_COUNT];
+	// Followed by the glyphs.
+};
+
+struct GlyphAtlasEntry {
+	int16_t width, height, xoff, yoff;
+	uint32_t type, dataBytes;
+	// Followed by the glyph's data.
+};
+
+uint64_t GlyphAtlasKey(GlyphCacheKey key) {
+	if (key.font.type && !key.font.atlasID) {
+		return 0; // The font is specific to this process.
+	}
+
+	if (key.glyphIndex >= (1 << 24) || key.size >= (1 << 12) || key.fractionalPosition >= (1 << 6)) {
+		return 0;
+	}
+
+	return ((uint64_t) key.glyphIndex << 0) | ((uint64_t) key.size << 24) | ((uint64_t) key.fractionalPosition << 36)
+		| ((uint64_t) key.font.atlasID << 42) | ((uint64_t) 1 << 63);
+}
+
+GlyphAtlas *GlyphAtlasGet() {
+	if (!fontManagement.glyphAtlasMapped) {
+		fontManagement.glyphAtlasMapped = true;
+
+		if (api.startupInformation->glyphAtlasRegion) {
+			fontManagement.glyphAtlas = (GlyphAtlas *) EsMemoryMapObject(api.startupInformation->glyphAtlasRegion, 0, GLYPH_ATLAS_BYTES, 
+					api.startupInformation->isDesktop ? ES_MEMORY_MAP_OBJECT_READ_WRITE : ES_MEMORY_MAP_OBJECT_READ_ONLY);
+		}
+	}
+
+	return fontManagement.glyphAtlas;
+}
+
+GlyphAtlasSlot *GlyphAtlasFindSlot(GlyphAtlas *atlas, uint64_t key, bool claim) {
+	uintptr_t start = (key * 0x9E3779B97F4A7C15) >> 51;
+
+	for (uintptr_t i = 0; i < GLYPH_ATLAS_MAXIMUM_PROBES; i++) {
+		GlyphAtlasSlot *slot = &atlas->slots[(start + i) & (GLYPH_ATLAS_SLOT_COUNT - 1)];
+		uint64_t slotKey = slot->key;
+
+		if (slotKey == key) {
+			return slot;
+		} else if (!slotKey) {
+			if (!claim) return nullptr;
+			slotKey = __sync_val_compare_and_swap(&slot->key, 0, key);
+			if (!slotKey || slotKey == key) return slot;
+		}
+	}
+
+	return nullptr;
+}
+
+bool GlyphAtlasLookup(GlyphCacheKey key, GlyphCacheEntry *entry) {
+	GlyphAtlas *atlas = GlyphAtlasGet();
+	uint64_t atlasKey = GlyphAtlasKey(key);
+	if (!atlas || !atlasKey) return false;
+
+	GlyphAtlasSlot *slot = GlyphAtlasFindSlot(atlas, atlasKey, false);
+	uint32_t offset = slot ? slot->offset : 0;
+	if (!offset) return false;
+	__sync_synchronize();
+
+	GlyphAtlasEntry *atlasEntry = (GlyphAtlasEntry *) ((uint8_t *) atlas + offset);
+	entry->width = atlasEntry->width, entry->height = atlasEntry->height;
+	entry->xoff = atlasEntry->xoff, entry->yoff = atlasEntry->yoff;
+	entry->type = atlasEntry->type;
+	entry->data = (uint8_t *) (atlasEntry + 1);
+	entry->dataBytes = 0; // Doesn't count towards this process's cache size.
+	entry->shared = true;
+	return true;
+}
+
+void GlyphAtlasShare(GlyphCacheKey key, GlyphCacheEntry *entry) {
+	// Called by the desktop after it renders a glyph that was registered in the cache.
+	// If the glyph is copied to the atlas, the entry is changed to use that copy instead.
+
+	if (!api.startupInformation->isDesktop || entry->shared) return;
+	GlyphAtlas *atlas = GlyphAtlasGet();
+	uint64_t atlasKey = GlyphAtlasKey(key);
+	if (!atlas || !atlasKey) return;
+
+	size_t bytes = (sizeof(GlyphAtlasEntry) + entry->dataBytes + 15) & ~15;
+	if (sizeof(GlyphAtlas) + atlas->bytesUsed + bytes > GLYPH_ATLAS_BYTES) return;
+	GlyphAtlasSlot *slot = GlyphAtlasFindSlot(atlas, atlasKey, true);
+	if (!slot || slot->offset) return;
+
+	uint32_t offset = sizeof(GlyphAtlas) + __sync_fetch_and_add(&atlas->bytesUsed, bytes);
+	if (offset + bytes > GLYPH_ATLAS_BYTES) return;
+
+	GlyphAtlasEntry *atlasEntry = (GlyphAtlasEntry *) ((uint8_t *) atlas + offset);
+	atlasEntry->width = entry->width, atlasEntry->height = entry->height;
+	atlasEntry->xoff = entry->xoff, atlasEntry->yoff = entry->yoff;
+	atlasEntry->type = entry->type;
+	atlasEntry->dataBytes = entry->dataBytes;
+	EsMemoryCopy(atlasEntry + 1, entry->data, entry->dataBytes);
+	__sync_synchronize();
+	slot->offset = offset;
+
+	EsAssert(fontManagement.glyphCacheBytes >= entry->dataBytes);
+	fontManagement.glyphCacheBytes -= entry->dataBytes;
+	EsHeapFree(entry->data);
+	entry->data = (uint8_t *) (atlasEntry + 1);
+	entry->dataBytes = 0;
+	entry->shared = true;
+}
+
 // --------------------------------- Glyph cache.
 
 void GlyphCacheFreeEntry() {
@@ -204,7 +344,7 @@ void GlyphCacheFreeEntry() {
 	fontManagement.glyphCache.Delete(&entry->key);
 	EsAssert(fontManagement.glyphCacheBytes >= entry->dataBytes);
 	fontManagement.glyphCacheBytes -= entry->dataBytes;
-	EsHeapFree(entry->data);
+	if (!entry->shared) EsHeapFree(entry->data);
 	EsHeapFree(entry);
 }
 
@@ -227,7 +367,14 @@ GlyphCacheEntry *LookupGlyphCacheEntry(GlyphCacheKey key) {
 	GlyphCacheEntry *entry = fontManagement.glyphCache.Get1(&key);
 
 	if (!entry) {
-		return (GlyphCacheEntry *) EsHeapAllocate(sizeof(GlyphCacheEntry), true);
+		entry = (GlyphCacheEntry *) EsHeapAllocate(sizeof(GlyphCacheEntry), true);
+
+		if (entry && GlyphAtlasLookup(key, entry)) {
+			// Another process has already rendered the glyph.
+			RegisterGlyphCacheEntry(key, entry);
+		}
+
+		return entry;
 	} else {
 		fontManagement.glyphCacheLRU.Remove(&entry->itemLRU);
 		fontManagement.glyphCacheLRU.InsertStart(&entry->itemLRU);
@@ -442,6 +589,11 @@ bool FontRenderGlyph(GlyphCacheKey key, GlyphCacheEntry *entry) {
 }
 
 void FontShapeTextDone(EsTextPlan *plan, uint32_t glyphCount, TextGlyphInfo *_glyphInfos, TextGlyphPosition *_glyphPositions) {
+	if (plan->shapedFromCache) {
+		plan->shapedFromCache = false;
+		return;
+	}
+
 	if (plan->font.type == FONT_TYPE_BITMAP) {
 		(void) glyphCount;
 		Array<TextGlyphInfo> glyphInfos = { .array = _glyphInfos };
@@ -451,7 +603,7 @@ void FontShapeTextDone(EsTextPlan *plan, uint32_t glyphCount, TextGlyphInfo *_gl
 	}
 }
 
-void FontShapeText(EsTextPlan *plan, const char *string, size_t stringBytes, 
+void FontShapeTextUncached(EsTextPlan *plan, const char *string, size_t stringBytes, 
 		uintptr_t sectionOffsetBytes, size_t sectionCountBytes,
 		TextFeature *features, size_t featureCount,
 		uint32_t *glyphCount, TextGlyphInfo **_glyphInfos, TextGlyphPosition **_glyphPositions) {
@@ -526,6 +678,147 @@ void FontShapeText(EsTextPlan *plan, const char *string, size_t stringBytes,
 #endif
 }
 
+// --------------------------------- Shaping cache.
+
+// Labels, list cells and buttons are laid out again and again with the same strings,
+// so remember the glyphs that each run of text was shaped into.
+// A run is identified by its font, size, segment properties, features, and text, including some context either side,
+// which HarfBuzz can look at when shaping.
+
+#define SHAPE_CACHE_MAX_RUN_BYTES (256)
+#define SHAPE_CACHE_CONTEXT_BYTES (20) // HarfBuzz keeps up to 5 codepoints of context.
+
+struct ShapeCacheKey {
+	Font font;
+	uint32_t size;
+	uint32_t direction, script;
+	uint32_t featureCount;
+	uintptr_t language;
+	TextFeature features[4];
+	uint32_t contextBeforeBytes, sectionBytes;
+	// Followed by the text.
+};
+
+struct ShapeCacheEntry {
+	LinkedItem<ShapeCacheEntry> itemLRU;
+	size_t bytes, keyBytes;
+	uint32_t glyphCount;
+	TextGlyphInfo *glyphInfos; // The clusters are relative to the start of the run.
+	TextGlyphPosition *glyphPositions;
+	char *key;
+};
+
+void ShapeCacheFreeEntry() {
+	ShapeCacheEntry *entry = fontManagement.shapeCacheLRU.lastItem->thisItem;
+	fontManagement.shapeCacheLRU.Remove(&entry->itemLRU);
+	fontManagement.shapeCache.Delete(entry->key, entry->keyBytes);
+	EsAssert(fontManagement.shapeCacheBytes >= entry->bytes);
+	fontManagement.shapeCacheBytes -= entry->bytes;
+	EsHeapFree(entry);
+}
+
+size_t ShapeCacheMakeKey(EsTextPlan *plan, char *buffer, const char *string, size_t stringBytes, 
+		uintptr_t sectionOffsetBytes, size_t sectionCountBytes, TextFeature *features, size_t featureCount) {
+	if (sectionCountBytes > SHAPE_CACHE_MAX_RUN_BYTES || featureCount > 4 || !plan->currentTextStyle) {
+		return 0;
+	}
+
+	uintptr_t contextStart = sectionOffsetBytes > SHAPE_CACHE_CONTEXT_BYTES ? sectionOffsetBytes - SHAPE_CACHE_CONTEXT_BYTES : 0;
+	uintptr_t contextEnd = sectionOffsetBytes + sectionCountBytes + SHAPE_CACHE_CONTEXT_BYTES;
+	if (contextEnd > stringBytes) contextEnd = stringBytes;
+
+	ShapeCacheKey key;
+	EsMemoryZero(&key, sizeof(key));
+	key.font = plan->font;
+	key.size = plan->currentTextStyle->size;
+	key.direction = plan->segmentProperties.direction;
+	key.script = plan->segmentProperties.script;
+	key.language = (uintptr_t) plan->segmentProperties.language;
+	key.featureCount = featureCount;
+	if (featureCount) EsMemoryCopy(key.features, features, featureCount * sizeof(TextFeature));
+	key.contextBeforeBytes = sectionOffsetBytes - contextStart;
+	key.sectionBytes = sectionCountBytes;
+
+	EsMemoryCopy(buffer, &key, sizeof(key));
+	EsMemoryCopy(buffer + sizeof(key), string + contextStart, contextEnd - contextStart);
+	return sizeof(key) + contextEnd - contextStart;
+}
+
+void ShapeCacheInsert(const char *key, size_t keyBytes, uint32_t glyphCount, 
+		const TextGlyphInfo *glyphInfos, const TextGlyphPosition *glyphPositions, uint32_t clusterOffset) {
+	size_t bytes = sizeof(ShapeCacheEntry) + keyBytes + glyphCount * (sizeof(TextGlyphInfo) + sizeof(TextGlyphPosition));
+
+	while (fontManagement.shapeCacheBytes + bytes > SHAPE_CACHE_MAX_SIZE && fontManagement.shapeCacheLRU.count) {
+		ShapeCacheFreeEntry();
+	}
+
+	ShapeCacheEntry *entry = (ShapeCacheEntry *) EsHeapAllocate(bytes, true);
+	if (!entry) return;
+	ShapeCacheEntry **slot = fontManagement.shapeCache.Put(key, keyBytes);
+
+	if (!slot) {
+		EsHeapFree(entry);
+		return;
+	}
+
+	entry->glyphInfos = (TextGlyphInfo *) (entry + 1);
+	entry->glyphPositions = (TextGlyphPosition *) (entry->glyphInfos + glyphCount);
+	entry->key = (char *) (entry->glyphPositions + glyphCount);
+	entry->bytes = bytes;
+	entry->keyBytes = keyBytes;
+	entry->glyphCount = glyphCount;
+	entry->itemLRU.thisItem = entry;
+	EsMemoryCopy(entry->key, key, keyBytes);
+	EsMemoryCopy(entry->glyphPositions, glyphPositions, glyphCount * sizeof(TextGlyphPosition));
+
+	for (uintptr_t i = 0; i < glyphCount; i++) {
+		entry->glyphInfos[i] = glyphInfos[i];
+		entry->glyphInfos[i].cluster -= clusterOffset;
+	}
+
+	*slot = entry;
+	fontManagement.shapeCacheLRU.InsertStart(&entry->itemLRU);
+	fontManagement.shapeCacheBytes += bytes;
+}
+
+void FontShapeText(EsTextPlan *plan, const char *string, size_t stringBytes, 
+		uintptr_t sectionOffsetBytes, size_t sectionCountBytes,
+		TextFeature *features, size_t featureCount,
+		uint32_t *glyphCount, TextGlyphInfo **_glyphInfos, TextGlyphPosition **_glyphPositions) {
+	EsMessageMutexCheck();
+
+	// HarfBuzz gives clusters relative to the start of the string, and the bitmap font backend relative to the start of the run.
+	uint32_t clusterOffset = plan->font.type == FONT_TYPE_FREETYPE_AND_HARFBUZZ ? sectionOffsetBytes : 0;
+
+	char key[sizeof(ShapeCacheKey) + SHAPE_CACHE_MAX_RUN_BYTES + SHAPE_CACHE_CONTEXT_BYTES * 2];
+	size_t keyBytes = ShapeCacheMakeKey(plan, key, string, stringBytes, sectionOffsetBytes, sectionCountBytes, features, featureCount);
+	ShapeCacheEntry *entry = keyBytes ? fontManagement.shapeCache.Get1(key, keyBytes) : nullptr;
+
+	if (entry && plan->cachedGlyphInfos.SetLength(entry->glyphCount) && plan->cachedGlyphPositions.SetLength(entry->glyphCount)) {
+		fontManagement.shapeCacheLRU.Remove(&entry->itemLRU);
+		fontManagement.shapeCacheLRU.InsertStart(&entry->itemLRU);
+
+		for (uintptr_t i = 0; i < entry->glyphCount; i++) {
+			plan->cachedGlyphInfos[i] = entry->glyphInfos[i];
+			plan->cachedGlyphInfos[i].cluster += clusterOffset;
+		}
+
+		EsMemoryCopy(plan->cachedGlyphPositions.array, entry->glyphPositions, entry->glyphCount * sizeof(TextGlyphPosition));
+		*glyphCount = entry->glyphCount;
+		*_glyphInfos = plan->cachedGlyphInfos.array;
+		*_glyphPositions = plan->cachedGlyphPositions.array;
+		plan->shapedFromCache = true;
+		return;
+	}
+
+	FontShapeTextUncached(plan, string, stringBytes, sectionOffsetBytes, sectionCountBytes, features, featureCount, 
+			glyphCount, _glyphInfos, _glyphPositions);
+
+	if (keyBytes) {
+		ShapeCacheInsert(key, keyBytes, *glyphCount, *_glyphInfos, *_glyphPositions, clusterOffset);
+	}
+}
+
 uint32_t FontGetScriptFromCodepoint(uint32_t codepoint, bool *inheritingScript) {
 #ifdef USE_FREETYPE_AND_HARFBUZZ
 	static hb_unicode_funcs_t *unicodeFunctions = nullptr;
@@ -645,6 +938,8 @@ void FontInitialise() {
 	}
 
 	EsMutexRelease(&api.systemConfigurationMutex);
+
+	fontManagement.systemFontCount = fontManagement.database.Length();
 }
 
 EsFontFamily FontGetStandardFamily(EsFontFamily family) {
@@ -886,6 +1181,10 @@ Font FontGet(EsFont key) {
 		return FontGet(key);
 	}
 
+	if (key.family < fontManagement.systemFontCount && key.family < 256) {
+		font.atlasID = (font.type << 13) | (key.family << 5) | ((key.weight & 15) << 1) | ((key.flags & ES_FONT_ITALIC) ? 1 : 0);
+	}
+
 	*fontManagement.loaded.Put(&key) = font;
 	return font;
 }
@@ -895,6 +1194,10 @@ void FontDatabaseFree() {
 		GlyphCacheFreeEntry();
 	}
 
+	while (fontManagement.shapeCacheLRU.count) {
+		ShapeCacheFreeEntry();
+	}
+
 	for (uintptr_t i = 0; i < fontManagement.loaded.Count(); i++) {
 		// TODO Unmap file store data.
 		Font font = fontManagement.loaded[i];
@@ -930,6 +1233,7 @@ void FontDatabaseFree() {
 	EsHeapFree(fontManagement.fallbackName);
 
 	fontManagement.glyphCache.Free();
+	fontManagement.shapeCache.Free();
 	fontManagement.substitutions.Free();
 	fontManagement.database.Free();
 	fontManagement.loaded.Free();
@@ -1515,6 +1819,7 @@ bool EsDrawStandardIcon(EsPainter *painter, uint32_t id, int size, EsRectangle r
 
 			if (image) {
 				DrawIcon(size, size, cacheEntry->data, image, size * 4, 0, 0, (float) size / image->width, (float) size / image->height);
+				GlyphAtlasShare(key, cacheEntry);
 			}
 		} else {
 			EsHeapFree(cacheEntry);
@@ -2061,6 +2366,8 @@ int32_t TextBuildTextPieces(EsTextPlan *plan, uintptr_t sectionStart, uintptr_t
 void TextPlanDestroy(EsTextPlan *plan) {
 	plan->glyphInfos.Free();
 	plan->glyphPositions.Free();
+	plan->cachedGlyphInfos.Free();
+	plan->cachedGlyphPositions.Free();
 	plan->pieces.Free();
 	plan->lines.Free();
 	plan->textRuns.Free();
@@ -2370,6 +2677,7 @@ void DrawTextPiece(EsPainter *painter, EsTextPlan *plan, TextPiece *piece, TextL
 				goto nextCharacter;
 			} else {
 				RegisterGlyphCacheEntry(key, entry);
+				GlyphAtlasShare(key, entry);
 			}
 		}
 
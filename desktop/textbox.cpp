@@ -9,12 +9,47 @@
 
 #define GET_BUFFER(line) TextboxGetDocumentLineBuffer(textbox, line)
 
+// The document's text and its array of lines are both stored in gap buffers, with the gaps kept at the most recent edit.
+// Lines after the gap store their offset and yPosition relative to the end of the document,
+// so inserting or removing lines at the gap does not need to update any of the lines that follow.
+// Therefore the cost of an edit is proportional to how far it is from the previous one, rather than to the size of the document.
+
 struct DocumentLine {
 	int32_t lengthBytes,
 		lengthWidth, 
 		height,
-		yPosition,
-		offset;
+		yPosition; // Use TextboxLineY to read this.
+	intptr_t offset; // Use TextboxLineOffset to read this.
+};
+
+struct DocumentLines {
+	DocumentLine *array;
+	uintptr_t gapStart, gapCount, allocated;
+
+	inline size_t Length() { 
+		return allocated - gapCount; 
+	}
+
+	inline DocumentLine &operator[](uintptr_t index) { 
+#ifdef DEBUG_BUILD
+		EsAssert(index < Length());
+#endif
+		return array[index < gapStart ? index : index + gapCount]; 
+	}
+
+	inline uintptr_t IndexOf(DocumentLine *line) {
+		uintptr_t index = line - array;
+		return index < gapStart ? index : index - gapCount;
+	}
+
+	inline DocumentLine &First() { return (*this)[0]; }
+	inline DocumentLine &Last() { return (*this)[Length() - 1]; }
+
+	inline void Free() {
+		EsHeapFree(array);
+		array = nullptr;
+		gapStart = gapCount = allocated = 0;
+	}
 };
 
 struct TextboxVisibleLine {
@@ -29,13 +64,13 @@ struct TextboxCaret {
 struct EsTextbox : EsElement {
 	ScrollPane scroll;
 
-	char *data; // Call TextboxSetActiveLine(textbox, -1) to access this.
+	char *data; // Call TextboxSetActiveLine(textbox, -1) and then TextboxGetData to access this.
 	uintptr_t dataAllocated;
-	int32_t dataBytes;
+	intptr_t dataBytes, dataGapStart; // The gap is dataAllocated - dataBytes bytes long.
 
 	bool editing;
 	char *editStartContent;
-	int32_t editStartContentBytes;
+	intptr_t editStartContentBytes;
 
 	bool ensureCaretVisibleQueued;
 
@@ -44,7 +79,8 @@ struct EsTextbox : EsElement {
 
 	char *activeLine;
 	uintptr_t activeLineAllocated;
-	int32_t activeLineIndex, activeLineStart, activeLineOldBytes, activeLineBytes;
+	int32_t activeLineIndex, activeLineOldBytes, activeLineBytes;
+	intptr_t activeLineStart;
 
 	int32_t longestLine, longestLineWidth; // To set the horizontal scroll bar's size.
 
@@ -52,7 +88,8 @@ struct EsTextbox : EsElement {
 	TextboxCaret wordSelectionAnchor, wordSelectionAnchor2;
 	bool wordSelectionAnchorValid;
 
-	Array<DocumentLine> lines;
+	DocumentLines lines;
+	int32_t totalHeight;
 	Array<TextboxVisibleLine> visibleLines;
 	int32_t firstVisibleLine;
 
@@ -114,6 +151,118 @@ void TextboxBufferResize(void **array, uintptr_t *allocated, uintptr_t needed, u
 	*array = newArray;
 }
 
+void TextboxMoveDataGap(EsTextbox *textbox, intptr_t offset) {
+	EsAssert(offset >= 0 && offset <= textbox->dataBytes);
+	intptr_t gapBytes = textbox->dataAllocated - textbox->dataBytes;
+
+	if (offset < textbox->dataGapStart) {
+		EsMemoryMove(textbox->data + offset, textbox->data + textbox->dataGapStart, gapBytes, false);
+	} else if (offset > textbox->dataGapStart) {
+		EsMemoryMove(textbox->data + textbox->dataGapStart + gapBytes, textbox->data + offset + gapBytes, -gapBytes, false);
+	}
+
+	textbox->dataGapStart = offset;
+}
+
+void TextboxReserveData(EsTextbox *textbox, intptr_t bytes) {
+	// Make sure that the gap can fit the given number of bytes.
+
+	uintptr_t oldAllocated = textbox->dataAllocated;
+	TextboxBufferResize((void **) &textbox->data, &textbox->dataAllocated, textbox->dataBytes + bytes, 1);
+
+	if (oldAllocated != textbox->dataAllocated) {
+		intptr_t oldGapBytes = oldAllocated - textbox->dataBytes;
+		EsMemoryMove(textbox->data + textbox->dataGapStart + oldGapBytes, textbox->data + oldAllocated, 
+				textbox->dataAllocated - oldAllocated, false);
+	}
+}
+
+char *TextboxGetData(EsTextbox *textbox, intptr_t offset, intptr_t bytes) {
+	// If the gap splits the range, move it to whichever end is closer.
+
+	if (offset < textbox->dataGapStart && offset + bytes > textbox->dataGapStart) {
+		TextboxMoveDataGap(textbox, offset + bytes - textbox->dataGapStart < textbox->dataGapStart - offset ? offset + bytes : offset);
+	}
+
+	return textbox->data + (offset < textbox->dataGapStart ? offset : offset + textbox->dataAllocated - textbox->dataBytes);
+}
+
+void TextboxMoveLineGap(EsTextbox *textbox, uintptr_t index) {
+	DocumentLines *lines = &textbox->lines;
+	EsAssert(index <= lines->Length());
+
+	while (lines->gapStart > index) {
+		DocumentLine line = lines->array[--lines->gapStart];
+		line.offset -= textbox->dataBytes;
+		line.yPosition -= textbox->totalHeight;
+		lines->array[lines->gapStart + lines->gapCount] = line;
+	}
+
+	while (lines->gapStart < index) {
+		DocumentLine line = lines->array[lines->gapStart + lines->gapCount];
+		line.offset += textbox->dataBytes;
+		line.yPosition += textbox->totalHeight;
+		lines->array[lines->gapStart++] = line;
+	}
+}
+
+bool TextboxInsertLines(EsTextbox *textbox, uintptr_t index, uintptr_t count, int32_t height) {
+	// The caller must set the offset of the new lines.
+	// Returns false if the lines could not be allocated, in which case nothing is changed.
+
+	DocumentLines *lines = &textbox->lines;
+	TextboxMoveLineGap(textbox, index);
+
+	if (lines->gapCount < count) {
+		uintptr_t newAllocated = lines->allocated * 2;
+		if (newAllocated < lines->Length() + count) newAllocated = lines->Length() + count + 16;
+		DocumentLine *newArray = (DocumentLine *) EsHeapAllocate(newAllocated * sizeof(DocumentLine), false);
+		if (!newArray) return false;
+		uintptr_t afterGap = lines->allocated - lines->gapStart - lines->gapCount;
+		EsMemoryCopy(newArray, lines->array, lines->gapStart * sizeof(DocumentLine));
+		EsMemoryCopy(newArray + newAllocated - afterGap, lines->array + lines->allocated - afterGap, afterGap * sizeof(DocumentLine));
+		EsHeapFree(lines->array);
+		lines->gapCount += newAllocated - lines->allocated;
+		lines->allocated = newAllocated;
+		lines->array = newArray;
+	}
+
+	int32_t yPosition = index ? lines->array[index - 1].yPosition + lines->array[index - 1].height : 0;
+
+	for (uintptr_t i = 0; i < count; i++) {
+		DocumentLine *line = &lines->array[index + i];
+		EsMemoryZero(line, sizeof(DocumentLine));
+		line->height = height;
+		line->yPosition = yPosition;
+		yPosition += height;
+	}
+
+	lines->gapStart += count;
+	lines->gapCount -= count;
+	textbox->totalHeight += count * height;
+	return true;
+}
+
+void TextboxDeleteLines(EsTextbox *textbox, uintptr_t index, uintptr_t count) {
+	DocumentLines *lines = &textbox->lines;
+	TextboxMoveLineGap(textbox, index + count);
+
+	for (uintptr_t i = index; i < index + count; i++) {
+		textbox->totalHeight -= lines->array[i].height;
+	}
+
+	lines->gapStart -= count;
+	lines->gapCount += count;
+}
+
+intptr_t TextboxLineOffset(EsTextbox *textbox, uintptr_t index) {
+	return textbox->lines[index].offset + (index < textbox->lines.gapStart ? 0 : textbox->dataBytes);
+}
+
+int32_t TextboxLineY(EsTextbox *textbox, uintptr_t index) {
+	return textbox->lines[index].yPosition + (index < textbox->lines.gapStart ? 0 : textbox->totalHeight);
+}
+
 void KeyboardLayoutLoad() {
 	if (api.keyboardLayoutIdentifier != api.global->keyboardLayout) {
 		char buffer[64];
@@ -268,41 +417,35 @@ void TextboxSetActiveLine(EsTextbox *textbox, int lineIndex) {
 	// EsPrint("TextboxSetActiveLine %i\n", lineIndex);
 
 	if (lineIndex == -1) {
-		int32_t lineBytesDelta = textbox->activeLineBytes - textbox->activeLineOldBytes;
+		// Step 1: Move the gaps to the end of the active line, so that the following lines' offsets are relative to the end of the document.
 
-		// Step 1: Resize the data buffer to fit the new contents of the line.
+		TextboxMoveLineGap(textbox, textbox->activeLineIndex + 1);
+		TextboxMoveDataGap(textbox, textbox->activeLineStart + textbox->activeLineOldBytes);
 
-		TextboxBufferResize((void **) &textbox->data, &textbox->dataAllocated, textbox->dataBytes + lineBytesDelta, 1);
+		// Step 2: Remove the old contents of the line, and make sure the gap can fit the new contents.
 
-		// Step 2: Move everything after the old end of the active line to its new position.
-
-		EsMemoryMove(textbox->data + textbox->activeLineStart + textbox->activeLineOldBytes,
-				textbox->data + textbox->dataBytes,
-				lineBytesDelta,
-				false);
-		textbox->dataBytes += lineBytesDelta;
-		EsAssert(textbox->dataBytes >= 0);
+		textbox->dataGapStart = textbox->activeLineStart;
+		textbox->dataBytes -= textbox->activeLineOldBytes;
+		TextboxReserveData(textbox, textbox->activeLineBytes);
 
 		// Step 3: Copy the active line back into the data buffer.
 
-		EsMemoryCopy(textbox->data + textbox->activeLineStart,
+		EsMemoryCopy(textbox->data + textbox->dataGapStart,
 				textbox->activeLine,
 				textbox->activeLineBytes);
-
-		// Step 4: Update the line byte offsets.
-
-		for (uintptr_t i = textbox->activeLineIndex + 1; i < textbox->lines.Length(); i++) {
-			textbox->lines[i].offset += lineBytesDelta;
-		}
+		textbox->dataGapStart += textbox->activeLineBytes;
+		textbox->dataBytes += textbox->activeLineBytes;
+		EsAssert(textbox->dataBytes >= 0);
 	} else {
 		TextboxSetActiveLine(textbox, -1);
 
 		DocumentLine *line = &textbox->lines[lineIndex];
+		intptr_t offset = TextboxLineOffset(textbox, lineIndex);
 
 		TextboxBufferResize((void **) &textbox->activeLine, &textbox->activeLineAllocated, (textbox->activeLineBytes = line->lengthBytes), 1);
-		EsMemoryCopy(textbox->activeLine, textbox->data + line->offset, textbox->activeLineBytes);
+		EsMemoryCopy(textbox->activeLine, TextboxGetData(textbox, offset, textbox->activeLineBytes), textbox->activeLineBytes);
 
-		textbox->activeLineStart = line->offset;
+		textbox->activeLineStart = offset;
 		textbox->activeLineOldBytes = textbox->activeLineBytes;
 	}
 
@@ -327,7 +470,7 @@ void EsTextboxStartEdit(EsTextbox *textbox) {
 		TextboxSetActiveLine(textbox, -1);
 		textbox->editStartContent = (char *) EsHeapAllocate(textbox->dataBytes, false);
 		textbox->editStartContentBytes = textbox->dataBytes;
-		EsMemoryCopy(textbox->editStartContent, textbox->data, textbox->editStartContentBytes);
+		EsMemoryCopy(textbox->editStartContent, TextboxGetData(textbox, 0, textbox->dataBytes), textbox->editStartContentBytes);
 		textbox->Repaint(true);
 	}
 }
@@ -339,7 +482,7 @@ void TextboxEndEdit(EsTextbox *textbox, bool reject) {
 		EsMessage m = { ES_MSG_TEXTBOX_EDIT_END };
 		m.endEdit.rejected = reject;
 		m.endEdit.unchanged = textbox->dataBytes == textbox->editStartContentBytes 
-			&& 0 == EsMemoryCompare(textbox->data, textbox->editStartContent, textbox->dataBytes);
+			&& 0 == EsMemoryCompare(TextboxGetData(textbox, 0, textbox->dataBytes), textbox->editStartContent, textbox->dataBytes);
 
 		if (reject || ES_REJECTED == EsMessageSend(textbox, &m)) {
 			EsTextboxSelectAll(textbox);
@@ -444,10 +587,12 @@ void TextboxUpdateCommands(EsTextbox *textbox, bool noClipboard) {
 }
 
 char *TextboxGetDocumentLineBuffer(EsTextbox *textbox, DocumentLine *line) {
-	if (textbox->activeLineIndex == line - textbox->lines.array) {
+	uintptr_t index = textbox->lines.IndexOf(line);
+
+	if (textbox->activeLineIndex == (int32_t) index) {
 		return textbox->activeLine;
 	} else {
-		return textbox->data + line->offset;
+		return TextboxGetData(textbox, TextboxLineOffset(textbox, index), line->lengthBytes);
 	}
 }
 
@@ -487,7 +632,7 @@ void TextboxEnsureCaretVisibleActionCallback(EsElement *element, EsGeneric conte
 		
 		EsRectangle bounds = textbox->GetBounds();
 		DocumentLine *line = &textbox->lines[caret.line];
-		int caretY = line->yPosition + textbox->insets.t;
+		int caretY = TextboxLineY(textbox, caret.line) + textbox->insets.t;
 
 		int scrollY = textbox->scroll.position[1];
 		int viewportHeight = bounds.b;
@@ -691,7 +836,7 @@ void TextboxRefreshVisibleLines(EsTextbox *textbox, bool repaint = true) {
 
 	while (low != high) {
 		int32_t middle = (low + high) / 2;
-		int32_t position = textbox->lines[middle].yPosition;
+		int32_t position = TextboxLineY(textbox, middle);
 
 		if (position < target && low != middle) low = middle;
 		else if (position > target && high != middle) high = middle;
@@ -703,7 +848,7 @@ void TextboxRefreshVisibleLines(EsTextbox *textbox, bool repaint = true) {
 
 	for (int32_t i = textbox->firstVisibleLine; i < (int32_t) textbox->lines.Length(); i++) {
 		TextboxVisibleLine line = {};
-		line.yPosition = textbox->lines[i].yPosition;
+		line.yPosition = TextboxLineY(textbox, i);
 		textbox->visibleLines.Add(line);
 
 		if (line.yPosition - scrollY > bounds.b) {
@@ -741,16 +886,6 @@ void TextboxRefreshVisibleLines(EsTextbox *textbox, bool repaint = true) {
 	}
 }
 
-void TextboxLineCountChangeCleanup(EsTextbox *textbox, int32_t offsetDelta, int32_t startLine) {
-	for (int32_t i = startLine; i < (int32_t) textbox->lines.Length(); i++) {
-		DocumentLine *line = &textbox->lines[i], *previous = &textbox->lines[i - 1];
-		line->yPosition = previous->yPosition + previous->height;
-		line->offset += offsetDelta;
-	}
-
-	TextboxRefreshVisibleLines(textbox);
-}
-
 void EsTextboxMoveCaret(EsTextbox *textbox, int32_t line, int32_t byte) {
 	EsMessageMutexCheck();
 
@@ -890,7 +1025,7 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 
 		// Step 2: Calculate the number of bytes we are deleting.
 
-		int32_t deltaBytes;
+		intptr_t deltaBytes;
 
 		if (deleteFrom.line == deleteTo.line) {
 			deltaBytes = deleteFrom.byte - deleteTo.byte;
@@ -915,8 +1050,8 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 
 		if (deleteFrom.line == deleteTo.line) {
 			EsAssert(deltaBytes < 0); // Expected deleteTo > deleteFrom.
-			DocumentLine *line = &textbox->lines[deleteFrom.line];
 			TextboxSetActiveLine(textbox, deleteFrom.line);
+			DocumentLine *line = &textbox->lines[deleteFrom.line]; // Setting the active line may move the line gap.
 
 			// Step 4: Update the width of the line and repaint it.
 
@@ -943,8 +1078,8 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 				char *position = (char *) (undoItem + 1);
 				
 				for (int32_t i = deleteFrom.line; i <= deleteTo.line; i++) {
-					char *from = textbox->data + textbox->lines[i].offset;
-					char *to = textbox->data + textbox->lines[i].offset + textbox->lines[i].lengthBytes;	
+					char *from = GET_BUFFER(&textbox->lines[i]);
+					char *to = from + textbox->lines[i].lengthBytes;	
 					if (i == deleteFrom.line) from += deleteFrom.byte;
 					if (i == deleteTo.line) to += deleteTo.byte - textbox->lines[i].lengthBytes;
 					EsMemoryCopy(position, from, to - from);
@@ -953,9 +1088,11 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 				}
 			}
 
-			// Step 5: Remove the text from the buffer.
+			// Step 5: Remove the text from the buffer, by moving the gap to the start of the deleted text and extending it.
+			// The line gap must be moved before the size of the document changes.
 
-			EsMemoryMove(textbox->data + deleteTo.byte + textbox->lines[deleteTo.line].offset, textbox->data + textbox->dataBytes, deltaBytes, false);
+			TextboxMoveLineGap(textbox, deleteTo.line + 1);
+			TextboxMoveDataGap(textbox, TextboxLineOffset(textbox, deleteFrom.line) + deleteFrom.byte);
 			textbox->dataBytes += deltaBytes;
 			EsAssert(textbox->dataBytes >= 0);
 
@@ -963,14 +1100,27 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 
 			DocumentLine *firstLine = &textbox->lines[deleteFrom.line];
 			firstLine->lengthBytes = textbox->lines[deleteTo.line].lengthBytes - deleteTo.byte + deleteFrom.byte;
-			firstLine->lengthWidth = TextGetStringWidth(textbox, &textbox->textStyle, textbox->data + firstLine->offset, firstLine->lengthBytes);
 			EsAssert(firstLine->lengthBytes >= 0);
 
 			// Step 7: Remove the deleted lines and update the textbox.
 
-			textbox->lines.DeleteMany(deleteFrom.line + 1, deleteTo.line - deleteFrom.line);
-			textbox->longestLine = -1;
-			TextboxLineCountChangeCleanup(textbox, deltaBytes, deleteFrom.line + 1);
+			TextboxDeleteLines(textbox, deleteFrom.line + 1, deleteTo.line - deleteFrom.line);
+			firstLine->lengthWidth = TextGetStringWidth(textbox, &textbox->textStyle, GET_BUFFER(firstLine), firstLine->lengthBytes);
+
+			// Step 8: Update the longest line.
+
+			if (textbox->longestLine >= deleteFrom.line && textbox->longestLine <= deleteTo.line) {
+				textbox->longestLine = -1;
+			} else if (textbox->longestLine > deleteTo.line) {
+				textbox->longestLine -= deleteTo.line - deleteFrom.line;
+			}
+
+			if (textbox->longestLine != -1 && firstLine->lengthWidth > textbox->longestLineWidth) {
+				textbox->longestLine = deleteFrom.line;
+				textbox->longestLineWidth = firstLine->lengthWidth;
+			}
+
+			TextboxRefreshVisibleLines(textbox);
 		}
 	} else {
 		if (textbox->undo && !textbox->readOnly) {
@@ -991,8 +1141,6 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 	{
 		TextboxCaret insertionPoint = textbox->carets[0];
 
-		DocumentLine *line = &textbox->lines[insertionPoint.line];
-
 		// Step 1: Count the number of newlines in the input string.
 
 		uintptr_t position = 0,
@@ -1021,6 +1169,7 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 			// Step 2: Update the active line buffer.
 
 			TextboxSetActiveLine(textbox, insertionPoint.line);
+			DocumentLine *line = &textbox->lines[insertionPoint.line];
 			int32_t offsetIntoLine = insertionPoint.byte;
 			TextboxBufferResize((void **) &textbox->activeLine, &textbox->activeLineAllocated, (textbox->activeLineBytes += bytesToInsert), 1);
 			EsMemoryMove(textbox->activeLine + offsetIntoLine, textbox->activeLine + line->lengthBytes, bytesToInsert, false);
@@ -1060,14 +1209,18 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 
 			TextboxSetActiveLine(textbox, -1);
 
-			int32_t lineByteOffset = line->offset,
-				offsetIntoLine = insertionPoint.byte,
-				byteOffset = offsetIntoLine + lineByteOffset;
+			// Add the new lines first, since they're the only part that can fail.
+			// If they can't be allocated, the insertion is dropped, and the undo item is left empty.
 
-			TextboxBufferResize((void **) &textbox->data, &textbox->dataAllocated, textbox->dataBytes + bytesToInsert, 1);
-			EsMemoryMove(textbox->data + byteOffset, textbox->data + textbox->dataBytes, bytesToInsert, false);
-			textbox->dataBytes += bytesToInsert;
-			EsAssert(textbox->dataBytes >= 0);
+			if (!TextboxInsertLines(textbox, insertionPoint.line + 1, newlines, TextGetLineHeight(textbox, &textbox->textStyle))) {
+				goto done;
+			}
+
+			DocumentLine *line = &textbox->lines[insertionPoint.line];
+			intptr_t byteOffset = TextboxLineOffset(textbox, insertionPoint.line) + insertionPoint.byte;
+
+			TextboxMoveDataGap(textbox, byteOffset);
+			TextboxReserveData(textbox, bytesToInsert);
 
 			// Step 3: Truncate the insertion line.
 
@@ -1075,32 +1228,28 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 			line->lengthBytes = insertionPoint.byte;
 			EsAssert(line->lengthBytes >= 0);
 
-			// Step 4: Add the new lines.
+			// Step 4: Fill in the new lines.
 
-			textbox->lines.InsertMany(insertionPoint.line + 1, newlines);
 			const char *dataToInsert = string;
 			uintptr_t insertedBytes = 0;
 
 			for (uintptr_t i = 0; i < newlines + 1; i++) {
-				DocumentLine *line = &textbox->lines[insertionPoint.line + i], *previous = line - 1;
+				DocumentLine *line = &textbox->lines[insertionPoint.line + i];
 
-				// Step 4a: Initialise the line.
+				// Step 4a: Set the offset of the line.
 
 				if (i) {
-					EsMemoryZero(line, sizeof(*line));
-					line->height = TextGetLineHeight(textbox, &textbox->textStyle);
-					line->yPosition = previous->yPosition + previous->height;
-					line->offset = lineByteOffset + insertedBytes;
+					line->offset = byteOffset + insertedBytes;
 				}
 
-				// Step 4b: Copy the string data into the line.
+				// Step 4b: Copy the string data into the gap.
 
 				const char *end = (const char *) EsCRTmemchr(dataToInsert, '\n', stringBytes - (dataToInsert - string)) ?: string + stringBytes;
 				bool carriageReturn = end != string && end[-1] == '\r';
 				if (carriageReturn) end--;
-				EsMemoryCopy(textbox->data + line->offset + line->lengthBytes, dataToInsert, end - dataToInsert);
+				EsMemoryCopy(textbox->data + textbox->dataGapStart + insertedBytes, dataToInsert, end - dataToInsert);
 				line->lengthBytes += end - dataToInsert;
-				insertedBytes += line->lengthBytes;
+				insertedBytes += end - dataToInsert;
 				dataToInsert = end + (carriageReturn ? 2 : 1);
 
 				if (i == newlines) {
@@ -1112,16 +1261,16 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 				// Step 4c: Update the line's width.
 
 				// EsPerformanceTimerPush(); 
-#if 0
-				line->lengthWidth = EsTextGetPartialStringWidth(&textbox->textStyle, textbox->data + line->offset, line->lengthBytes, 0, line->lengthBytes);
-#else
-				line->lengthWidth = -1;
-#endif
+				line->lengthWidth = -1; // The text isn't in place yet; the line will be measured when it becomes visible.
 				// double time = EsPerformanceTimerPop();
 				// measureLineTime += time;
 				// EsPrint("Measured the length of line %d in %Fms.\n", insertionPoint.line + i, time * 1000);
 			}
 
+			EsAssert(insertedBytes == bytesToInsert); // Added incorrect number of bytes in EsTextboxInsert.
+			textbox->dataGapStart += bytesToInsert;
+			textbox->dataBytes += bytesToInsert;
+
 			// Step 5: Update the carets.
 
 			textbox->carets[0].line = insertionPoint.line + newlines;
@@ -1129,10 +1278,15 @@ void EsTextboxInsert(EsTextbox *textbox, const char *string, ptrdiff_t stringByt
 			textbox->carets[0].byte = textbox->lines[insertionPoint.line + newlines].lengthBytes - truncation;
 			textbox->carets[1].byte = textbox->lines[insertionPoint.line + newlines].lengthBytes - truncation;
 
-			// Step 6: Update the textbox.
+			// Step 6: Update the longest line, and the textbox.
 
-			textbox->longestLine = -1;
-			TextboxLineCountChangeCleanup(textbox, bytesToInsert, insertionPoint.line + 1 + newlines);
+			if (textbox->longestLine == insertionPoint.line) {
+				textbox->longestLine = -1;
+			} else if (textbox->longestLine > insertionPoint.line) {
+				textbox->longestLine += newlines;
+			}
+
+			TextboxRefreshVisibleLines(textbox);
 		}
 
 		if (undoItem) undoItem->caretsBefore[1] = textbox->carets[0];
@@ -1526,13 +1680,15 @@ void TextboxStyleChanged(EsTextbox *textbox) {
 	}
 
 	int lineHeight = TextGetLineHeight(textbox, &textbox->textStyle);
+	TextboxMoveLineGap(textbox, textbox->lines.Length());
+	textbox->totalHeight = 0;
 
 	for (int32_t i = 0; i < (int32_t) textbox->lines.Length(); i++) {
 		DocumentLine *line = &textbox->lines[i];
-		DocumentLine *previous = i ? (&textbox->lines[i - 1]) : nullptr;
 		line->height = lineHeight;
-		line->yPosition = previous ? (previous->yPosition + previous->height) : 0;
+		line->yPosition = textbox->totalHeight;
 		line->lengthWidth = -1;
+		textbox->totalHeight += lineHeight;
 		textbox->longestLine = -1;
 	}
 
@@ -1915,8 +2071,7 @@ int ProcessTextboxMessage(EsElement *element, EsMessage *message) {
 	} else if (message->type == ES_MSG_GET_WIDTH) {
 		message->measure.width = textbox->longestLineWidth + textbox->insets.l + textbox->insets.r;
 	} else if (message->type == ES_MSG_GET_HEIGHT) {
-		DocumentLine *lastLine = &textbox->lines.Last();
-		message->measure.height = lastLine->yPosition + lastLine->height + textbox->insets.t + textbox->insets.b;
+		message->measure.height = textbox->totalHeight + textbox->insets.t + textbox->insets.b;
 	} else if (message->type == ES_MSG_SCROLL_X) {
 		TextboxSetHorizontalScroll(textbox, message->scroll.scroll);
 	} else if (message->type == ES_MSG_SCROLL_Y) {
@@ -1953,6 +2108,11 @@ EsTextbox *EsTextboxCreate(EsElement *parent, uint64_t flags, EsStyleID style) {
 	EsTextbox *textbox = (EsTextbox *) EsHeapAllocate(sizeof(EsTextbox), true);
 	if (!textbox) return nullptr;
 
+	if (!TextboxInsertLines(textbox, 0, 1, 0 /* set once the style is known */)) {
+		EsHeapFree(textbox);
+		return nullptr;
+	}
+
 	if (!style) {
 		if (flags & ES_TEXTBOX_MULTILINE) {
 			style = ES_STYLE_TEXTBOX_BORDERED_MULTILINE;
@@ -1979,9 +2139,7 @@ EsTextbox *EsTextboxCreate(EsElement *parent, uint64_t flags, EsStyleID style) {
 
 	textbox->smartReplacement = true;
 
-	DocumentLine firstLine = {};
-	firstLine.height = TextGetLineHeight(textbox, &textbox->textStyle);
-	textbox->lines.Add(firstLine);
+	textbox->lines[0].height = textbox->totalHeight = TextGetLineHeight(textbox, &textbox->textStyle);
 
 	TextboxVisibleLine firstVisibleLine = {};
 	textbox->visibleLines.Add(firstVisibleLine);
@@ -2079,7 +2237,7 @@ void EsTextboxUseNumberOverlay(EsTextbox *textbox, bool defaultBehaviour) {
 			}
 		} else if (message->type == ES_MSG_TEXTBOX_NUMBER_DRAG_DELTA && defaultBehaviour) {
 			TextboxSetActiveLine(textbox, -1);
-			double oldValue = EsDoubleParse(textbox->data, textbox->lines[0].lengthBytes, nullptr);
+			double oldValue = EsDoubleParse(GET_BUFFER(&textbox->lines[0]), textbox->lines[0].lengthBytes, nullptr);
 			double newValue = oldValue + message->numberDragDelta.delta * (message->numberDragDelta.fast ? 10 : 1);
 
 			EsMessage m = { ES_MSG_TEXTBOX_NUMBER_UPDATED };
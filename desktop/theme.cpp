@@ -1201,6 +1201,16 @@ typedef struct ThemeAnimation {
 	Array<ThemeAnimatingProperty> properties;
 } ThemeAnimation;
 
+struct ThemeSliceCache {
+	// The layers of one mode, pre-rendered at the smallest size that contains all their non-repeating parts.
+	// Painting splits the bitmap into nine slices: the corners are copied, the edges and centre are stretched.
+	uint32_t *bits; // Null if the layers cannot be drawn this way.
+	int8_t childType, whichLayers;
+	uint16_t width, height;
+	EsRectangle outsets; // How far the bitmap extends outside the element.
+	EsRectangle slices; // The distance from each side of the element to the stretched row/column.
+};
+
 struct UIStyle {
 	intptr_t referenceCount;
 
@@ -1224,15 +1234,23 @@ struct UIStyle {
 	// Followed by overrides, then layer data.
 	// The overrides store the base value, and the layer data contains the overriden values.
 
+	// Cached layer bitmaps.
+
+	Array<ThemeSliceCache> sliceCaches;
+	bool transient; // Set for interpolated styles, which only live for a single paint.
+
 	// Loaded styles management.
 
 	void CloseReference();
+	void FreeSliceCaches();
 
 	// Painting.
 
 	void PaintText(EsPainter *painter, EsElement *element, EsRectangle rectangle, const char *text, size_t textBytes, 
 			uint32_t iconID, uint32_t flags, const EsTextSelection *selectionProperties = nullptr);
 	void PaintLayers(EsPainter *painter, EsRectangle rectangle, int childType, int whichLayers);
+	void PaintLayersDirect(EsPainter *painter, EsRectangle bounds, EsRectangle opaqueRegion, int childType, int whichLayers);
+	ThemeSliceCache *GetSliceCache(int childType, int whichLayers);
 	void PaintTextLayers(EsPainter *painter, EsTextPlan *plan, EsRectangle textBounds, const EsTextSelection *selectionProperties);
 
 	// Misc.
@@ -1403,6 +1421,8 @@ UIStyle *ThemeStyleInterpolate(UIStyle *source, ThemeAnimation *animation) {
 	size_t byteCount = sizeof(UIStyle) + source->layerDataByteCount;
 	UIStyle *destination = (UIStyle *) EsHeapAllocate(byteCount, false);
 	EsMemoryCopy(destination, source, byteCount);
+	destination->sliceCaches = {};
+	destination->transient = true;
 	uint8_t *layerData = (uint8_t *) (destination + 1);
 	destination->metrics = (ThemeMetrics *) (layerData + sizeof(ThemeLayer));
 
@@ -1836,6 +1856,7 @@ void FreeUnusedStyles(bool includePermanentStyles) {
 		if (style->referenceCount == 0 || (style->referenceCount == -1 && includePermanentStyles)) {
 			UIStyleKey key = theming.loadedStyles.KeyAtIndex(i);
 			theming.loadedStyles.Delete(&key);
+			style->FreeSliceCaches();
 			EsHeapFree(style);
 			i--;
 		}
@@ -1875,6 +1896,20 @@ void UIStyle::CloseReference() {
 	referenceCount--;
 }
 
+void UIStyle::FreeSliceCaches() {
+	for (uintptr_t i = 0; i < sliceCaches.Length(); i++) {
+		EsHeapFree(sliceCaches[i].bits);
+	}
+
+	sliceCaches.Free();
+}
+
+void ThemeFlushSliceCaches() {
+	for (uintptr_t i = 0; i < theming.loadedStyles.Count(); i++) {
+		theming.loadedStyles[i]->FreeSliceCaches();
+	}
+}
+
 void UIStyle::PaintTextLayers(EsPainter *painter, EsTextPlan *plan, EsRectangle textBounds, const EsTextSelection *selectionProperties) {
 	EsBuffer data = {};
 	data.in = (uint8_t *) (this + 1);
@@ -2010,30 +2045,129 @@ void EsDrawTextLayers(EsPainter *painter, EsTextPlan *plan, EsRectangle bounds,
 	((UIStyle *) painter->style)->PaintTextLayers(painter, plan, bounds, selectionProperties);
 }
 
-void UIStyle::PaintLayers(EsPainter *painter, EsRectangle location, int childType, int whichLayers) {
+#define THEME_SLICE_CACHE_MAXIMUM_SIZE (128)
+
+EsRectangle ThemeOpaqueRegion(EsRectangle bounds, EsRectangle opaqueInsets) {
+	if (opaqueInsets.l != 0x7F && opaqueInsets.r != 0x7F
+			&& opaqueInsets.t != 0x7F && opaqueInsets.b != 0x7F) {
+		return THEME_RECT_4(bounds.l + opaqueInsets.l, bounds.r - opaqueInsets.r, 
+			bounds.t + opaqueInsets.t, bounds.b - opaqueInsets.b);
+	} else {
+		return {};
+	}
+}
+
+ThemeSliceCache *UIStyle::GetSliceCache(int childType, int whichLayers) {
+	for (uintptr_t i = 0; i < sliceCaches.Length(); i++) {
+		if (sliceCaches[i].childType == childType && sliceCaches[i].whichLayers == whichLayers) {
+			return &sliceCaches[i];
+		}
+	}
+
+	ThemeSliceCache cache = {};
+	cache.childType = childType;
+	cache.whichLayers = whichLayers;
+
+	// Work out whether the layers can be stretched, and how large their fixed parts are.
+	// Only box layers anchored to the sides of the element, with solid paints and pixel-aligned offsets, are supported;
+	// everything else (gradients, bit patterns, paths, ...) depends on the size or position of the element.
+
 	EsBuffer data = {};
 	data.in = (uint8_t *) (this + 1);
 	data.bytes = layerDataByteCount;
 
-	if (!THEME_RECT_VALID(painter->clip)) {
-		return;
-	}
+	bool cacheable = true, anyLayers = false;
+	EsRectangle outsets = {}, slices = {};
 
-	EsRectangle opaqueRegion = {};
-	EsRectangle _bounds = Translate(location, painter->offsetX, painter->offsetY);
+	for (uintptr_t i = 0; i < style->layerCount && cacheable; i++) {
+		const ThemeLayer *layer = (const ThemeLayer *) EsBufferRead(&data, sizeof(ThemeLayer));
 
-	if (opaqueInsets.l != 0x7F && opaqueInsets.r != 0x7F
-			&& opaqueInsets.t != 0x7F && opaqueInsets.b != 0x7F) {
-		opaqueRegion = THEME_RECT_4(_bounds.l + opaqueInsets.l, _bounds.r - opaqueInsets.r, 
-			_bounds.t + opaqueInsets.t, _bounds.b - opaqueInsets.b);
+		if (!layer) {
+			cacheable = false;
+			break;
+		}
+
+		EsBuffer layerData = data;
+		EsBufferRead(&data, layer->dataByteCount - sizeof(ThemeLayer));
+
+		if (layer->mode != whichLayers || (layer->type != THEME_LAYER_BOX && layer->type != THEME_LAYER_PATH)) {
+			continue;
+		}
+
+		const ThemeLayerBox *box = layer->type == THEME_LAYER_BOX ? (const ThemeLayerBox *) EsBufferRead(&layerData, sizeof(ThemeLayerBox)) : nullptr;
+
+		if (!box || layer->position.l != 0 || layer->position.r != 100 || layer->position.t != 0 || layer->position.b != 100
+				|| (box->mainPaintType != 0 && box->mainPaintType != THEME_PAINT_SOLID)
+				|| (box->borderPaintType != 0 && box->borderPaintType != THEME_PAINT_SOLID)) {
+			cacheable = false;
+			break;
+		}
+
+		float boxOffsets[4] = { box->offset.l * scale, box->offset.r * scale, box->offset.t * scale, box->offset.b * scale };
+
+		for (uintptr_t j = 0; j < 4; j++) {
+			if ((float) (int) boxOffsets[j] != boxOffsets[j]) {
+				cacheable = false; // ThemeDrawBox would round differently depending on where the element is.
+			}
+		}
+
+		int extent = 0;
+		extent = MaximumInteger3(extent, box->borders.l * scale, box->borders.r * scale);
+		extent = MaximumInteger3(extent, box->borders.t * scale, box->borders.b * scale);
+		extent = MaximumInteger3(extent, box->corners.tl * scale + 0.5f, box->corners.tr * scale + 0.5f);
+		extent = MaximumInteger3(extent, box->corners.bl * scale + 0.5f, box->corners.br * scale + 0.5f);
+
+		int l = (int) (scale * layer->offset.l) + (int) boxOffsets[0];
+		int r = (int) (scale * layer->offset.r) + (int) boxOffsets[1];
+		int t = (int) (scale * layer->offset.t) + (int) boxOffsets[2];
+		int b = (int) (scale * layer->offset.b) + (int) boxOffsets[3];
+
+		outsets = THEME_RECT_4(MaximumInteger(outsets.l, -l), MaximumInteger(outsets.r, r), MaximumInteger(outsets.t, -t), MaximumInteger(outsets.b, b));
+		slices = THEME_RECT_4(MaximumInteger(slices.l, l + extent), MaximumInteger(slices.r, extent - r), 
+				MaximumInteger(slices.t, t + extent), MaximumInteger(slices.b, extent - b));
+		anyLayers = true;
 	}
 
-	if (appearanceIndex != -1 && whichLayers == 0) {
-		EsThemeAppearance *themeAppearance = &theming.internedStyles[appearanceIndex].appearance;
-		EsDrawRectangle(painter, _bounds, themeAppearance->backgroundColor, themeAppearance->borderColor, themeAppearance->borderSize);
-		return;
+	if (opaqueInsets.l != 0x7F && opaqueInsets.r != 0x7F && opaqueInsets.t != 0x7F && opaqueInsets.b != 0x7F) {
+		// Make sure the opaque region is valid at the cached size whenever it would be valid at the painted size.
+		slices = THEME_RECT_4(MaximumInteger(slices.l, opaqueInsets.l), MaximumInteger(slices.r, opaqueInsets.r), 
+				MaximumInteger(slices.t, opaqueInsets.t), MaximumInteger(slices.b, opaqueInsets.b));
 	}
 
+	int width = outsets.l + slices.l + 1 + slices.r + outsets.r;
+	int height = outsets.t + slices.t + 1 + slices.b + outsets.b;
+
+	if (cacheable && anyLayers && width <= THEME_SLICE_CACHE_MAXIMUM_SIZE && height <= THEME_SLICE_CACHE_MAXIMUM_SIZE) {
+		// Render the layers at the smallest size.
+
+		cache.bits = (uint32_t *) EsHeapAllocate(width * height * 4, true);
+		cache.width = width, cache.height = height;
+		cache.outsets = outsets, cache.slices = slices;
+
+		if (cache.bits) {
+			EsPaintTarget target = {};
+			target.bits = cache.bits;
+			target.width = width, target.height = height;
+			target.stride = width * 4;
+			target.fullAlpha = true;
+
+			EsPainter painter = {};
+			painter.clip = ES_RECT_4(0, width, 0, height);
+			painter.target = &target;
+
+			EsRectangle bounds = ES_RECT_4(outsets.l, width - outsets.r, outsets.t, height - outsets.b);
+			PaintLayersDirect(&painter, bounds, ThemeOpaqueRegion(bounds, opaqueInsets), childType, whichLayers);
+		}
+	}
+
+	return sliceCaches.Add(cache) ? &sliceCaches.Last() : nullptr;
+}
+
+void UIStyle::PaintLayersDirect(EsPainter *painter, EsRectangle _bounds, EsRectangle opaqueRegion, int childType, int whichLayers) {
+	EsBuffer data = {};
+	data.in = (uint8_t *) (this + 1);
+	data.bytes = layerDataByteCount;
+
 	for (uintptr_t i = 0; i < style->layerCount; i++) {
 		const ThemeLayer *layer = (const ThemeLayer *) EsBufferRead(&data, sizeof(ThemeLayer));
 
@@ -2061,6 +2195,56 @@ void UIStyle::PaintLayers(EsPainter *painter, EsRectangle location, int childTyp
 	}
 }
 
+void UIStyle::PaintLayers(EsPainter *painter, EsRectangle location, int childType, int whichLayers) {
+	if (!THEME_RECT_VALID(painter->clip)) {
+		return;
+	}
+
+	EsRectangle _bounds = Translate(location, painter->offsetX, painter->offsetY);
+
+	if (appearanceIndex != -1 && whichLayers == 0) {
+		EsThemeAppearance *themeAppearance = &theming.internedStyles[appearanceIndex].appearance;
+		EsDrawRectangle(painter, _bounds, themeAppearance->backgroundColor, themeAppearance->borderColor, themeAppearance->borderSize);
+		return;
+	}
+
+	ThemeSliceCache *cache = transient ? nullptr : GetSliceCache(childType, whichLayers);
+
+	if (!cache || !cache->bits || THEME_RECT_WIDTH(_bounds) <= cache->slices.l + cache->slices.r 
+			|| THEME_RECT_HEIGHT(_bounds) <= cache->slices.t + cache->slices.b) {
+		PaintLayersDirect(painter, _bounds, ThemeOpaqueRegion(_bounds, opaqueInsets), childType, whichLayers);
+		return;
+	}
+
+	// Blit the nine slices.
+	// The corners are copied, the left and right edges repeat their middle row, 
+	// and every row of the top and bottom edges and the centre is a single color.
+
+	const uint32_t *bits = cache->bits;
+	uintptr_t stride = cache->width * 4;
+	int x0 = _bounds.l - cache->outsets.l, x1 = _bounds.l + cache->slices.l, x2 = _bounds.r - cache->slices.r, x3 = _bounds.r + cache->outsets.r;
+	int y0 = _bounds.t - cache->outsets.t, y1 = _bounds.t + cache->slices.t, y2 = _bounds.b - cache->slices.b, y3 = _bounds.b + cache->outsets.b;
+	int cx = x1 - x0, cy = y1 - y0; // The stretched column and row in the bitmap.
+
+	EsDrawBitmap(painter, ES_RECT_4(x0, x1, y0, y1), bits, stride, 0xFF);
+	EsDrawBitmap(painter, ES_RECT_4(x2, x3, y0, y1), bits + cx + 1, stride, 0xFF);
+	EsDrawBitmap(painter, ES_RECT_4(x0, x1, y2, y3), bits + (cy + 1) * cache->width, stride, 0xFF);
+	EsDrawBitmap(painter, ES_RECT_4(x2, x3, y2, y3), bits + (cy + 1) * cache->width + cx + 1, stride, 0xFF);
+
+	EsDrawBitmap(painter, ES_RECT_4(x0, x1, y1, y2), bits + cy * cache->width, 0, 0xFF);
+	EsDrawBitmap(painter, ES_RECT_4(x2, x3, y1, y2), bits + cy * cache->width + cx + 1, 0, 0xFF);
+
+	for (int y = y0; y < y1; y++) {
+		EsDrawBlock(painter, ES_RECT_4(x1, x2, y, y + 1), bits[(y - y0) * cache->width + cx]);
+	}
+
+	for (int y = y2; y < y3; y++) {
+		EsDrawBlock(painter, ES_RECT_4(x1, x2, y, y + 1), bits[(y - y2 + cy + 1) * cache->width + cx]);
+	}
+
+	EsDrawBlock(painter, ES_RECT_4(x1, x2, y1, y2), bits[cy * cache->width + cx]);
+}
+
 inline void UIStyle::GetTextStyle(EsTextStyle *style) {
 	// Also need to update PaintText.
 	EsMemoryZero(style, sizeof(EsTextStyle));
@@ -2083,8 +2267,12 @@ bool UIStyle::IsStateChangeObserved(uint16_t state1, uint16_t state2) {
 }
 
 bool UIStyle::IsRegionCompletelyOpaque(EsRectangle region, int width, int height) {
-	return region.l >= opaqueInsets.l && region.r < width - opaqueInsets.r
-		&& region.t >= opaqueInsets.t && region.b < height - opaqueInsets.b;
+	if (opaqueInsets.l == 0x7F || opaqueInsets.r == 0x7F || opaqueInsets.t == 0x7F || opaqueInsets.b == 0x7F) {
+		return false;
+	}
+
+	return region.l >= opaqueInsets.l && region.r <= width - opaqueInsets.r
+		&& region.t >= opaqueInsets.t && region.b <= height - opaqueInsets.b;
 }
 
 void EsDrawRoundedRectangle(EsPainter *painter, EsRectangle bounds, EsDeviceColor mainColor, EsDeviceColor borderColor, EsRectangle borderSize, EsCornerRadii cornerRadii) {
@@ -22,13 +22,72 @@
 #define ESFS_CHECK_READ_ONLY(x, y)       if (!(x)) { KernelLog(LOG_ERROR, "EsFS", "mount read only", "Mount - " y " Mounting as read only.\n"); volume->readOnly = true; }
 #define ESFS_CHECK_ERROR_READ_ONLY(x, y) if ((x) != ES_SUCCESS) { KernelLog(LOG_ERROR, "EsFS", "mount read only", "Mount - " y " Mounting as read only.\n"); volume->readOnly = true; }
 
+#define ESFS_JOURNAL_COMMIT_INTERVAL_MS (1000) // How often the running transaction is committed.
+#define ESFS_PREALLOCATE_MAXIMUM_BLOCKS (1024) // The most blocks that will be allocated past the end of a growing file.
+#define ESFS_HANDLE_MAXIMUM_EXTENTS     (16)   // The most extents a file grows or shrinks by under one journal handle; see Resize.
+#define ESFS_ENCODED_EXTENT_MAXIMUM     (17)   // The most bytes an extent takes in an extent list; see EncodeExtent.
+
+struct FreeRange {
+	AVLItem<FreeRange> itemStart, itemCount;
+	uint32_t start, count; // Relative to the start of the group.
+};
+
+struct GroupFreeExtents {
+	// Built from the block bitmap the first time the group is used, and then kept in sync with it.
+	AVLTree<FreeRange> byStart, byCount;
+	uint8_t *bitmap; // A copy of the block bitmap, so that allocations only write the blocks of it they change.
+	bool loaded;
+};
+
+struct JournalBlock {
+	uint64_t block;
+	uint8_t *data;
+};
+
+struct JournalFreedExtent {
+	uint64_t start, count;
+};
+
+struct Journal {
+	// Metadata writes are collected into the running transaction, instead of being written in place immediately.
+	// The commit thread periodically writes the transaction to the journal in one sequential access,
+	// and then copies the blocks to their targets. Reads of metadata blocks see the uncommitted contents.
+	// Blocks freed by a transaction are not reused until it has been written to the journal; see FreeExtent.
+
+	bool enabled;
+	volatile bool stopping;
+	uint64_t sequence;
+	size_t capacity; // The maximum number of blocks that can be written to the journal at once.
+
+	KMutex mutex; // Protects the fields below.
+	uintptr_t handles; // The number of operations in progress; see JournalStart.
+	size_t reserved; // The number of blocks the operations in progress may still add to the running transaction.
+	bool commitPending, gdtModified;
+	KEvent idle, startable;
+	Array<JournalBlock, K_FIXED> running, committing; // Sorted by block. Also protected by overlayLock.
+	Array<JournalBlock, K_FIXED> live; // The targets of the transaction stored in the journal. The data is not kept.
+	Array<JournalFreedExtent, K_FIXED> runningFreed, committingFreed; // Extents freed by the transactions, not yet given back to the allocator.
+
+	KMutex commitMutex; // Held for the duration of a commit.
+	KMutex writeMutex; // Held while writing to the journal, and copying blocks to their targets.
+	KWriterLock overlayLock; // Taken shared to apply the transactions to a metadata read, and exclusive to modify their blocks.
+	volatile uintptr_t retired; // Incremented when a transaction has been copied to its targets, and removed from the overlay.
+	KEvent wake, stopped;
+};
+
 struct Volume : KFileSystem {
 	Superblock superblock;
 	struct FSNode *root;
 	bool readOnly;
 	KWriterLock blockBitmapLock; 
 	GroupDescriptor *groupDescriptorTable;
+	GroupFreeExtents *groupFreeExtents; // One for each group; protected by blockBitmapLock.
 	KMutex nextIdentifierMutex;
+	Journal journal;
+};
+
+struct FSExtent {
+	uint64_t blockInFile, start, count;
 };
 
 struct FSNode {
@@ -38,11 +97,479 @@ struct FSNode {
 	EsUniqueIdentifier identifier;
 	EsNodeType type;
 	bool corrupt;
+
+	// The decoded extent list of the data attribute, sorted by blockInFile.
+	// Built on first access by LoadExtents, and kept up to date by ResizeInternal.
+	KMutex extentsMutex;
+	Array<FSExtent, K_FIXED> extents;
+	Array<FSExtent, K_FIXED> indexExtents; // The blocks storing the extent index, for ESFS_INDIRECTION_L2.
+	Array<uint32_t, K_FIXED> indexBlockExtents; // The number of extents stored in each block of the extent index.
+	uintptr_t extentsModified; // The first extent changed since the list was stored. StoreExtents only rewrites the index blocks from here.
+	volatile bool extentsLoaded;
 };
 
+static uintptr_t JournalFind(Array<JournalBlock, K_FIXED> *blocks, uint64_t block, bool *found) {
+	uintptr_t low = 0, high = blocks->Length();
+
+	while (low < high) {
+		uintptr_t middle = (low + high) / 2;
+		uint64_t compare = (*blocks)[middle].block;
+		if (compare == block) { *found = true; return middle; }
+		else if (compare < block) low = middle + 1;
+		else high = middle;
+	}
+
+	*found = false;
+	return low;
+}
+
+static bool JournalContains(Array<JournalBlock, K_FIXED> *blocks, uint64_t index, uint64_t count) {
+	bool found;
+	uintptr_t position = JournalFind(blocks, index, &found);
+	return position < blocks->Length() && (*blocks)[position].block < index + count;
+}
+
+static void JournalFreeBlocks(Array<JournalBlock, K_FIXED> *blocks) {
+	for (uintptr_t i = 0; i < blocks->Length(); i++) {
+		EsHeapFree((*blocks)[i].data, 0, K_FIXED);
+	}
+
+	blocks->Free();
+}
+
+static bool JournalWriteLocked(Volume *volume, uint64_t index, uint64_t count, const void *buffer) {
+	Journal *journal = &volume->journal;
+	uint64_t blockSize = volume->superblock.blockSize;
+	KMutexAssertLocked(&journal->mutex);
+
+	// The transaction must be written to the journal in one piece. JournalStart reserves space for each operation,
+	// so this only fails if an operation modifies more blocks than it reserved.
+
+	size_t added = 0;
+
+	for (uint64_t i = 0; i < count; i++) {
+		bool found;
+		JournalFind(&journal->running, index + i, &found);
+		if (!found) added++;
+	}
+
+	ESFS_CHECK(journal->running.Length() + added <= journal->capacity, "JournalWrite - Transaction is too large for the journal.");
+
+	KWriterLockTake(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+	EsDefer(KWriterLockReturn(&journal->overlayLock, K_LOCK_EXCLUSIVE));
+
+	for (uint64_t i = 0; i < count; i++) {
+		bool found;
+		uintptr_t position = JournalFind(&journal->running, index + i, &found);
+
+		if (!found) {
+			JournalBlock block = { index + i, (uint8_t *) EsHeapAllocate(blockSize, false, K_FIXED) };
+
+			if (!block.data || !journal->running.Insert(block, position)) {
+				EsHeapFree(block.data, 0, K_FIXED);
+				ESFS_CHECK(false, "JournalWrite - Could not allocate transaction block.");
+			}
+		}
+
+		EsMemoryCopy(journal->running[position].data, (const uint8_t *) buffer + i * blockSize, blockSize);
+	}
+
+	if (journal->running.Length() >= journal->capacity / 2) {
+		KEventSet(&journal->wake, true);
+	}
+
+	return true;
+}
+
+static void JournalOverlay(Volume *volume, Array<JournalBlock, K_FIXED> *blocks, uint64_t index, uint64_t count, uint8_t *buffer) {
+	bool found;
+	uint64_t blockSize = volume->superblock.blockSize;
+
+	for (uintptr_t i = JournalFind(blocks, index, &found); i < blocks->Length() && (*blocks)[i].block < index + count; i++) {
+		EsMemoryCopy(buffer + ((*blocks)[i].block - index) * blockSize, (*blocks)[i].data, blockSize);
+	}
+}
+
+static bool JournalAccess(Volume *volume, uint64_t index, uint64_t count, void *buffer, int driveAccess) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+
+	if (driveAccess == K_ACCESS_WRITE) {
+		KMutexAcquire(&journal->mutex);
+		EsDefer(KMutexRelease(&journal->mutex));
+		return JournalWriteLocked(volume, index, count, buffer);
+	}
+
+	while (true) {
+		uintptr_t retired = journal->retired;
+		__sync_synchronize();
+
+		EsError error = volume->Access(index * superblock->blockSize, count * superblock->blockSize, driveAccess, buffer, FS_BLOCK_ACCESS_CACHED, nullptr);
+		ESFS_CHECK(error == ES_SUCCESS, "AccessBlock - Could not access blocks.");
+
+		// Apply the blocks that have not been copied to their targets yet; newer transactions take precedence.
+		// If a transaction was retired during the read, the blocks might be older than its copy of them, so read them again.
+
+		KWriterLockTake(&journal->overlayLock, K_LOCK_SHARED);
+		EsDefer(KWriterLockReturn(&journal->overlayLock, K_LOCK_SHARED));
+
+		if (retired == journal->retired) {
+			JournalOverlay(volume, &journal->committing, index, count, (uint8_t *) buffer);
+			JournalOverlay(volume, &journal->running, index, count, (uint8_t *) buffer);
+			return true;
+		}
+	}
+}
+
+static void JournalGroupDescriptorsModified(Volume *volume) {
+	Journal *journal = &volume->journal;
+	if (!journal->enabled) return;
+	KMutexAcquire(&journal->mutex);
+	journal->gdtModified = true;
+	KMutexRelease(&journal->mutex);
+}
+
+static size_t JournalLimit(Volume *volume) {
+	// The number of blocks operations can add to a transaction.
+	// The group descriptor table is added when the transaction is committed, so space is kept for it.
+	Superblock *superblock = &volume->superblock;
+	uint64_t gdtBlocks = (superblock->groupCount * sizeof(GroupDescriptor) + superblock->blockSize - 1) / superblock->blockSize;
+	return volume->journal.capacity - gdtBlocks;
+}
+
+static size_t JournalStart(Volume *volume, size_t credits) {
+	// Operations hold a handle while they modify metadata, so that a transaction never contains a partial operation.
+	// The caller gives the most blocks the operation can modify, and this waits until the running transaction has space for them,
+	// asking the commit thread to start a new transaction if necessary. Returns the number of blocks reserved, to pass to JournalStop.
+
+	Journal *journal = &volume->journal;
+	if (!journal->enabled) return 0;
+	size_t limit = JournalLimit(volume);
+	if (credits > limit) credits = limit; // The operation will fail in JournalWriteLocked if it really does modify this many blocks.
+	KMutexAcquire(&journal->mutex);
+
+	while (journal->commitPending || journal->running.Length() + journal->reserved + credits > limit) {
+		if (!journal->commitPending) KEventSet(&journal->wake, true);
+		KEventReset(&journal->startable);
+		KMutexRelease(&journal->mutex);
+		KEventWait(&journal->startable);
+		KMutexAcquire(&journal->mutex);
+	}
+
+	journal->handles++;
+	journal->reserved += credits;
+	KMutexRelease(&journal->mutex);
+	return credits;
+}
+
+static void JournalStop(Volume *volume, size_t credits) {
+	// The blocks the operation modified are now counted in the running transaction, so its reservation is returned.
+
+	Journal *journal = &volume->journal;
+	if (!journal->enabled) return;
+	KMutexAcquire(&journal->mutex);
+	journal->handles--;
+	journal->reserved -= credits;
+	if (!journal->handles) KEventSet(&journal->idle, true);
+	KEventSet(&journal->startable, true);
+	KMutexRelease(&journal->mutex);
+}
+
+static bool JournalClear(Volume *volume) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+	KMutexAssertLocked(&journal->writeMutex);
+
+	uint8_t *zero = (uint8_t *) EsHeapAllocate(superblock->blockSize, true, K_FIXED);
+	EsDefer(EsHeapFree(zero, 0, K_FIXED));
+	ESFS_CHECK(zero, "JournalClear - Could not allocate buffer.");
+
+	EsError error = volume->Access(superblock->journalFirstBlock * superblock->blockSize, superblock->blockSize, 
+			K_ACCESS_WRITE, zero, ES_FLAGS_DEFAULT, nullptr);
+	ESFS_CHECK(error == ES_SUCCESS, "JournalClear - Could not clear the journal.");
+
+	KMutexAcquire(&journal->mutex);
+	journal->live.Free();
+	KMutexRelease(&journal->mutex);
+	return true;
+}
+
+static bool JournalRevoke(Volume *volume, uint64_t index, uint64_t count) {
+	// Called when blocks are freed. They might be reused for file data, which is not journaled,
+	// so we must ensure no older copy of the blocks is written over them later.
+
+	Journal *journal = &volume->journal;
+	if (!journal->enabled) return true;
+	bool wait;
+
+	{
+		KMutexAcquire(&journal->mutex);
+		EsDefer(KMutexRelease(&journal->mutex));
+
+		bool found;
+		uintptr_t position = JournalFind(&journal->running, index, &found);
+		KWriterLockTake(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+
+		while (position < journal->running.Length() && journal->running[position].block < index + count) {
+			EsHeapFree(journal->running[position].data, 0, K_FIXED);
+			journal->running.Delete(position);
+		}
+
+		KWriterLockReturn(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+
+		wait = JournalContains(&journal->committing, index, count) || JournalContains(&journal->live, index, count);
+	}
+
+	if (!wait) {
+		return true;
+	}
+
+	// Wait for the committing transaction to be copied to its targets, 
+	// and then clear the journal so the blocks can't be overwritten by a replay.
+
+	KMutexAcquire(&journal->writeMutex);
+	EsDefer(KMutexRelease(&journal->writeMutex));
+	KMutexAcquire(&journal->mutex);
+	bool clear = JournalContains(&journal->live, index, count);
+	KMutexRelease(&journal->mutex);
+	return !clear || JournalClear(volume);
+}
+
+static bool JournalWriteTransaction(Volume *volume, JournalBlock *blocks, size_t count, bool *written) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+	uint64_t blockSize = superblock->blockSize;
+	KMutexAssertLocked(&journal->writeMutex);
+
+	uint64_t descriptorBlocks = (ESFS_JOURNAL_TARGET_OFFSET + count * sizeof(uint64_t) + blockSize - 1) / blockSize;
+	uint8_t *buffer = (uint8_t *) EsHeapAllocate((descriptorBlocks + count) * blockSize, true, K_FIXED);
+	EsDefer(EsHeapFree(buffer, 0, K_FIXED));
+	*written = false;
+	ESFS_CHECK(buffer, "JournalWriteTransaction - Could not allocate buffer.");
+
+	JournalHeader *header = (JournalHeader *) buffer;
+	uint64_t *targets = (uint64_t *) (buffer + ESFS_JOURNAL_TARGET_OFFSET);
+	uint8_t *data = buffer + descriptorBlocks * blockSize;
+
+	for (uintptr_t i = 0; i < count; i++) {
+		targets[i] = blocks[i].block;
+		EsMemoryCopy(data + i * blockSize, blocks[i].data, blockSize);
+	}
+
+	EsMemoryCopy(header->signature, ESFS_JOURNAL_SIGNATURE, 4);
+	header->sequence = ++journal->sequence;
+	header->blockCount = count;
+	header->dataChecksum = ChecksumMetadata(superblock, data, count * blockSize);
+	header->checksum = ChecksumMetadata(superblock, buffer, descriptorBlocks * blockSize);
+
+	// Write the whole transaction to the journal in a single access.
+
+	EsError error = volume->Access(superblock->journalFirstBlock * blockSize, (descriptorBlocks + count) * blockSize, 
+			K_ACCESS_WRITE, buffer, ES_FLAGS_DEFAULT, nullptr);
+
+	if (error != ES_SUCCESS) {
+		// The blocks must not be copied to their targets, since a crash part way through would leave the metadata inconsistent.
+		// The transaction is kept, and written again at the next commit.
+		KernelLog(LOG_ERROR, "EsFS", "journal write failure", "JournalWriteTransaction - Could not write to journal (error %d).\n", error);
+		*written = false;
+		return false;
+	}
+
+	*written = true;
+
+	// Copy the blocks to their targets, merging adjacent blocks into one access.
+
+	for (uintptr_t i = 0, j; i < count; i = j) {
+		for (j = i + 1; j < count && blocks[j].block == blocks[j - 1].block + 1; j++);
+
+		error = volume->Access(blocks[i].block * blockSize, (j - i) * blockSize, 
+				K_ACCESS_WRITE, data + i * blockSize, FS_BLOCK_ACCESS_CACHED, nullptr);
+		ESFS_CHECK(error == ES_SUCCESS, "JournalWriteTransaction - Could not write metadata blocks.");
+	}
+
+	return true;
+}
+
+static void ReleaseFreedExtents(Volume *volume); // See FreeExtent.
+
+static bool JournalCheckpoint(Volume *volume) {
+	// Write the committing transaction to the journal, and then copy its blocks to their targets.
+	// Once it is in the journal, the extents it freed can be reused.
+
+	Journal *journal = &volume->journal;
+	KMutexAssertLocked(&journal->commitMutex);
+	bool success = true;
+
+	if (journal->committing.Length()) {
+		KMutexAcquire(&journal->writeMutex);
+		EsDefer(KMutexRelease(&journal->writeMutex));
+
+		// JournalStart keeps the transaction within the journal's capacity, so it is always written in one piece.
+
+		bool written;
+		success = JournalWriteTransaction(volume, &journal->committing[0], journal->committing.Length(), &written);
+
+		if (!written) {
+			// The transaction stays in the overlay, and its freed extents stay unavailable, until it can be written.
+			return false;
+		}
+
+		// Retire the transaction. Its targets are remembered until the journal is overwritten; see JournalRevoke.
+
+		KMutexAcquire(&journal->mutex);
+		KWriterLockTake(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+
+		for (uintptr_t i = 0; i < journal->committing.Length(); i++) {
+			EsHeapFree(journal->committing[i].data, 0, K_FIXED);
+			journal->committing[i].data = nullptr;
+		}
+
+		journal->live.Free();
+		journal->live = journal->committing;
+		journal->committing = {};
+		journal->retired++;
+
+		KWriterLockReturn(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+		KMutexRelease(&journal->mutex);
+	}
+
+	// This takes the block bitmap lock, so it must be done without the write mutex; see JournalRevoke.
+	ReleaseFreedExtents(volume);
+	return success;
+}
+
+static bool JournalCommit(Volume *volume) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+
+	KMutexAcquire(&journal->commitMutex);
+	EsDefer(KMutexRelease(&journal->commitMutex));
+
+	if (!JournalCheckpoint(volume)) {
+		// The previous transaction still could not be written to the journal.
+		return false;
+	}
+
+	{
+		KMutexAcquire(&journal->mutex);
+		EsDefer(KMutexRelease(&journal->mutex));
+
+		if (!journal->running.Length() && !journal->gdtModified && !journal->runningFreed.Length()) {
+			return true;
+		}
+
+		// Wait for the operations in progress to complete, and block new ones from starting until the transaction is swapped out.
+
+		journal->commitPending = true;
+		KEventReset(&journal->startable);
+
+		while (journal->handles) {
+			KEventReset(&journal->idle);
+			KMutexRelease(&journal->mutex);
+			KEventWait(&journal->idle);
+			KMutexAcquire(&journal->mutex);
+		}
+
+		if (journal->gdtModified) {
+			// The group descriptor table is only modified by operations, so it can be read without the block bitmap lock.
+			uint64_t gdtBlocks = (superblock->groupCount * sizeof(GroupDescriptor) + superblock->blockSize - 1) / superblock->blockSize;
+			journal->gdtModified = !JournalWriteLocked(volume, superblock->gdtFirstBlock, gdtBlocks, volume->groupDescriptorTable);
+		}
+
+		KWriterLockTake(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+		journal->committing = journal->running;
+		journal->running = {};
+		KWriterLockReturn(&journal->overlayLock, K_LOCK_EXCLUSIVE);
+		journal->committingFreed = journal->runningFreed;
+		journal->runningFreed = {};
+		journal->commitPending = false;
+		KEventSet(&journal->startable, true);
+	}
+
+	return JournalCheckpoint(volume);
+}
+
+static void JournalThread(uintptr_t argument) {
+	Volume *volume = (Volume *) argument;
+	Journal *journal = &volume->journal;
+
+	while (!journal->stopping) {
+		KEventWait(&journal->wake, ESFS_JOURNAL_COMMIT_INTERVAL_MS);
+
+		if (!journal->stopping) {
+			JournalCommit(volume);
+		}
+	}
+
+	KEventSet(&journal->stopped);
+	KThreadTerminate();
+}
+
+static bool JournalReplay(Volume *volume, bool *replayed) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+	uint64_t blockSize = superblock->blockSize;
+
+	uint8_t *buffer = (uint8_t *) EsHeapAllocate(blockSize, false, K_FIXED);
+	EsDefer(EsHeapFree(buffer, 0, K_FIXED));
+	ESFS_CHECK(buffer, "JournalReplay - Could not allocate buffer.");
+
+	ESFS_CHECK(ES_SUCCESS == volume->Access(superblock->journalFirstBlock * blockSize, blockSize, K_ACCESS_READ, buffer, ES_FLAGS_DEFAULT, nullptr),
+			"JournalReplay - Could not read the journal.");
+
+	JournalHeader *header = (JournalHeader *) buffer;
+
+	if (EsMemoryCompare(header->signature, ESFS_JOURNAL_SIGNATURE, 4) || header->sequence <= superblock->journalSequence 
+			|| !header->blockCount || header->blockCount > journal->capacity) {
+		// The journal is empty.
+		return true;
+	}
+
+	uint64_t count = header->blockCount;
+	uint64_t descriptorBlocks = (ESFS_JOURNAL_TARGET_OFFSET + count * sizeof(uint64_t) + blockSize - 1) / blockSize;
+	uint8_t *transaction = (uint8_t *) EsHeapAllocate((descriptorBlocks + count) * blockSize, false, K_FIXED);
+	EsDefer(EsHeapFree(transaction, 0, K_FIXED));
+	ESFS_CHECK(transaction, "JournalReplay - Could not allocate buffer.");
+
+	ESFS_CHECK(ES_SUCCESS == volume->Access(superblock->journalFirstBlock * blockSize, (descriptorBlocks + count) * blockSize, 
+				K_ACCESS_READ, transaction, ES_FLAGS_DEFAULT, nullptr), "JournalReplay - Could not read the journal.");
+
+	header = (JournalHeader *) transaction;
+	uint64_t *targets = (uint64_t *) (transaction + ESFS_JOURNAL_TARGET_OFFSET);
+	uint8_t *data = transaction + descriptorBlocks * blockSize;
+	uint32_t checksum = header->checksum;
+	header->checksum = 0;
+
+	if (checksum != ChecksumMetadata(superblock, transaction, descriptorBlocks * blockSize) 
+			|| header->dataChecksum != ChecksumMetadata(superblock, data, count * blockSize)) {
+		// The transaction was not completely written, so it was never committed.
+		KernelLog(LOG_INFO, "EsFS", "incomplete transaction", "JournalReplay - Ignoring incomplete transaction %d.\n", header->sequence);
+		return true;
+	}
+
+	for (uintptr_t i = 0; i < count; i++) {
+		ESFS_CHECK(targets[i] < superblock->blockCount && (targets[i] < superblock->journalFirstBlock 
+					|| targets[i] >= superblock->journalFirstBlock + superblock->journalBlockCount), 
+				"JournalReplay - Invalid transaction target.");
+		ESFS_CHECK(ES_SUCCESS == volume->Access(targets[i] * blockSize, blockSize, K_ACCESS_WRITE, data + i * blockSize, FS_BLOCK_ACCESS_CACHED, nullptr),
+				"JournalReplay - Could not write metadata block.");
+	}
+
+	KernelLog(LOG_INFO, "EsFS", "replayed transaction", "JournalReplay - Replayed transaction %d (%d blocks).\n", header->sequence, count);
+	journal->sequence = header->sequence;
+	*replayed = true;
+	return true;
+}
+
 static bool AccessBlock(Volume *volume, uint64_t index, uint64_t count, void *buffer, uint64_t flags, int driveAccess) {
 	// TODO Return EsError.
 	Superblock *superblock = &volume->superblock;
+
+	if ((flags & FS_BLOCK_ACCESS_CACHED) && volume->journal.enabled) {
+		// Metadata goes through the journal.
+		return JournalAccess(volume, index, count, buffer, driveAccess);
+	}
+
 	EsError error = volume->Access(index * superblock->blockSize, count * superblock->blockSize, driveAccess, buffer, flags, nullptr);
 	ESFS_CHECK_ERROR(error, "AccessBlock - Could not access blocks.");
 	return error == ES_SUCCESS;
@@ -51,7 +578,7 @@ static bool AccessBlock(Volume *volume, uint64_t index, uint64_t count, void *bu
 static bool ValidateIndexVertex(Superblock *superblock, IndexVertex *vertex) {
 	uint32_t checksum = vertex->checksum;
 	vertex->checksum = 0;
-	uint32_t calculated = CalculateCRC32(vertex, superblock->blockSize, 0);
+	uint32_t calculated = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 
 	ESFS_CHECK(checksum == calculated, "ValidateIndexVertex - Invalid vertex checksum.");
 	ESFS_CHECK(0 == EsMemoryCompare(vertex->signature, ESFS_INDEX_VERTEX_SIGNATURE, 4), "ValidateIndexVertex - Invalid vertex signature.");
@@ -112,7 +639,7 @@ static EsError FindDirectoryEntryReferenceFromIndex(Volume *volume, uint8_t *buf
 static bool ValidateDirectoryEntry(Volume *volume, DirectoryEntry *entry) {
 	uint32_t checksum = entry->checksum;
 	entry->checksum = 0;
-	uint32_t calculated = CalculateCRC32(entry, sizeof(DirectoryEntry), 0);
+	uint32_t calculated = ChecksumMetadata(&volume->superblock, entry, sizeof(DirectoryEntry));
 	entry->checksum = calculated;
 
 	ESFS_CHECK_VA(checksum == calculated, "ValidateDirectoryEntry - Invalid checksum (%x, calculated %x).", checksum, calculated);
@@ -131,7 +658,9 @@ static bool ValidateDirectoryEntry(Volume *volume, DirectoryEntry *entry) {
 			if (data->indirection == ESFS_INDIRECTION_DIRECT) {
 				ESFS_CHECK(data->dataOffset + data->count <= data->size, "ValidateDirectoryEntry - Data too long.");
 				ESFS_CHECK(data->count == entry->fileSize, "ValidateDirectoryEntry - Expected direct attribute to cover entire file.");
-			} 
+			} else if (data->indirection == ESFS_INDIRECTION_L1 || data->indirection == ESFS_INDIRECTION_L2) {
+				ESFS_CHECK(data->dataOffset <= data->size, "ValidateDirectoryEntry - Invalid extent list offset.");
+			}
 		} else if (attribute->type == ESFS_ATTRIBUTE_DIRECTORY) {
 			AttributeDirectory *directory = (AttributeDirectory *) attribute;
 			ESFS_CHECK(directory->indexRootBlock < volume->superblock.blockCount, "ValidateDirectoryEntry - Directory index root block outside volume.");
@@ -168,6 +697,179 @@ static Attribute *FindAttribute(DirectoryEntry *entry, uint16_t type) {
 	return attribute;
 }
 
+static bool DecodeExtentList(Volume *volume, Array<FSExtent, K_FIXED> *extents, uint8_t *list, uint64_t listBytes, uint64_t count) {
+	// The decoded extents are appended to the array.
+	uint64_t previousExtentStart = 0, position = 0, blockInFile = extents->Length() ? extents->Last().blockInFile + extents->Last().count : 0;
+
+	for (uintptr_t i = 0; i < count; i++) {
+		uint64_t extentCount = 0;
+
+		ESFS_CHECK(DecodeExtent(&previousExtentStart, &extentCount, list, &position, listBytes) && extentCount && previousExtentStart, 
+				"DecodeExtentList - Invalid extent.");
+		ESFS_CHECK(previousExtentStart + extentCount <= volume->superblock.blockCount, "DecodeExtentList - Extent goes past end of the volume.");
+		ESFS_CHECK(extents->Add({ blockInFile, previousExtentStart, extentCount }), "DecodeExtentList - Could not allocate extent list.");
+
+		blockInFile += extentCount;
+	}
+
+	return true;
+}
+
+static uint64_t EncodeExtentList(Array<FSExtent, K_FIXED> *extents, uint8_t *list /* nullptr to only measure the list */) {
+	uint64_t previousExtentStart = 0, position = 0;
+
+	for (uintptr_t i = 0; i < extents->Length(); i++) {
+		uint8_t encode[32];
+		uint64_t length = EncodeExtent((*extents)[i].start, previousExtentStart, (*extents)[i].count, encode);
+		if (list) EsMemoryCopy(list + position, encode, length);
+		previousExtentStart = (*extents)[i].start;
+		position += length;
+	}
+
+	return position;
+}
+
+static void UnloadExtents(FSNode *file) {
+	file->extents.Free();
+	file->indexExtents.Free();
+	file->indexBlockExtents.Free();
+	file->extentsModified = 0;
+	file->extentsLoaded = false;
+}
+
+static void ExtentsModified(FSNode *file, uintptr_t index) {
+	if (index < file->extentsModified) {
+		file->extentsModified = index;
+	}
+}
+
+static bool LoadExtents(FSNode *file, AttributeData *data) {
+	if (file->extentsLoaded) {
+		return true;
+	}
+
+	// Readers only hold the node's lock shared, so they might race to decode the list.
+
+	KMutexAcquire(&file->extentsMutex);
+	EsDefer(KMutexRelease(&file->extentsMutex));
+
+	if (file->extentsLoaded) {
+		return true;
+	}
+
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+	uint8_t *list = (uint8_t *) data + data->dataOffset;
+	uint64_t listBytes = data->size - data->dataOffset;
+
+	file->extents.SetLength(0);
+	file->indexExtents.SetLength(0);
+	file->indexBlockExtents.SetLength(0);
+
+	if (data->indirection == ESFS_INDIRECTION_L1) {
+		if (!DecodeExtentList(volume, &file->extents, list, listBytes, data->count)) {
+			UnloadExtents(file);
+			return false;
+		}
+	} else if (data->indirection == ESFS_INDIRECTION_L2) {
+		if (!DecodeExtentList(volume, &file->indexExtents, list, listBytes, data->count)) {
+			UnloadExtents(file);
+			return false;
+		}
+
+		// Read the extent index.
+
+		uint64_t indexBlocks = 0;
+
+		for (uintptr_t i = 0; i < file->indexExtents.Length(); i++) {
+			indexBlocks += file->indexExtents[i].count;
+		}
+
+		if (!indexBlocks) {
+			UnloadExtents(file);
+			ESFS_CHECK(false, "LoadExtents - Empty extent index.");
+		}
+
+		uint8_t *index = (uint8_t *) EsHeapAllocate(indexBlocks * superblock->blockSize, false, K_FIXED);
+		EsDefer(EsHeapFree(index, 0, K_FIXED));
+
+		if (!index) {
+			UnloadExtents(file);
+			ESFS_CHECK(false, "LoadExtents - Could not allocate buffer for extent index.");
+		}
+
+		for (uintptr_t i = 0; i < file->indexExtents.Length(); i++) {
+			FSExtent *extent = &file->indexExtents[i];
+
+			if (!AccessBlock(volume, extent->start, extent->count, index + extent->blockInFile * superblock->blockSize, 
+						FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ)) {
+				UnloadExtents(file);
+				return false;
+			}
+		}
+
+		// Each block of the index has its own header and part of the list.
+		// Indices written before driver version 14 instead have a single header and list spanning all the blocks.
+
+		uint64_t blockListBytes = superblock->blockSize - sizeof(ExtentIndexHeader);
+		bool flat = ((ExtentIndexHeader *) index)->bytes > blockListBytes;
+
+		for (uintptr_t i = 0; i < indexBlocks; i++) {
+			ExtentIndexHeader *header = (ExtentIndexHeader *) (index + i * superblock->blockSize);
+			uint64_t maximumBytes = flat ? indexBlocks * superblock->blockSize - sizeof(ExtentIndexHeader) : blockListBytes;
+			bool valid = header->bytes <= maximumBytes && header->count <= 0xFFFFFFFF;
+
+			if (valid) {
+				uint32_t checksum = header->checksum;
+				header->checksum = 0;
+				valid = checksum == ChecksumMetadata(superblock, header, sizeof(ExtentIndexHeader) + header->bytes)
+					&& 0 == EsMemoryCompare(header->signature, ESFS_EXTENT_INDEX_SIGNATURE, 4);
+			}
+
+			if (!valid || !DecodeExtentList(volume, &file->extents, (uint8_t *) (header + 1), header->bytes, header->count)) {
+				UnloadExtents(file);
+				ESFS_CHECK(false, "LoadExtents - Invalid extent index.");
+			}
+
+			if (flat) {
+				break;
+			}
+
+			if (!file->indexBlockExtents.Add(header->count)) {
+				UnloadExtents(file);
+				ESFS_CHECK(false, "LoadExtents - Could not allocate extent list.");
+			}
+		}
+	} else {
+		ESFS_CHECK(false, "LoadExtents - Unrecognised indirection mode.");
+	}
+
+	// An index in the old layout is rewritten in full the next time it is stored.
+	file->extentsModified = data->indirection == ESFS_INDIRECTION_L2 && !file->indexBlockExtents.Length() ? 0 : file->extents.Length();
+	__sync_synchronize();
+	file->extentsLoaded = true;
+	return true;
+}
+
+static FSExtent *FindExtent(FSNode *file, uint64_t block) {
+	uintptr_t low = 0, high = file->extents.Length();
+
+	while (low < high) {
+		uintptr_t middle = (low + high) / 2;
+		FSExtent *extent = &file->extents[middle];
+
+		if (block < extent->blockInFile) {
+			high = middle;
+		} else if (block >= extent->blockInFile + extent->count) {
+			low = middle + 1;
+		} else {
+			return extent;
+		}
+	}
+
+	return nullptr;
+}
+
 static bool ReadWrite(FSNode *file, uint64_t offset, uint64_t count, uint8_t *buffer, bool needBlockBuffer, bool write, 
 		DirectoryEntryReference *reference = nullptr /* Returns the position of a directory just accessed */) {
 	// TODO Return EsError.
@@ -204,41 +906,22 @@ static bool ReadWrite(FSNode *file, uint64_t offset, uint64_t count, uint8_t *bu
 		} else {
 			EsMemoryCopy(buffer, (uint8_t *) data + data->dataOffset + offset, count);
 		}
-	} else if (data->indirection == ESFS_INDIRECTION_L1) {
+	} else if (data->indirection == ESFS_INDIRECTION_L1 || data->indirection == ESFS_INDIRECTION_L2) {
 		uint64_t offsetBlock = offset / superblock->blockSize;
 		uint64_t offsetIntoCurrentBlock = offset % superblock->blockSize;
-		uint8_t *extentList = (uint8_t *) data + data->dataOffset;
-		uint64_t previousExtentStart = 0, positionInExtentList = 0, blockInFile = 0, extentIndex = 0;
+
+		ESFS_CHECK(LoadExtents(file, data), "Read - Could not load extent list.");
 
 		while (count) {
 			// Find the extent containing offsetBlock.
 
-			uint64_t extentStart = 0, extentCount = 0;
+			FSExtent *extent = FindExtent(file, offsetBlock);
+			ESFS_CHECK(extent, "Read - Invalid extent.");
 
-			while (!extentStart) {
-				if (extentIndex == data->count) {
-					ESFS_CHECK(false, "Read - Invalid extent.");
-				}
-
-				uint64_t count = 0;
-
-				if (!DecodeExtent(&previousExtentStart, &count, extentList, &positionInExtentList, data->size - data->dataOffset) 
-						|| !count || !previousExtentStart) {
-					ESFS_CHECK(false, "Read - Invalid extent.");
-				}
-
-				// EsPrint("\tExtent %d -> %d covers blocks %d -> %d\n", previousExtentStart, previousExtentStart + count, blockInFile, blockInFile + count);
-
-				if (blockInFile + count > offsetBlock) {
-					uint64_t offsetIntoExtent = offsetBlock - blockInFile;
-					extentStart = previousExtentStart + offsetIntoExtent;
-					extentCount = count - offsetIntoExtent; 
-					// EsPrint("\t\tUsing section %d -> %d for reading from block %d\n", extentStart, extentStart + extentCount, offsetBlock);
-				}
-
-				blockInFile += count;
-				extentIndex++;
-			}
+			uint64_t offsetIntoExtent = offsetBlock - extent->blockInFile;
+			uint64_t extentStart = extent->start + offsetIntoExtent;
+			uint64_t extentCount = extent->count - offsetIntoExtent; 
+			// EsPrint("\t\tUsing section %d -> %d for reading from block %d\n", extentStart, extentStart + extentCount, offsetBlock);
 
 			// Read the data.  
 
@@ -328,48 +1011,6 @@ static size_t Write(KNode *node, const void *_buffer, EsFileOffset offset, EsFil
 	return ReadWrite(file, offset, count, (uint8_t *) _buffer, true, true) ? count : ES_ERROR_UNKNOWN;
 }
 
-static void Sync(KNode *_directory, KNode *node) {
-	(void) _directory;
-	FSNode *file = (FSNode *) node->driverNode;
-	if (!file) KernelPanic("EsFS::Sync - Node %x has null driver node.\n", node);
-	if (file->corrupt) return;
-	Volume *volume = file->volume;
-	Superblock *superblock = &volume->superblock;
-
-	// EsPrint("SYNC! %d,%d\n", file->reference.block, file->reference.offsetIntoBlock);
-
-	if (file->type == ES_NODE_DIRECTORY) {
-		// Get the most recent totalSize for the directory.
-		AttributeDirectory *directoryAttribute = (AttributeDirectory *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DIRECTORY);
-		directoryAttribute->totalSize = FSNodeGetTotalSize(node);
-	}
-
-	{
-		file->entry.checksum = 0;
-		file->entry.checksum = CalculateCRC32(&file->entry, sizeof(DirectoryEntry), 0);
-	}
-
-	uint8_t *blockBuffer = (uint8_t *) EsHeapAllocate(superblock->blockSize, false, K_FIXED);
-	EsDefer(EsHeapFree(blockBuffer, 0, K_FIXED));
-	ESFS_CHECK_RETURN(blockBuffer, "Sync - Could not allocate block buffer.");
-
-	if (!AccessBlock(volume, file->reference.block, 1, blockBuffer, FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ)) {
-		KernelLog(LOG_ERROR, "EsFS", "drive access failure", "Sync - Could not read reference block.\n");
-		return;
-	}
-
-	if (!ValidateDirectoryEntry(volume, (DirectoryEntry *) (blockBuffer + file->reference.offsetIntoBlock))) {
-		return;
-	}
-
-	EsMemoryCopy(blockBuffer + file->reference.offsetIntoBlock, &file->entry, sizeof(DirectoryEntry));
-
-	if (!AccessBlock(volume, file->reference.block, 1, blockBuffer, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE)) {
-		KernelLog(LOG_ERROR, "EsFS", "drive access failure", "Sync - Could not write reference block.\n");
-		return;
-	}
-}
-
 static EsError Enumerate(KNode *node) {
 	// TODO Support KWorkGroup.
 
@@ -401,111 +1042,274 @@ static EsError Enumerate(KNode *node) {
 		for (uint64_t j = 0; j < entriesInThisBlock; j++, reference.offsetIntoBlock += sizeof(DirectoryEntry)) {
 			DirectoryEntry *entry = (DirectoryEntry *) blockBuffer + j;
 
-			if (!ValidateDirectoryEntry(volume, entry)) {
-				// Try the entries in the next block.
-				break;
-			}
+			if (!ValidateDirectoryEntry(volume, entry)) {
+				// Try the entries in the next block.
+				break;
+			}
+
+			AttributeFilename *filename = (AttributeFilename *) FindAttribute(entry, ESFS_ATTRIBUTE_FILENAME);
+			if (!filename) continue;
+
+			KNodeMetadata metadata = {};
+
+			metadata.type = entry->nodeType == ESFS_NODE_TYPE_DIRECTORY ? ES_NODE_DIRECTORY : ES_NODE_FILE;
+			metadata.identifier = entry->identifier;
+			metadata.modificationTime = entry->modificationTime;
+
+			if (metadata.type == ES_NODE_DIRECTORY) {
+				AttributeDirectory *directory = (AttributeDirectory *) FindAttribute(entry, ESFS_ATTRIBUTE_DIRECTORY);
+
+				if (directory) {
+					metadata.directoryChildren = directory->childNodes;
+					metadata.totalSize = directory->totalSize;
+				}
+			} else if (metadata.type == ES_NODE_FILE) {
+				metadata.totalSize = entry->fileSize;
+			}
+
+			EsError error = FSDirectoryEntryFound(node, &metadata, &reference, 
+					(const char *) filename->filename, filename->length, false);
+
+			if (error != ES_SUCCESS) {
+				return error;
+			}
+		}
+	}
+
+	return ES_SUCCESS;
+}
+
+static bool ValidateGroupDescriptor(GroupDescriptor *descriptor, Superblock *superblock) {
+	uint32_t checksum = descriptor->checksum;
+	descriptor->checksum = 0;
+	uint32_t calculated = ChecksumMetadata(superblock, descriptor, sizeof(GroupDescriptor));
+	ESFS_CHECK(checksum == calculated, "ValidateGroupDescriptor - Invalid checksum.");
+	ESFS_CHECK(0 == EsMemoryCompare(descriptor->signature, ESFS_GROUP_DESCRIPTOR_SIGNATURE, 4), "ValidateGroupDescriptor - Invalid signature.");
+	return true;
+}
+
+static bool ValidateBlockBitmap(GroupDescriptor *descriptor, uint8_t *bitmap, Superblock *superblock) {
+	uint32_t calculated = ChecksumMetadata(superblock, bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize);
+	ESFS_CHECK(calculated == descriptor->bitmapChecksum, "ValidateBlockBitmap - Invalid checksum.");
+
+	uint32_t blocksUsed = 0;
+
+	for (uint64_t i = 0; i < superblock->blocksPerGroup; i++) {
+		if (bitmap[i / 8] & (1 << (i % 8))) {
+			blocksUsed++;
+		}
+	}
+
+	ESFS_CHECK(blocksUsed == descriptor->blocksUsed, "ValidateBlockBitmap - Used block count mismatch.");
+
+	return true;
+}
+
+static bool AddFreeRange(GroupFreeExtents *group, uint32_t start, uint32_t count) {
+	FreeRange *range = (FreeRange *) EsHeapAllocate(sizeof(FreeRange), true, K_FIXED);
+	if (!range) return false;
+	range->start = start, range->count = count;
+	TreeInsert(&group->byStart, &range->itemStart, range, MakeShortKey(start));
+	TreeInsert(&group->byCount, &range->itemCount, range, MakeShortKey(count), AVL_DUPLICATE_KEYS_ALLOW);
+	return true;
+}
 
-			AttributeFilename *filename = (AttributeFilename *) FindAttribute(entry, ESFS_ATTRIBUTE_FILENAME);
-			if (!filename) continue;
+static void RemoveFreeRange(GroupFreeExtents *group, FreeRange *range) {
+	TreeRemove(&group->byStart, &range->itemStart);
+	TreeRemove(&group->byCount, &range->itemCount);
+	EsHeapFree(range, sizeof(FreeRange), K_FIXED);
+}
 
-			KNodeMetadata metadata = {};
+static void UpdateFreeRange(GroupFreeExtents *group, FreeRange *range, uint32_t start, uint32_t count) {
+	TreeRemove(&group->byStart, &range->itemStart);
+	TreeRemove(&group->byCount, &range->itemCount);
+	range->start = start, range->count = count;
+	TreeInsert(&group->byStart, &range->itemStart, range, MakeShortKey(start));
+	TreeInsert(&group->byCount, &range->itemCount, range, MakeShortKey(count), AVL_DUPLICATE_KEYS_ALLOW);
+}
 
-			metadata.type = entry->nodeType == ESFS_NODE_TYPE_DIRECTORY ? ES_NODE_DIRECTORY : ES_NODE_FILE;
+static void UnloadFreeExtents(GroupFreeExtents *group) {
+	while (group->byStart.root) {
+		RemoveFreeRange(group, group->byStart.root->thisItem);
+	}
 
-			if (metadata.type == ES_NODE_DIRECTORY) {
-				AttributeDirectory *directory = (AttributeDirectory *) FindAttribute(entry, ESFS_ATTRIBUTE_DIRECTORY);
+	EsHeapFree(group->bitmap, 0, K_FIXED);
+	group->bitmap = nullptr;
+	group->loaded = false;
+}
 
-				if (directory) {
-					metadata.directoryChildren = directory->childNodes;
-					metadata.totalSize = directory->totalSize;
-				}
-			} else if (metadata.type == ES_NODE_FILE) {
-				metadata.totalSize = entry->fileSize;
-			}
+static void MarkFreedExtents(Volume *volume, uintptr_t groupIndex, uint8_t *bitmap, bool used) {
+	Journal *journal = &volume->journal;
+	Superblock *superblock = &volume->superblock;
+	KMutexAcquire(&journal->mutex);
+	EsDefer(KMutexRelease(&journal->mutex));
 
-			EsError error = FSDirectoryEntryFound(node, &metadata, &reference, 
-					(const char *) filename->filename, filename->length, false);
+	for (uintptr_t i = 0; i < 2; i++) {
+		Array<JournalFreedExtent, K_FIXED> *extents = i ? &journal->committingFreed : &journal->runningFreed;
 
-			if (error != ES_SUCCESS) {
-				return error;
+		for (uintptr_t j = 0; j < extents->Length(); j++) {
+			JournalFreedExtent extent = (*extents)[j];
+			if (extent.start / superblock->blocksPerGroup != groupIndex) continue;
+			uint64_t start = extent.start % superblock->blocksPerGroup;
+
+			for (uint64_t k = start; k < start + extent.count; k++) {
+				if (used) bitmap[k / 8] |= 1 << (k % 8);
+				else bitmap[k / 8] &= ~(1 << (k % 8));
 			}
 		}
 	}
-
-	return ES_SUCCESS;
 }
 
-static uint64_t FindLargestExtent(uint8_t *bitmap, Superblock *superblock) {
-	uint64_t largestExtentCount = 0, i = 0;
+static bool LoadFreeExtents(Volume *volume, GroupDescriptor *descriptor) {
+	Superblock *superblock = &volume->superblock;
+	uintptr_t groupIndex = descriptor - volume->groupDescriptorTable;
+	GroupFreeExtents *group = volume->groupFreeExtents + groupIndex;
+	if (group->loaded) return true;
+
+	size_t bitmapBytes = superblock->blocksPerGroupBlockBitmap * superblock->blockSize;
+	group->bitmap = (uint8_t *) EsHeapAllocate(bitmapBytes, false, K_FIXED);
+	ESFS_CHECK(group->bitmap, "LoadFreeExtents - Could not allocate buffer for block bitmap.");
+	uint8_t *bitmap = group->bitmap;
+
+	if (descriptor->blockBitmap) {
+		if (!AccessBlock(volume, descriptor->blockBitmap, superblock->blocksPerGroupBlockBitmap, bitmap, FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ)
+				|| !ValidateBlockBitmap(descriptor, bitmap, superblock)) {
+			UnloadFreeExtents(group);
+			ESFS_CHECK(false, "LoadFreeExtents - Could not read block bitmap.");
+		}
+	} else {
+		// This is the first time the group has been used; the bitmap marks only its own blocks as used.
+		EsMemoryZero(bitmap, bitmapBytes);
+		for (uint64_t i = 0; i < superblock->blocksPerGroupBlockBitmap; i++) bitmap[i / 8] |= 1 << (i % 8);
+	}
+
+	// The last group might extend past the end of the volume.
+	uint64_t blocksInGroup = superblock->blockCount - groupIndex * superblock->blocksPerGroup;
+	if (blocksInGroup > superblock->blocksPerGroup) blocksInGroup = superblock->blocksPerGroup;
 
-	while (i < superblock->blocksPerGroup) {
+	// Blocks freed by transactions that are not in the journal yet must not be reused, so treat them as used while building the trees.
+	MarkFreedExtents(volume, groupIndex, bitmap, true);
+
+	for (uint64_t i = 0; i < blocksInGroup; ) {
 		if (bitmap[i / 8] & (1 << (i % 8))) {
 			i++;
 		} else {
-			uint64_t count = 0;
-
-			while (i < superblock->blocksPerGroup) {
-				if (bitmap[i / 8] & (1 << (i % 8))) break;
-				else count++, i++;
-			}
+			uint64_t start = i;
+			while (i < blocksInGroup && (~bitmap[i / 8] & (1 << (i % 8)))) i++;
 
-			if (largestExtentCount < count) {
-				largestExtentCount = count;
+			if (!AddFreeRange(group, start, i - start)) {
+				UnloadFreeExtents(group);
+				ESFS_CHECK(false, "LoadFreeExtents - Could not allocate free extent.");
 			}
 		}
 	}
 
-	return largestExtentCount;
+	MarkFreedExtents(volume, groupIndex, bitmap, false);
+	group->loaded = true;
+	return true;
 }
 
-static bool ValidateGroupDescriptor(GroupDescriptor *descriptor) {
-	uint32_t checksum = descriptor->checksum;
-	descriptor->checksum = 0;
-	uint32_t calculated = CalculateCRC32(descriptor, sizeof(GroupDescriptor), 0);
-	ESFS_CHECK(checksum == calculated, "ValidateGroupDescriptor - Invalid checksum.");
-	ESFS_CHECK(0 == EsMemoryCompare(descriptor->signature, ESFS_GROUP_DESCRIPTOR_SIGNATURE, 4), "ValidateGroupDescriptor - Invalid signature.");
-	return true;
+static bool WriteBlockBitmap(Volume *volume, GroupDescriptor *descriptor, uint64_t start, uint64_t count) {
+	// Write the blocks of the bitmap holding the bits for the given range of the group.
+	Superblock *superblock = &volume->superblock;
+	uint8_t *bitmap = volume->groupFreeExtents[descriptor - volume->groupDescriptorTable].bitmap;
+	uint64_t first = start / 8 / superblock->blockSize, last = (start + count - 1) / 8 / superblock->blockSize;
+	return AccessBlock(volume, descriptor->blockBitmap + first, last - first + 1, bitmap + first * superblock->blockSize, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE);
 }
 
-static bool ValidateBlockBitmap(GroupDescriptor *descriptor, uint8_t *bitmap, Superblock *superblock) {
-	uint32_t calculated = CalculateCRC32(bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize, 0);
-	ESFS_CHECK(calculated == descriptor->bitmapChecksum, "ValidateBlockBitmap - Invalid checksum.");
+static uint64_t LargestFreeExtent(GroupFreeExtents *group) {
+	AVLItem<FreeRange> *item = TreeFind(&group->byCount, MakeShortKey((uintptr_t) -1), TREE_SEARCH_LARGEST_BELOW_OR_EQUAL);
+	return item ? item->thisItem->count : 0;
+}
 
-	uint32_t blocksUsed = 0;
+static FreeRange *ChooseFreeExtent(GroupFreeExtents *group, uint64_t nearby /* relative to the group, or -1 */, uint64_t increaseBlocks) {
+	// Prefer continuing from the nearby block, then the extent after it if it can satisfy the request,
+	// then the smallest extent in the group that can, and otherwise the largest extent.
 
-	for (uint64_t i = 0; i < superblock->blocksPerGroup; i++) {
-		if (bitmap[i / 8] & (1 << (i % 8))) {
-			blocksUsed++;
-		}
+	AVLItem<FreeRange> *item = nullptr;
+
+	if (nearby != (uint64_t) -1) {
+		item = TreeFind(&group->byStart, MakeShortKey(nearby), TREE_SEARCH_SMALLEST_ABOVE_OR_EQUAL);
+		if (item && (item->thisItem->start == nearby || item->thisItem->count >= increaseBlocks)) return item->thisItem;
 	}
 
-	ESFS_CHECK(blocksUsed == descriptor->blocksUsed, "ValidateBlockBitmap - Used block count mismatch.");
+	item = TreeFind(&group->byCount, MakeShortKey(increaseBlocks), TREE_SEARCH_SMALLEST_ABOVE_OR_EQUAL);
+	if (!item) item = TreeFind(&group->byCount, MakeShortKey((uintptr_t) -1), TREE_SEARCH_LARGEST_BELOW_OR_EQUAL);
+	return item ? item->thisItem : nullptr;
+}
 
-	return true;
+static void InsertFreeExtent(GroupFreeExtents *group, uint32_t start, uint32_t count) {
+	// Merge with the neighbouring extents.
+
+	AVLItem<FreeRange> *before = TreeFind(&group->byStart, MakeShortKey(start), TREE_SEARCH_LARGEST_BELOW_OR_EQUAL);
+	AVLItem<FreeRange> *after = TreeFind(&group->byStart, MakeShortKey(start), TREE_SEARCH_SMALLEST_ABOVE_OR_EQUAL);
+	FreeRange *previous = before ? before->thisItem : nullptr;
+	FreeRange *next = after ? after->thisItem : nullptr;
+
+	if (previous && previous->start + previous->count == start) {
+		uint32_t merged = previous->count + count;
+
+		if (next && start + count == next->start) {
+			merged += next->count;
+			RemoveFreeRange(group, next);
+		}
+
+		UpdateFreeRange(group, previous, previous->start, merged);
+	} else if (next && start + count == next->start) {
+		UpdateFreeRange(group, next, start, next->count + count);
+	} else if (!AddFreeRange(group, start, count)) {
+		// Rebuild the trees from the bitmap next time.
+		UnloadFreeExtents(group);
+	}
 }
 
-static bool AllocateExtent(Volume *volume, uint64_t nearby, uint64_t increaseBlocks, uint64_t *extentStart, uint64_t *extentCount, bool zero) {
+static bool ZeroBlocks(Volume *volume, uint64_t start, uint64_t count) {
+	// TODO This is really slow - introduce K_ACCESS_ZERO?
+	// TODO Support KWorkGroup.
+
 	Superblock *superblock = &volume->superblock;
-	KWriterLockAssertExclusive(&volume->blockBitmapLock);
+	size_t zeroBufferSize = superblock->blockSize * (count > 16 ? 16 : count);
+	uint8_t *zeroBuffer = (uint8_t *) EsHeapAllocate(zeroBufferSize, true, K_FIXED);
+	EsDefer(EsHeapFree(zeroBuffer, 0, K_FIXED));
+	ESFS_CHECK(zeroBuffer, "ZeroBlocks - Could not allocate buffer for zeroing extent.");
 
-	(void) nearby;
-	// TODO Smarter extent allocation.
+	for (uint64_t i = 0; i < count * superblock->blockSize; i += zeroBufferSize) {
+		uint64_t bytes = zeroBufferSize;
 
-	uint8_t *zeroBuffer = nullptr;
-	EsDefer(EsHeapFree(zeroBuffer, 0, K_FIXED));
-	size_t zeroBufferSize = superblock->blockSize * (increaseBlocks > 16 ? 16 : increaseBlocks);
+		if (i + bytes >= count * superblock->blockSize) {
+			bytes = count * superblock->blockSize - i;
+		}
 
-	if (zero) {
-		zeroBuffer = (uint8_t *) EsHeapAllocate(zeroBufferSize, true, K_FIXED);
-		ESFS_CHECK(zeroBuffer, "AllocateExtent - Could not allocate buffer for zeroing extent.");
+		if (!AccessBlock(volume, start + i / superblock->blockSize, bytes / superblock->blockSize, zeroBuffer, ES_FLAGS_DEFAULT, K_ACCESS_WRITE)) {
+			return false;
+		}
 	}
 
+	return true;
+}
+
+static bool AllocateExtent(Volume *volume, uint64_t nearby, uint64_t increaseBlocks, uint64_t *extentStart, uint64_t *extentCount, bool zero) {
+	Superblock *superblock = &volume->superblock;
+	KWriterLockAssertExclusive(&volume->blockBitmapLock);
+
 	// Find a group to allocate the next extent from.
+	// Try the group containing the nearby block first, so that files stay close together.
 
 	GroupDescriptor *target = nullptr;
 
 	{
+		if (nearby && nearby < superblock->blockCount) {
+			uintptr_t groupIndex = nearby / superblock->blocksPerGroup;
+			GroupDescriptor *group = volume->groupDescriptorTable + groupIndex;
+			GroupFreeExtents *freeExtents = volume->groupFreeExtents + groupIndex;
+
+			if (group->blockBitmap && group->largestExtent >= increaseBlocks) {
+				target = group;
+			} else if (freeExtents->loaded && TreeFind(&freeExtents->byStart, MakeShortKey(nearby % superblock->blocksPerGroup), TREE_SEARCH_EXACT)) {
+				target = group;
+			}
+		}
+
 		for (uint64_t i = 0; !target && i < superblock->groupCount; i++) {
 			GroupDescriptor *group = volume->groupDescriptorTable + i;
 			if (!group->blocksUsed) group->largestExtent = superblock->blocksPerGroup - superblock->blocksPerGroupBlockBitmap;
@@ -527,98 +1331,111 @@ static bool AllocateExtent(Volume *volume, uint64_t nearby, uint64_t increaseBlo
 		return false;
 	}
 
-	ESFS_CHECK(ValidateGroupDescriptor(target), "AllocateExtent - Invalid group descriptor.");
+	ESFS_CHECK(ValidateGroupDescriptor(target, superblock), "AllocateExtent - Invalid group descriptor.");
 
-	// Load the bitmap, find the largest extent, and mark it as in use.
+	uintptr_t groupIndex = target - volume->groupDescriptorTable;
+	GroupFreeExtents *freeExtents = volume->groupFreeExtents + groupIndex;
 
-	uint8_t *bitmap = (uint8_t *) EsHeapAllocate(superblock->blocksPerGroupBlockBitmap * superblock->blockSize, false, K_FIXED);
-	EsDefer(EsHeapFree(bitmap, 0, K_FIXED));
-	ESFS_CHECK(bitmap, "AllocateExtent - Could not allocate buffer for block bitmap.");
+	// Load the group's free extents, pick one, and mark it as in use.
 
 	{
-		if (target->blockBitmap) {
-			if (!AccessBlock(volume, target->blockBitmap, superblock->blocksPerGroupBlockBitmap, bitmap, FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ)) {
-				return false;
-			}
+		bool newGroup = !target->blockBitmap;
 
-			ESFS_CHECK(ValidateBlockBitmap(target, bitmap, superblock), "AllocateExtent - Invalid block bitmap.");
-		} else {
-			EsMemoryZero(bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize);
-			for (uint64_t i = 0; i < superblock->blocksPerGroupBlockBitmap; i++) bitmap[i / 8] |= 1 << (i % 8);
-			target->blockBitmap = superblock->blocksPerGroup * (target - volume->groupDescriptorTable);
-			target->blocksUsed = superblock->blocksPerGroupBlockBitmap;
+		if (!LoadFreeExtents(volume, target)) {
+			return false;
 		}
 
-		uint64_t largestExtentStart = 0, largestExtentCount = 0, i = 0;
-
-		while (i < superblock->blocksPerGroup) {
-			if (bitmap[i / 8] & (1 << (i % 8))) {
-				i++;
-			} else {
-				uint64_t start = i, count = 0;
+		if (newGroup) {
+			target->blockBitmap = superblock->blocksPerGroup * groupIndex;
+			target->blocksUsed = superblock->blocksPerGroupBlockBitmap;
+		}
 
-				while (i < superblock->blocksPerGroup) {
-					if (bitmap[i / 8] & (1 << (i % 8))) break;
-					else count++, i++;
-				}
+		uint64_t groupNearby = nearby / superblock->blocksPerGroup == groupIndex ? nearby % superblock->blocksPerGroup : (uint64_t) -1;
+		FreeRange *extent = ChooseFreeExtent(freeExtents, groupNearby, increaseBlocks);
 
-				if (largestExtentCount < count) {
-					largestExtentStart = start;
-					largestExtentCount = count;
-				}
-			}
+		if (!extent) {
+			// The group descriptor was wrong about the group having free space.
+			target->largestExtent = 0;
+			target->checksum = 0;
+			target->checksum = ChecksumMetadata(superblock, target, sizeof(GroupDescriptor));
+			JournalGroupDescriptorsModified(volume);
+			return false;
 		}
 
-		*extentStart = largestExtentStart;
-		*extentCount = largestExtentCount;
+		*extentStart = extent->start;
+		*extentCount = extent->count;
 
 		if (*extentCount > increaseBlocks) {
 			*extentCount = increaseBlocks;
 		}
 
+		if (extent->count == *extentCount) {
+			RemoveFreeRange(freeExtents, extent);
+		} else {
+			UpdateFreeRange(freeExtents, extent, extent->start + *extentCount, extent->count - *extentCount);
+		}
+
+		uint8_t *bitmap = freeExtents->bitmap;
+
 		for (uint64_t i = *extentStart; i < *extentStart + *extentCount; i++) {
 			bitmap[i / 8] |= 1 << (i % 8);
 		}
 
-		if (!AccessBlock(volume, target->blockBitmap, superblock->blocksPerGroupBlockBitmap, bitmap, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE)) {
+		uint64_t writeStart = newGroup ? 0 : *extentStart;
+		uint64_t writeCount = newGroup ? superblock->blocksPerGroup : *extentCount;
+
+		if (!WriteBlockBitmap(volume, target, writeStart, writeCount)) {
+			UnloadFreeExtents(freeExtents);
 			return false;
 		}
 
-		target->largestExtent = FindLargestExtent(bitmap, superblock);
+		// The group descriptor stores one checksum for the whole bitmap, 
+		// but it is computed from the copy in memory, so nothing needs to be read back.
+
+		target->largestExtent = LargestFreeExtent(freeExtents);
 		target->blocksUsed += *extentCount;
-		target->bitmapChecksum = CalculateCRC32(bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize, 0);
+		target->bitmapChecksum = ChecksumMetadata(superblock, bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize);
 		target->checksum = 0;
-		target->checksum = CalculateCRC32(target, sizeof(GroupDescriptor), 0);
+		target->checksum = ChecksumMetadata(superblock, target, sizeof(GroupDescriptor));
+		JournalGroupDescriptorsModified(volume);
 	}
 
-	*extentStart += (target - volume->groupDescriptorTable) * superblock->blocksPerGroup;
+	*extentStart += groupIndex * superblock->blocksPerGroup;
 	superblock->blocksUsed += *extentCount;
 	volume->spaceUsed += *extentCount * superblock->blockSize;
 
-	if (zero) {
-		// TODO This is really slow - introduce K_ACCESS_ZERO?
-		// TODO Support KWorkGroup.
+	if (zero && !ZeroBlocks(volume, *extentStart, *extentCount)) {
+		return false;
+	}
 
-		for (uint64_t i = 0; i < *extentCount * superblock->blockSize; i += zeroBufferSize) {
-#if 0
-			if ((i / zeroBufferSize) % 100 == 0) {
-				EsPrint("AllocateExtent zeroing %d/%d\n", i / zeroBufferSize, extentCount * superblock->blockSize / zeroBufferSize);
-			}
-#endif
+	return true;
+}
 
-			uint64_t count = zeroBufferSize;
+static void ReleaseExtent(Volume *volume, uint64_t extentStart, uint64_t extentCount) {
+	// Give the blocks of a freed extent back to the allocator.
 
-			if (i + count >= *extentCount * superblock->blockSize) {
-				count = *extentCount * superblock->blockSize - i;
-			}
+	Superblock *superblock = &volume->superblock;
+	KWriterLockAssertExclusive(&volume->blockBitmapLock);
 
-			if (!AccessBlock(volume, *extentStart + i / superblock->blockSize, count / superblock->blockSize, zeroBuffer, ES_FLAGS_DEFAULT, K_ACCESS_WRITE)) {
-				return false;
-			}
-		}
+	uint64_t blockGroup = extentStart / superblock->blocksPerGroup;
+	GroupDescriptor *target = volume->groupDescriptorTable + blockGroup;
+	GroupFreeExtents *freeExtents = volume->groupFreeExtents + blockGroup;
+
+	if (freeExtents->loaded) {
+		// If the trees cannot be updated, this unloads them.
+		InsertFreeExtent(freeExtents, extentStart % superblock->blocksPerGroup, extentCount);
 	}
 
-	return true;
+	if (freeExtents->loaded) {
+		target->largestExtent = LargestFreeExtent(freeExtents);
+	} else if (target->largestExtent < extentCount) {
+		// The trees are built from the bitmap when the group is next used; the largest extent is only a hint, and AllocateExtent corrects it.
+		target->largestExtent = extentCount;
+	}
+
+	target->checksum = 0;
+	target->checksum = ChecksumMetadata(superblock, target, sizeof(GroupDescriptor));
+	JournalGroupDescriptorsModified(volume);
 }
 
 static bool FreeExtent(Volume *volume, uint64_t extentStart, uint64_t extentCount) {
@@ -627,6 +1444,7 @@ static bool FreeExtent(Volume *volume, uint64_t extentStart, uint64_t extentCoun
 	KWriterLockAssertExclusive(&volume->blockBitmapLock);
 
 	uint64_t blockGroup = extentStart / superblock->blocksPerGroup;
+	uint64_t startInGroup = extentStart % superblock->blocksPerGroup;
 
 	// Validate the extent.
 
@@ -637,41 +1455,340 @@ static bool FreeExtent(Volume *volume, uint64_t extentStart, uint64_t extentCoun
 	// Load the block bitmap.
 
 	GroupDescriptor *target = volume->groupDescriptorTable + blockGroup;
-	ESFS_CHECK(ValidateGroupDescriptor(target), "FreeExtent - Invalid group descriptor.");
-	uint8_t *bitmap = (uint8_t *) EsHeapAllocate(superblock->blocksPerGroupBlockBitmap * superblock->blockSize, false, K_FIXED);
-	EsDefer(EsHeapFree(bitmap, 0, K_FIXED));
-	ESFS_CHECK(bitmap, "FreeExtent - Could not allocate buffer for block bitmap.");
+	GroupFreeExtents *freeExtents = volume->groupFreeExtents + blockGroup;
+	ESFS_CHECK(ValidateGroupDescriptor(target, superblock), "FreeExtent - Invalid group descriptor.");
 	ESFS_CHECK(target->blockBitmap, "FreeExtent - Group descriptor does not have block bitmap.");
 	ESFS_CHECK(target->blocksUsed >= extentCount, "FreeExtent - Group descriptor indicates fewer blocks are used than are given in this extent.");
-	ESFS_CHECK(AccessBlock(volume, target->blockBitmap, superblock->blocksPerGroupBlockBitmap, bitmap, FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ), "FreeExtent - Could not read block bitmap.");
-	ESFS_CHECK(ValidateBlockBitmap(target, bitmap, superblock), "FreeExtent - Invalid block bitmap.");
+	ESFS_CHECK(LoadFreeExtents(volume, target), "FreeExtent - Could not load block bitmap.");
+	uint8_t *bitmap = freeExtents->bitmap;
 
 	// Clear the bits representing the freed blocks.
 
-	for (uint64_t i = 0; i < extentCount; i++) {
-		uint64_t blockInGroup = (extentStart % superblock->blocksPerGroup) + i;
-		uint8_t bit = bitmap[blockInGroup / 8] & (1 << (blockInGroup % 8));
-		ESFS_CHECK(bit, "FreeExtent - Attempting to free a block that has not been allocated.");
-		bitmap[blockInGroup / 8] &= ~(1 << (blockInGroup % 8));
+	for (uint64_t i = startInGroup; i < startInGroup + extentCount; i++) {
+		ESFS_CHECK(bitmap[i / 8] & (1 << (i % 8)), "FreeExtent - Attempting to free a block that has not been allocated.");
+	}
+
+	for (uint64_t i = startInGroup; i < startInGroup + extentCount; i++) {
+		bitmap[i / 8] &= ~(1 << (i % 8));
+	}
+
+	// Make sure no pending metadata writes can overwrite the blocks after they are reused.
+
+	if (!JournalRevoke(volume, extentStart, extentCount)) {
+		UnloadFreeExtents(freeExtents);
+		ESFS_CHECK(false, "FreeExtent - Could not revoke blocks from the journal.");
 	}
 
-	// Write out the modified bitmap and update the group descriptor.
+	// Write out the modified part of the bitmap and update the group descriptor.
 
-	if (!AccessBlock(volume, target->blockBitmap, superblock->blocksPerGroupBlockBitmap, bitmap, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE)) {
+	if (!WriteBlockBitmap(volume, target, startInGroup, extentCount)) {
+		UnloadFreeExtents(freeExtents);
 		return false;
 	}
 
-	target->largestExtent = FindLargestExtent(bitmap, superblock);
-	target->bitmapChecksum = CalculateCRC32(bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize, 0);
+	target->bitmapChecksum = ChecksumMetadata(superblock, bitmap, superblock->blocksPerGroupBlockBitmap * superblock->blockSize);
 	target->blocksUsed -= extentCount;
 	target->checksum = 0;
-	target->checksum = CalculateCRC32(target, sizeof(GroupDescriptor), 0);
+	target->checksum = ChecksumMetadata(superblock, target, sizeof(GroupDescriptor));
+	JournalGroupDescriptorsModified(volume);
 	superblock->blocksUsed -= extentCount;
 	volume->spaceUsed -= extentCount * superblock->blockSize;
 
+	// File data is not journaled, so if the blocks were reused before the transaction freeing them is in the journal,
+	// a crash could leave the old metadata pointing at another file's data. Keep them out of the allocator until then.
+
+	Journal *journal = &volume->journal;
+
+	if (journal->enabled) {
+		KMutexAcquire(&journal->mutex);
+		JournalFreedExtent extent = { extentStart, extentCount };
+		bool added = journal->runningFreed.Add(extent);
+		KMutexRelease(&journal->mutex);
+
+		if (!added) {
+			// The blocks are unavailable until the volume is mounted again.
+			KernelLog(LOG_ERROR, "EsFS", "leaked extent", "FreeExtent - Could not record freed extent.\n");
+		}
+	} else {
+		ReleaseExtent(volume, extentStart, extentCount);
+	}
+
+	return true;
+}
+
+static void ReleaseFreedExtents(Volume *volume) {
+	// Called by JournalCheckpoint once the transaction that freed the extents is in the journal.
+
+	Journal *journal = &volume->journal;
+	KMutexAssertLocked(&journal->commitMutex);
+	if (!journal->committingFreed.Length()) return;
+
+	KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+
+	for (uintptr_t i = 0; i < journal->committingFreed.Length(); i++) {
+		ReleaseExtent(volume, journal->committingFreed[i].start, journal->committingFreed[i].count);
+	}
+
+	KMutexAcquire(&journal->mutex);
+	journal->committingFreed.Free();
+	KMutexRelease(&journal->mutex);
+	KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+}
+
+static bool StoreExtents(FSNode *file, AttributeData *data, size_t dataBufferSize) {
+	// Store the extent list in the data attribute if it fits, otherwise move it into an extent index.
+
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+	uint8_t *dataBuffer = (uint8_t *) data + data->dataOffset;
+	uint64_t listBytes = EncodeExtentList(&file->extents, nullptr);
+
+	if (listBytes <= dataBufferSize && file->extents.Length() <= 0xFFFF) {
+		if (file->indexExtents.Length()) {
+			KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+			for (uintptr_t i = 0; i < file->indexExtents.Length(); i++) {
+				ESFS_CHECK(FreeExtent(volume, file->indexExtents[i].start, file->indexExtents[i].count), "StoreExtents - Could not free extent index.");
+			}
+
+			file->indexExtents.SetLength(0);
+			file->indexBlockExtents.SetLength(0);
+		}
+
+		EncodeExtentList(&file->extents, dataBuffer);
+		data->indirection = ESFS_INDIRECTION_L1;
+		data->count = file->extents.Length();
+		file->extentsModified = file->extents.Length();
+		return true;
+	}
+
+	// Each block of the index holds part of the list, so only the blocks from the one containing the first modified extent need rewriting.
+	// Since extents are only added and removed at the end of the list, this is usually just the last block or two.
+
+	uint64_t blockListBytes = superblock->blockSize - sizeof(ExtentIndexHeader);
+	uintptr_t firstBlock = 0, firstExtent = 0;
+
+	if (data->indirection == ESFS_INDIRECTION_L2) {
+		while (firstBlock + 1 < file->indexBlockExtents.Length() && firstExtent + file->indexBlockExtents[firstBlock] < file->extentsModified) {
+			firstExtent += file->indexBlockExtents[firstBlock];
+			firstBlock++;
+		}
+	}
+
+	// Pack the extents from there into blocks.
+
+	Array<uint32_t, K_FIXED> blockExtents = {};
+	EsDefer(blockExtents.Free());
+	ESFS_CHECK(blockExtents.SetLength(firstBlock), "StoreExtents - Could not allocate extent list.");
+	EsMemoryCopy(blockExtents.array, file->indexBlockExtents.array, firstBlock * sizeof(uint32_t));
+
+	for (uintptr_t i = firstExtent; i < file->extents.Length(); ) {
+		uint64_t previousExtentStart = 0, bytes = 0;
+		uint32_t count = 0;
+
+		for (; i < file->extents.Length(); i++, count++) {
+			uint8_t encode[32];
+			uint64_t length = EncodeExtent(file->extents[i].start, previousExtentStart, file->extents[i].count, encode);
+			if (bytes + length > blockListBytes) break;
+			previousExtentStart = file->extents[i].start;
+			bytes += length;
+		}
+
+		ESFS_CHECK(blockExtents.Add(count), "StoreExtents - Could not allocate extent list.");
+	}
+
+	uint64_t indexBlocks = blockExtents.Length();
+	uint64_t oldIndexBlocks = file->indexExtents.Length() ? file->indexExtents.Last().blockInFile + file->indexExtents.Last().count : 0;
+
+	// Resize the extent index.
+
+	{
+		KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+		EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+		while (oldIndexBlocks < indexBlocks) {
+			FSExtent *last = file->indexExtents.Length() ? &file->indexExtents.Last() : nullptr;
+			uint64_t allocatedStart, allocatedCount;
+
+			ESFS_CHECK(AllocateExtent(volume, last ? last->start + last->count : file->extents[0].start, indexBlocks - oldIndexBlocks, 
+						&allocatedStart, &allocatedCount, false), "StoreExtents - Could not allocate extent index.");
+
+			if (last && last->start + last->count == allocatedStart) {
+				last->count += allocatedCount;
+			} else if (!file->indexExtents.Add({ oldIndexBlocks, allocatedStart, allocatedCount })) {
+				FreeExtent(volume, allocatedStart, allocatedCount);
+				ESFS_CHECK(false, "StoreExtents - Could not allocate extent list.");
+			}
+
+			oldIndexBlocks += allocatedCount;
+		}
+
+		while (file->indexExtents.Length() && file->indexExtents.Last().blockInFile >= indexBlocks) {
+			FSExtent extent = file->indexExtents.Pop();
+			ESFS_CHECK(FreeExtent(volume, extent.start, extent.count), "StoreExtents - Could not free extent index.");
+		}
+
+		FSExtent *last = &file->indexExtents.Last();
+
+		if (last->blockInFile + last->count > indexBlocks) {
+			uint64_t keep = indexBlocks - last->blockInFile;
+			ESFS_CHECK(FreeExtent(volume, last->start + keep, last->count - keep), "StoreExtents - Could not free extent index.");
+			last->count = keep;
+		}
+	}
+
+	ESFS_CHECK(EncodeExtentList(&file->indexExtents, nullptr) <= dataBufferSize, "StoreExtents - Extent index is too fragmented.");
+
+	// Write out the modified blocks of the extent index.
+
+	uint8_t *index = (uint8_t *) EsHeapAllocate((indexBlocks - firstBlock) * superblock->blockSize, true, K_FIXED);
+	EsDefer(EsHeapFree(index, 0, K_FIXED));
+	ESFS_CHECK(index, "StoreExtents - Could not allocate buffer for extent index.");
+
+	for (uintptr_t i = firstBlock, extent = firstExtent; i < indexBlocks; i++) {
+		ExtentIndexHeader *header = (ExtentIndexHeader *) (index + (i - firstBlock) * superblock->blockSize);
+		uint64_t previousExtentStart = 0;
+		EsMemoryCopy(header->signature, ESFS_EXTENT_INDEX_SIGNATURE, 4);
+		header->count = blockExtents[i];
+
+		for (uintptr_t j = 0; j < blockExtents[i]; j++, extent++) {
+			header->bytes += EncodeExtent(file->extents[extent].start, previousExtentStart, file->extents[extent].count, 
+					(uint8_t *) (header + 1) + header->bytes);
+			previousExtentStart = file->extents[extent].start;
+		}
+
+		header->checksum = ChecksumMetadata(superblock, header, sizeof(ExtentIndexHeader) + header->bytes);
+	}
+
+	for (uintptr_t i = 0; i < file->indexExtents.Length(); i++) {
+		FSExtent *extent = &file->indexExtents[i];
+		uint64_t from = extent->blockInFile > firstBlock ? extent->blockInFile : firstBlock;
+		uint64_t to = extent->blockInFile + extent->count;
+		if (from >= to) continue;
+
+		if (!AccessBlock(volume, extent->start + from - extent->blockInFile, to - from, index + (from - firstBlock) * superblock->blockSize, 
+					FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE)) {
+			return false;
+		}
+	}
+
+	EncodeExtentList(&file->indexExtents, dataBuffer);
+	data->indirection = ESFS_INDIRECTION_L2;
+	data->count = file->indexExtents.Length();
+
+	file->indexBlockExtents.Free();
+	file->indexBlockExtents = blockExtents;
+	blockExtents = {};
+	file->extentsModified = file->extents.Length();
+
+	// Older drivers cannot read extent indices, and before version 14 they could only read indices with a single header.
+
+	uint16_t version = indexBlocks > 1 ? 14 : 11;
+	if (superblock->requiredReadVersion < version) superblock->requiredReadVersion = version;
+	if (superblock->requiredWriteVersion < version) superblock->requiredWriteVersion = version;
+
+	return true;
+}
+
+static bool ZeroFileBlocks(FSNode *file, uint64_t from, uint64_t to) {
+	for (uint64_t block = from; block < to; ) {
+		FSExtent *extent = FindExtent(file, block);
+		ESFS_CHECK(extent, "ZeroFileBlocks - Block is not in the extent list.");
+
+		uint64_t offset = block - extent->blockInFile, count = extent->count - offset;
+		if (count > to - block) count = to - block;
+
+		if (!ZeroBlocks(file->volume, extent->start + offset, count)) {
+			return false;
+		}
+
+		block += count;
+	}
+
+	return true;
+}
+
+static bool FreeExtentsAfter(FSNode *file, uint64_t blocks) {
+	// Free the extents past the given block, and shorten the extent containing it.
+
+	Volume *volume = file->volume;
+	KWriterLockAssertExclusive(&volume->blockBitmapLock);
+
+	while (file->extents.Length()) {
+		FSExtent *last = &file->extents.Last();
+
+		if (last->blockInFile >= blocks) {
+			if (!FreeExtent(volume, last->start, last->count)) {
+				return false;
+			}
+
+			file->extents.Pop();
+			ExtentsModified(file, file->extents.Length());
+		} else {
+			if (last->blockInFile + last->count > blocks) {
+				uint64_t keep = blocks - last->blockInFile;
+
+				if (!FreeExtent(volume, last->start + keep, last->count - keep)) {
+					return false;
+				}
+
+				last->count = keep;
+				ExtentsModified(file, file->extents.Length() - 1);
+			}
+
+			break;
+		}
+	}
+
 	return true;
 }
 
+static size_t JournalExtentCredits(FSNode *file, uint64_t extents) {
+	// The most blocks modified when up to the given number of the node's extents are allocated or freed:
+	// the block bitmaps of the groups containing them, and the blocks of the extent index that StoreExtents rewrites.
+	// These are the block containing the first modified extent, and enough blocks to hold the extents after it.
+
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+	AttributeData *data = (AttributeData *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DATA);
+
+	if (data && data->indirection != ESFS_INDIRECTION_DIRECT && !LoadExtents(file, data)) {
+		return (size_t) -1; // The operation will fail when it tries to load the extents.
+	}
+
+	uint64_t blockExtents = (superblock->blockSize - sizeof(ExtentIndexHeader)) / ESFS_ENCODED_EXTENT_MAXIMUM;
+	uint64_t modified = file->extents.Length() - file->extentsModified + 1 /* the last extent may grow or shrink */ + extents;
+	uint64_t indexBlocks = 1 + (modified + blockExtents - 1) / blockExtents;
+	uint64_t groups = extents + file->indexExtents.Length() + indexBlocks;
+	if (groups > superblock->groupCount) groups = superblock->groupCount;
+	return groups * superblock->blocksPerGroupBlockBitmap + indexBlocks;
+}
+
+static size_t JournalIndexCredits(FSNode *directory) {
+	// The most blocks modified when a key is added to, removed from or modified in a directory's index.
+	// Each level may have a vertex and its sibling modified and a vertex allocated or freed, and a new root may be added.
+	// Vertices other than the root are at least half full, which bounds the depth of the tree.
+
+	Superblock *superblock = &directory->volume->superblock;
+	AttributeDirectory *attribute = (AttributeDirectory *) FindAttribute(&directory->entry, ESFS_ATTRIBUTE_DIRECTORY);
+	uint64_t minimumKeys = ((superblock->blockSize - ESFS_INDEX_KEY_OFFSET) / sizeof(IndexKey) - 1) / 2;
+	uint64_t depth = 2;
+
+	for (uint64_t keys = attribute ? attribute->childNodes : 0; keys > minimumKeys && depth < ESFS_INDEX_MAX_DEPTH; keys /= minimumKeys) {
+		depth++;
+	}
+
+	uint64_t groups = depth < superblock->groupCount ? depth : superblock->groupCount;
+	return 3 * depth + groups * superblock->blocksPerGroupBlockBitmap;
+}
+
+static size_t JournalDirectoryCredits(FSNode *directory) {
+	// The most blocks modified when an entry is added to or removed from a directory:
+	// the block containing the entry, the block containing the last entry that replaces it, the index, and the directory changing size by one block.
+	return 2 + 2 * JournalIndexCredits(directory) + JournalExtentCredits(directory, 1);
+}
+
 static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, uint64_t newDataAttributeSize = 0) {
 	if (file->corrupt) return *error = ES_ERROR_CORRUPT_DATA, 0;
 
@@ -698,12 +1815,11 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 
 	AttributeData *data = (AttributeData *) FindAttribute(entry, ESFS_ATTRIBUTE_DATA);
 	uint8_t *dataBuffer = (uint8_t *) data + data->dataOffset;
-	size_t dataBufferSize = data->size - data->dataOffset;
 	size_t newDataBufferSize = (newDataAttributeSize ? newDataAttributeSize : data->size) - data->dataOffset;
 
 	if (newDataBufferSize >= newSize && entry->nodeType != ESFS_NODE_TYPE_DIRECTORY) {
 		if (data->indirection == ESFS_INDIRECTION_DIRECT) {
-		} else if (data->indirection == ESFS_INDIRECTION_L1) {
+		} else if (data->indirection == ESFS_INDIRECTION_L1 || data->indirection == ESFS_INDIRECTION_L2) {
 			// Load the data from the indirect storage.
 
 			if (entry->fileSize) {
@@ -712,28 +1828,30 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 				}
 			}
 
-			// Free the extents.
+			// Free the extents, and the extent index.
 
-			uint64_t previousExtentStart = 0, extentCount = 0, position = 0;
-
-			for (uintptr_t i = 0; i < data->count; i++) {
-				if (!DecodeExtent(&previousExtentStart, &extentCount, dataBuffer, &position, dataBufferSize)) {
-					file->corrupt = true;
-					*error = ES_ERROR_CORRUPT_DATA;
-					return (entry->fileSize = 0);
-				}
+			if (!LoadExtents(file, data)) {
+				file->corrupt = true;
+				*error = ES_ERROR_CORRUPT_DATA;
+				return (entry->fileSize = 0);
+			}
 
-				KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
-				EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+			KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+			for (uintptr_t i = 0; i < file->extents.Length() + file->indexExtents.Length(); i++) {
+				FSExtent *extent = i < file->extents.Length() ? &file->extents[i] : &file->indexExtents[i - file->extents.Length()];
 
-				if (!FreeExtent(volume, previousExtentStart, extentCount)) {
+				if (!FreeExtent(volume, extent->start, extent->count)) {
+					UnloadExtents(file);
 					file->corrupt = true;
-					entry->fileSize = 0;
 					*error = ES_ERROR_HARDWARE_FAILURE;
 					return (entry->fileSize = 0);
 				}
 			}
 
+			UnloadExtents(file);
+
 			// Store the existing data in the entry.
 
 			EsMemoryCopy(dataBuffer, blockBuffer, newSize);
@@ -750,7 +1868,8 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 	} else {
 		uint64_t oldBlocks = (entry->fileSize + superblock->blockSize - 1) / superblock->blockSize;
 		uint64_t newBlocks = (newSize + superblock->blockSize - 1) / superblock->blockSize;
-		bool copyData = false;
+		bool copyData = false, partial = false;
+		EsError growError = ES_SUCCESS;
 
 		if (data->indirection == ESFS_INDIRECTION_DIRECT) {
 			if (!ReadWrite(file, 0, entry->fileSize, blockBuffer, false, false)) {
@@ -762,28 +1881,27 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 			data->count = 0;
 			oldBlocks = 0;
 			entry->fileSize = 0;
-		} else if (data->indirection != ESFS_INDIRECTION_L1) {
+
+			UnloadExtents(file);
+			file->extentsLoaded = true;
+		} else if (data->indirection == ESFS_INDIRECTION_L1 || data->indirection == ESFS_INDIRECTION_L2) {
+			if (!LoadExtents(file, data)) {
+				*error = ES_ERROR_CORRUPT_DATA;
+				return entry->fileSize;
+			}
+		} else {
 			*error = ES_ERROR_UNSUPPORTED;
 			return entry->fileSize; // Unrecognised indirection.
 		}
 
-		if (oldBlocks < newBlocks) {
-			uint64_t previousExtentStart = 0, oldPreviousExtentStart = 0, extentCount = 0, position = 0, previousPosition = 0;
-
-			for (uintptr_t i = 0; i < data->count; i++) {
-				previousPosition = position;
-				oldPreviousExtentStart = previousExtentStart;
-
-				if (!DecodeExtent(&previousExtentStart, &extentCount, dataBuffer, &position, dataBufferSize)) {
-					*error = ES_ERROR_CORRUPT_DATA;
-					return entry->fileSize;
-				}
-			}
+		// Growing files may have blocks allocated past their end, which are used before allocating any more.
+		uint64_t allocatedBlocks = file->extents.Length() ? file->extents.Last().blockInFile + file->extents.Last().count : 0;
 
+		if (oldBlocks < newBlocks) {
 			KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
 			EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
 
-			uint64_t remaining = newBlocks - oldBlocks;
+			uint64_t remaining = newBlocks > allocatedBlocks ? newBlocks - allocatedBlocks : 0;
 
 			if (superblock->blocksUsed + remaining >= superblock->blockCount) {
 				// There isn't enough space to grow the file.
@@ -791,119 +1909,105 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 				return entry->fileSize;
 			}
 
-			while (remaining) {
+			if (remaining && oldBlocks && entry->nodeType == ESFS_NODE_TYPE_FILE) {
+				// The file is being extended again, so expect it to keep growing.
+				// Allocate extra blocks now so the next extension can continue the same extent.
+				// These are freed when the node is synchronised.
+
+				uint64_t preallocate = newBlocks - oldBlocks > newBlocks / 8 ? newBlocks - oldBlocks : newBlocks / 8;
+				if (preallocate > ESFS_PREALLOCATE_MAXIMUM_BLOCKS) preallocate = ESFS_PREALLOCATE_MAXIMUM_BLOCKS;
+
+				if (superblock->blocksUsed + remaining + preallocate < superblock->blockCount - superblock->blockCount / 16) {
+					remaining += preallocate;
+				}
+			}
+
+			for (uintptr_t extentsAllocated = 0; remaining; extentsAllocated++) {
+				if (extentsAllocated == ESFS_HANDLE_MAXIMUM_EXTENTS) {
+					// Stop here, so that the transaction does not get too large for the journal.
+					// If the file has not reached its new size, Resize continues growing it under a new handle.
+					partial = allocatedBlocks < newBlocks;
+					break;
+				}
+
+				FSExtent *last = file->extents.Length() ? &file->extents.Last() : nullptr;
 				uint64_t allocatedStart, allocatedCount;
 
 				bool success = AllocateExtent(volume, 
-						previousExtentStart + extentCount /* Attempt to allocate near the end of the last extent */, 
+						last ? last->start + last->count : 0 /* Attempt to allocate near the end of the last extent */, 
 						remaining /* Attempt to get an extent covering all the remaining blocks */,
-						&allocatedStart, &allocatedCount, true /* Zero the blocks */);
+						&allocatedStart, &allocatedCount, false /* The blocks are zeroed below as they come into use */);
 
 				if (!success) {
-					*error = ES_ERROR_HARDWARE_FAILURE;
-					return entry->fileSize;
+					if (allocatedBlocks < newBlocks) growError = ES_ERROR_HARDWARE_FAILURE;
+					break;
 				}
 
-				if (previousExtentStart + extentCount == allocatedStart) {
+				if (last && last->start + last->count == allocatedStart) {
 					// We need to grow the previous extent.
-
-					allocatedStart = previousExtentStart;
-					previousExtentStart = oldPreviousExtentStart;
-					remaining += extentCount;
-					allocatedCount += extentCount;
-					position = previousPosition;
-					data->count--;
+					last->count += allocatedCount;
+				} else if (!file->extents.Add({ allocatedBlocks, allocatedStart, allocatedCount })) {
+					FreeExtent(volume, allocatedStart, allocatedCount);
+					if (allocatedBlocks < newBlocks) growError = ES_ERROR_INSUFFICIENT_RESOURCES;
+					break;
 				}
 
-				oldPreviousExtentStart = previousExtentStart;
-				uint8_t encode[32];
-				uint64_t length = EncodeExtent(allocatedStart, previousExtentStart, allocatedCount, encode);
+				ExtentsModified(file, file->extents.Length() - 1);
 
-				if (length + position > newDataBufferSize) {
-					// The data buffer is full.
-					*error = ES_ERROR_FILE_TOO_LARGE;
-					return entry->fileSize;
-				} else {
-					EsMemoryCopy(dataBuffer + position, encode, length);
-					previousPosition = position;
-					position += length;
-					data->count++;
-					remaining -= allocatedCount;
-					entry->fileSize += allocatedCount * superblock->blockSize;
-					previousExtentStart = allocatedStart;
-				}
+				remaining -= allocatedCount;
+				allocatedBlocks += allocatedCount;
 			}
-		} else if (oldBlocks > newBlocks) {
-			uint64_t previousExtentStart = 0, extentCount = 0, 
-				 position = 0, blockInFile = 0;
-
-			file->corrupt = true;
-			entry->fileSize = 0;
-			*error = ES_ERROR_HARDWARE_FAILURE;
-
-			// Free the removed extents.
-
-			for (uintptr_t i = 0; i < data->count; i++) {
-				if (!DecodeExtent(&previousExtentStart, &extentCount, dataBuffer, &position, dataBufferSize)) {
-					return 0;
-				}
 
-				if (blockInFile + extentCount > newBlocks) {
-					uint64_t extentStart = previousExtentStart, extentCount2 = extentCount;
+			// Zero the blocks that are now part of the file.
 
-					if (blockInFile < newBlocks) {
-						extentStart += newBlocks - blockInFile;
-						extentCount2 -= newBlocks - blockInFile;
-					}
-
-					KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
-					EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
-
-					if (!FreeExtent(volume, extentStart, extentCount2)) {
-						return 0;
-					}
-				}
+			uint64_t zeroEnd = allocatedBlocks < newBlocks ? allocatedBlocks : newBlocks;
 
-				blockInFile += extentCount;
+			if (!ZeroFileBlocks(file, oldBlocks, zeroEnd)) {
+				growError = ES_ERROR_HARDWARE_FAILURE;
+				zeroEnd = oldBlocks;
 			}
 
-			// Modify the last extent.
-
-			previousExtentStart = 0, position = 0, blockInFile = 0;
-
-			for (uintptr_t i = 0; i < data->count; i++) {
-				uint64_t previousPosition = position, lastExtentStart = previousExtentStart;
+			if ((growError != ES_SUCCESS || partial) && zeroEnd > oldBlocks) {
+				newSize = zeroEnd * superblock->blockSize;
+				entry->fileSize = newSize;
+			}
+		} else if (oldBlocks > newBlocks) {
+			file->corrupt = true;
+			entry->fileSize = 0;
+			*error = ES_ERROR_HARDWARE_FAILURE;
 
-				if (!DecodeExtent(&previousExtentStart, &extentCount, dataBuffer, &position, dataBufferSize)) {
-					return 0;
-				}
+			// Free the removed extents and any preallocated blocks, and shorten the last extent.
 
-				if (blockInFile + extentCount > newBlocks) {
-					uint64_t extentStart = previousExtentStart;
-
-					if (blockInFile < newBlocks) {
-						uint8_t encode[32];
-						uint64_t length = EncodeExtent(extentStart, lastExtentStart, newBlocks - blockInFile, encode);
-						EsMemoryCopy(dataBuffer + previousPosition, encode, length);
-						data->count = i + 1;
-						break;
-					} else {
-						data->count = i;
-						break;
-					}
-				}
+			KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
 
-				blockInFile += extentCount;
+			if (!FreeExtentsAfter(file, newBlocks)) {
+				UnloadExtents(file);
+				return 0;
 			}
 		} else {
 			// Do nothing.
 		}
 
-		data->indirection = ESFS_INDIRECTION_L1;
+		// Write back the extent list.
+		// This also handles the data attribute changing size when the node is renamed.
+
+		if (!StoreExtents(file, data, newDataBufferSize)) {
+			UnloadExtents(file);
+			file->corrupt = true;
+			*error = ES_ERROR_HARDWARE_FAILURE;
+			return (entry->fileSize = 0);
+		}
+
+		if (growError != ES_SUCCESS) {
+			*error = growError;
+			return entry->fileSize;
+		}
 
 		if (copyData) {
 			if (!ReadWrite(file, 0, superblock->blockSize, blockBuffer, false, true)) {
 				// Rollback changes.
+				UnloadExtents(file);
 				data->indirection = ESFS_INDIRECTION_DIRECT;
 				data->count = entry->fileSize = oldSize;
 				EsMemoryCopy(dataBuffer, blockBuffer, data->count);
@@ -919,9 +2023,296 @@ static uint64_t ResizeInternal(FSNode *file, uint64_t newSize, EsError *error, u
 	return (entry->fileSize = newSize);
 }
 
+static uint64_t ResizeStepTarget(FSNode *file, uint64_t newSize) {
+	// Shrinking frees at most ESFS_HANDLE_MAXIMUM_EXTENTS extents at a time, so that the transaction does not get too large for the journal.
+
+	AttributeData *data = (AttributeData *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DATA);
+
+	if (newSize >= file->entry.fileSize || data->indirection == ESFS_INDIRECTION_DIRECT 
+			|| !LoadExtents(file, data) || file->extents.Length() <= ESFS_HANDLE_MAXIMUM_EXTENTS) {
+		return newSize;
+	}
+
+	uint64_t stepSize = file->extents[file->extents.Length() - ESFS_HANDLE_MAXIMUM_EXTENTS].blockInFile * file->volume->superblock.blockSize;
+	return stepSize > newSize && stepSize < file->entry.fileSize ? stepSize : newSize;
+}
+
 static uint64_t Resize(KNode *node, uint64_t newSize, EsError *error) {
 	// EsPrint("Resize %s to %d\n", node->name.bytes, node->name.buffer, newSize);
-	return ResizeInternal((FSNode *) node->driverNode, newSize, error);
+	FSNode *file = (FSNode *) node->driverNode;
+	Volume *volume = file->volume;
+
+	// Large changes are made in steps, each under its own handle. The file is consistent between steps.
+
+	while (true) {
+		uint64_t oldSize = file->entry.fileSize, target = ResizeStepTarget(file, newSize);
+		size_t credits = JournalStart(volume, JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS + 1));
+		uint64_t size = ResizeInternal(file, target, error);
+		JournalStop(volume, credits);
+
+		if (*error != ES_SUCCESS || size == newSize || size == oldSize) {
+			return size;
+		}
+	}
+}
+
+static bool TrimPreallocatedBlocks(FSNode *file) {
+	// Free the blocks that were preallocated past the end of the file while it was growing.
+	// The caller holds a journal handle; see SyncInternal.
+
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+	AttributeData *data = (AttributeData *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DATA);
+
+	if (!file->extentsLoaded || (data->indirection != ESFS_INDIRECTION_L1 && data->indirection != ESFS_INDIRECTION_L2)) {
+		return true;
+	}
+
+	uint64_t blocks = (file->entry.fileSize + superblock->blockSize - 1) / superblock->blockSize;
+
+	if (!file->extents.Length() || file->extents.Last().blockInFile + file->extents.Last().count <= blocks) {
+		return true;
+	}
+
+	{
+		KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+		EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+		ESFS_CHECK(FreeExtentsAfter(file, blocks), "TrimPreallocatedBlocks - Could not free preallocated blocks.");
+	}
+
+	ESFS_CHECK(StoreExtents(file, data, data->size - data->dataOffset), "TrimPreallocatedBlocks - Could not store extent list.");
+	return true;
+}
+
+static bool StoreDirectoryEntry(FSNode *file) {
+	// Write the node's directory entry back to its parent.
+
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+
+	{
+		file->entry.checksum = 0;
+		file->entry.checksum = ChecksumMetadata(superblock, &file->entry, sizeof(DirectoryEntry));
+	}
+
+	uint8_t *blockBuffer = (uint8_t *) EsHeapAllocate(superblock->blockSize, false, K_FIXED);
+	EsDefer(EsHeapFree(blockBuffer, 0, K_FIXED));
+	ESFS_CHECK(blockBuffer, "StoreDirectoryEntry - Could not allocate block buffer.");
+
+	if (!AccessBlock(volume, file->reference.block, 1, blockBuffer, FS_BLOCK_ACCESS_CACHED, K_ACCESS_READ)) {
+		KernelLog(LOG_ERROR, "EsFS", "drive access failure", "StoreDirectoryEntry - Could not read reference block.\n");
+		return false;
+	}
+
+	if (!ValidateDirectoryEntry(volume, (DirectoryEntry *) (blockBuffer + file->reference.offsetIntoBlock))) {
+		return false;
+	}
+
+	EsMemoryCopy(blockBuffer + file->reference.offsetIntoBlock, &file->entry, sizeof(DirectoryEntry));
+
+	if (!AccessBlock(volume, file->reference.block, 1, blockBuffer, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE)) {
+		KernelLog(LOG_ERROR, "EsFS", "drive access failure", "StoreDirectoryEntry - Could not write reference block.\n");
+		return false;
+	}
+
+	return true;
+}
+
+static size_t SyncCredits(FSNode *file) {
+	// The directory entry, and for files, freeing the preallocated blocks.
+	// These were allocated by the last step of a resize, so they are in at most ESFS_HANDLE_MAXIMUM_EXTENTS extents.
+	return 1 + (file->type == ES_NODE_FILE ? JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS + 1) : 0);
+}
+
+static void SyncInternal(KNode *node) {
+	// The caller holds a journal handle with at least SyncCredits reserved.
+	// Operations that synchronise a node as one of their steps call this directly, since starting a nested handle could deadlock
+	// with a commit waiting for the outer handle.
+
+	FSNode *file = (FSNode *) node->driverNode;
+	if (!file) KernelPanic("EsFS::Sync - Node %x has null driver node.\n", node);
+	if (file->corrupt) return;
+
+	// EsPrint("SYNC! %d,%d\n", file->reference.block, file->reference.offsetIntoBlock);
+
+	if (file->type == ES_NODE_FILE && !TrimPreallocatedBlocks(file)) {
+		file->corrupt = true;
+		return;
+	}
+
+	if (file->type == ES_NODE_DIRECTORY) {
+		// Get the most recent totalSize for the directory.
+		AttributeDirectory *directoryAttribute = (AttributeDirectory *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DIRECTORY);
+		directoryAttribute->totalSize = FSNodeGetTotalSize(node);
+	}
+
+	if (file->type == ES_NODE_FILE) {
+		// The file system layer updates the modification time when the file is written or resized.
+		file->entry.modificationTime = FSNodeGetModificationTime(node);
+	}
+
+	StoreDirectoryEntry(file);
+}
+
+static void Sync(KNode *_directory, KNode *node) {
+	(void) _directory;
+	FSNode *file = (FSNode *) node->driverNode;
+	if (!file) KernelPanic("EsFS::Sync - Node %x has null driver node.\n", node);
+	if (file->corrupt) return;
+
+	size_t credits = JournalStart(file->volume, SyncCredits(file));
+	SyncInternal(node);
+	JournalStop(file->volume, credits);
+}
+
+static EsError Defragment(KNode *node) {
+	// Move the file's data into as few extents as possible.
+	// The caller flushes the file's cache and holds its writer lock until this returns, 
+	// so the cache cannot read from or write to the old extents while they are copied, switched and freed.
+	// The cached pages stay valid, since they are indexed by the offset into the file rather than by block.
+
+	FSNode *file = (FSNode *) node->driverNode;
+	if (file->corrupt) return ES_ERROR_CORRUPT_DATA;
+	Volume *volume = file->volume;
+	Superblock *superblock = &volume->superblock;
+	AttributeData *data = (AttributeData *) FindAttribute(&file->entry, ESFS_ATTRIBUTE_DATA);
+
+	if (data->indirection != ESFS_INDIRECTION_L1 && data->indirection != ESFS_INDIRECTION_L2) {
+		return ES_SUCCESS; // The data is stored in the directory entry.
+	}
+
+	if (!LoadExtents(file, data)) {
+		return ES_ERROR_CORRUPT_DATA;
+	}
+
+	if (file->extents.Length() <= 1) {
+		return ES_SUCCESS;
+	}
+
+	uint64_t blocks = file->extents.Last().blockInFile + file->extents.Last().count;
+	Array<FSExtent, K_FIXED> extents = {};
+	EsDefer(extents.Free());
+
+	// Allocate the new extents.
+	// The copy is done outside of a journal handle so that other operations are not held up by it.
+	// If the system crashes before the switch is committed, the new blocks stay marked as used.
+	// At most ESFS_HANDLE_MAXIMUM_EXTENTS are allocated, so that the transaction does not get too large for the journal.
+
+	{
+		size_t credits = JournalStart(volume, JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS));
+		EsDefer(JournalStop(volume, credits));
+		KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+		EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+		if (superblock->blocksUsed + blocks >= superblock->blockCount) {
+			return ES_ERROR_DRIVE_FULL;
+		}
+
+		uint64_t allocatedBlocks = 0;
+
+		while (allocatedBlocks < blocks && extents.Length() < file->extents.Length() && extents.Length() < ESFS_HANDLE_MAXIMUM_EXTENTS) {
+			FSExtent *last = extents.Length() ? &extents.Last() : nullptr;
+			uint64_t allocatedStart, allocatedCount;
+
+			if (!AllocateExtent(volume, last ? last->start + last->count : 0, blocks - allocatedBlocks, 
+						&allocatedStart, &allocatedCount, false)) {
+				break;
+			}
+
+			if (last && last->start + last->count == allocatedStart) {
+				last->count += allocatedCount;
+			} else if (!extents.Add({ allocatedBlocks, allocatedStart, allocatedCount })) {
+				FreeExtent(volume, allocatedStart, allocatedCount);
+				break;
+			}
+
+			allocatedBlocks += allocatedCount;
+		}
+
+		if (allocatedBlocks < blocks || extents.Length() >= file->extents.Length()) {
+			// The free space is too fragmented to improve the file's layout.
+
+			for (uintptr_t i = 0; i < extents.Length(); i++) {
+				FreeExtent(volume, extents[i].start, extents[i].count);
+			}
+
+			return ES_SUCCESS;
+		}
+	}
+
+	// Copy the data to its new location.
+
+	{
+		uint64_t bufferBlocks = blocks > 64 ? 64 : blocks;
+		uint8_t *buffer = (uint8_t *) EsHeapAllocate(bufferBlocks * superblock->blockSize, false, K_FIXED);
+		EsDefer(EsHeapFree(buffer, 0, K_FIXED));
+		bool success = buffer != nullptr;
+
+		for (uintptr_t i = 0, j = 0, block = 0; success && block < blocks; ) {
+			FSExtent *from = &file->extents[i], *to = &extents[j];
+			uint64_t offsetIntoFrom = block - from->blockInFile, offsetIntoTo = block - to->blockInFile;
+			uint64_t count = bufferBlocks;
+			if (count > from->count - offsetIntoFrom) count = from->count - offsetIntoFrom;
+			if (count > to->count - offsetIntoTo) count = to->count - offsetIntoTo;
+
+			success = AccessBlock(volume, from->start + offsetIntoFrom, count, buffer, ES_FLAGS_DEFAULT, K_ACCESS_READ)
+				&& AccessBlock(volume, to->start + offsetIntoTo, count, buffer, ES_FLAGS_DEFAULT, K_ACCESS_WRITE);
+
+			block += count;
+			if (block == from->blockInFile + from->count) i++;
+			if (block == to->blockInFile + to->count) j++;
+		}
+
+		if (!success) {
+			size_t credits = JournalStart(volume, JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS));
+			EsDefer(JournalStop(volume, credits));
+			KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+			for (uintptr_t i = 0; i < extents.Length(); i++) {
+				FreeExtent(volume, extents[i].start, extents[i].count);
+			}
+
+			return ES_ERROR_HARDWARE_FAILURE;
+		}
+	}
+
+	// Switch the file to the new extents.
+	// The old extents are freed afterwards, in batches, so that no transaction gets too large for the journal however fragmented the file was.
+	// FreeExtent does not let the blocks be reused until the transaction freeing them, and so the switch before it, is in the journal.
+	// If the system crashes part way through, the old extents that have not been freed yet stay marked as used.
+
+	Array<FSExtent, K_FIXED> oldExtents = file->extents;
+	file->extents = extents;
+	file->extentsModified = 0;
+	extents = oldExtents;
+
+	{
+		size_t credits = JournalStart(volume, 1 /* directory entry */ + JournalExtentCredits(file, 0));
+		EsDefer(JournalStop(volume, credits));
+
+		if (!StoreExtents(file, data, data->size - data->dataOffset) || !StoreDirectoryEntry(file)) {
+			UnloadExtents(file);
+			file->corrupt = true;
+			return ES_ERROR_HARDWARE_FAILURE;
+		}
+	}
+
+	for (uintptr_t i = 0; i < extents.Length(); ) {
+		size_t credits = JournalStart(volume, JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS));
+		EsDefer(JournalStop(volume, credits));
+		KWriterLockTake(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE);
+		EsDefer(KWriterLockReturn(&volume->blockBitmapLock, K_LOCK_EXCLUSIVE));
+
+		for (uintptr_t j = 0; i < extents.Length() && j < ESFS_HANDLE_MAXIMUM_EXTENTS; i++, j++) {
+			if (!FreeExtent(volume, extents[i].start, extents[i].count)) {
+				// The file is intact, but the remaining old extents are not freed.
+				return ES_ERROR_HARDWARE_FAILURE;
+			}
+		}
+	}
+
+	return ES_SUCCESS;
 }
 
 static IndexKey *InsertKeyIntoVertex(uint64_t newKey, IndexVertex *vertex) {
@@ -984,7 +2375,7 @@ static bool IndexModifyKey(Volume *volume, uint64_t newKey, DirectoryEntryRefere
 						&& keys[i].data.offsetIntoBlock + sizeof(DirectoryEntry) <= superblock->blockSize, 
 						"IndexModifyKey - Invalid key entry.");
 				keys[i].data = reference;
-				vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+				vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 				return AccessBlock(volume, block, 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE);
 			}
 		}
@@ -1162,8 +2553,8 @@ static bool IndexAddKey(Volume *volume, uint64_t newKey, DirectoryEntryReference
 
 		// Write the blocks.
 
-		sibling->checksum = 0; sibling->checksum = CalculateCRC32(sibling, superblock->blockSize, 0);
-		vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+		sibling->checksum = 0; sibling->checksum = ChecksumMetadata(superblock, sibling, superblock->blockSize);
+		vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 		ESFS_CHECK(AccessBlock(volume, siblingBlock, 1, sibling, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexAddKey - Could not update index.");
 		ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexAddKey - Could not update index.");
 
@@ -1175,7 +2566,7 @@ static bool IndexAddKey(Volume *volume, uint64_t newKey, DirectoryEntryReference
 
 	// Write the block.
 
-	vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+	vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 	ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexAddKey - Could not update index.");
 
 	return true;
@@ -1245,7 +2636,7 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 		ESFS_VERTEX_KEY(vertex, position)->value = ESFS_VERTEX_KEY(search, 0)->value;
 		ESFS_VERTEX_KEY(vertex, position)->data  = ESFS_VERTEX_KEY(search, 0)->data;
 
-		vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+		vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 		ESFS_CHECK(AccessBlock(volume, blocks[startDepth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 
 		EsMemoryCopy(vertex, search, superblock->blockSize);
@@ -1264,7 +2655,7 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 
 	if (vertex->count >= (vertex->maxCount - 1) / 2) {
 		// EsPrint("Vertex has enough keys, exiting...\n");
-		vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+		vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 		ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 		return true;
 	}
@@ -1281,7 +2672,7 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 			*rootBlock = vertex->keys[0].child;
 		} else {
 			// EsPrint("Vertex is at root, exiting...\n");
-			vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock->blockSize, 0);
+			vertex->checksum = 0; vertex->checksum = ChecksumMetadata(superblock, vertex, superblock->blockSize);
 			ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 		}
 
@@ -1325,9 +2716,9 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 
 			sibling->count--, vertex->count++;
 
-			vertex->checksum = 0; 	vertex->checksum = 	CalculateCRC32(vertex, 	superblock->blockSize, 0);
-			sibling->checksum = 0; 	sibling->checksum = 	CalculateCRC32(sibling, superblock->blockSize, 0);
-			parent->checksum = 0; 	parent->checksum = 	CalculateCRC32(parent, 	superblock->blockSize, 0);
+			vertex->checksum = 0; 	vertex->checksum = 	ChecksumMetadata(superblock, vertex, 	superblock->blockSize);
+			sibling->checksum = 0; 	sibling->checksum = 	ChecksumMetadata(superblock, sibling, superblock->blockSize);
+			parent->checksum = 0; 	parent->checksum = 	ChecksumMetadata(superblock, parent, 	superblock->blockSize);
 
 			ESFS_CHECK(AccessBlock(volume, ESFS_VERTEX_KEY(parent, positionInParent - 1)->child, 1, sibling, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 			ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
@@ -1353,9 +2744,9 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 
 			sibling->count--, vertex->count++;
 
-			vertex->checksum = 0; 	vertex->checksum = 	CalculateCRC32(vertex, 	superblock->blockSize, 0);
-			sibling->checksum = 0; 	sibling->checksum = 	CalculateCRC32(sibling, superblock->blockSize, 0);
-			parent->checksum = 0; 	parent->checksum = 	CalculateCRC32(parent, 	superblock->blockSize, 0);
+			vertex->checksum = 0; 	vertex->checksum = 	ChecksumMetadata(superblock, vertex, 	superblock->blockSize);
+			sibling->checksum = 0; 	sibling->checksum = 	ChecksumMetadata(superblock, sibling, superblock->blockSize);
+			parent->checksum = 0; 	parent->checksum = 	ChecksumMetadata(superblock, parent, 	superblock->blockSize);
 
 			ESFS_CHECK(AccessBlock(volume, ESFS_VERTEX_KEY(parent, positionInParent + 1)->child, 1, sibling, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 			ESFS_CHECK(AccessBlock(volume, blocks[depth], 1, vertex, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
@@ -1397,7 +2788,7 @@ static bool IndexRemoveKey(Volume *volume, uint64_t removeKey, uint64_t *rootBlo
 			ESFS_CHECK(FreeExtent(volume, blocks[depth], 1), "IndexRemoveKey - Could not free merged vertex.");
 		}
 
-		sibling->checksum = 0; 	sibling->checksum = 	CalculateCRC32(sibling, superblock->blockSize, 0);
+		sibling->checksum = 0; 	sibling->checksum = 	ChecksumMetadata(superblock, sibling, superblock->blockSize);
 		ESFS_CHECK(AccessBlock(volume, ESFS_VERTEX_KEY(parent, positionInParent - 1)->child, 1, sibling, FS_BLOCK_ACCESS_CACHED, K_ACCESS_WRITE), "IndexRemoveKey - Could not write index.");
 
 		EsMemoryCopy(vertex, parent, superblock->blockSize);
@@ -1495,6 +2886,25 @@ static EsError Remove(KNode *_directory, KNode *node) {
 	if (!blockBuffers) return ES_ERROR_INSUFFICIENT_RESOURCES;
 	EsDefer(EsHeapFree(blockBuffers, 0, K_FIXED));
 
+	// Step 0: Shrink large files in steps, so that the transaction that removes the node does not get too large for the journal.
+
+	if (entry->nodeType == ESFS_NODE_TYPE_FILE) {
+		while (true) {
+			uint64_t target = ResizeStepTarget(file, 0);
+			if (!target) break;
+
+			EsError error;
+			size_t credits = JournalStart(volume, JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS + 1));
+			uint64_t size = ResizeInternal(file, target, &error);
+			JournalStop(volume, credits);
+			ESFS_CHECK_TO_ERROR(size == target, "Remove - Could not resize node.", error);
+		}
+	}
+
+	size_t credits = JournalStart(volume, JournalDirectoryCredits(directory) + JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS + 1) 
+			+ SyncCredits(file) + superblock->blocksPerGroupBlockBitmap /* index root */);
+	EsDefer(JournalStop(volume, credits));
+
 	// Step 1: If we're deleting a directory, deallocate its empty index.
 
 	if (entry->nodeType == ESFS_NODE_TYPE_DIRECTORY) {
@@ -1523,7 +2933,7 @@ static EsError Remove(KNode *_directory, KNode *node) {
 
 	// Step 3: Sync the file, and remove its directory entry.
 
-	Sync(_directory, node);
+	SyncInternal(node);
 	return RemoveDirectoryEntry(file, blockBuffers, directory, _directory);
 }
 
@@ -1605,6 +3015,7 @@ static bool CreateInternal(const char *name, size_t nameLength, EsNodeType type,
 		entry->attributeOffset = ESFS_ATTRIBUTE_OFFSET;
 		entry->nodeType = type == ES_NODE_DIRECTORY ? ESFS_NODE_TYPE_DIRECTORY : ESFS_NODE_TYPE_FILE; 
 		entry->parent = parent->identifier;
+		entry->creationTime = entry->modificationTime = KGetUnixTimeInUs();
 
 		uint8_t *position = entry->attributes;
 
@@ -1646,7 +3057,7 @@ static bool CreateInternal(const char *name, size_t nameLength, EsNodeType type,
 	}
 
 	entry->checksum = 0;
-	entry->checksum = CalculateCRC32(entry, sizeof(DirectoryEntry), 0);
+	entry->checksum = ChecksumMetadata(superblock, entry, sizeof(DirectoryEntry));
 	if (!ValidateDirectoryEntry(volume, entry)) KernelPanic("EsFS::CreateInternal - Created directory entry is invalid.\n");
 
 	// Write the directory entry.
@@ -1681,16 +3092,21 @@ static EsError Move(KNode *_oldDirectory, KNode *_file, KNode *_newDirectory, co
 	if (oldDirectory->type != ES_NODE_DIRECTORY || newDirectory->type != ES_NODE_DIRECTORY) KernelPanic("EsFS::Move - Incorrect node types.\n");
 
 	file->entry.checksum = 0;
-	file->entry.checksum = CalculateCRC32(&file->entry, sizeof(DirectoryEntry), 0);
+	file->entry.checksum = ChecksumMetadata(superblock, &file->entry, sizeof(DirectoryEntry));
 	if (!ValidateDirectoryEntry(volume, &file->entry)) KernelPanic("EsFS::Move - Existing entry is invalid.\n");
 
 	uint8_t *buffers = (uint8_t *) EsHeapAllocate(superblock->blockSize * 2, true, K_FIXED);
 	if (!buffers) return ES_ERROR_INSUFFICIENT_RESOURCES;
 	EsDefer(EsHeapFree(buffers, 0, K_FIXED));
 
+	// Synchronising the node, removing it from the old directory, adding it to the new directory, and resizing its data attribute for the new name.
+	size_t credits = JournalStart(volume, SyncCredits(file) + JournalExtentCredits(file, ESFS_HANDLE_MAXIMUM_EXTENTS + 1) 
+			+ JournalDirectoryCredits(oldDirectory) + JournalDirectoryCredits(newDirectory));
+	EsDefer(JournalStop(volume, credits));
+
 	// Remove the node from the old directory.
 
-	Sync(_oldDirectory, _file);
+	SyncInternal(_file);
 	ESFS_CHECK_ERROR(RemoveDirectoryEntry(file, buffers, oldDirectory, _oldDirectory), "Move - Could not remove old directory entry.");
 
 	// Add the node to the new directory.
@@ -1704,6 +3120,7 @@ static EsError Move(KNode *_oldDirectory, KNode *_file, KNode *_newDirectory, co
 }
 
 static void Close(KNode *node) {
+	UnloadExtents((FSNode *) node->driverNode);
 	EsHeapFree(node->driverNode, sizeof(FSNode), K_FIXED);
 }
 
@@ -1752,7 +3169,7 @@ static EsError Load(KNode *_directory, KNode *_node, KNodeMetadata *, const void
 	return LoadInternal(directory->volume, _node, entry, reference);
 }
 
-static EsError Create(const char *name, size_t nameLength, EsNodeType type, KNode *_parent, KNode *node, void *driverData) {
+static EsError Create(const char *name, size_t nameLength, EsNodeType type, KNode *_parent, KNode *node, KNodeMetadata *metadata, void *driverData) {
 	FSNode *parent = (FSNode *) _parent->driverNode;
 	if (!parent) return ES_ERROR_UNKNOWN;
 	Volume *volume = parent->volume;
@@ -1762,6 +3179,9 @@ static EsError Create(const char *name, size_t nameLength, EsNodeType type, KNod
 	if (!buffer) return ES_ERROR_INSUFFICIENT_RESOURCES;
 	EsDefer(EsHeapFree(buffer, 0, K_FIXED));
 
+	size_t credits = JournalStart(volume, JournalDirectoryCredits(parent));
+	EsDefer(JournalStop(volume, credits));
+
 	DirectoryEntryReference reference = {};
 
 	if (!CreateInternal(name, nameLength, type, parent, buffer, nullptr, &reference)) {
@@ -1769,6 +3189,7 @@ static EsError Create(const char *name, size_t nameLength, EsNodeType type, KNod
 	}
 
 	EsMemoryCopy(driverData, &reference, sizeof(DirectoryEntryReference));
+	metadata->identifier = ((DirectoryEntry *) buffer)->identifier;
 	return LoadInternal(volume, node, (DirectoryEntry *) buffer, reference);
 }
 
@@ -1822,6 +3243,8 @@ static EsError Scan(const char *name, size_t nameLength, KNode *_directory) {
 	}
 
 	metadata.type = entry->nodeType == ESFS_NODE_TYPE_DIRECTORY ? ES_NODE_DIRECTORY : ES_NODE_FILE;
+	metadata.identifier = entry->identifier;
+	metadata.modificationTime = entry->modificationTime;
 
 	KNode *_node;
 	error = FSDirectoryEntryFound(_directory, &metadata, &reference, name, nameLength, false, &_node);
@@ -1886,6 +3309,33 @@ static bool Mount(Volume *volume, EsFileOffsetDifference *rootDirectoryChildren)
 					K_ACCESS_WRITE, (uint8_t *) superblock, ES_FLAGS_DEFAULT), "Could not mark volume as mounted.");
 	}
 
+	// Replay the metadata journal.
+
+	bool replayedJournal = false;
+
+	if (superblock->journalBlockCount) {
+		Journal *journal = &volume->journal;
+		journal->sequence = superblock->journalSequence;
+		journal->capacity = (superblock->journalBlockCount * superblock->blockSize - ESFS_JOURNAL_TARGET_OFFSET) / (superblock->blockSize + sizeof(uint64_t));
+		journal->wake.autoReset = true;
+
+		uint64_t gdtBlocks = (superblock->groupCount * sizeof(GroupDescriptor) + superblock->blockSize - 1) / superblock->blockSize;
+		ESFS_CHECK_FATAL(superblock->journalFirstBlock + superblock->journalBlockCount <= superblock->blockCount && journal->capacity > gdtBlocks, "Invalid journal.");
+
+		if (!volume->readOnly) {
+			ESFS_CHECK_FATAL(JournalReplay(volume, &replayedJournal), "Could not replay journal.");
+
+			if (replayedJournal) {
+				KMutexAcquire(&journal->writeMutex);
+				bool cleared = JournalClear(volume);
+				KMutexRelease(&journal->writeMutex);
+				ESFS_CHECK_FATAL(cleared, "Could not clear journal.");
+			}
+		} else if (superblock->mounted) {
+			KernelLog(LOG_ERROR, "EsFS", "journal not replayed", "Mount - Cannot replay the journal on a read-only volume.\n");
+		}
+	}
+
 	// Load the group descriptor table.
 
 	{
@@ -1896,6 +3346,23 @@ static bool Mount(Volume *volume, EsFileOffsetDifference *rootDirectoryChildren)
 			EsHeapFree(volume->groupDescriptorTable, 0, K_FIXED);
 			ESFS_CHECK_FATAL(false, "Could not read group descriptor table.");
 		}
+
+		volume->groupFreeExtents = (GroupFreeExtents *) EsHeapAllocate(superblock->groupCount * sizeof(GroupFreeExtents), true, K_FIXED);
+
+		if (!volume->groupFreeExtents) {
+			EsHeapFree(volume->groupDescriptorTable, 0, K_FIXED);
+			ESFS_CHECK_FATAL(false, "Could not allocate group free extent lists.");
+		}
+
+		if (replayedJournal) {
+			// The superblock is only written when the volume is unmounted, so recalculate the number of used blocks.
+
+			superblock->blocksUsed = 0;
+
+			for (uintptr_t i = 0; i < superblock->groupCount; i++) {
+				superblock->blocksUsed += volume->groupDescriptorTable[i].blocksUsed;
+			}
+		}
 	}
 
 	// Load the root directory.
@@ -1940,16 +3407,54 @@ static bool Mount(Volume *volume, EsFileOffsetDifference *rootDirectoryChildren)
 
 		failure:;
 		if (node) EsHeapFree(node, sizeof(FSNode), K_FIXED);
+		EsHeapFree(volume->groupFreeExtents, 0, K_FIXED);
+		EsHeapFree(volume->groupDescriptorTable, 0, K_FIXED);
 		return false;
 	}
 
 	success:;
+
+	if (superblock->journalBlockCount && !volume->readOnly) {
+		// Start committing metadata writes through the journal.
+
+		volume->journal.enabled = true;
+
+		if (!KThreadCreate("EsFSJournal", JournalThread, (uintptr_t) volume)) {
+			KernelLog(LOG_ERROR, "EsFS", "journal disabled", "Mount - Could not create journal thread.\n");
+			volume->journal.enabled = false;
+		}
+	}
+
 	return true;
 }
 
 static void Unmount(KFileSystem *fileSystem) {
 	Volume *volume = (Volume *) fileSystem;
 	Superblock *superblock = &volume->superblock;
+	Journal *journal = &volume->journal;
+
+	if (journal->enabled) {
+		// Stop the commit thread, commit the last transaction, and then empty the journal.
+
+		journal->stopping = true;
+		KEventSet(&journal->wake, true);
+		KEventWait(&journal->stopped);
+
+		JournalCommit(volume);
+		journal->enabled = false;
+
+		KMutexAcquire(&journal->writeMutex);
+		JournalClear(volume);
+		KMutexRelease(&journal->writeMutex);
+
+		// If the last transaction could not be written, its freed extents are not released; the bitmap on the drive still has them in use.
+		JournalFreeBlocks(&journal->running);
+		JournalFreeBlocks(&journal->committing);
+		journal->runningFreed.Free();
+		journal->committingFreed.Free();
+		journal->live.Free();
+		superblock->journalSequence = journal->sequence;
+	}
 
 	if (!volume->readOnly) {
 		AccessBlock(volume, superblock->gdtFirstBlock, (superblock->groupCount * sizeof(GroupDescriptor) + superblock->blockSize - 1) / superblock->blockSize, 
@@ -1962,6 +3467,11 @@ static void Unmount(KFileSystem *fileSystem) {
 				(uint8_t *) superblock, ES_FLAGS_DEFAULT);
 	}
 
+	for (uintptr_t i = 0; i < superblock->groupCount; i++) {
+		UnloadFreeExtents(volume->groupFreeExtents + i);
+	}
+
+	EsHeapFree(volume->groupFreeExtents, 0, K_FIXED);
 	EsHeapFree(volume->groupDescriptorTable, 0, K_FIXED);
 }
 
@@ -1999,6 +3509,7 @@ static void Register(KDevice *_parent) {
 		volume->create = Create;
 		volume->remove = Remove;
 		volume->move = Move;
+		volume->defragment = Defragment;
 	}
 
 	volume->superblock.volumeName[ESFS_MAXIMUM_VOLUME_NAME_LENGTH - 1] = 0;
@@ -21,12 +21,13 @@ struct CCCachedSection {
 
 struct CCActiveSection {
 	KEvent loadCompleteEvent, writeCompleteEvent; 
-	LinkedItem<CCActiveSection> listItem; // Either in the LRU list, or the modified list. If accessors > 0, it should not be in a list.
+	LinkedItem<CCActiveSection> listItem; // Either in the LRU list, or the modified list of its shard. If accessors > 0, it should not be in a list.
+	struct CCActiveSectionShard *shard; // The shard owning this section. Its mutex protects everything here, except as noted for accessors.
 
 	EsFileOffset offset;
 	struct CCSpace *cache;
 
-	size_t accessors;
+	volatile size_t accessors; // Only modified atomically. May be incremented without the shard's mutex if already non-zero; see CCActiveSectionTryReference.
 	volatile bool loading, writing, modified, flush;
 
 	uint16_t referencedPageCount; 
@@ -40,15 +41,40 @@ struct CCActiveSectionReference {
 	uintptr_t index; // Index of the active section.
 };
 
+// The active sections are split between several shards, each with their own lists and mutex,
+// so that accesses to unrelated files do not contend on a single lock.
+
+struct CCActiveSectionShard {
+	KMutex mutex;
+	LinkedList<CCActiveSection> lruList;
+	LinkedList<CCActiveSection> modifiedList;
+};
+
+// A request to load an active section on one of the loader threads.
+
+struct CCLoadRequest {
+	LinkedItem<CCLoadRequest> item;
+	CCSpace *cache;
+	EsFileOffset offset, count;
+	KWorkGroup *group;
+	volatile bool inUse;
+};
+
 struct MMActiveSectionManager {
 	CCActiveSection *sections;
 	size_t sectionCount;
 	uint8_t *baseAddress;
-	KMutex mutex;
-	LinkedList<CCActiveSection> lruList;
-	LinkedList<CCActiveSection> modifiedList;
+	CCActiveSectionShard shards[CC_ACTIVE_SECTION_SHARDS];
+
+	KMutex modifiedMutex; // Protects modifiedCount and the modified events. Acquired after a shard's mutex.
+	size_t modifiedCount; // The total number of sections on the shards' modified lists.
 	KEvent modifiedNonEmpty, modifiedNonFull, modifiedGettingFull;
+	volatile uintptr_t writeBehindShard; // The next shard to take a section from for write behind. Only modified atomically.
 	Thread *writeBackThread;
+
+	KMutex loadMutex;
+	LinkedList<CCLoadRequest> loadQueue;
+	KEvent loadQueueNonEmpty;
 };
 
 // The callbacks for a CCSpace.
@@ -75,6 +101,7 @@ void CCSpaceUncover(CCSpace *cache, EsFileOffset removeStart, EsFileOffset remov
 #define CC_ACCESS_WRITE_BACK         (1 << 3) // Wait for the write to complete before returning.
 #define CC_ACCESS_PRECISE            (1 << 4) // Do not write back bytes not touched by this write. (Usually modified tracking is to page granularity.) Requires WRITE_BACK.
 #define CC_ACCESS_USER_BUFFER_MAPPED (1 << 5) // Set if the user buffer is memory-mapped to mirror this or another cache.
+#define CC_ACCESS_LOAD_AHEAD         (1 << 6) // Load the following active sections concurrently on the loader threads. Only used for file caches.
 
 EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *buffer, EsFileOffset offset, EsFileOffset count, uint32_t flags, 
 		MMSpace *mapSpace = nullptr, unsigned mapFlags = ES_FLAGS_DEFAULT);
@@ -240,20 +267,101 @@ void CCSpaceUncover(CCSpace *cache, EsFileOffset removeStart, EsFileOffset remov
 	}
 }
 
+uintptr_t CCActiveSectionPreferredShard(CCSpace *cache, EsFileOffset sectionOffset) {
+	// Spread the sections of each file between the shards, so that neither a single large file,
+	// nor many small files, end up on the same shard.
+	uint64_t hash = ((uint64_t) (uintptr_t) cache >> 4) ^ (sectionOffset / CC_ACTIVE_SECTION_SIZE);
+	hash *= 0x9E3779B97F4A7C15;
+	return (hash >> 32) % CC_ACTIVE_SECTION_SHARDS;
+}
+
+bool CCActiveSectionTryReference(CCActiveSection *section) {
+	// Increment the accessors count without acquiring the shard's mutex, if it is already non-zero.
+	// A section with accessors is not in a list and cannot be reused, so the caller only needs to check
+	// afterwards that the section still covers the region it wanted.
+
+	while (true) {
+		size_t accessors = section->accessors;
+
+		if (!accessors) {
+			return false;
+		}
+
+		if (__sync_bool_compare_and_swap(&section->accessors, accessors, accessors + 1)) {
+			return true;
+		}
+	}
+}
+
+bool CCActiveSectionReleaseAccessor(CCActiveSection *section) {
+	// Decrement the accessors count. Returns true if this was the last accessor.
+	// Since accessors can only be incremented without the mutex if it is non-zero, 
+	// once this reaches zero it stays at zero until the mutex is released.
+
+	KMutexAssertLocked(&section->shard->mutex);
+
+	while (true) {
+		size_t accessors = section->accessors;
+
+		if (!accessors) {
+			KernelPanic("CCActiveSectionReleaseAccessor - Active section %x has no accessors.\n", section);
+		}
+
+		if (__sync_bool_compare_and_swap(&section->accessors, accessors, accessors - 1)) {
+			return accessors == 1;
+		}
+	}
+}
+
+void CCActiveSectionInsertModified(CCActiveSection *section) {
+	KMutexAssertLocked(&section->shard->mutex);
+	KMutexAcquire(&activeSectionManager.modifiedMutex);
+
+	if (activeSectionManager.modifiedCount == CC_MAX_MODIFIED) {
+		KEventReset(&activeSectionManager.modifiedNonFull);
+	}
+
+	if (activeSectionManager.modifiedCount >= CC_MODIFIED_GETTING_FULL) {
+		KEventSet(&activeSectionManager.modifiedGettingFull, true);
+	}
+
+	KEventSet(&activeSectionManager.modifiedNonEmpty, true);
+
+	activeSectionManager.modifiedCount++;
+	section->shard->modifiedList.InsertEnd(&section->listItem);
+
+	KMutexRelease(&activeSectionManager.modifiedMutex);
+}
+
+void CCActiveSectionRemoveFromLists(CCActiveSection *section) {
+	CCActiveSectionShard *shard = section->shard;
+	KMutexAssertLocked(&shard->mutex);
+
+	if (section->listItem.list == &shard->modifiedList) {
+		KMutexAcquire(&activeSectionManager.modifiedMutex);
+		shard->modifiedList.Remove(&section->listItem);
+		activeSectionManager.modifiedCount--;
+		if (!activeSectionManager.modifiedCount) KEventReset(&activeSectionManager.modifiedNonEmpty);
+		if (activeSectionManager.modifiedCount < CC_MODIFIED_GETTING_FULL) KEventReset(&activeSectionManager.modifiedGettingFull);
+		KEventSet(&activeSectionManager.modifiedNonFull, true);
+		KMutexRelease(&activeSectionManager.modifiedMutex);
+	} else if (section->listItem.list) {
+		section->listItem.RemoveFromList();
+	}
+}
+
 void CCWriteSectionPrepare(CCActiveSection *section) {
-	KMutexAssertLocked(&activeSectionManager.mutex);
+	KMutexAssertLocked(&section->shard->mutex);
 	if (!section->modified) KernelPanic("CCWriteSectionPrepare - Unmodified section %x on modified list.\n", section);
 	if (section->accessors) KernelPanic("CCWriteSectionPrepare - Section %x with accessors on modified list.\n", section);
 	if (section->writing) KernelPanic("CCWriteSectionPrepare - Section %x already being written.\n", section);
-	activeSectionManager.modifiedList.Remove(&section->listItem);
+	if (section->listItem.list != &section->shard->modifiedList) KernelPanic("CCWriteSectionPrepare - Section %x not on modified list.\n", section);
+	CCActiveSectionRemoveFromLists(section);
 	section->writing = true;
 	section->modified = false;
 	section->flush = false;
 	KEventReset(&section->writeCompleteEvent);
 	section->accessors = 1;
-	if (!activeSectionManager.modifiedList.count) KEventReset(&activeSectionManager.modifiedNonEmpty);
-	if (activeSectionManager.modifiedList.count < CC_MODIFIED_GETTING_FULL) KEventReset(&activeSectionManager.modifiedGettingFull);
-	KEventSet(&activeSectionManager.modifiedNonFull, true);
 }
 
 void CCWriteSection(CCActiveSection *section) {
@@ -282,24 +390,24 @@ void CCWriteSection(CCActiveSection *section) {
 
 	// Return the active section.
 
-	KMutexAcquire(&activeSectionManager.mutex);
+	KMutexAcquire(&section->shard->mutex);
 
 	if (!section->accessors) KernelPanic("CCWriteSection - Section %x has no accessors while being written.\n", section);
 	if (section->modified) KernelPanic("CCWriteSection - Section %x was modified while being written.\n", section);
 
-	section->accessors--;
+	bool lastAccessor = CCActiveSectionReleaseAccessor(section);
 	section->writing = false;
 	EsMemoryZero(section->modifiedPages, sizeof(section->modifiedPages));
 	__sync_synchronize();
 	KEventSet(&section->writeCompleteEvent);
 	KEventSet(&section->cache->writeComplete, true);
 
-	if (!section->accessors) {
+	if (lastAccessor) {
 		if (section->loading) KernelPanic("CCSpaceAccess - Active section %x with no accessors is loading.", section);
-		activeSectionManager.lruList.InsertEnd(&section->listItem);
+		section->shard->lruList.InsertEnd(&section->listItem);
 	}
 
-	KMutexRelease(&activeSectionManager.mutex);
+	KMutexRelease(&section->shard->mutex);
 }
 
 void CCSpaceFlush(CCSpace *cache) {
@@ -307,10 +415,10 @@ void CCSpaceFlush(CCSpace *cache) {
 		bool complete = true;
 
 		KMutexAcquire(&cache->activeSectionsMutex);
-		KMutexAcquire(&activeSectionManager.mutex);
 
 		for (uintptr_t i = 0; i < cache->activeSections.Length(); i++) {
 			CCActiveSection *section = activeSectionManager.sections + cache->activeSections[i].index;
+			KMutexAcquire(&section->shard->mutex);
 
 			if (section->cache == cache && section->offset == cache->activeSections[i].offset) {
 				if (section->writing) {
@@ -325,18 +433,18 @@ void CCSpaceFlush(CCSpace *cache) {
 						// Nobody is accessing the section; we can write it ourselves.
 						complete = false;
 						CCWriteSectionPrepare(section);
-						KMutexRelease(&activeSectionManager.mutex);
+						KMutexRelease(&section->shard->mutex);
 						KMutexRelease(&cache->activeSectionsMutex);
 						CCWriteSection(section);
 						KMutexAcquire(&cache->activeSectionsMutex);
-						KMutexAcquire(&activeSectionManager.mutex);
+						continue;
 					}
 				}
 			}
 
+			KMutexRelease(&section->shard->mutex);
 		}
 
-		KMutexRelease(&activeSectionManager.mutex);
 		KMutexRelease(&cache->activeSectionsMutex);
 
 		if (!complete) {
@@ -363,42 +471,33 @@ void CCActiveSectionReturnToLists(CCActiveSection *section, bool writeBack) {
 
 		// Decrement the accessors count.
 
-		KMutexAcquire(&activeSectionManager.mutex);
-		EsDefer(KMutexRelease(&activeSectionManager.mutex));
+		KMutexAcquire(&section->shard->mutex);
+		EsDefer(KMutexRelease(&section->shard->mutex));
 
 		if (!section->accessors) KernelPanic("CCSpaceAccess - Active section %x has no accessors.\n", section);
 
-		if (section->accessors == 1) {
+		if (section->accessors == 1 && section->modified && activeSectionManager.modifiedCount > CC_MAX_MODIFIED) {
+			waitNonFull = true;
+			continue;
+		}
+
+		if (CCActiveSectionReleaseAccessor(section)) {
 			if (section->loading) KernelPanic("CCSpaceAccess - Active section %x with no accessors is loading.", section);
 
 			// If nobody is accessing the section, put it at the end of the LRU list.
 
 			if (section->modified) {
-				if (activeSectionManager.modifiedList.count > CC_MAX_MODIFIED) {
-					waitNonFull = true;
-					continue;
-				}
-
-				if (activeSectionManager.modifiedList.count == CC_MAX_MODIFIED) {
-					KEventReset(&activeSectionManager.modifiedNonFull);
-				}
-
-				if (activeSectionManager.modifiedList.count >= CC_MODIFIED_GETTING_FULL) {
-					KEventSet(&activeSectionManager.modifiedGettingFull, true);
-				}
-
-				KEventSet(&activeSectionManager.modifiedNonEmpty, true);
-
-				activeSectionManager.modifiedList.InsertEnd(&section->listItem);
+				CCActiveSectionInsertModified(section);
 			} else {
-				activeSectionManager.lruList.InsertEnd(&section->listItem);
+				section->shard->lruList.InsertEnd(&section->listItem);
 			}
-		}
-
-		section->accessors--;
 
-		if (writeBack && !section->accessors && section->modified) {
-			CCWriteSectionPrepare(section);
+			if ((writeBack || section->flush) && section->modified) {
+				CCWriteSectionPrepare(section);
+				writeBack = true;
+			} else {
+				writeBack = false;
+			}
 		} else {
 			writeBack = false;
 		}
@@ -423,12 +522,13 @@ void CCSpaceTruncate(CCSpace *cache, EsFileOffset newSize) {
 		CCActiveSection *section = nullptr;
 
 		KMutexAcquire(&cache->activeSectionsMutex);
-		KMutexAcquire(&activeSectionManager.mutex);
 
 		if (cache->activeSections.Length()) {
 			// Get the last active section.
 			CCActiveSectionReference reference = cache->activeSections.Last();
 			section = activeSectionManager.sections + reference.index;
+			CCActiveSectionShard *shard = section->shard;
+			KMutexAcquire(&shard->mutex);
 
 			if (section->cache != cache || section->offset != reference.offset) {
 				// Remove invalid section.
@@ -452,7 +552,7 @@ void CCSpaceTruncate(CCSpace *cache, EsFileOffset newSize) {
 
 						waitForWritingToComplete = true;
 					} else {
-						section->listItem.RemoveFromList();
+						CCActiveSectionRemoveFromLists(section);
 					}
 
 					if (section->loading) {
@@ -461,7 +561,7 @@ void CCSpaceTruncate(CCSpace *cache, EsFileOffset newSize) {
 								section, cache);
 					}
 
-					section->accessors++;
+					__sync_fetch_and_add(&section->accessors, 1);
 
 					if (section->offset >= newSize) {
 						cache->activeSections.SetLength(cache->activeSections.Length() - 1);
@@ -469,11 +569,12 @@ void CCSpaceTruncate(CCSpace *cache, EsFileOffset newSize) {
 				}
 
 			}
+
+			KMutexRelease(&shard->mutex);
 		} else {
 			doneActiveSections = true;
 		}
 
-		KMutexRelease(&activeSectionManager.mutex);
 		KMutexRelease(&cache->activeSectionsMutex);
 
 		if (section) {
@@ -486,18 +587,25 @@ void CCSpaceTruncate(CCSpace *cache, EsFileOffset newSize) {
 				KMutexAcquire(&cache->cachedSectionsMutex);
 				CCSpaceUncover(cache, section->offset, section->offset + CC_ACTIVE_SECTION_SIZE);
 				KMutexRelease(&cache->cachedSectionsMutex);
-				KMutexAcquire(&activeSectionManager.mutex);
+				KMutexAcquire(&section->shard->mutex);
 				CCDereferenceActiveSection(section);
 				section->cache = nullptr;
-				section->accessors = 0;
 				section->modified = false; // Don't try to write this section back!
-				activeSectionManager.lruList.InsertStart(&section->listItem);
-				KMutexRelease(&activeSectionManager.mutex);
+				section->flush = false;
+
+				// Someone with a stale reference to the section may have incremented the accessors count.
+				// If so, they will put it back in the LRU list when they notice its identity changed.
+
+				if (CCActiveSectionReleaseAccessor(section)) {
+					section->shard->lruList.InsertStart(&section->listItem);
+				}
+
+				KMutexRelease(&section->shard->mutex);
 			} else {
 				// Remove part of the active section containing the truncation point.
-				KMutexAcquire(&activeSectionManager.mutex);
+				KMutexAcquire(&section->shard->mutex);
 				CCDereferenceActiveSection(section, newSizePages - section->offset / K_PAGE_SIZE);
-				KMutexRelease(&activeSectionManager.mutex);
+				KMutexRelease(&section->shard->mutex);
 				CCActiveSectionReturnToLists(section, false);
 				break;
 			}
@@ -573,24 +681,23 @@ void CCSpaceDestroy(CCSpace *cache) {
 	CCSpaceFlush(cache);
 
 	for (uintptr_t i = 0; i < cache->activeSections.Length(); i++) {
-		KMutexAcquire(&activeSectionManager.mutex);
-
 		CCActiveSection *section = activeSectionManager.sections + cache->activeSections[i].index;
+		KMutexAcquire(&section->shard->mutex);
 
 		if (section->cache == cache && section->offset == cache->activeSections[i].offset) {
 			CCDereferenceActiveSection(section);
 			section->cache = nullptr;
 
-			if (section->accessors || section->modified || section->listItem.list != &activeSectionManager.lruList) {
+			if (section->accessors || section->modified || section->listItem.list != &section->shard->lruList) {
 				KernelPanic("CCSpaceDestroy - Section %x has invalid state to destroy cache space %x.\n",
 						section, cache);
 			}
 
 			section->listItem.RemoveFromList();
-			activeSectionManager.lruList.InsertStart(&section->listItem);
+			section->shard->lruList.InsertStart(&section->listItem);
 		}
 
-		KMutexRelease(&activeSectionManager.mutex);
+		KMutexRelease(&section->shard->mutex);
 	}
 
 	for (uintptr_t i = 0; i < cache->cachedSections.Length(); i++) {
@@ -625,7 +732,7 @@ bool CCSpaceInitialise(CCSpace *cache) {
 }
 
 void CCDereferenceActiveSection(CCActiveSection *section, uintptr_t startingPage) {
-	KMutexAssertLocked(&activeSectionManager.mutex);
+	KMutexAssertLocked(&section->shard->mutex);
 
 	if (!startingPage) {
 		MMArchUnmapPages(kernelMMSpace, 
@@ -651,10 +758,35 @@ void CCDereferenceActiveSection(CCActiveSection *section, uintptr_t startingPage
 	}
 }
 
+void CCSpaceLoadAhead(CCSpace *cache, CCLoadRequest *requests, KWorkGroup *group, 
+		EsFileOffset *nextOffset, EsFileOffset currentSection, EsFileOffset end) {
+	// Queue the active sections after the current one to be loaded on the loader threads,
+	// so that several reads to the backing store can be in progress at the same time.
+
+	for (uintptr_t i = 0; i < CC_CONCURRENT_SECTION_LOADS; i++) {
+		if (*nextOffset <= currentSection) *nextOffset = currentSection + CC_ACTIVE_SECTION_SIZE;
+		if (*nextOffset >= end || *nextOffset > currentSection + CC_CONCURRENT_SECTION_LOADS * CC_ACTIVE_SECTION_SIZE) break;
+		if (requests[i].inUse) continue;
+
+		CCLoadRequest *request = requests + i;
+		request->item.thisItem = request;
+		request->cache = cache;
+		request->offset = *nextOffset;
+		request->count = end - *nextOffset > CC_ACTIVE_SECTION_SIZE ? CC_ACTIVE_SECTION_SIZE : end - *nextOffset;
+		request->group = group;
+		request->inUse = true;
+		*nextOffset += CC_ACTIVE_SECTION_SIZE;
+
+		group->Start();
+		KMutexAcquire(&activeSectionManager.loadMutex);
+		activeSectionManager.loadQueue.InsertEnd(&request->item);
+		KEventSet(&activeSectionManager.loadQueueNonEmpty, true);
+		KMutexRelease(&activeSectionManager.loadMutex);
+	}
+}
+
 EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset offset, EsFileOffset count, uint32_t flags, 
 		MMSpace *mapSpace, unsigned mapFlags) {
-	// TODO Reading in multiple active sections at the same time - will this give better performance on AHCI/NVMe?
-	// 	- Each active section needs to be separately committed.
 	// TODO Read-ahead.
 
 	// Commit CC_ACTIVE_SECTION_SIZE bytes, since we require an active section to be active at a time.
@@ -675,7 +807,24 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 	bool writeBack = (flags & CC_ACCESS_WRITE_BACK) && (~flags & CC_ACCESS_PRECISE);
 	bool preciseWriteBack = (flags & CC_ACCESS_WRITE_BACK) && (flags & CC_ACCESS_PRECISE);
 
+	// If reading more than one active section, load the following sections concurrently.
+	// We must wait for the loads to complete before returning, since the requests are on our stack,
+	// and the caller is responsible for keeping the cache space alive.
+	// A loader thread must never queue requests itself, since it would then wait on the pool it belongs to.
+
+	CCLoadRequest loadRequests[CC_CONCURRENT_SECTION_LOADS] = {};
+	KWorkGroup loadGroup = {};
+	EsFileOffset nextLoadOffset = firstSection;
+	bool loadAhead = (flags & CC_ACCESS_READ) && (flags & CC_ACCESS_LOAD_AHEAD) && !GetCurrentThread()->isCacheLoader
+		&& lastSection - firstSection > CC_ACTIVE_SECTION_SIZE;
+	if (loadAhead) loadGroup.Initialise();
+	EsDefer(if (loadAhead) loadGroup.Wait());
+
 	for (EsFileOffset sectionOffset = firstSection; sectionOffset < lastSection; sectionOffset += CC_ACTIVE_SECTION_SIZE) {
+		if (loadAhead) {
+			CCSpaceLoadAhead(cache, loadRequests, &loadGroup, &nextLoadOffset, sectionOffset, offset + count);
+		}
+
 		if (MM_AVAILABLE_PAGES() < MM_CRITICAL_AVAILABLE_PAGES_THRESHOLD && !GetCurrentThread()->isPageGenerator) {
 			KernelLog(LOG_ERROR, "Memory", "waiting for non-critical state", "File cache read on non-generator thread, waiting for more available pages.\n");
 			KEventWait(&pmm.availableNotCritical);
@@ -727,32 +876,68 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 			guessedActiveSectionIndex = index + 1;
 		}
 
-		KMutexAcquire(&activeSectionManager.mutex);
-
-		CCActiveSection *section;
+		CCActiveSection *section = nullptr, *staleSection = nullptr;
 
 		// Replace active section in list if it has been used for something else.
 
 		bool replace = false;
 
 		if (found) {
-			CCActiveSection *section = activeSectionManager.sections + cache->activeSections[index].index;
+			section = activeSectionManager.sections + cache->activeSections[index].index;
+
+			if (CCActiveSectionTryReference(section)) {
+				// Someone else is already accessing the section, so we didn't need to acquire the shard's mutex.
+
+				if (section->cache != cache || section->offset != sectionOffset) {
+					// Returning the section may wait for the modified list to drain, so do it after releasing activeSectionsMutex.
+					staleSection = section;
+					replace = true, found = false;
+				}
+			} else {
+				KMutexAcquire(&section->shard->mutex);
 
-			if (section->cache != cache || section->offset != sectionOffset) {
-				replace = true, found = false;
+				if (section->cache != cache || section->offset != sectionOffset) {
+					replace = true, found = false;
+				} else {
+					// Remove the active section from the LRU/modified list, if present, 
+					// and increment the accessors count.
+					// Don't bother keeping track of its place in the modified list.
+
+					if (!section->accessors) {
+						if (section->writing) KernelPanic("CCSpaceAccess - Active section %x in list is being written.\n", section);
+						CCActiveSectionRemoveFromLists(section);
+					} else if (section->listItem.list) {
+						KernelPanic("CCSpaceAccess - Active section %x in list had accessors (2).\n", section);
+					}
+
+					__sync_fetch_and_add(&section->accessors, 1);
+				}
+
+				KMutexRelease(&section->shard->mutex);
 			}
 		}
 
 		if (!found) {
-			// Allocate a new active section.
+			// Allocate a new active section, preferring the shard this part of the file hashes to.
+
+			CCActiveSectionShard *shard = nullptr;
+			uintptr_t preferredShard = CCActiveSectionPreferredShard(cache, sectionOffset);
 
-			if (!activeSectionManager.lruList.count) {
-				KMutexRelease(&activeSectionManager.mutex);
+			for (uintptr_t i = 0; i < CC_ACTIVE_SECTION_SHARDS; i++) {
+				shard = activeSectionManager.shards + (preferredShard + i) % CC_ACTIVE_SECTION_SHARDS;
+				KMutexAcquire(&shard->mutex);
+				if (shard->lruList.count) break;
+				KMutexRelease(&shard->mutex);
+				shard = nullptr;
+			}
+
+			if (!shard) {
 				KMutexRelease(&cache->activeSectionsMutex);
+				if (staleSection) CCActiveSectionReturnToLists(staleSection, false);
 				return ES_ERROR_INSUFFICIENT_RESOURCES;
 			}
 
-			section = activeSectionManager.lruList.firstItem->thisItem;
+			section = shard->lruList.firstItem->thisItem;
 
 			// Add it to the file cache's list of active sections.
 
@@ -762,7 +947,7 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 				cache->activeSections[index] = reference;
 			} else {
 				if (!cache->activeSections.Insert(reference, index)) {
-					KMutexRelease(&activeSectionManager.mutex);
+					KMutexRelease(&shard->mutex);
 					KMutexRelease(&cache->activeSectionsMutex);
 					return ES_ERROR_INSUFFICIENT_RESOURCES;
 				}
@@ -794,8 +979,9 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 			if (!CCSpaceCover(cache, sectionOffset, sectionOffset + CC_ACTIVE_SECTION_SIZE)) {
 				KMutexRelease(&cache->cachedSectionsMutex);
 				cache->activeSections.Delete(index);
-				KMutexRelease(&activeSectionManager.mutex);
+				KMutexRelease(&shard->mutex);
 				KMutexRelease(&cache->activeSectionsMutex);
+				if (staleSection) CCActiveSectionReturnToLists(staleSection, false);
 				return ES_ERROR_INSUFFICIENT_RESOURCES;
 			}
 
@@ -803,16 +989,18 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 
 			// Remove it from the LRU list.
 
-			activeSectionManager.lruList.Remove(activeSectionManager.lruList.firstItem);
+			shard->lruList.Remove(shard->lruList.firstItem);
 
 			// Setup the section.
+			// Its new identity must be visible before the accessors count becomes non-zero, for CCActiveSectionTryReference.
 
 			if (section->accessors) KernelPanic("CCSpaceAccess - Active section %x in the LRU list had accessors.\n", section);
 			if (section->loading) KernelPanic("CCSpaceAccess - Active section %x in the LRU list was loading.\n", section);
 
-			section->accessors = 1;
 			section->offset = sectionOffset;
 			section->cache = cache;
+			__sync_synchronize();
+			section->accessors = 1;
 
 #if 0
 			{
@@ -828,26 +1016,16 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 				}
 			}
 #endif
-		} else {
-			// Remove the active section from the LRU/modified list, if present, 
-			// and increment the accessors count.
-			// Don't bother keeping track of its place in the modified list.
-
-			section = activeSectionManager.sections + cache->activeSections[index].index;
 
-			if (!section->accessors) {
-				if (section->writing) KernelPanic("CCSpaceAccess - Active section %x in list is being written.\n", section);
-				section->listItem.RemoveFromList();
-			} else if (section->listItem.list) {
-				KernelPanic("CCSpaceAccess - Active section %x in list had accessors (2).\n", section);
-			}
-
-			section->accessors++;
+			KMutexRelease(&shard->mutex);
 		}
 
-		KMutexRelease(&activeSectionManager.mutex);
 		KMutexRelease(&cache->activeSectionsMutex);
 
+		if (staleSection) {
+			CCActiveSectionReturnToLists(staleSection, false);
+		}
+
 		if ((flags & CC_ACCESS_WRITE) && section->writing) {
 			// If writing, wait for any in progress write-behinds to complete.
 			// Note that, once this event is set, a new write can't be started until accessors is 0.
@@ -1175,14 +1353,21 @@ EsError CCSpaceAccess(CCSpace *cache, K_USER_BUFFER void *_buffer, EsFileOffset
 
 bool CCWriteBehindSection() {
 	CCActiveSection *section = nullptr;
-	KMutexAcquire(&activeSectionManager.mutex);
 
-	if (activeSectionManager.modifiedList.count) {
-		section = activeSectionManager.modifiedList.firstItem->thisItem;
-		CCWriteSectionPrepare(section);
-	}
+	// Take turns between the shards, so that each one's modified list is written back at a similar rate.
+
+	for (uintptr_t i = 0; i < CC_ACTIVE_SECTION_SHARDS && !section; i++) {
+		uintptr_t shardIndex = __sync_fetch_and_add(&activeSectionManager.writeBehindShard, 1) % CC_ACTIVE_SECTION_SHARDS;
+		CCActiveSectionShard *shard = activeSectionManager.shards + shardIndex;
+		KMutexAcquire(&shard->mutex);
 
-	KMutexRelease(&activeSectionManager.mutex);
+		if (shard->modifiedList.count) {
+			section = shard->modifiedList.firstItem->thisItem;
+			CCWriteSectionPrepare(section);
+		}
+
+		KMutexRelease(&shard->mutex);
+	}
 
 	if (section) {
 		CCWriteSection(section);
@@ -1224,15 +1409,49 @@ void CCWriteBehindThread() {
 
 		// Write back 1/CC_WRITE_BACK_DIVISORth of the modified list.
 		lastWriteMs = scheduler.timeMs;
-		KMutexAcquire(&activeSectionManager.mutex);
-		uintptr_t writeCount = (activeSectionManager.modifiedList.count + CC_WRITE_BACK_DIVISOR - 1) / CC_WRITE_BACK_DIVISOR;
-		KMutexRelease(&activeSectionManager.mutex);
+		KMutexAcquire(&activeSectionManager.modifiedMutex);
+		uintptr_t writeCount = (activeSectionManager.modifiedCount + CC_WRITE_BACK_DIVISOR - 1) / CC_WRITE_BACK_DIVISOR;
+		KMutexRelease(&activeSectionManager.modifiedMutex);
 		while (writeCount && CCWriteBehindSection()) writeCount--;
 		lastWriteMs = scheduler.timeMs - lastWriteMs;
 #endif
 	}
 }
 
+void CCLoaderThread() {
+	while (true) {
+		KEventWait(&activeSectionManager.loadQueueNonEmpty);
+
+		KMutexAcquire(&activeSectionManager.loadMutex);
+		CCLoadRequest *request = nullptr;
+
+		if (activeSectionManager.loadQueue.count) {
+			request = activeSectionManager.loadQueue.firstItem->thisItem;
+			activeSectionManager.loadQueue.Remove(&request->item);
+		}
+
+		if (!activeSectionManager.loadQueue.count) {
+			KEventReset(&activeSectionManager.loadQueueNonEmpty);
+		}
+
+		KMutexRelease(&activeSectionManager.loadMutex);
+
+		if (!request) {
+			continue;
+		}
+
+		// Passing no buffer loads the pages into the active section without copying them anywhere.
+		// Any errors are ignored; the thread that queued the request will encounter them itself when it accesses the section.
+		CCSpaceAccess(request->cache, nullptr, request->offset, request->count, CC_ACCESS_READ);
+
+		// The request is on the stack of the thread waiting for the work group, so don't touch it after it's been ended.
+		KWorkGroup *group = request->group;
+		__sync_synchronize();
+		request->inUse = false;
+		group->End(true);
+	}
+}
+
 void CCInitialise() {
 	activeSectionManager.sectionCount = CC_SECTION_BYTES / CC_ACTIVE_SECTION_SIZE;
 	activeSectionManager.sections = (CCActiveSection *) EsHeapAllocate(activeSectionManager.sectionCount * sizeof(CCActiveSection), true, K_FIXED);
@@ -1242,16 +1461,22 @@ void CCInitialise() {
 	KMutexRelease(&kernelMMSpace->reserveMutex);
 
 	for (uintptr_t i = 0; i < activeSectionManager.sectionCount; i++) {
+		CCActiveSectionShard *shard = activeSectionManager.shards + i * CC_ACTIVE_SECTION_SHARDS / activeSectionManager.sectionCount;
+		activeSectionManager.sections[i].shard = shard;
 		activeSectionManager.sections[i].listItem.thisItem = &activeSectionManager.sections[i];
-		activeSectionManager.lruList.InsertEnd(&activeSectionManager.sections[i].listItem);
+		shard->lruList.InsertEnd(&activeSectionManager.sections[i].listItem);
 	}
 
-	KernelLog(LOG_INFO, "Memory", "cache initialised", "MMInitialise - Active section manager initialised with a maximum of %d of entries.\n", 
-			activeSectionManager.sectionCount);
+	KernelLog(LOG_INFO, "Memory", "cache initialised", "MMInitialise - Active section manager initialised with a maximum of %d of entries in %d shards.\n", 
+			activeSectionManager.sectionCount, CC_ACTIVE_SECTION_SHARDS);
 
 	KEventSet(&activeSectionManager.modifiedNonFull);
 	activeSectionManager.writeBackThread = ThreadSpawn("CCWriteBehind", (uintptr_t) CCWriteBehindThread, 0, ES_FLAGS_DEFAULT);
 	activeSectionManager.writeBackThread->isPageGenerator = true;
+
+	for (uintptr_t i = 0; i < CC_CONCURRENT_SECTION_LOADS; i++) {
+		ThreadSpawn("CCLoader", (uintptr_t) CCLoaderThread, 0, ES_FLAGS_DEFAULT)->isCacheLoader = true;
+	}
 }
 
 #endif
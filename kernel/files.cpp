@@ -96,6 +96,10 @@ EsFileOffset FSNodeGetTotalSize(KNode *node) {
 	return node->directoryEntry->totalSize;
 }
 
+uint64_t FSNodeGetModificationTime(KNode *node) {
+	return node->directoryEntry->modificationTime;
+}
+
 char *FSNodeGetName(KNode *node, size_t *bytes) {
 	KWriterLockAssertLocked(&node->writerLock);
 	*bytes = node->directoryEntry->item.key.longKeyBytes;
@@ -190,7 +194,7 @@ EsError FSFileCreateAndResizeOnFileSystem(FSFile *node, EsFileOffset fileSize) {
 
 		if (error == ES_SUCCESS) {
 			error = node->fileSystem->create((const char *) entry->item.key.longKey, entry->item.key.longKeyBytes, 
-					ES_NODE_FILE, entry->parent, node, entry + 1);
+					ES_NODE_FILE, entry->parent, node, entry, entry + 1);
 		}
 
 		if (error == ES_SUCCESS) {
@@ -283,7 +287,7 @@ ptrdiff_t FSFileReadSync(KNode *node, K_USER_BUFFER void *buffer, EsFileOffset o
 	if (!bytes) return 0;
 
 	EsError error = CCSpaceAccess(&file->cache, buffer, offset, bytes, 
-			CC_ACCESS_READ | ((accessFlags & FS_FILE_ACCESS_USER_BUFFER_MAPPED) ? CC_ACCESS_USER_BUFFER_MAPPED : 0));
+			CC_ACCESS_READ | CC_ACCESS_LOAD_AHEAD | ((accessFlags & FS_FILE_ACCESS_USER_BUFFER_MAPPED) ? CC_ACCESS_USER_BUFFER_MAPPED : 0));
 	return error == ES_SUCCESS ? bytes : error;
 }
 
@@ -316,6 +320,7 @@ void _FSFileResize(FSFile *file, EsFileOffset newSize) {
 
 	// We'll get the filesystem to resize the file during write-back.
 	file->directoryEntry->totalSize = newSize;
+	file->directoryEntry->modificationTime = KGetUnixTimeInUs();
 
 	KNode *ancestor = file->directoryEntry->parent;
 
@@ -377,40 +382,118 @@ ptrdiff_t FSFileWriteSync(KNode *node, K_USER_BUFFER const void *buffer, EsFileO
 
 	EsError error = CCSpaceAccess(&file->cache, (void *) buffer, offset, bytes, 
 			CC_ACCESS_WRITE | ((flags & FS_FILE_ACCESS_USER_BUFFER_MAPPED) ? CC_ACCESS_USER_BUFFER_MAPPED : 0));
+	file->directoryEntry->modificationTime = KGetUnixTimeInUs();
 	__sync_fetch_and_or(&file->flags, NODE_MODIFIED);
 	return error == ES_SUCCESS ? bytes : error;
 }
 
+ptrdiff_t FSFileCopyRange(KNode *destination, EsFileOffset destinationOffset, KNode *source, EsFileOffset sourceOffset, EsFileOffset bytes) {
+	// The data moves directly between the two files' caches, without passing through user space or a bounce buffer.
+	// Each chunk of the source is mapped read-only into the kernel's address space, which maps its cache's pages as they are touched,
+	// and is written from there into the destination's cache. So the data is copied once, from one cache to the other.
+	// TODO Share the extents instead if both files are on the same volume, once a file system supports it.
+
+	if (fs.shutdown) KernelPanic("FSFileCopyRange - Attempting to copy between files after FSShutdown called.\n");
+
+	if (!destination->fileSystem->write) return ES_ERROR_FILE_ON_READ_ONLY_VOLUME;
+	if (sourceOffset > source->directoryEntry->totalSize) return ES_ERROR_ACCESS_NOT_WITHIN_FILE_BOUNDS;
+	if (bytes > source->directoryEntry->totalSize - sourceOffset) bytes = source->directoryEntry->totalSize - sourceOffset;
+	if (!bytes) return 0;
+
+	if (source == destination && sourceOffset < destinationOffset + bytes && destinationOffset < sourceOffset + bytes) {
+		return ES_ERROR_UNSUPPORTED; // The ranges overlap.
+	}
+
+	if (destinationOffset + bytes > destination->directoryEntry->totalSize) {
+		// Resize the destination up front, rather than once per chunk.
+		// This must happen before the source is mapped, since the mapping prevents the source being resized, and it could be the same file.
+		if (ES_SUCCESS != FSFileResize(destination, destinationOffset + bytes)) {
+			return ES_ERROR_COULD_NOT_RESIZE_FILE;
+		}
+	}
+
+	EsFileOffset copied = 0;
+
+	while (copied < bytes) {
+		EsFileOffset count = bytes - copied > CC_ACTIVE_SECTION_SIZE ? CC_ACTIVE_SECTION_SIZE : bytes - copied;
+		uint8_t *mapping = (uint8_t *) MMMapFile(kernelMMSpace, (FSFile *) source, sourceOffset + copied, count, ES_MEMORY_MAP_OBJECT_READ_ONLY, nullptr);
+
+		if (!mapping) {
+			if (sourceOffset + copied >= source->directoryEntry->totalSize) break; // The source was truncated.
+			return ES_ERROR_INSUFFICIENT_RESOURCES;
+		}
+
+		// The source cannot be resized while it is mapped.
+		if (count > source->directoryEntry->totalSize - sourceOffset - copied) count = source->directoryEntry->totalSize - sourceOffset - copied;
+
+		// The buffer mirrors the source's cache, so the destination's cache must not hold an active section loading while it reads from it.
+		ptrdiff_t written = FSFileWriteSync(destination, mapping, destinationOffset + copied, count, FS_FILE_ACCESS_USER_BUFFER_MAPPED);
+		MMFree(kernelMMSpace, (void *) ((uintptr_t) mapping & ~(K_PAGE_SIZE - 1)));
+
+		if (ES_CHECK_ERROR(written)) return written;
+		copied += written;
+		if ((EsFileOffset) written != count) break; // The destination was truncated.
+	}
+
+	return copied;
+}
+
 EsError FSFileControl(KNode *node, uint32_t flags) {
 	FSFile *file = (FSFile *) node;
 
-	if (flags & ES_FILE_CONTROL_FLUSH) {
+	if (flags & (ES_FILE_CONTROL_FLUSH | ES_FILE_CONTROL_DEFRAGMENT)) {
 		KWriterLockTake(&file->resizeLock, K_LOCK_EXCLUSIVE);
 		EsDefer(KWriterLockReturn(&file->resizeLock, K_LOCK_EXCLUSIVE));
 
 		CCSpaceFlush(&file->cache);
 
-		KWriterLockTake(&file->writerLock, K_LOCK_EXCLUSIVE);
-		EsDefer(KWriterLockReturn(&file->writerLock, K_LOCK_EXCLUSIVE));
+		{
+			KWriterLockTake(&file->writerLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&file->writerLock, K_LOCK_EXCLUSIVE));
+
+			__sync_fetch_and_and(&file->flags, ~NODE_MODIFIED);
+
+			EsError error = FSFileCreateAndResizeOnFileSystem(file, file->directoryEntry->totalSize);
+			if (error != ES_SUCCESS) return error;
+
+			if (file->fileSystem->sync) {
+				// TODO Should we also sync the parent?
+				FSDirectory *parent = file->directoryEntry->parent;
+
+				if (parent) KWriterLockTake(&parent->writerLock, K_LOCK_EXCLUSIVE);
+				file->fileSystem->sync(parent, file);
+				if (parent) KWriterLockReturn(&parent->writerLock, K_LOCK_EXCLUSIVE);
+			}
+
+			if (file->error != ES_SUCCESS) {
+				EsError error = file->error;
+				file->error = ES_SUCCESS;
+				return error;
+			}
+		}
 
-		__sync_fetch_and_and(&file->flags, ~NODE_MODIFIED);
+		if (flags & ES_FILE_CONTROL_DEFRAGMENT) {
+			if (!file->fileSystem->defragment) {
+				return ES_ERROR_UNSUPPORTED;
+			}
 
-		EsError error = FSFileCreateAndResizeOnFileSystem(file, file->directoryEntry->totalSize);
-		if (error != ES_SUCCESS) return error;
+			// Write back anything dirtied through a mapping since the first flush,
+			// and then hold the writer lock until the old extents have been freed.
+			// The cache takes the writer lock to read or write the file,
+			// so it cannot access the blocks while the file system relocates them.
+
+			CCSpaceFlush(&file->cache);
+
+			KWriterLockTake(&file->writerLock, K_LOCK_EXCLUSIVE);
+			EsDefer(KWriterLockReturn(&file->writerLock, K_LOCK_EXCLUSIVE));
 
-		if (file->fileSystem->sync) {
-			// TODO Should we also sync the parent?
 			FSDirectory *parent = file->directoryEntry->parent;
 
 			if (parent) KWriterLockTake(&parent->writerLock, K_LOCK_EXCLUSIVE);
-			file->fileSystem->sync(parent, file);
+			EsError error = file->fileSystem->defragment(file);
 			if (parent) KWriterLockReturn(&parent->writerLock, K_LOCK_EXCLUSIVE);
-		}
 
-		if (file->error != ES_SUCCESS) {
-			EsError error = file->error;
-			file->error = ES_SUCCESS;
-			return error;
+			if (error != ES_SUCCESS) return error;
 		}
 	}
 
@@ -799,6 +882,7 @@ EsError FSNodeCreate(FSDirectory *parent, const char *name, size_t nameBytes, Es
 
 	KNodeMetadata metadata = {};
 	metadata.type = type;
+	metadata.modificationTime = KGetUnixTimeInUs();
 
 	KNode *node;
 	EsError error = FSDirectoryEntryFound(parent, &metadata, nullptr, name, nameBytes, false, &node);
@@ -814,7 +898,7 @@ EsError FSNodeCreate(FSDirectory *parent, const char *name, size_t nameBytes, Es
 	// Only create directories immediately; files are created in FSWriteFromCache.
 
 	if (type != ES_NODE_FILE) {
-		error = fileSystem->create(name, nameBytes, type, parent, node, node->directoryEntry + 1);
+		error = fileSystem->create(name, nameBytes, type, parent, node, node->directoryEntry, node->directoryEntry + 1);
 
 		if (error == ES_SUCCESS) {
 			__sync_fetch_and_or(&node->flags, NODE_CREATED_ON_FILE_SYSTEM);
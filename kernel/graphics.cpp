@@ -31,10 +31,18 @@ struct Graphics {
 	bool debuggerActive;
 	size_t totalSurfaceBytes;
 	KMutex registerFirstGraphicsTargetMutex;
+
+	// Scratch space for BlurRegionOfImageDownsampled. Only used by the window manager, while holding its mutex.
+	uint32_t *blurScratch;
+	size_t blurScratchCount;
 };
 
 void GraphicsUpdateScreen(K_USER_BUFFER void *bits = nullptr, EsRectangle *bounds = nullptr, uintptr_t stride = 0);
 
+#ifdef DEBUG_BUILD
+void GraphicsBenchmark();
+#endif
+
 Graphics graphics;
 
 #else
@@ -335,6 +343,89 @@ void BlurRegionOfImage(uint32_t *image, int width, int height, int stride, uintp
 	}
 }
 
+inline uint32_t BlurAverage(uint32_t a, uint32_t b) {
+	// Per-channel (a + b + 1) / 2, matching _mm_avg_epu8.
+	return (a | b) - (((a ^ b) >> 1) & 0x7F7F7F7F);
+}
+
+ES_FUNCTION_OPTIMISE_O3
+void BlurRegionOfImageDownsampled(uint32_t *image, int width, int height, int stride) {
+	// Approximates BlurRegionOfImage with repeat = 3 at a fraction of the cost:
+	// average 2x2 blocks into a half resolution image, blur that once, and scale it back up.
+
+	int halfWidth = (width + 1) / 2, halfHeight = (height + 1) / 2;
+	size_t scratchCount = halfWidth * halfHeight + halfWidth;
+
+	if (halfWidth <= 3 || halfHeight <= 3) {
+		BlurRegionOfImage(image, width, height, stride, 3);
+		return;
+	}
+
+	if (graphics.blurScratchCount < scratchCount) {
+		EsHeapFree(graphics.blurScratch, 0, K_PAGED);
+		graphics.blurScratch = (uint32_t *) EsHeapAllocate(scratchCount * 4, false, K_PAGED);
+		graphics.blurScratchCount = graphics.blurScratch ? scratchCount : 0;
+
+		if (!graphics.blurScratch) {
+			BlurRegionOfImage(image, width, height, stride, 3);
+			return;
+		}
+	}
+
+	uint32_t *half = graphics.blurScratch;
+	uint32_t *row = half + halfWidth * halfHeight;
+
+	for (int y = 0; y < halfHeight; y++) {
+		uint32_t *row0 = image + stride * y * 2;
+		uint32_t *row1 = y * 2 + 1 < height ? row0 + stride : row0;
+		uint32_t *output = half + halfWidth * y;
+		int x = 0;
+
+		for (; x + 4 <= width / 2; x += 4) {
+			__m128i a = _mm_avg_epu8(_mm_loadu_si128((__m128i *) (row0 + x * 2 + 0)), _mm_loadu_si128((__m128i *) (row1 + x * 2 + 0)));
+			__m128i b = _mm_avg_epu8(_mm_loadu_si128((__m128i *) (row0 + x * 2 + 4)), _mm_loadu_si128((__m128i *) (row1 + x * 2 + 4)));
+			__m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd  = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm_storeu_si128((__m128i *) (output + x), _mm_avg_epu8(even, odd));
+		}
+
+		for (; x < halfWidth; x++) {
+			int x1 = x * 2 + 1 < width ? x * 2 + 1 : x * 2;
+			output[x] = BlurAverage(BlurAverage(row0[x * 2], row1[x * 2]), BlurAverage(row0[x1], row1[x1]));
+		}
+	}
+
+	BlurRegionOfImage(half, halfWidth, halfHeight, halfWidth, 1);
+
+	for (int y = 0; y < height; y++) {
+		// Each output pixel is 3/4 of its nearest half resolution pixel, and 1/4 of the next nearest.
+
+		int y0 = y / 2;
+		int y1 = (y & 1) ? (y0 + 1 < halfHeight ? y0 + 1 : y0) : (y0 ? y0 - 1 : 0);
+		uint32_t *near = half + halfWidth * y0, *far = half + halfWidth * y1;
+		int x = 0;
+
+		for (; x + 4 <= halfWidth; x += 4) {
+			__m128i a = _mm_loadu_si128((__m128i *) (near + x));
+			__m128i b = _mm_loadu_si128((__m128i *) (far + x));
+			_mm_storeu_si128((__m128i *) (row + x), _mm_avg_epu8(a, _mm_avg_epu8(a, b)));
+		}
+
+		for (; x < halfWidth; x++) {
+			row[x] = BlurAverage(near[x], BlurAverage(near[x], far[x]));
+		}
+
+		uint32_t *output = image + stride * y;
+
+		for (x = 0; x < width; x++) {
+			int x0 = x / 2;
+			int x1 = (x & 1) ? (x0 + 1 < halfWidth ? x0 + 1 : x0) : (x0 ? x0 - 1 : 0);
+			uint32_t color = BlurAverage(row[x0], BlurAverage(row[x0], row[x1]));
+			output[x] = (color & 0x00FFFFFF) | (output[x] & 0xFF000000);
+		}
+	}
+}
+
 void Surface::Blur(EsRectangle region, EsRectangle clip) {
 #if 1
 	if (!EsRectangleClip(region, ES_RECT_4(0, width, 0, height), &region)) {
@@ -375,7 +466,10 @@ void Surface::BlendWindow(Surface *source, EsPoint destinationPoint, EsRectangle
 		int repeat = material == BLEND_WINDOW_MATERIAL_GLASS ? 3 : 1;
 
 #ifndef SIMPLE_GRAPHICS
-		if (alpha == 0xFF) {
+		if (alpha == 0xFF && repeat == 3) {
+			BlurRegionOfImageDownsampled((uint32_t *) bits + materialRegion.l + materialRegion.t * width, 
+					Width(materialRegion), Height(materialRegion), width);
+		} else if (alpha == 0xFF) {
 			BlurRegionOfImage((uint32_t *) bits + materialRegion.l + materialRegion.t * width, 
 					Width(materialRegion), Height(materialRegion), width, repeat);
 		} else {
@@ -404,9 +498,12 @@ void Surface::BlendWindow(Surface *source, EsPoint destinationPoint, EsRectangle
 	uint8_t *sourcePixel = (uint8_t *) source->bits + sourceRegion.t * source->stride + sourceRegion.l * 4;
 
 #ifndef SIMPLE_GRAPHICS
-	__m128i constantAlphaMask = _mm_set1_epi32(0xFF000000);
-	__m128i constantAlpha = _mm_set1_epi32(alpha);
-	__m128i constant255 = _mm_set1_epi32(0xFF);
+	__m128i constantAlpha = _mm_set1_epi16(alpha);
+	__m128i constant255 = _mm_set1_epi16(0xFF);
+	__m128i constantOpaque = _mm_set1_epi32(0xFF);
+	__m128i maskRedBlue = _mm_set1_epi32(0x00FF00FF);
+	__m128i maskGreen = _mm_set1_epi32(0x0000FF00);
+	__m128i maskColor = _mm_set1_epi32(0x00FFFFFF);
 #endif
 
 	while (y < sourceRegion.b) {
@@ -418,26 +515,37 @@ void Surface::BlendWindow(Surface *source, EsPoint destinationPoint, EsRectangle
 			__m128i sourceValue 	 = _mm_loadu_si128((__m128i *) sourcePixel);
 
 #ifndef SIMPLE_GRAPHICS
-			__m128i destinationValue = _mm_loadu_si128((__m128i *) destinationPixel);
+			__m128i sourceAlpha = _mm_srli_epi32(sourceValue, 24);
 
 			if (alpha != 0xFF) {
-				sourceValue = _mm_or_si128(_mm_andnot_si128(constantAlphaMask, sourceValue), 
-						_mm_and_si128(_mm_slli_epi32(_mm_mullo_epi16(_mm_srli_epi32(sourceValue, 24), constantAlpha), 16), constantAlphaMask));
+				sourceAlpha = _mm_srli_epi32(_mm_mullo_epi16(sourceAlpha, constantAlpha), 8);
 			}
 
-			__m128i alpha = _mm_srli_epi32(sourceValue, 24);
-
-			__m128i red 	= _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(sourceValue, 0),  constant255), alpha);
-			__m128i green 	= _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(sourceValue, 8),  constant255), alpha);
-			__m128i blue 	= _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(sourceValue, 16), constant255), alpha);
-
-			alpha = _mm_sub_epi32(constant255, alpha);
+			int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha, constantOpaque));
+			int transparent = _mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha, _mm_setzero_si128()));
+
+			if (transparent == 0xFFFF) {
+				// Nothing to blend.
+				destinationPixel += 16;
+				sourcePixel += 16;
+				countX -= 4;
+				continue;
+			} else if (opaque == 0xFFFF) {
+				// Most of a window is opaque, so copy it without blending.
+				sourceValue = _mm_and_si128(sourceValue, maskColor);
+			} else {
+				// Blend red and blue together, and green separately, with each channel in a 16-bit lane.
+				__m128i destinationValue = _mm_loadu_si128((__m128i *) destinationPixel);
+				__m128i alpha2 = _mm_or_si128(sourceAlpha, _mm_slli_epi32(sourceAlpha, 16));
+				__m128i inverse2 = _mm_sub_epi16(constant255, alpha2);
 
-			red 	= _mm_srli_epi32(_mm_add_epi32(red,   _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(destinationValue, 0),  constant255), alpha)), 8);
-			green 	= _mm_srli_epi32(_mm_add_epi32(green, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(destinationValue, 8),  constant255), alpha)), 8);
-			blue 	= _mm_srli_epi32(_mm_add_epi32(blue,  _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(destinationValue, 16), constant255), alpha)), 8);
+				__m128i redBlue = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(sourceValue, maskRedBlue), alpha2), 
+						_mm_mullo_epi16(_mm_and_si128(destinationValue, maskRedBlue), inverse2));
+				__m128i green = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(sourceValue, 8), maskRedBlue), alpha2), 
+						_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(destinationValue, 8), maskRedBlue), inverse2));
 
-			sourceValue = _mm_or_si128(_mm_slli_epi32(red, 0), _mm_or_si128(_mm_slli_epi32(green, 8), _mm_slli_epi32(blue, 16)));
+				sourceValue = _mm_or_si128(_mm_srli_epi16(redBlue, 8), _mm_and_si128(green, maskGreen));
+			}
 #endif
 
 			_mm_storeu_si128((__m128i *) destinationPixel, sourceValue);
@@ -459,6 +567,8 @@ void Surface::BlendWindow(Surface *source, EsPoint destinationPoint, EsRectangle
 			uint32_t r1 = m1 * (modified & 0x00FF00FF);
 			uint32_t g1 = m1 * (modified & 0x0000FF00);
 			uint32_t result = (0x0000FF00 & ((g1 + g2) >> 8)) | (0x00FF00FF & ((r1 + r2) >> 8));
+			if (m1 == 0xFF) result = modified & 0x00FFFFFF;
+			else if (!m1) result = original;
 #else
 			uint32_t result = modified;
 #endif
@@ -643,6 +753,63 @@ void GraphicsDebugClearScreen32(unsigned screenWidth, unsigned screenHeight, uns
 	}
 }
 
+#ifdef DEBUG_BUILD
+void GraphicsBenchmark() {
+	// Time each of the compositing kernels on a 1024x768 surface, and log the results.
+
+	Surface source = {}, destination = {};
+
+	if (!source.Resize(1024, 768) || !destination.Resize(1024, 768)) {
+		EsHeapFree(source.bits, 0, K_PAGED);
+		EsHeapFree(destination.bits, 0, K_PAGED);
+		__sync_fetch_and_sub(&graphics.totalSurfaceBytes, source.width * source.height * 4 + destination.width * destination.height * 4);
+		return;
+	}
+
+	EsRectangle bounds = ES_RECT_4(0, 1024, 0, 768);
+	uint32_t *sourceBits = (uint32_t *) source.bits;
+
+	for (uintptr_t i = 0; i < 1024 * 768; i++) {
+		// Opaque on the left third, translucent in the middle and transparent on the right.
+		uintptr_t x = i % 1024;
+		uint32_t alpha = x < 340 ? 0xFF : x < 680 ? 0x80 : 0x00;
+		sourceBits[i] = (alpha << 24) | (EsRandomU64() & 0xFFFFFF);
+	}
+
+	for (uintptr_t i = 0; i < 1024 * 768; i++) {
+		((uint32_t *) destination.bits)[i] = 0xFF000000 | (EsRandomU64() & 0xFFFFFF);
+	}
+
+	KMutexAcquire(&windowManager.mutex);
+
+	for (uintptr_t test = 0; test < 7; test++) {
+		const uintptr_t iterations = 16;
+		uint64_t start = ProcessorReadTimeStamp();
+
+		for (uintptr_t i = 0; i < iterations; i++) {
+			if (test == 0) destination.BlendWindow(&source, ES_POINT(0, 0), bounds, BLEND_WINDOW_MATERIAL_NONE, 0xFF, bounds);
+			if (test == 1) destination.BlendWindow(&source, ES_POINT(0, 0), bounds, BLEND_WINDOW_MATERIAL_NONE, 0x80, bounds);
+			if (test == 2) destination.BlendWindow(&source, ES_POINT(0, 0), bounds, BLEND_WINDOW_MATERIAL_LIGHT_BLUR, 0xFF, bounds);
+			if (test == 3) destination.BlendWindow(&source, ES_POINT(0, 0), bounds, BLEND_WINDOW_MATERIAL_GLASS, 0xFF, bounds);
+			if (test == 4) destination.BlendWindow(&source, ES_POINT(0, 0), bounds, BLEND_WINDOW_MATERIAL_GLASS, 0x80, bounds);
+			if (test == 5) BlurRegionOfImage((uint32_t *) destination.bits, 1024, 768, 1024, 3);
+			if (test == 6) destination.Draw(&source, bounds, 0, 0, 0xFF);
+		}
+
+		uint64_t microseconds = (ProcessorReadTimeStamp() - start) * 1000 / timeStampTicksPerMs / iterations;
+		const char *names[] = { "blend", "blend with constant alpha", "light blur", "glass", 
+			"glass with constant alpha", "full resolution blur", "draw" };
+		KernelLog(LOG_INFO, "Graphics", "benchmark", "GraphicsBenchmark - %z: %d us per frame.\n", names[test], microseconds);
+	}
+
+	KMutexRelease(&windowManager.mutex);
+
+	__sync_fetch_and_sub(&graphics.totalSurfaceBytes, 1024 * 768 * 4 * 2);
+	EsHeapFree(source.bits, 0, K_PAGED);
+	EsHeapFree(destination.bits, 0, K_PAGED);
+}
+#endif
+
 #undef C0
 #undef C1
 #undef C2
@@ -31,6 +31,12 @@
 // The size at which the modified list is determined to be getting worryingly full;
 // passing this threshold causes the write back thread to immediately start working.
 #define CC_MODIFIED_GETTING_FULL                  (CC_MAX_MODIFIED * 2 / 3)
+
+// The number of shards the active sections are split between. Each shard has its own mutex and lists.
+#define CC_ACTIVE_SECTION_SHARDS                  (8)
+
+// The number of active sections that can be loaded concurrently by the loader threads, per access.
+#define CC_CONCURRENT_SECTION_LOADS               (4)
 										      
 // The size of the kernel's address space used for mapping active sections.
 #if defined(ES_BITS_32)                                                                  
@@ -186,7 +192,6 @@ extern "C" {
 #include <shared/crc.h>
 #include <shared/bitset.cpp>
 #include <shared/arena.cpp>
-#include <shared/avl_tree.cpp>
 #include <shared/range_set.cpp>
 #include <shared/partitions.cpp>
 #include <shared/heap.cpp>
@@ -223,6 +228,13 @@ uint64_t KGetTimeInMs() {
 	return scheduler.timeMs;
 }
 
+uint64_t KGetUnixTimeInUs() {
+	uint64_t offset = mmGlobalData->schedulerTimeOffset;
+	if (!offset) return 0; // The Desktop hasn't read the clock yet.
+	uint64_t linear = scheduler.timeMs + offset; // In milliseconds since 1st January of year 0.
+	return (linear - 62167219200000 /* DateToLinear of 1st January 1970 */) * 1000;
+}
+
 bool KBootedFromEFI() {
 	extern uint32_t bootloaderID;
 	return bootloaderID == 2;
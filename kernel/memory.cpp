@@ -294,7 +294,7 @@ PMM pmm;
 MMRegion *mmCoreRegions = (MMRegion *) MM_CORE_REGIONS_START;
 size_t mmCoreRegionCount, mmCoreRegionArrayCommit;
 
-MMSharedRegion *mmGlobalDataRegion, *mmAPITableRegion;
+MMSharedRegion *mmGlobalDataRegion, *mmAPITableRegion, *mmGlyphAtlasRegion;
 GlobalData *mmGlobalData; // Shared with all processes.
 
 // Code!
@@ -1652,17 +1652,20 @@ void MMBalanceThread() {
 			} else if (region->flags & MM_REGION_CACHE) {
 				// TODO Trim the cache's active sections and cached sections lists.
 
-				KMutexAcquire(&activeSectionManager.mutex);
+				for (uintptr_t i = 0; i < CC_ACTIVE_SECTION_SHARDS && MM_AVAILABLE_PAGES() < targetAvailablePages; i++) {
+					CCActiveSectionShard *shard = activeSectionManager.shards + i;
+					KMutexAcquire(&shard->mutex);
 
-				LinkedItem<CCActiveSection> *item = activeSectionManager.lruList.firstItem;
+					LinkedItem<CCActiveSection> *item = shard->lruList.firstItem;
 
-				while (item && MM_AVAILABLE_PAGES() < targetAvailablePages) {
-					CCActiveSection *section = item->thisItem;
-					if (section->cache && section->referencedPageCount) CCDereferenceActiveSection(section);
-					item = item->nextItem;
-				}
+					while (item && MM_AVAILABLE_PAGES() < targetAvailablePages) {
+						CCActiveSection *section = item->thisItem;
+						if (section->cache && section->referencedPageCount) CCDereferenceActiveSection(section);
+						item = item->nextItem;
+					}
 
-				KMutexRelease(&activeSectionManager.mutex);
+					KMutexRelease(&shard->mutex);
+				}
 			}
 
 			KMutexRelease(&region->data.mapMutex);
@@ -2253,12 +2256,13 @@ void MMInitialise() {
 	}
 
 	{
-		// Create the global data shared region, and the API table region.
+		// Create the global data shared region, the API table region, and the glyph atlas region.
 
 		mmAPITableRegion = MMSharedCreateRegion(0xF000, false, 0); 
 		mmGlobalDataRegion = MMSharedCreateRegion(sizeof(GlobalData), false, 0); 
 		mmGlobalData = (GlobalData *) MMMapShared(kernelMMSpace, mmGlobalDataRegion, 0, sizeof(GlobalData), MM_REGION_FIXED);
 		MMFaultRange((uintptr_t) mmGlobalData, sizeof(GlobalData), MM_HANDLE_PAGE_FAULT_FOR_SUPERVISOR);
+		mmGlyphAtlasRegion = MMSharedCreateRegion(GLYPH_ATLAS_BYTES, false, 0); // Pages are allocated as the desktop fills it.
 	}
 }
 
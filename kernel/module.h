@@ -114,8 +114,10 @@ void KUnregisterMSI(uintptr_t tag);
 #include <shared/unicode.cpp>
 #include <shared/linked_list.cpp>
 #include <shared/array.cpp>
+#include <shared/avl_tree.cpp>
 
 uint32_t CalculateCRC32(const void *_buffer, size_t length, uint32_t carry);
+uint32_t CalculateCRC32C(const void *_buffer, size_t length, uint32_t carry);
 uint64_t CalculateCRC64(const void *_buffer, size_t length, uint64_t carry);
 
 // ---------------------------------------------------------------------------------------------------------------
@@ -152,6 +154,7 @@ void KRegisterAsyncTask(KAsyncTask *task, KAsyncTaskCallback callback);
 // ---------------------------------------------------------------------------------------------------------------
 
 uint64_t KGetTimeInMs(); // Scheduler time.
+uint64_t KGetUnixTimeInUs(); // Wall clock time, in microseconds since 1st January 1970; 0 if not yet known.
 EsUniqueIdentifier KGetBootIdentifier();
 size_t KGetCPUCount();
 struct CPULocalStorage *KGetCPULocal(uintptr_t index);
@@ -805,6 +808,8 @@ struct KNodeMetadata {
 	bool removingNodeFromCache, removingThisFromCache;
 	EsFileOffset totalSize;
 	EsFileOffsetDifference directoryChildren; // ES_DIRECTORY_CHILDREN_UNKNOWN if not supported by the file system.
+	EsUniqueIdentifier identifier; // Zero if not supported by the file system.
+	uint64_t modificationTime; // In microseconds since 1st January 1970; 0 if unknown.
 };
 
 struct KNode {
@@ -854,10 +859,12 @@ struct KFileSystem : KDevice {
 	EsError		(*load)		(KNode *directory, KNode *node, KNodeMetadata *metadata /* for if you need to update it */, 
 						const void *entryData /* driverData passed to FSDirectoryEntryFound */);
 	EsFileOffset  	(*resize)	(KNode *file, EsFileOffset newSize, EsError *error);
-	EsError		(*create)	(const char *name, size_t nameLength, EsNodeType type, KNode *parent, KNode *node, void *driverData);
+	EsError		(*create)	(const char *name, size_t nameLength, EsNodeType type, KNode *parent, KNode *node, 
+						KNodeMetadata *metadata /* for if you need to update it */, void *driverData);
 	EsError 	(*enumerate)	(KNode *directory); // Add the entries with FSDirectoryEntryFound.
 	EsError		(*remove)	(KNode *directory, KNode *file);
 	EsError  	(*move)		(KNode *oldDirectory, KNode *file, KNode *newDirectory, const char *newName, size_t newNameLength);
+	EsError		(*defragment)	(KNode *file); // Move the file's data into fewer extents. Called with the file's cache flushed.
 	void  		(*close)	(KNode *node);
 	void		(*unmount)	(KFileSystem *fileSystem);
 
@@ -906,6 +913,7 @@ struct KNodeInformation {
 KNodeInformation FSNodeOpen(const char *path, size_t pathBytes, uint32_t flags, KNode *baseDirectory = nullptr);
 
 EsFileOffset FSNodeGetTotalSize(KNode *node);
+uint64_t FSNodeGetModificationTime(KNode *node);
 
 char *FSNodeGetName(KNode *node, size_t *bytes); // For debugging use only.
 
@@ -913,6 +921,7 @@ char *FSNodeGetName(KNode *node, size_t *bytes); // For debugging use only.
 #define FS_FILE_ACCESS_USER_BUFFER_MAPPED (1 << 0)
 ptrdiff_t FSFileReadSync(KNode *node, K_USER_BUFFER void *buffer, EsFileOffset offset, EsFileOffset bytes, uint32_t flags);
 ptrdiff_t FSFileWriteSync(KNode *node, const K_USER_BUFFER void *buffer, EsFileOffset offset, EsFileOffset bytes, uint32_t flags);
+ptrdiff_t FSFileCopyRange(KNode *destination, EsFileOffset destinationOffset, KNode *source, EsFileOffset sourceOffset, EsFileOffset bytes);
 
 // ---------------------------------------------------------------------------------------------------------------
 // Graphics.
@@ -94,7 +94,7 @@ struct Thread {
 	uint64_t lastInterruptTimeStamp;
 
 	ThreadType type;
-	bool isKernelThread, isPageGenerator;
+	bool isKernelThread, isPageGenerator, isCacheLoader;
 	int8_t priority;
 	int32_t blockedThreadPriorities[THREAD_PRIORITY_COUNT]; // The number of threads blocking on this thread at each priority level.
 
@@ -777,6 +777,11 @@ void ProcessLoadExecutable() {
 				startupInformation->globalDataRegion = thisProcess->handleTable.OpenHandle(mmGlobalDataRegion, globalDataRegionFlags, KERNEL_OBJECT_SHMEM);
 			}
 
+			// Only the desktop adds glyphs to the atlas; other processes can only read it.
+			if (mmGlyphAtlasRegion && OpenHandleToObject(mmGlyphAtlasRegion, KERNEL_OBJECT_SHMEM, globalDataRegionFlags)) {
+				startupInformation->glyphAtlasRegion = thisProcess->handleTable.OpenHandle(mmGlyphAtlasRegion, globalDataRegionFlags, KERNEL_OBJECT_SHMEM);
+			}
+
 			EsMemoryCopy(&startupInformation->data, &thisProcess->data, sizeof(EsProcessCreateData));
 		}
 	}
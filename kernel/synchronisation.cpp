@@ -780,4 +780,109 @@ void Scheduler::NotifyObject(LinkedList<Thread> *blockedThreads, bool unblockAll
 	} while (unblockAll && unblockedItem);
 }
 
+// Futexes: waiting on a userland address until another thread wakes it.
+// Waiters are kept in a fixed table of buckets, hashed by address space and address,
+// so that the userland locks built on top of them need no kernel objects of their own.
+// TODO Shared memory regions mapped at different addresses in different processes are keyed separately.
+
+#define FUTEX_BUCKET_COUNT (64)
+
+struct FutexWaiter {
+	MMSpace *space;
+	uintptr_t address;
+	KEvent woken;
+	LinkedItem<FutexWaiter> item;
+};
+
+struct FutexBucket {
+	KMutex mutex;
+	LinkedList<FutexWaiter> waiters;
+};
+
+FutexBucket futexBuckets[FUTEX_BUCKET_COUNT];
+
+FutexBucket *FutexGetBucket(MMSpace *space, uintptr_t address) {
+	uint64_t hash = ((uint64_t) (uintptr_t) space ^ ((uint64_t) address >> 2)) * 0x9E3779B97F4A7C15;
+	return &futexBuckets[(hash >> 32) % FUTEX_BUCKET_COUNT];
+}
+
+EsError FutexWait(MMSpace *space, uintptr_t address, uint32_t expected, uintptr_t timeoutMs) {
+	FutexBucket *bucket = FutexGetBucket(space, address);
+
+	FutexWaiter waiter = {};
+	waiter.space = space;
+	waiter.address = address;
+	waiter.item.thisItem = &waiter;
+
+	// Check the value while holding the bucket's mutex, so that a wake between the check and the wait cannot be lost.
+
+	KMutexAcquire(&bucket->mutex);
+
+	uint32_t value;
+
+	if (!MMArchSafeCopy((uintptr_t) &value, address, sizeof(uint32_t))) {
+		KMutexRelease(&bucket->mutex);
+		return ES_FATAL_ERROR_INVALID_BUFFER;
+	}
+
+	if (value != expected) {
+		KMutexRelease(&bucket->mutex);
+		return ES_SUCCESS;
+	}
+
+	bucket->waiters.InsertEnd(&waiter.item);
+	KMutexRelease(&bucket->mutex);
+
+	// Only the wait itself can be interrupted by the thread terminating;
+	// the waiter lives on this stack, so it must always be unlinked afterwards.
+
+	Thread *thread = GetCurrentThread();
+	thread->terminatableState = THREAD_USER_BLOCK_REQUEST;
+
+	if (timeoutMs == (uintptr_t) ES_WAIT_NO_TIMEOUT) {
+		KEvent *events[1] = { &waiter.woken };
+		KEventWaitMultiple(events, 1);
+	} else {
+		KTimer timer = {};
+		KTimerSet(&timer, timeoutMs);
+		KEvent *events[2] = { &waiter.woken, &timer.event };
+		KEventWaitMultiple(events, 2);
+		KTimerRemove(&timer);
+	}
+
+	thread->terminatableState = THREAD_IN_SYSCALL;
+
+	KMutexAcquire(&bucket->mutex);
+	if (waiter.item.list) bucket->waiters.Remove(&waiter.item);
+	bool woken = waiter.woken.state;
+	KMutexRelease(&bucket->mutex);
+
+	return woken ? ES_SUCCESS : ES_ERROR_TIMEOUT_REACHED;
+}
+
+size_t FutexWake(MMSpace *space, uintptr_t address, size_t count) {
+	FutexBucket *bucket = FutexGetBucket(space, address);
+	size_t woken = 0;
+
+	KMutexAcquire(&bucket->mutex);
+
+	LinkedItem<FutexWaiter> *item = bucket->waiters.firstItem;
+
+	while (item && woken < count) {
+		LinkedItem<FutexWaiter> *next = item->nextItem;
+		FutexWaiter *waiter = item->thisItem;
+
+		if (waiter->space == space && waiter->address == address) {
+			bucket->waiters.Remove(item);
+			KEventSet(&waiter->woken);
+			woken++;
+		}
+
+		item = next;
+	}
+
+	KMutexRelease(&bucket->mutex);
+	return woken;
+}
+
 #endif
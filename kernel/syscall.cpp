@@ -447,6 +447,7 @@ SYSCALL_IMPLEMENT(ES_SYSCALL_WINDOW_SET_BITS) {
 	bool didDirectUpdate = false;
 
 	if (argument3 != WINDOW_SET_BITS_AFTER_RESIZE && EsRectangleEquals(region, EsRectangleIntersection(region, directUpdateSubRegion))) {
+		// Put the bits on the screen immediately if nothing covers them, to reduce latency.
 		didDirectUpdate = window->UpdateDirect((K_USER_BUFFER uint32_t *) argument2, stride, clippedRegion);
 	}
 
@@ -466,10 +467,14 @@ if (ES_RECT_VALID(subRegion)) { surface->SetBits((K_USER_BUFFER const uint8_t *)
 		SET_BITS_REGION(0, window->width, 0, window->height);
 	}
 
-	window->Update(&region, !didDirectUpdate);
-
-	if (!didDirectUpdate) {
+	if (argument3 == WINDOW_SET_BITS_AFTER_RESIZE) {
+		// Draw the resized window straight away, so that the container and embedded window appear together.
+		window->Update(&region, true);
 		GraphicsUpdateScreen();
+	} else {
+		// The compositor thread draws the window into the frame buffer at the start of the next frame.
+		// After a direct update the bits are already on the screen, so it does not present them again.
+		windowManager.Damage(window, region, !didDirectUpdate);
 	}
 
 	if (resizeQueued) {
@@ -702,6 +707,8 @@ SYSCALL_IMPLEMENT(ES_SYSCALL_NODE_OPEN) {
 	information.type = _information.node->directoryEntry->type;
 	information.fileSize = _information.node->directoryEntry->totalSize;
 	information.directoryChildren = _information.node->directoryEntry->directoryChildren;
+	information.identifier = _information.node->directoryEntry->identifier;
+	information.modificationTime = _information.node->directoryEntry->modificationTime;
 	information.handle = currentProcess->handleTable.OpenHandle(_information.node, flags, KERNEL_OBJECT_NODE);
 	SYSCALL_WRITE(argument3, &information, sizeof(_EsNodeInformation));
 
@@ -769,6 +776,25 @@ SYSCALL_IMPLEMENT(ES_SYSCALL_FILE_WRITE_SYNC) {
 	}
 }
 
+SYSCALL_IMPLEMENT(ES_SYSCALL_FILE_COPY_RANGE) {
+	SYSCALL_HANDLE_2(argument0, KERNEL_OBJECT_NODE, handle);
+	KNode *destination = (KNode *) handle.object; 
+	SYSCALL_HANDLE(argument1, KERNEL_OBJECT_NODE, source, KNode);
+
+	if (destination->directoryEntry->type != ES_NODE_FILE) SYSCALL_RETURN(ES_FATAL_ERROR_INCORRECT_NODE_TYPE, true);
+	if (source->directoryEntry->type != ES_NODE_FILE) SYSCALL_RETURN(ES_FATAL_ERROR_INCORRECT_NODE_TYPE, true);
+	if (!(handle.flags & (ES_FILE_WRITE_SHARED | ES_FILE_WRITE))) SYSCALL_RETURN(ES_FATAL_ERROR_INCORRECT_FILE_ACCESS, true);
+
+	_EsFileCopyRange range;
+	SYSCALL_READ(&range, argument2, sizeof(_EsFileCopyRange));
+
+	// Limit the amount copied in one call, so that the thread can be terminated, and the caller can report progress.
+	const EsFileOffset maximumBytes = 16 * 1024 * 1024;
+	if (range.bytes > maximumBytes) range.bytes = maximumBytes;
+
+	SYSCALL_RETURN(FSFileCopyRange(destination, range.destinationOffset, source, range.sourceOffset, range.bytes), false);
+}
+
 SYSCALL_IMPLEMENT(ES_SYSCALL_FILE_GET_SIZE) {
 	SYSCALL_HANDLE(argument0, KERNEL_OBJECT_NODE, file, KNode);
 	if (file->directoryEntry->type != ES_NODE_FILE) SYSCALL_RETURN(ES_FATAL_ERROR_INCORRECT_NODE_TYPE, true);
@@ -800,6 +826,23 @@ SYSCALL_IMPLEMENT(ES_SYSCALL_EVENT_RESET) {
 	SYSCALL_RETURN(ES_SUCCESS, false);
 }
 
+SYSCALL_IMPLEMENT(ES_SYSCALL_FUTEX_WAIT) {
+	if ((argument0 & 3) || !MMArchIsBufferInUserRange(argument0, sizeof(uint32_t))) {
+		SYSCALL_RETURN(ES_FATAL_ERROR_INVALID_BUFFER, true);
+	}
+
+	EsError error = FutexWait(currentVMM, argument0, argument1, argument2);
+	SYSCALL_RETURN(error, error == ES_FATAL_ERROR_INVALID_BUFFER);
+}
+
+SYSCALL_IMPLEMENT(ES_SYSCALL_FUTEX_WAKE) {
+	if ((argument0 & 3) || !MMArchIsBufferInUserRange(argument0, sizeof(uint32_t))) {
+		SYSCALL_RETURN(ES_FATAL_ERROR_INVALID_BUFFER, true);
+	}
+
+	SYSCALL_RETURN(FutexWake(currentVMM, argument0, argument1), false);
+}
+
 SYSCALL_IMPLEMENT(ES_SYSCALL_SLEEP) {
 	KTimer timer = {};
 #ifdef ES_BITS_64
@@ -1710,6 +1753,8 @@ SYSCALL_IMPLEMENT(ES_SYSCALL_DEBUG_COMMAND) {
 		KEventWait(&event, 1000);
 		EsHeapFree(scheduler.threadEventLog, 0, K_FIXED);
 		scheduler.threadEventLog = nullptr;
+	} else if (argument0 == 13) {
+		GraphicsBenchmark();
 	}
 #endif
 
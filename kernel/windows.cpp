@@ -56,6 +56,10 @@ struct Window {
 	// Location:
 	EsPoint position;
 	size_t width, height;
+
+	// Compositing:
+	EsRectangle damage; // The region updated by the owner since the compositor last drew the window.
+	bool damageNeedsPresent; // Set unless all of the damage was already put on the screen by direct updates.
 };
 
 struct WindowManager {
@@ -72,6 +76,9 @@ struct WindowManager {
 
 	void Redraw(EsPoint position, int width, int height, Window *except = nullptr, int startingAt = 0, bool addToModifiedRegion = true);
 
+	void Damage(Window *window, EsRectangle region, bool present); // Queue a region of the window to be drawn (and presented) in the next frame.
+	void Composite(); // Draw the damaged regions of windows, and present them.
+
 	bool ActivateWindow(Window *window); // Returns true if any menus were closed.
 	void HideWindow(Window *window);
 	Window *FindWindowToActivate(Window *excluding = nullptr);
@@ -125,6 +132,13 @@ struct WindowManager {
 	uint64_t eyedropAvoidID;
 	uint32_t eyedropCancelColor;
 
+	// Compositor:
+
+#define COMPOSITOR_FRAME_INTERVAL_MS (16) // Presents from applications are coalesced into one frame per interval.
+#define COMPOSITOR_FRAME_BUDGET_MS (12) // Windows still damaged once a frame has taken this long are left for the next frame.
+	KEvent compositorDamaged; // Set when a window is damaged.
+	uint64_t compositorFrameTimeStampMs;
+
 	// Miscellaneous:
 
 	EsRectangle workArea;
@@ -745,10 +759,43 @@ void _CloseWindows(uintptr_t) {
 	}
 }
 
+void _Compositor(uintptr_t) {
+	while (true) {
+		KEventWait(&windowManager.compositorDamaged);
+
+		// Wait for the start of the next frame, so that presents arriving in the meantime are drawn together.
+		// Graphics targets don't report vertical blanking, so frames are aligned to a fixed interval instead.
+
+		uint64_t timeStampMs = KGetTimeInMs();
+		uint64_t nextFrameMs = windowManager.compositorFrameTimeStampMs + COMPOSITOR_FRAME_INTERVAL_MS;
+
+		if (timeStampMs < nextFrameMs) {
+			KTimer timer = {};
+			KTimerSet(&timer, nextFrameMs - timeStampMs);
+			KEventWait(&timer.event, ES_WAIT_NO_TIMEOUT);
+			KTimerRemove(&timer);
+			timeStampMs = nextFrameMs;
+		}
+
+		windowManager.compositorFrameTimeStampMs = timeStampMs - timeStampMs % COMPOSITOR_FRAME_INTERVAL_MS;
+
+		// TODO Composite without the window manager's mutex.
+		// 	The window surfaces and the frame buffer are still protected by it, 
+		// 	so SetBits and UpdateDirect wait for the frame to be drawn, and copy synchronously.
+		// 	This needs a lock per surface, and the frame buffer to be double buffered.
+
+		KMutexAcquire(&windowManager.mutex);
+		windowManager.Composite();
+		KMutexRelease(&windowManager.mutex);
+	}
+}
+
 void WindowManager::Initialise() {
 	windowsToCloseEvent.autoReset = true;
+	compositorDamaged.autoReset = true;
 	cursorProperties = K_CURSOR_MOVEMENT_SCALE << 16;
 	KThreadCreate("CloseWindows", _CloseWindows);
+	KThreadCreate("Compositor", _Compositor);
 	KMutexAcquire(&mutex);
 	MoveCursor(graphics.width / 2 * K_CURSOR_MOVEMENT_SCALE, graphics.height / 2 * K_CURSOR_MOVEMENT_SCALE);
 	GraphicsUpdateScreen();
@@ -1060,6 +1107,47 @@ void WindowManager::Redraw(EsPoint position, int width, int height, Window *exce
 	}
 }
 
+void WindowManager::Damage(Window *window, EsRectangle region, bool present) {
+	KMutexAssertLocked(&mutex);
+	if (!ES_RECT_VALID(region)) return;
+	window->damage = ES_RECT_VALID(window->damage) ? EsRectangleBounding(window->damage, region) : region;
+	if (present) window->damageNeedsPresent = true;
+	KEventSet(&compositorDamaged, true);
+}
+
+void WindowManager::Composite() {
+	KMutexAssertLocked(&mutex);
+
+	uint64_t startTimeStampMs = KGetTimeInMs();
+	bool composited = false, present = false;
+
+	for (uintptr_t i = 0; i < windows.Length(); i++) {
+		Window *window = windows[i];
+
+		if (!ES_RECT_VALID(window->damage)) {
+			continue;
+		}
+
+		if (composited && KGetTimeInMs() - startTimeStampMs >= COMPOSITOR_FRAME_BUDGET_MS) {
+			// Leave the remaining windows for the next frame, so that this one isn't delayed further.
+			KEventSet(&compositorDamaged, true);
+			break;
+		}
+
+		// Damage put on the screen by a direct update only needs to be drawn into the frame buffer.
+		EsRectangle damage = window->damage;
+		window->Update(&damage, window->damageNeedsPresent);
+		present |= window->damageNeedsPresent;
+		window->damage = {};
+		window->damageNeedsPresent = false;
+		composited = true;
+	}
+
+	if (present) {
+		GraphicsUpdateScreen();
+	}
+}
+
 bool Window::UpdateDirect(K_USER_BUFFER void *bits, uintptr_t stride, EsRectangle region) {
 	KMutexAssertLocked(&windowManager.mutex);
 
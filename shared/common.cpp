@@ -1212,6 +1212,139 @@ void PathGetName(const char *path, ptrdiff_t pathBytes, const char **name, ptrdi
 
 #ifdef SHARED_COMMON_WANT_ALL
 
+#ifdef ES_ARCH_X86_64
+
+// Copies and fills are split by size:
+// - Small blocks use a pair of overlapping loads and stores, with no loop and no tail.
+// - Medium blocks use a 64 byte SSE2 loop; the last 64 bytes are loaded up front and stored last, covering any remainder.
+// - Large blocks use rep movsb/stosb, if the processor reports the enhanced implementation (ERMS).
+// - Very large blocks that do not overlap use non-temporal stores, so that they don't evict the whole cache.
+// Everything loads before it stores, so the forward copy remains correct for overlapping moves towards lower addresses.
+// TODO AVX would need the kernel to enable XSAVE and save the upper register state on context switches.
+
+#define MEMORY_FEATURES_DETECTED (1 << 0)
+#define MEMORY_FEATURE_ERMS (1 << 1)
+#define MEMORY_FEATURE_FSRM (1 << 2)
+
+#define MEMORY_REP_THRESHOLD (1024)
+#define MEMORY_NON_TEMPORAL_THRESHOLD (4 * 1024 * 1024)
+
+volatile uint8_t memoryFeatures;
+
+__attribute__((no_instrument_function))
+static uint8_t MemoryGetFeatures() {
+	uint8_t features = memoryFeatures;
+
+	if (!features) {
+		uint32_t eax, ebx, ecx, edx;
+		features = MEMORY_FEATURES_DETECTED;
+		__asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0), "c" (0));
+
+		if (eax >= 7) {
+			__asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (7), "c" (0));
+			if (ebx & (1 << 9)) features |= MEMORY_FEATURE_ERMS;
+			if (edx & (1 << 4)) features |= MEMORY_FEATURE_FSRM;
+		}
+
+		memoryFeatures = features;
+	}
+
+	return features;
+}
+
+__attribute__((no_instrument_function))
+static inline void MemoryCopySmall(uint8_t *destination, const uint8_t *source, size_t bytes) {
+	// Copies up to 64 bytes.
+
+	if (bytes > 32) {
+		__m128i a = _mm_loadu_si128((__m128i *) source + 0), b = _mm_loadu_si128((__m128i *) source + 1);
+		__m128i c = _mm_loadu_si128((__m128i *) (source + bytes - 32)), d = _mm_loadu_si128((__m128i *) (source + bytes - 16));
+		_mm_storeu_si128((__m128i *) destination + 0, a), _mm_storeu_si128((__m128i *) destination + 1, b);
+		_mm_storeu_si128((__m128i *) (destination + bytes - 32), c), _mm_storeu_si128((__m128i *) (destination + bytes - 16), d);
+	} else if (bytes > 16) {
+		__m128i a = _mm_loadu_si128((__m128i *) source), b = _mm_loadu_si128((__m128i *) (source + bytes - 16));
+		_mm_storeu_si128((__m128i *) destination, a), _mm_storeu_si128((__m128i *) (destination + bytes - 16), b);
+	} else if (bytes >= 8) {
+		uint64_t a, b;
+		__builtin_memcpy(&a, source, 8), __builtin_memcpy(&b, source + bytes - 8, 8);
+		__builtin_memcpy(destination, &a, 8), __builtin_memcpy(destination + bytes - 8, &b, 8);
+	} else if (bytes >= 4) {
+		uint32_t a, b;
+		__builtin_memcpy(&a, source, 4), __builtin_memcpy(&b, source + bytes - 4, 4);
+		__builtin_memcpy(destination, &a, 4), __builtin_memcpy(destination + bytes - 4, &b, 4);
+	} else if (bytes) {
+		uint8_t a = source[0], b = source[bytes >> 1], c = source[bytes - 1];
+		destination[0] = a, destination[bytes >> 1] = b, destination[bytes - 1] = c;
+	}
+}
+
+__attribute__((no_instrument_function))
+static inline void MemorySetSmall(uint8_t *destination, uint8_t byte, size_t bytes) {
+	// Sets up to 64 bytes.
+
+	if (bytes >= 16) {
+		__m128i a = _mm_set1_epi8(byte);
+		_mm_storeu_si128((__m128i *) destination, a);
+		_mm_storeu_si128((__m128i *) (destination + bytes - 16), a);
+
+		if (bytes > 32) {
+			_mm_storeu_si128((__m128i *) destination + 1, a);
+			_mm_storeu_si128((__m128i *) (destination + bytes - 32), a);
+		}
+	} else if (bytes >= 4) {
+		uint64_t a = 0x0101010101010101UL * byte;
+
+		if (bytes >= 8) {
+			__builtin_memcpy(destination, &a, 8), __builtin_memcpy(destination + bytes - 8, &a, 8);
+		} else {
+			__builtin_memcpy(destination, &a, 4), __builtin_memcpy(destination + bytes - 4, &a, 4);
+		}
+	} else if (bytes) {
+		destination[0] = byte, destination[bytes >> 1] = byte, destination[bytes - 1] = byte;
+	}
+}
+
+__attribute__((no_instrument_function))
+static void MemorySet(uint8_t *destination, uint8_t byte, size_t bytes) {
+	if (bytes <= 64) {
+		MemorySetSmall(destination, byte, bytes);
+		return;
+	}
+
+	uint8_t features = MemoryGetFeatures();
+	__m128i a = _mm_set1_epi8(byte);
+
+	if (bytes >= MEMORY_NON_TEMPORAL_THRESHOLD) {
+		_mm_storeu_si128((__m128i *) destination, a);
+		uint8_t *end = destination + bytes;
+		_mm_storeu_si128((__m128i *) (end - 16), a);
+		destination = (uint8_t *) (((uintptr_t) destination + 16) & ~15);
+
+		while (destination + 16 <= end) {
+			_mm_stream_si128((__m128i *) destination, a);
+			destination += 16;
+		}
+
+		_mm_sfence();
+	} else if (bytes >= MEMORY_REP_THRESHOLD && (features & MEMORY_FEATURE_ERMS)) {
+		__asm__ volatile ("rep stosb" : "+D" (destination), "+c" (bytes) : "a" (byte) : "memory");
+	} else {
+		uint8_t *end = destination + bytes;
+
+		while (destination + 64 <= end) {
+			_mm_storeu_si128((__m128i *) destination + 0, a);
+			_mm_storeu_si128((__m128i *) destination + 1, a);
+			_mm_storeu_si128((__m128i *) destination + 2, a);
+			_mm_storeu_si128((__m128i *) destination + 3, a);
+			destination += 64;
+		}
+
+		MemorySetSmall(end - 64, byte, 64);
+	}
+}
+
+#endif
+
 __attribute__((no_instrument_function))
 void EsMemoryCopy(void *_destination, const void *_source, size_t bytes) {
 	// TODO Prevent this from being optimised out in the kernel.
@@ -1224,16 +1357,56 @@ void EsMemoryCopy(void *_destination, const void *_source, size_t bytes) {
 	uint8_t *source = (uint8_t *) _source;
 
 #ifdef ES_ARCH_X86_64
-	while (bytes >= 16) {
-		_mm_storeu_si128((__m128i *) destination, 
-				_mm_loadu_si128((__m128i *) source));
-
-		source += 16;
-		destination += 16;
-		bytes -= 16;
+	if (bytes <= 64) {
+		MemoryCopySmall(destination, source, bytes);
+		return;
 	}
-#endif
 
+	uint8_t features = MemoryGetFeatures();
+	bool overlapping = destination < source + bytes && source < destination + bytes;
+
+	if (bytes >= MEMORY_NON_TEMPORAL_THRESHOLD && !overlapping) {
+		uint8_t *end = destination + bytes;
+		__m128i head = _mm_loadu_si128((__m128i *) source);
+		__m128i tail = _mm_loadu_si128((__m128i *) (source + bytes - 16));
+		_mm_storeu_si128((__m128i *) destination, head);
+		uintptr_t skip = 16 - ((uintptr_t) destination & 15);
+		destination += skip, source += skip;
+
+		while (destination + 64 <= end) {
+			__m128i a = _mm_loadu_si128((__m128i *) source + 0), b = _mm_loadu_si128((__m128i *) source + 1);
+			__m128i c = _mm_loadu_si128((__m128i *) source + 2), d = _mm_loadu_si128((__m128i *) source + 3);
+			_mm_stream_si128((__m128i *) destination + 0, a), _mm_stream_si128((__m128i *) destination + 1, b);
+			_mm_stream_si128((__m128i *) destination + 2, c), _mm_stream_si128((__m128i *) destination + 3, d);
+			source += 64, destination += 64;
+		}
+
+		while (destination + 16 <= end) {
+			_mm_stream_si128((__m128i *) destination, _mm_loadu_si128((__m128i *) source));
+			source += 16, destination += 16;
+		}
+
+		_mm_sfence();
+		_mm_storeu_si128((__m128i *) (end - 16), tail);
+	} else if (bytes >= MEMORY_REP_THRESHOLD && (features & MEMORY_FEATURE_ERMS)) {
+		__asm__ volatile ("rep movsb" : "+D" (destination), "+S" (source), "+c" (bytes) : : "memory");
+	} else {
+		uint8_t *end = destination + bytes;
+		__m128i t0 = _mm_loadu_si128((__m128i *) (source + bytes - 64)), t1 = _mm_loadu_si128((__m128i *) (source + bytes - 48));
+		__m128i t2 = _mm_loadu_si128((__m128i *) (source + bytes - 32)), t3 = _mm_loadu_si128((__m128i *) (source + bytes - 16));
+
+		while (destination + 64 <= end) {
+			__m128i a = _mm_loadu_si128((__m128i *) source + 0), b = _mm_loadu_si128((__m128i *) source + 1);
+			__m128i c = _mm_loadu_si128((__m128i *) source + 2), d = _mm_loadu_si128((__m128i *) source + 3);
+			_mm_storeu_si128((__m128i *) destination + 0, a), _mm_storeu_si128((__m128i *) destination + 1, b);
+			_mm_storeu_si128((__m128i *) destination + 2, c), _mm_storeu_si128((__m128i *) destination + 3, d);
+			source += 64, destination += 64;
+		}
+
+		_mm_storeu_si128((__m128i *) (end - 64), t0), _mm_storeu_si128((__m128i *) (end - 48), t1);
+		_mm_storeu_si128((__m128i *) (end - 32), t2), _mm_storeu_si128((__m128i *) (end - 16), t3);
+	}
+#else
 	while (bytes >= 1) {
 		((uint8_t *) destination)[0] = ((uint8_t *) source)[0];
 
@@ -1241,6 +1414,7 @@ void EsMemoryCopy(void *_destination, const void *_source, size_t bytes) {
 		destination += 1;
 		bytes -= 1;
 	}
+#endif
 }
 
 __attribute__((no_instrument_function))
@@ -1254,6 +1428,31 @@ void EsMemoryCopyReverse(void *_destination, const void *_source, size_t bytes)
 	uint8_t *destination = (uint8_t *) _destination;
 	uint8_t *source = (uint8_t *) _source;
 
+#ifdef ES_ARCH_X86_64
+	// Copy from the end backwards, so that overlapping moves towards higher addresses are correct.
+	// The first 64 bytes are loaded up front and stored last, covering any remainder.
+
+	if (bytes <= 64) {
+		MemoryCopySmall(destination, source, bytes);
+		return;
+	}
+
+	__m128i h0 = _mm_loadu_si128((__m128i *) source + 0), h1 = _mm_loadu_si128((__m128i *) source + 1);
+	__m128i h2 = _mm_loadu_si128((__m128i *) source + 2), h3 = _mm_loadu_si128((__m128i *) source + 3);
+	uint8_t *start = destination;
+	destination += bytes, source += bytes;
+
+	while (destination - 64 >= start) {
+		source -= 64, destination -= 64;
+		__m128i a = _mm_loadu_si128((__m128i *) source + 0), b = _mm_loadu_si128((__m128i *) source + 1);
+		__m128i c = _mm_loadu_si128((__m128i *) source + 2), d = _mm_loadu_si128((__m128i *) source + 3);
+		_mm_storeu_si128((__m128i *) destination + 0, a), _mm_storeu_si128((__m128i *) destination + 1, b);
+		_mm_storeu_si128((__m128i *) destination + 2, c), _mm_storeu_si128((__m128i *) destination + 3, d);
+	}
+
+	_mm_storeu_si128((__m128i *) start + 0, h0), _mm_storeu_si128((__m128i *) start + 1, h1);
+	_mm_storeu_si128((__m128i *) start + 2, h2), _mm_storeu_si128((__m128i *) start + 3, h3);
+#else
 	destination += bytes - 1;
 	source += bytes - 1;
 
@@ -1264,6 +1463,7 @@ void EsMemoryCopyReverse(void *_destination, const void *_source, size_t bytes)
 		destination -= 1;
 		bytes -= 1;
 	}
+#endif
 }
 
 __attribute__((no_instrument_function))
@@ -1274,9 +1474,13 @@ void EsMemoryZero(void *destination, size_t bytes) {
 		return;
 	}
 
+#ifdef ES_ARCH_X86_64
+	MemorySet((uint8_t *) destination, 0, bytes);
+#else
 	for (uintptr_t i = 0; i < bytes; i++) {
 		((uint8_t *) destination)[i] = 0;
 	}
+#endif
 }
 
 __attribute__((no_instrument_function))
@@ -1314,8 +1518,23 @@ int EsMemoryCompare(const void *a, const void *b, size_t bytes) {
 
 	const uint8_t *x = (const uint8_t *) a;
 	const uint8_t *y = (const uint8_t *) b;
+	uintptr_t i = 0;
 
-	for (uintptr_t i = 0; i < bytes; i++) {
+#ifdef ES_ARCH_X86_64
+	// Find the first differing 16 byte block, then the first differing byte within it.
+
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i p = _mm_loadu_si128((__m128i *) (x + i)), q = _mm_loadu_si128((__m128i *) (y + i));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(p, q)) ^ 0xFFFF;
+
+		if (mask) {
+			i += __builtin_ctz(mask);
+			return x[i] < y[i] ? -1 : 1;
+		}
+	}
+#endif
+
+	for (; i < bytes; i++) {
 		if (x[i] < y[i]) {
 			return -1;
 		} else if (x[i] > y[i]) {
@@ -1345,7 +1564,11 @@ __attribute__((no_instrument_function))
 void EsMemoryFill(void *from, void *to, uint8_t byte) {
 	uint8_t *a = (uint8_t *) from;
 	uint8_t *b = (uint8_t *) to;
+#ifdef ES_ARCH_X86_64
+	MemorySet(a, byte, b - a);
+#else
 	while (a != b) *a = byte, a++;
+#endif
 }
 
 #endif
@@ -1580,9 +1803,13 @@ size_t EsPathFindUniqueName(char *buffer, size_t originalBytes, size_t bufferByt
 }
 
 uint8_t *EsImageLoad(const void *file, size_t fileSize, uint32_t *imageX, uint32_t *imageY, int imageChannels) {
+	return EsImageLoadScaled(file, fileSize, imageX, imageY, imageChannels, 0, 0);
+}
+
+uint8_t *EsImageLoadScaled(const void *file, size_t fileSize, uint32_t *imageX, uint32_t *imageY, int imageChannels, uint32_t fitWidth, uint32_t fitHeight) {
 #ifdef USE_STB_IMAGE
 	int unused;
-	uint32_t *image = (uint32_t *) stbi_load_from_memory((uint8_t *) file, fileSize, (int *) imageX, (int *) imageY, &unused, imageChannels);
+	uint32_t *image = (uint32_t *) stbi_load_from_memory_scaled((uint8_t *) file, fileSize, (int *) imageX, (int *) imageY, &unused, imageChannels, fitWidth, fitHeight);
 
 	if (!image) {
 		return nullptr;
@@ -1599,6 +1826,8 @@ uint8_t *EsImageLoad(const void *file, size_t fileSize, uint32_t *imageX, uint32
 	return (uint8_t *) image;
 #else
 	(void) imageChannels;
+	(void) fitWidth;
+	(void) fitHeight;
 	PNGReader reader = {};
 	reader.buffer = file;
 	reader.bytes = fileSize;
@@ -1671,64 +1900,156 @@ void EsSpinlockRelease(EsSpinlock *spinlock) {
 
 #ifndef KERNEL
 
+// All the locks below are built on EsFutexWait/EsFutexWake, and are unlocked when zero-initialised.
+// The kernel is only entered when a thread actually has to sleep, or there is a sleeping thread to wake.
+
+#define MUTEX_SPIN_LIMIT (1000)
+
+static inline void SpinPause() {
+#if defined(ES_ARCH_X86_64) || defined(ES_ARCH_X86_32)
+	__builtin_ia32_pause();
+#endif
+}
+
 void EsMutexAcquire(EsMutex *mutex) {
-	bool acquired = false;
+	// States: 0 = unlocked, 1 = locked, 2 = locked and there may be threads parked on it.
 
-	while (true) {
-		EsSpinlockAcquire(&mutex->spinlock);
+	if (__sync_bool_compare_and_swap(&mutex->state, 0, 1)) {
+		return;
+	}
 
-		if (mutex->event == ES_INVALID_HANDLE) {
-			mutex->event = EsEventCreate(false);
-		}
+	// Spin for a while, since the lock will often be released before a round trip to the kernel would complete.
+	// The spin length adapts to how long it took to acquire the lock on previous attempts.
 
-		if (mutex->state == 0) {
-			acquired = true;
-			mutex->state = 1;
-		} 
+	uint32_t estimate = mutex->spinEstimate;
+	uint32_t maximum = estimate * 2 + 10 > MUTEX_SPIN_LIMIT ? MUTEX_SPIN_LIMIT : estimate * 2 + 10;
 
-		if (acquired) {
-			// TODO Test this.
-			EsSpinlockRelease(&mutex->spinlock);
+	for (uint32_t i = 0; i < maximum; i++) {
+		if (mutex->state == 0 && __sync_bool_compare_and_swap(&mutex->state, 0, 1)) {
+			mutex->spinEstimate = estimate + ((int32_t) i - (int32_t) estimate) / 8;
 			return;
 		}
 
-		__sync_fetch_and_add(&mutex->queued, 1); 
-		EsEventReset(mutex->event);
-		EsSpinlockRelease(&mutex->spinlock);
-		EsWaitSingle(mutex->event);
-		__sync_fetch_and_sub(&mutex->queued, 1);
-	} 
+		SpinPause();
+	}
+
+	mutex->spinEstimate = estimate + ((int32_t) maximum - (int32_t) estimate) / 8;
+
+	// Park until the lock is handed back to us.
+
+	while (__sync_lock_test_and_set(&mutex->state, 2)) {
+		EsFutexWait(&mutex->state, 2, ES_WAIT_NO_TIMEOUT);
+	}
 }
 
 void EsMutexRelease(EsMutex *mutex) {
-	volatile bool queued = false;
+	uint32_t previous = __sync_fetch_and_sub(&mutex->state, 1);
 
-	EsSpinlockAcquire(&mutex->spinlock);
-
-	if (!mutex->state) {
+	if (previous == 0) {
 		EsPanic("EsMutexRelease - Mutex not acquired.");
+	} else if (previous == 2) {
+		mutex->state = 0;
+		__sync_synchronize();
+		EsFutexWake(&mutex->state, 1);
+	}
+}
+
+void EsMutexDestroy(EsMutex *mutex) {
+	EsAssert(!mutex->state);
+}
+
+#define WRITER_LOCK_EXCLUSIVE (1U << 30)
+#define WRITER_LOCK_WAITERS (1U << 31)
+#define WRITER_LOCK_WRITER (1U << 20) // Added to the state for each writer waiting to take the lock.
+#define WRITER_LOCK_WRITERS (WRITER_LOCK_EXCLUSIVE - WRITER_LOCK_WRITER)
+#define WRITER_LOCK_READERS (WRITER_LOCK_WRITER - 1)
+
+void EsWriterLockTake(EsWriterLock *lock, bool write) {
+	// New readers wait while a writer is waiting, so that a steady stream of readers cannot starve writers.
+	bool waitingWriter = false;
+
+	while (true) {
+		uint32_t state = lock->state;
+
+		if (write && !(state & (WRITER_LOCK_EXCLUSIVE | WRITER_LOCK_READERS))) {
+			uint32_t next = (state | WRITER_LOCK_EXCLUSIVE) - (waitingWriter ? WRITER_LOCK_WRITER : 0);
+			if (__sync_bool_compare_and_swap(&lock->state, state, next)) return;
+		} else if (!write && !(state & (WRITER_LOCK_EXCLUSIVE | WRITER_LOCK_WRITERS))) {
+			if (__sync_bool_compare_and_swap(&lock->state, state, state + 1)) return;
+		} else if (write && !waitingWriter) {
+			waitingWriter = __sync_bool_compare_and_swap(&lock->state, state, state + WRITER_LOCK_WRITER);
+		} else if ((state & WRITER_LOCK_WAITERS) || __sync_bool_compare_and_swap(&lock->state, state, state | WRITER_LOCK_WAITERS)) {
+			EsFutexWait(&lock->state, state | WRITER_LOCK_WAITERS, ES_WAIT_NO_TIMEOUT);
+		}
 	}
+}
 
-	mutex->state = 0;
+void EsWriterLockReturn(EsWriterLock *lock, bool write) {
+	uint32_t state;
 
-	if (mutex->queued) {
-		queued = true;
-		EsEventSet(mutex->event);
+	if (write) {
+		EsAssert(lock->state & WRITER_LOCK_EXCLUSIVE);
+		state = __sync_and_and_fetch(&lock->state, ~WRITER_LOCK_EXCLUSIVE);
+	} else {
+		EsAssert(lock->state & WRITER_LOCK_READERS);
+		state = __sync_sub_and_fetch(&lock->state, 1);
 	}
 
-	EsSpinlockRelease(&mutex->spinlock);
+	// Wake the waiting threads once the lock is free, even if writers are still waiting to take it.
+	// Any that cannot take it set WRITER_LOCK_WAITERS again before they wait.
 
-	if (queued) {
-		EsSchedulerYield();
+	while ((state & WRITER_LOCK_WAITERS) && !(state & (WRITER_LOCK_EXCLUSIVE | WRITER_LOCK_READERS))) {
+		if (__sync_bool_compare_and_swap(&lock->state, state, state & ~WRITER_LOCK_WAITERS)) {
+			EsFutexWake(&lock->state, (size_t) -1);
+			break;
+		}
+
+		state = lock->state;
 	}
 }
 
-void EsMutexDestroy(EsMutex *mutex) {
-	EsAssert(!mutex->state && !mutex->queued && !mutex->spinlock.state);
+bool EsConditionVariableWait(EsConditionVariable *variable, EsMutex *mutex, uintptr_t timeoutMs) {
+	// The sequence number changes on every signal, so a signal sent after the mutex is released
+	// but before the thread parks is not lost; the futex wait returns immediately.
+
+	__sync_fetch_and_add(&variable->waiters, 1);
+	uint32_t sequence = variable->sequence;
+	EsMutexRelease(mutex);
+	EsError error = EsFutexWait(&variable->sequence, sequence, timeoutMs);
+	__sync_fetch_and_sub(&variable->waiters, 1);
+	EsMutexAcquire(mutex);
+	return error != ES_ERROR_TIMEOUT_REACHED;
+}
+
+void EsConditionVariableSignal(EsConditionVariable *variable) {
+	__sync_fetch_and_add(&variable->sequence, 1);
+	if (variable->waiters) EsFutexWake(&variable->sequence, 1);
+}
 
-	if (mutex->event != ES_INVALID_HANDLE) {
-		EsHandleClose(mutex->event);
-		mutex->event = ES_INVALID_HANDLE;
+void EsConditionVariableBroadcast(EsConditionVariable *variable) {
+	__sync_fetch_and_add(&variable->sequence, 1);
+	if (variable->waiters) EsFutexWake(&variable->sequence, (size_t) -1);
+}
+
+void EsLatchSet(EsLatch *latch) {
+	// States: 0 = not set, 1 = not set and there may be threads waiting, 2 = set.
+
+	if (__sync_lock_test_and_set(&latch->state, 2) == 1) {
+		EsFutexWake(&latch->state, (size_t) -1);
+	}
+}
+
+bool EsLatchWait(EsLatch *latch, uintptr_t timeoutMs) {
+	while (true) {
+		uint32_t state = latch->state;
+
+		if (state == 2) {
+			return true;
+		} else if (state == 1 || __sync_bool_compare_and_swap(&latch->state, 0, 1)) {
+			if (EsFutexWait(&latch->state, 1, timeoutMs) == ES_ERROR_TIMEOUT_REACHED) {
+				return latch->state == 2;
+			}
+		}
 	}
 }
 
@@ -1770,33 +2091,23 @@ uint32_t SwapBigEndian32(uint32_t x) {
 #ifdef SHARED_COMMON_WANT_ALL
 
 void *EsCRTmemset(void *s, int c, size_t n) {
-	uint8_t *s8 = (uint8_t *) s;
-	for (uintptr_t i = 0; i < n; i++) {
-		s8[i] = (uint8_t) c;
-	}
+	EsMemoryFill(s, (uint8_t *) s + n, (uint8_t) c);
 	return s;
 }
 
 void *EsCRTmemcpy(void *dest, const void *src, size_t n) {
-	uint8_t *dest8 = (uint8_t *) dest;
-	const uint8_t *src8 = (const uint8_t *) src;
-	for (uintptr_t i = 0; i < n; i++) {
-		dest8[i] = src8[i];
-	}
+	EsMemoryCopy(dest, src, n);
 	return dest;
 }
 
 void *EsCRTmemmove(void *dest, const void *src, size_t n) {
 	if ((uintptr_t) dest < (uintptr_t) src) {
-		return EsCRTmemcpy(dest, src, n);
+		EsMemoryCopy(dest, src, n);
 	} else {
-		uint8_t *dest8 = (uint8_t *) dest;
-		const uint8_t *src8 = (const uint8_t *) src;
-		for (uintptr_t i = n; i; i--) {
-			dest8[i - 1] = src8[i - 1];
-		}
-		return dest;
+		EsMemoryCopyReverse(dest, src, n);
 	}
+
+	return dest;
 }
 
 #ifndef KERNEL
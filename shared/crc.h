@@ -1,5 +1,6 @@
 // TODO Replace with FNV1a, as used in hash_table.cpp?
 // Currently used for: EsFS, theme constants, build core configuration hash, make bundle.
+// CRC-32C is used for EsFS metadata on volumes with ESFS_SUPERBLOCK_FLAG_CRC32C.
 
 #ifdef __cplusplus
 constexpr uint32_t crc32Table[] = { 
@@ -79,15 +80,189 @@ uint64_t crc64Table[] = {
 	0x66E7A46C27F3AA2CUL, 0x1C3FD4A417C62355UL, 0x935745FC4798B8DEUL, 0xE98F353477AD31A7UL, 0xA6DF411FBFB21CA3UL, 0xDC0731D78F8795DAUL, 0x536FA08FDFD90E51UL, 0x29B7D047EFEC8728UL,
 };
 
+// Slice-by-8 tables for CRC-32 and CRC-32C, generated on first use.
+// Table 0 is the usual byte-at-a-time table; table k advances the remainder by k further zero bytes.
+// Threads may generate the tables concurrently. This is harmless, since each thread computes every entry it reads itself, and they all write the same values.
+
+#define CRC32_POLYNOMIAL (0xEDB88320)
+#define CRC32C_POLYNOMIAL (0x82F63B78)
+
+uint32_t crc32Slices[8][256], crc32cSlices[8][256];
+volatile int crcSlicesGenerated;
+
+void CRCGenerateSlices(uint32_t table[8][256], uint32_t polynomial) {
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t x = i;
+		for (int j = 0; j < 8; j++) x = (x >> 1) ^ (polynomial & (0 - (x & 1)));
+		table[0][i] = x;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int j = 1; j < 8; j++) {
+			table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xFF];
+		}
+	}
+}
+
+uint32_t CRCSliceBy8(uint32_t table[8][256], uint32_t x, const uint8_t *buffer, size_t length) {
+	if (!crcSlicesGenerated) {
+		CRCGenerateSlices(crc32Slices, CRC32_POLYNOMIAL);
+		CRCGenerateSlices(crc32cSlices, CRC32C_POLYNOMIAL);
+		__sync_synchronize();
+		crcSlicesGenerated = 1;
+	}
+
+	while (length >= 8) {
+		uint32_t a = x ^ (buffer[0] | ((uint32_t) buffer[1] << 8) | ((uint32_t) buffer[2] << 16) | ((uint32_t) buffer[3] << 24));
+		uint32_t b = buffer[4] | ((uint32_t) buffer[5] << 8) | ((uint32_t) buffer[6] << 16) | ((uint32_t) buffer[7] << 24);
+		x = table[7][a & 0xFF] ^ table[6][(a >> 8) & 0xFF] ^ table[5][(a >> 16) & 0xFF] ^ table[4][a >> 24]
+			^ table[3][b & 0xFF] ^ table[2][(b >> 8) & 0xFF] ^ table[1][(b >> 16) & 0xFF] ^ table[0][b >> 24];
+		buffer += 8, length -= 8;
+	}
+
+	while (length) {
+		x = table[0][(x ^ *buffer) & 0xFF] ^ (x >> 8);
+		buffer++, length--;
+	}
+
+	return x;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC_HARDWARE_X86_64
+
+#include <x86intrin.h>
+
+#define CRC_FEATURES_DETECTED (1 << 0)
+#define CRC_FEATURE_SSE42 (1 << 1)
+#define CRC_FEATURE_PCLMUL (1 << 2)
+
+volatile int crcFeatures;
+
+int CRCGetFeatures() {
+	int features = crcFeatures;
+
+	if (!features) {
+		uint32_t eax, ebx, ecx, edx;
+		__asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1), "c" (0));
+		features = CRC_FEATURES_DETECTED;
+		if (ecx & (1 << 20)) features |= CRC_FEATURE_SSE42;
+		if ((ecx & (1 << 1)) && (ecx & (1 << 19))) features |= CRC_FEATURE_PCLMUL;
+		crcFeatures = features;
+	}
+
+	return features;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t CRC32CHardware(uint32_t x, const uint8_t *buffer, size_t length) {
+	while (length && ((uintptr_t) buffer & 7)) {
+		x = _mm_crc32_u8(x, *buffer);
+		buffer++, length--;
+	}
+
+	uint64_t y = x;
+
+	while (length >= 8) {
+		y = _mm_crc32_u64(y, *(const uint64_t *) buffer);
+		buffer += 8, length -= 8;
+	}
+
+	x = (uint32_t) y;
+
+	while (length) {
+		x = _mm_crc32_u8(x, *buffer);
+		buffer++, length--;
+	}
+
+	return x;
+}
+
+__attribute__((target("pclmul,sse4.1")))
+uint32_t CRC32FoldPCLMUL(uint32_t crc, const uint8_t *buffer, size_t length) {
+	// Fold 64 bytes at a time with carry-less multiplication, then reduce to 32 bits with Barrett reduction.
+	// See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel, 2009.
+	// The length must be a multiple of 16, and at least 64.
+
+	const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+	const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i *) buffer + 0);
+	__m128i x2 = _mm_loadu_si128((const __m128i *) buffer + 1);
+	__m128i x3 = _mm_loadu_si128((const __m128i *) buffer + 2);
+	__m128i x4 = _mm_loadu_si128((const __m128i *) buffer + 3);
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	buffer += 64, length -= 64;
+
+	while (length >= 64) {
+		__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00), x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00), x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11), x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11), x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) buffer + 0));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) buffer + 1));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) buffer + 2));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) buffer + 3));
+		buffer += 64, length -= 64;
+	}
+
+	// Fold the 4 accumulators into one, then any remaining 16 byte blocks into it.
+
+	__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+
+	while (length >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_loadu_si128((const __m128i *) buffer)), x5);
+		buffer += 16, length -= 16;
+	}
+
+	// Fold 128 bits to 64 bits, then reduce to 32 bits.
+
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00), x2);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+#endif
+
 uint32_t CalculateCRC32(const void *_buffer, size_t length, uint32_t carry) {
 	const uint8_t *buffer = (const uint8_t *) _buffer;
 	uint32_t x = ~carry;
-	
-	for (uintptr_t i = 0; i < length; i++) {
-		x = crc32Table[(x ^ (uint32_t) buffer[i]) & 0xFF] ^ (x >> 8);
+
+#ifdef CRC_HARDWARE_X86_64
+	if (length >= 64 && (CRCGetFeatures() & CRC_FEATURE_PCLMUL)) {
+		size_t folded = length & ~(size_t) 15;
+		x = CRC32FoldPCLMUL(x, buffer, folded);
+		buffer += folded, length -= folded;
 	}
-	
-	return ~x;
+#endif
+
+	return ~CRCSliceBy8(crc32Slices, x, buffer, length);
+}
+
+uint32_t CalculateCRC32C(const void *_buffer, size_t length, uint32_t carry) {
+	const uint8_t *buffer = (const uint8_t *) _buffer;
+	uint32_t x = ~carry;
+
+#ifdef CRC_HARDWARE_X86_64
+	if (CRCGetFeatures() & CRC_FEATURE_SSE42) {
+		return ~CRC32CHardware(x, buffer, length);
+	}
+#endif
+
+	return ~CRCSliceBy8(crc32cSlices, x, buffer, length);
 }
 
 uint64_t CalculateCRC64(const void *_buffer, size_t length, uint64_t carry) {
@@ -6,9 +6,7 @@
 // 		Extent allocation algorithm.
 // TODO Design:
 // 		Meta/flex block groups.
-// 		Journal.
 // 		Inline b-tree.
-// 		Further data indirection. 
 // 		Hash collisions. (Probably just remove index and enumerate directory contents instead?)
 
 #ifndef KERNEL
@@ -35,7 +33,7 @@ typedef struct EsUniqueIdentifier {
 
 #define ESFS_BOOT_SUPER_BLOCK_SIZE 			(8192)			// The bootloader and superblock take up 16KB.
 #define ESFS_DRIVE_MINIMUM_SIZE 			(1048576)		// The minimum drive size that can be formatted.
-#define ESFS_DRIVER_VERSION 				(10)			// The current driver version.
+#define ESFS_DRIVER_VERSION 				(14)			// The current driver version. The bootloader (esfs-stage2.s) checks this too.
 #define ESFS_MAXIMUM_VOLUME_NAME_LENGTH 		(32)			// The volume name limit.
 
 #define ESFS_CORE_NODE_KERNEL				(0)			// The kernel core node.
@@ -46,6 +44,10 @@ typedef struct EsUniqueIdentifier {
 #define ESFS_DIRECTORY_ENTRY_SIGNATURE 			("DirEntry")		// The signature in directory entries.
 #define ESFS_GROUP_DESCRIPTOR_SIGNATURE			("GDTE")		// The signature in a group descriptor.
 #define ESFS_INDEX_VERTEX_SIGNATURE			("INXE")		// The signature in a index vertex.
+#define ESFS_EXTENT_INDEX_SIGNATURE			("EXTI")		// The signature at the start of an extent index.
+#define ESFS_JOURNAL_SIGNATURE				("JRNL")		// The signature at the start of a journal transaction.
+
+#define ESFS_SUPERBLOCK_FLAG_CRC32C			(1 << 0)		// Metadata checksums use CRC-32C instead of CRC-32. The superblock always uses CRC-32.
 
 #define ESFS_NODE_TYPE_FILE 				(1)			// DirectoryEntry.nodeType: a file.
 #define ESFS_NODE_TYPE_DIRECTORY 			(2)			// DirectoryEntry.nodeType: a directory.
@@ -56,6 +58,7 @@ typedef struct EsUniqueIdentifier {
 
 #define ESFS_INDIRECTION_DIRECT				(1)			// The data is stored in the attribute.
 #define ESFS_INDIRECTION_L1				(2)			// The attribute contains a extent list that points to the data.
+#define ESFS_INDIRECTION_L2				(3)			// The attribute contains a extent list that points to an extent index.
 
 #define ESFS_INDEX_MAX_DEPTH				(16)			// The maximum depth of the index tree. I'd be surprised if this gets past 8.
 #define ESFS_VERTEX_KEY(vertex, key) 			((IndexKey *) ((uint8_t *) vertex + vertex->offset) + key)
@@ -101,6 +104,21 @@ typedef struct AttributeData {
 	//       uint8_t count[countSize + 1];				// The number of blocks encompassed by the extent. Big endian.
 } AttributeData;
 
+typedef struct ExtentIndexHeader {
+	/*  0 */ char signature[4];					// Must be ESFS_EXTENT_INDEX_SIGNATURE.
+	/*  4 */ uint32_t checksum;					// CRC-32 checksum of the header and the extent list.
+	/*  8 */ uint64_t count;					// The number of extents in the block's list.
+	/* 16 */ uint64_t bytes;					// The size of the block's encoded extent list in bytes.
+	/* 24 */ uint64_t _unused;					// Unused.
+
+	// The header is followed by the extent list, in the same format used by AttributeData.
+	// The index is stored in the blocks given by the extent list in the data attribute, in order. 
+	// Each block starts with a header, and holds the next part of the file's extent list; the first extent in each block is relative to 0.
+	// This lets the driver rewrite only the blocks at the end of the index when the file is resized.
+	// The first version of the driver to support ESFS_INDIRECTION_L2 is 11.
+	// Before version 14, the index had a single header, with the list continuing across all its blocks. Version 14 can still read these.
+} ExtentIndexHeader;
+
 typedef struct DirectoryEntry {
 	/*  0 */ char signature[8];					// Must be ESFS_DIRECTORY_ENTRY_SIGNATURE.
 	/*  8 */ EsUniqueIdentifier identifier;				// Identifier of the node.
@@ -162,7 +180,8 @@ typedef struct Superblock {
 	
 	/*  52 */ uint32_t checksum;					// CRC-32 checksum of Superblock.
 	/*  56 */ uint8_t mounted;					// Non-zero to indicate that the volume is mounted, or was not properly unmounted.
-	/*  57 */ uint8_t _unused2[7];
+	/*  57 */ uint8_t flags;					// ESFS_SUPERBLOCK_FLAG_... flags.
+	/*  58 */ uint8_t _unused2[6];
 	
 	/*  64 */ uint64_t blockSize;					// The size of a block on the volume.
 	/*  72 */ uint64_t blockCount;					// The number of blocks on the volume.
@@ -183,9 +202,35 @@ typedef struct Superblock {
 	/* 184 */ DirectoryEntryReference kernel;			// The kernel. For convenient access by the bootloader.
 	/* 200 */ DirectoryEntryReference root;				// The root directory.
 
-	/* 216 */ uint8_t _unused1[8192 - 216];				// Unused.
+	/* 216 */ uint64_t journalFirstBlock;				// The first block of the metadata journal.
+	/* 224 */ uint64_t journalBlockCount;				// The number of blocks in the metadata journal. 0 if the volume has no journal.
+	/* 232 */ uint64_t journalSequence;				// The sequence number of the last transaction written before the volume was mounted.
+
+	/* 240 */ uint8_t _unused1[8192 - 240];				// Unused.
 } Superblock;
 
+typedef struct JournalHeader {
+	/*  0 */ char signature[4];					// Must be ESFS_JOURNAL_SIGNATURE.
+	/*  4 */ uint32_t checksum;					// CRC-32 checksum of the descriptor blocks.
+	/*  8 */ uint64_t sequence;					// Must be greater than Superblock.journalSequence to be replayed.
+	/* 16 */ uint32_t blockCount;					// The number of metadata blocks in the transaction.
+	/* 20 */ uint32_t dataChecksum;				// CRC-32 checksum of the metadata blocks.
+	/* 24 */ uint64_t _unused;					// Unused.
+
+#define ESFS_JOURNAL_TARGET_OFFSET (32)
+	/* 32 */ uint64_t targets[1];					// Where each metadata block belongs on the volume, in ascending order.
+
+	// A transaction is stored at the start of the journal.
+	// The header and target list are padded to a whole number of "descriptor blocks".
+	// The metadata blocks follow the descriptor blocks, in the same order as the target list.
+	// A transaction whose checksums are correct was committed, but might not have been copied to the targets.
+} JournalHeader;
+
+uint32_t ChecksumMetadata(const Superblock *superblock, const void *buffer, size_t bytes) {
+	// The superblock is always checked with CRC-32, since it contains the flag that selects the algorithm for everything else.
+	return (superblock->flags & ESFS_SUPERBLOCK_FLAG_CRC32C) ? CalculateCRC32C(buffer, bytes, 0) : CalculateCRC32(buffer, bytes, 0);
+}
+
 uint64_t EncodeExtent(uint64_t extentStart, uint64_t previousExtentStart, uint64_t extentCount, uint8_t *encode) {
 	int64_t relativeStart = (int64_t) (extentStart - previousExtentStart);
 	uint64_t absoluteRelativeStart = (uint64_t) (relativeStart < 0 ? -relativeStart : relativeStart);
@@ -291,7 +336,7 @@ bool ReadDirectoryEntryReference(DirectoryEntryReference reference, DirectoryEnt
 
 bool WriteDirectoryEntryReference(DirectoryEntryReference reference, DirectoryEntry *entry) {
 	entry->checksum = 0;
-	entry->checksum = CalculateCRC32(entry, sizeof(DirectoryEntry), 0);
+	entry->checksum = ChecksumMetadata(&superblock, entry, sizeof(DirectoryEntry));
 	uint8_t buffer[superblock.blockSize];
 
 	if (ReadBlock(reference.block, 1, buffer)) {
@@ -357,7 +402,7 @@ IndexKey *InsertKeyIntoVertex(uint64_t newKey, IndexVertex *vertex) {
 	// Update the checksum.
 
 	vertex->checksum = 0;
-	vertex->checksum = CalculateCRC32(vertex, superblock.blockSize, 0);
+	vertex->checksum = ChecksumMetadata(&superblock, vertex, superblock.blockSize);
 
 	return insertionPosition;
 }
@@ -467,9 +512,9 @@ bool AllocateExtent(uint64_t increaseBlocks, uint64_t *extentStart, uint64_t *ex
 			assert(superblock.blocksPerGroup == target->blocksUsed || target->largestExtent);
 		}
 
-		target->bitmapChecksum = CalculateCRC32(bitmap, sizeof(bitmap), 0);
+		target->bitmapChecksum = ChecksumMetadata(&superblock, bitmap, sizeof(bitmap));
 		target->checksum = 0;
-		target->checksum = CalculateCRC32(target, sizeof(GroupDescriptor), 0);
+		target->checksum = ChecksumMetadata(&superblock, target, sizeof(GroupDescriptor));
 
 		if (!WriteBlock(target->blockBitmap, superblock.blocksPerGroupBlockBitmap, bitmap)) {
 			return false;
@@ -482,6 +527,217 @@ bool AllocateExtent(uint64_t increaseBlocks, uint64_t *extentStart, uint64_t *ex
 	return true;
 }
 
+typedef struct NodeExtent {
+	uint64_t start, count;
+} NodeExtent;
+
+bool AppendExtent(NodeExtent **extents, uint64_t *extentCount, uint64_t start, uint64_t count) {
+	if (*extentCount && (*extents)[*extentCount - 1].start + (*extents)[*extentCount - 1].count == start) {
+		(*extents)[*extentCount - 1].count += count;
+		return true;
+	}
+
+	*extents = (NodeExtent *) realloc(*extents, (*extentCount + 1) * sizeof(NodeExtent));
+	if (!(*extents)) return false;
+	(*extents)[*extentCount].start = start;
+	(*extents)[*extentCount].count = count;
+	*extentCount = *extentCount + 1;
+	return true;
+}
+
+bool DecodeExtentArray(NodeExtent **extents, uint64_t *extentCount, uint8_t *list, uint64_t listBytes, uint64_t count) {
+	uint64_t position = 0, start = 0;
+
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t extentBlocks = 0;
+
+		if (!DecodeExtent(&start, &extentBlocks, list, &position, listBytes) || !extentBlocks || start + extentBlocks > superblock.blockCount) {
+			return false;
+		}
+
+		*extents = (NodeExtent *) realloc(*extents, (*extentCount + 1) * sizeof(NodeExtent));
+		if (!(*extents)) return false;
+		(*extents)[*extentCount].start = start;
+		(*extents)[*extentCount].count = extentBlocks;
+		*extentCount = *extentCount + 1;
+	}
+
+	return true;
+}
+
+bool LoadNodeExtents(AttributeData *dataAttribute, NodeExtent **extents, uint64_t *extentCount, NodeExtent **indexExtents, uint64_t *indexExtentCount) {
+	// Decode the extent list of the data attribute, reading it from the extent index for ESFS_INDIRECTION_L2.
+	// The caller frees the returned arrays.
+
+	uint8_t *list = (uint8_t *) dataAttribute + dataAttribute->dataOffset;
+	uint64_t listBytes = dataAttribute->size - dataAttribute->dataOffset;
+	*extents = *indexExtents = NULL;
+	*extentCount = *indexExtentCount = 0;
+
+	if (dataAttribute->indirection == ESFS_INDIRECTION_DIRECT) {
+		return true;
+	} else if (dataAttribute->indirection == ESFS_INDIRECTION_L1) {
+		return DecodeExtentArray(extents, extentCount, list, listBytes, dataAttribute->count);
+	}
+
+	assert(dataAttribute->indirection == ESFS_INDIRECTION_L2);
+
+	if (!DecodeExtentArray(indexExtents, indexExtentCount, list, listBytes, dataAttribute->count)) {
+		return false;
+	}
+
+	uint64_t indexBlocks = 0;
+
+	for (uint64_t i = 0; i < *indexExtentCount; i++) {
+		indexBlocks += (*indexExtents)[i].count;
+	}
+
+	if (!indexBlocks) {
+		return false;
+	}
+
+	uint8_t *index = (uint8_t *) malloc(indexBlocks * superblock.blockSize);
+	assert(index);
+
+	for (uint64_t i = 0, block = 0; i < *indexExtentCount; block += (*indexExtents)[i].count, i++) {
+		if (!ReadBlock((*indexExtents)[i].start, (*indexExtents)[i].count, index + block * superblock.blockSize)) {
+			free(index);
+			return false;
+		}
+	}
+
+	// Each block of the index has its own header and part of the list.
+	// Indices written before driver version 14 instead have a single header and list spanning all the blocks.
+
+	bool flat = ((ExtentIndexHeader *) index)->bytes > superblock.blockSize - sizeof(ExtentIndexHeader);
+
+	for (uint64_t i = 0; i < (flat ? 1 : indexBlocks); i++) {
+		ExtentIndexHeader *header = (ExtentIndexHeader *) (index + i * superblock.blockSize);
+
+		if (memcmp(header->signature, ESFS_EXTENT_INDEX_SIGNATURE, 4)
+				|| header->bytes + sizeof(ExtentIndexHeader) > (flat ? indexBlocks : 1) * superblock.blockSize
+				|| !DecodeExtentArray(extents, extentCount, (uint8_t *) (header + 1), header->bytes, header->count)) {
+			free(index);
+			return false;
+		}
+	}
+
+	free(index);
+	return true;
+}
+
+bool StoreNodeExtents(AttributeData *dataAttribute, NodeExtent *extents, uint64_t extentCount, NodeExtent **indexExtents, uint64_t *indexExtentCount) {
+	// Store the extent list in the data attribute if it fits, otherwise in an extent index.
+	// Nodes only grow here, so once a node has an extent index it keeps it, and the index never needs fewer blocks.
+
+	uint8_t *list = (uint8_t *) dataAttribute + dataAttribute->dataOffset;
+	uint64_t listBytes = dataAttribute->size - dataAttribute->dataOffset;
+	uint64_t blockListBytes = superblock.blockSize - sizeof(ExtentIndexHeader);
+	uint64_t encodedBytes = 0, previousExtentStart = 0;
+	uint8_t encode[32];
+
+	for (uint64_t i = 0; i < extentCount; i++) {
+		encodedBytes += EncodeExtent(extents[i].start, previousExtentStart, extents[i].count, encode);
+		previousExtentStart = extents[i].start;
+	}
+
+	if (!(*indexExtentCount) && encodedBytes <= listBytes && extentCount <= 0xFFFF) {
+		previousExtentStart = 0;
+		encodedBytes = 0;
+
+		for (uint64_t i = 0; i < extentCount; i++) {
+			encodedBytes += EncodeExtent(extents[i].start, previousExtentStart, extents[i].count, list + encodedBytes);
+			previousExtentStart = extents[i].start;
+		}
+
+		dataAttribute->indirection = ESFS_INDIRECTION_L1;
+		dataAttribute->count = extentCount;
+		return true;
+	}
+
+	// Pack the extents into blocks, each with its own header, as the driver does.
+
+	uint64_t indexBlocks = 0, oldIndexBlocks = 0;
+
+	for (uint64_t i = 0; i < extentCount; indexBlocks++) {
+		previousExtentStart = encodedBytes = 0;
+
+		for (; i < extentCount; i++) {
+			uint64_t length = EncodeExtent(extents[i].start, previousExtentStart, extents[i].count, encode);
+			if (encodedBytes + length > blockListBytes) break;
+			previousExtentStart = extents[i].start;
+			encodedBytes += length;
+		}
+	}
+
+	for (uint64_t i = 0; i < *indexExtentCount; i++) {
+		oldIndexBlocks += (*indexExtents)[i].count;
+	}
+
+	assert(oldIndexBlocks <= indexBlocks);
+
+	while (oldIndexBlocks < indexBlocks) {
+		uint64_t extentStart, extentBlocks;
+
+		if (!AllocateExtent(indexBlocks - oldIndexBlocks, &extentStart, &extentBlocks)
+				|| !AppendExtent(indexExtents, indexExtentCount, extentStart, extentBlocks)) {
+			return false;
+		}
+
+		oldIndexBlocks += extentBlocks;
+	}
+
+	uint8_t *index = (uint8_t *) calloc(indexBlocks, superblock.blockSize);
+	assert(index);
+
+	for (uint64_t i = 0, extent = 0; i < indexBlocks; i++) {
+		ExtentIndexHeader *header = (ExtentIndexHeader *) (index + i * superblock.blockSize);
+		memcpy(header->signature, ESFS_EXTENT_INDEX_SIGNATURE, 4);
+		previousExtentStart = 0;
+
+		for (; extent < extentCount; extent++) {
+			uint64_t length = EncodeExtent(extents[extent].start, previousExtentStart, extents[extent].count, encode);
+			if (header->bytes + length > blockListBytes) break;
+			memcpy((uint8_t *) (header + 1) + header->bytes, encode, length);
+			previousExtentStart = extents[extent].start;
+			header->bytes += length;
+			header->count++;
+		}
+
+		header->checksum = ChecksumMetadata(&superblock, header, sizeof(ExtentIndexHeader) + header->bytes);
+	}
+
+	for (uint64_t i = 0, block = 0; i < *indexExtentCount; block += (*indexExtents)[i].count, i++) {
+		if (!WriteBlock((*indexExtents)[i].start, (*indexExtents)[i].count, index + block * superblock.blockSize)) {
+			free(index);
+			return false;
+		}
+	}
+
+	free(index);
+
+	// Store the list of index extents in the attribute.
+
+	previousExtentStart = encodedBytes = 0;
+
+	for (uint64_t i = 0; i < *indexExtentCount; i++) {
+		uint64_t length = EncodeExtent((*indexExtents)[i].start, previousExtentStart, (*indexExtents)[i].count, encode);
+
+		if (encodedBytes + length > listBytes) {
+			Log("Extent index is too fragmented.\n");
+			EsFSError();
+		}
+
+		memcpy(list + encodedBytes, encode, length);
+		previousExtentStart = (*indexExtents)[i].start;
+		encodedBytes += length;
+	}
+
+	dataAttribute->indirection = ESFS_INDIRECTION_L2;
+	dataAttribute->count = *indexExtentCount;
+	return true;
+}
+
 bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uint64_t totalCount, DirectoryEntryReference *reference, bool read) {
 	if (!totalCount) return true;
 	AttributeData *dataAttribute = (AttributeData *) FindAttribute(node, ESFS_ATTRIBUTE_DATA);
@@ -495,9 +751,18 @@ bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uin
 		return true;
 	}
 
-	assert(dataAttribute->indirection == ESFS_INDIRECTION_L1);
+	assert(dataAttribute->indirection == ESFS_INDIRECTION_L1 || dataAttribute->indirection == ESFS_INDIRECTION_L2);
 
-	int decoded = -1;
+	NodeExtent *extents, *indexExtents;
+	uint64_t extentCount, indexExtentCount;
+
+	if (!LoadNodeExtents(dataAttribute, &extents, &extentCount, &indexExtents, &indexExtentCount)) {
+		free(extents);
+		free(indexExtents);
+		return false;
+	}
+
+	free(indexExtents);
 
 	// Log("\twrite %ld bytes at %ld\n", totalCount, offsetIntoFile);
 
@@ -511,29 +776,21 @@ bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uin
 
 	// Find the extent.
 
-	uint8_t *extents = ((uint8_t *) dataAttribute + dataAttribute->dataOffset);
-
 	{
-		uint64_t position = 0, blockInFile = 0, extentStart = 0;
-		assert(dataAttribute->count || !node->fileSize);
+		uint64_t blockInFile = 0;
+		assert(extentCount || !node->fileSize);
 
 		bool found = false;
 
-		for (uint64_t i = 0; i < dataAttribute->count; i++) {
-			uint64_t extentCount = 0;
-			DecodeExtent(&extentStart, &extentCount, extents, &position, dataAttribute->size - dataAttribute->dataOffset);
-			if (decoded < (int) i) {
-				decoded = i;
-			}
-
-			if (blockInFile + extentCount > block) {
+		for (uint64_t i = 0; i < extentCount; i++) {
+			if (blockInFile + extents[i].count > block) {
 				uint64_t offsetIntoExtent = block - blockInFile;
-				block = extentStart + offsetIntoExtent;
+				block = extents[i].start + offsetIntoExtent;
 				found = true;
 				break;
 			}
 
-			blockInFile += extentCount;
+			blockInFile += extents[i].count;
 		}
 
 		assert(found);
@@ -543,6 +800,7 @@ bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uin
 
 	if (read || count != superblock.blockSize) {
 		if (!ReadBlock(block, 1, blockBuffer)) {
+			free(extents);
 			return false;
 		}
 	}
@@ -553,6 +811,7 @@ bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uin
 		memcpy(blockBuffer + offset, buffer, count);
 
 		if (!WriteBlock(block, 1, blockBuffer)) {
+			free(extents);
 			return false;
 		}
 	}
@@ -570,6 +829,7 @@ bool AccessNode(DirectoryEntry *node, void *buffer, uint64_t offsetIntoFile, uin
 		goto next;
 	}
 
+	free(extents);
 	return true;
 }
 
@@ -586,63 +846,37 @@ bool ResizeNode(DirectoryEntry *entry, uint64_t newSize) {
 
 	// Log("\tresize to %lu\n", newSize);
 
-	dataAttribute->indirection = ESFS_INDIRECTION_L1;
-
 	uint64_t oldSize = entry->fileSize;
 	uint64_t oldBlocks = (oldSize + superblock.blockSize - 1) / superblock.blockSize;
 	uint64_t newBlocks = (newSize + superblock.blockSize - 1) / superblock.blockSize;
 
+	if (dataAttribute->indirection == ESFS_INDIRECTION_DIRECT) {
+		// Any data stored in the attribute is discarded.
+		oldBlocks = 0;
+		dataAttribute->indirection = ESFS_INDIRECTION_L1;
+		dataAttribute->count = 0;
+	}
+
 	entry->fileSize = newSize;
 
 	if (oldBlocks == newBlocks) {
 		// Do nothing.
 	} else if (oldBlocks < newBlocks) {
 		uint64_t increaseBlocks = newBlocks - oldBlocks;
-		uint64_t previousExtentStart = 0, previousExtentCount = 0, previousExtentStart2 = 0;
-
-		uint8_t *extents = ((uint8_t *) dataAttribute + dataAttribute->dataOffset);
-		uint64_t offsetIntoExtentList = 0;
-		uint64_t previousOffsetIntoExtentList = 0;
-
-		for (uint64_t i = 0; i < dataAttribute->count; i++) {
-			previousOffsetIntoExtentList = offsetIntoExtentList;
-			previousExtentStart2 = previousExtentStart;
-			DecodeExtent(&previousExtentStart, &previousExtentCount, extents, &offsetIntoExtentList, dataAttribute->size - dataAttribute->dataOffset);
-			// Log("%ld/%ld/%ld\n", previousExtentStart, extentCount, offsetIntoExtentList);
-			assert(previousExtentStart < superblock.blockCount);
+		NodeExtent *extents, *indexExtents;
+		uint64_t extentCount, indexExtentCount;
+		bool success = LoadNodeExtents(dataAttribute, &extents, &extentCount, &indexExtents, &indexExtentCount);
+
+		while (success && increaseBlocks) {
+			uint64_t extentStart, extentBlocks;
+			success = AllocateExtent(increaseBlocks, &extentStart, &extentBlocks) && AppendExtent(&extents, &extentCount, extentStart, extentBlocks);
+			if (success) increaseBlocks -= extentBlocks;
 		}
 
-		while (increaseBlocks) {
-			uint64_t extentStart, extentCount, encodedLength;
-			uint8_t encode[32];
-
-			if (!AllocateExtent(increaseBlocks, &extentStart, &extentCount)) {
-				return false;
-			}
-
-			if (extentStart == previousExtentStart + previousExtentCount) {
-				dataAttribute->count--;
-				offsetIntoExtentList = previousOffsetIntoExtentList;
-				encodedLength = EncodeExtent(previousExtentStart, previousExtentStart2, extentCount + previousExtentCount, encode);
-			} else {
-				encodedLength = EncodeExtent(extentStart, previousExtentStart, extentCount, encode);
-			}
-
-			// Log("\t@%ld alloc %ld, %ld\n", offsetIntoExtentList, extentStart, extentCount);
-
-			// Log("%ld vs %ld\n", offsetIntoExtentList + encodedLength, (uint64_t) (dataAttribute->size - dataAttribute->dataOffset));
-
-			if (offsetIntoExtentList + encodedLength > (uint64_t) (dataAttribute->size - dataAttribute->dataOffset)) {
-				Log("Unimplemented - indirection past L1.\n");
-				EsFSError();
-			}
-
-			memcpy(extents + offsetIntoExtentList, encode, encodedLength);
-			offsetIntoExtentList += encodedLength;
-			increaseBlocks -= extentCount;
-			dataAttribute->count++;
-			previousExtentStart = extentStart;
-		}
+		success = success && StoreNodeExtents(dataAttribute, extents, extentCount, &indexExtents, &indexExtentCount);
+		free(extents);
+		free(indexExtents);
+		return success;
 	} else {
 		Log("Unimplemented - node truncation.\n");
 		EsFSError();
@@ -731,7 +965,7 @@ void NewDirectoryEntry(DirectoryEntry *entry, uint8_t nodeType, EsUniqueIdentifi
 
 	assert(position == (uint8_t *) (entry + 1));
 	entry->checksum = 0;
-	entry->checksum = CalculateCRC32(entry, sizeof(DirectoryEntry), 0);
+	entry->checksum = ChecksumMetadata(&superblock, entry, sizeof(DirectoryEntry));
 }
 
 bool AddNode(const char *name, uint8_t nodeType, DirectoryEntry *outputEntry, DirectoryEntryReference *outputReference, 
@@ -748,7 +982,7 @@ bool AddNode(const char *name, uint8_t nodeType, DirectoryEntry *outputEntry, Di
 
 	{
 
-		assert(dataAttribute->indirection == ESFS_INDIRECTION_L1);
+		assert(dataAttribute->indirection == ESFS_INDIRECTION_L1 || dataAttribute->indirection == ESFS_INDIRECTION_L2);
 
 		if (!(directoryAttribute->childNodes % superblock.directoryEntriesPerBlock)) {
 			// Log("increasing directory to fit %ld entries\n========={\n", (directory.fileSize + superblock.blockSize) / sizeof(DirectoryEntry));
@@ -934,8 +1168,8 @@ bool AddNode(const char *name, uint8_t nodeType, DirectoryEntry *outputEntry, Di
 
 			// Write the blocks.
 
-			sibling->checksum = 0; sibling->checksum = CalculateCRC32(sibling, superblock.blockSize, 0);
-			vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock.blockSize, 0);
+			sibling->checksum = 0; sibling->checksum = ChecksumMetadata(&superblock, sibling, superblock.blockSize);
+			vertex->checksum = 0; vertex->checksum = ChecksumMetadata(&superblock, vertex, superblock.blockSize);
 			if (!WriteBlock(siblingBlock, 1, sibling)) return false;
 			if (!WriteBlock(blocks[depth], 1, vertex)) return false;
 
@@ -947,7 +1181,7 @@ bool AddNode(const char *name, uint8_t nodeType, DirectoryEntry *outputEntry, Di
 
 		// Write the block.
 
-		vertex->checksum = 0; vertex->checksum = CalculateCRC32(vertex, superblock.blockSize, 0);
+		vertex->checksum = 0; vertex->checksum = ChecksumMetadata(&superblock, vertex, superblock.blockSize);
 		if (!WriteBlock(blocks[depth], 1, vertex)) return false;
 	}
 
@@ -1094,6 +1328,196 @@ int64_t Import(ImportNode node, DirectoryEntryReference parentDirectory) {
 
 	return totalSize;
 }
+
+typedef struct VolumeAnalysis {
+	uint64_t files, directories;
+	uint64_t inlineFiles, indexedFiles, fragmentedFiles, extents;
+	uint64_t mostExtents;
+	char mostExtentsName[64];
+
+	uint64_t deepestIndex, largestDirectory;
+	char deepestIndexName[64];
+
+	uint64_t freeBlocks, freeExtents, largestFreeExtent;
+	uint64_t freeExtentSizes[5]; // 1, 2-15, 16-255, 256-4095, and 4096+ blocks.
+} VolumeAnalysis;
+
+void AnalyzeCopyName(DirectoryEntry *entry, char *name, size_t nameBytes) {
+	AttributeFilename *filename = (AttributeFilename *) FindAttribute(entry, ESFS_ATTRIBUTE_FILENAME);
+	size_t length = filename->length;
+	if (length > nameBytes - 1) length = nameBytes - 1;
+	memcpy(name, filename->filename, length);
+	name[length] = 0;
+}
+
+uint64_t AnalyzeExtentCount(AttributeData *data) {
+	if (data->indirection != ESFS_INDIRECTION_L1 && data->indirection != ESFS_INDIRECTION_L2) {
+		return 0;
+	}
+
+	NodeExtent *extents, *indexExtents;
+	uint64_t extentCount, indexExtentCount;
+	if (!LoadNodeExtents(data, &extents, &extentCount, &indexExtents, &indexExtentCount)) extentCount = 0;
+	free(extents);
+	free(indexExtents);
+	return extentCount;
+}
+
+uint64_t AnalyzeIndexDepth(uint64_t block, uint64_t depth) {
+	if (!block || depth > ESFS_INDEX_MAX_DEPTH) return 0;
+
+	uint8_t buffer[superblock.blockSize];
+	if (!ReadBlock(block, 1, buffer)) return 0;
+	IndexVertex *vertex = (IndexVertex *) buffer;
+	if (memcmp(vertex->signature, ESFS_INDEX_VERTEX_SIGNATURE, 4)) return 0;
+
+	uint64_t deepest = 0;
+
+	for (uint64_t i = 0; i <= vertex->count; i++) {
+		uint64_t childDepth = AnalyzeIndexDepth(ESFS_VERTEX_KEY(vertex, i)->child, depth + 1);
+		if (childDepth > deepest) deepest = childDepth;
+	}
+
+	return deepest + 1;
+}
+
+bool AnalyzeDirectory(DirectoryEntry *directory, bool isRoot, VolumeAnalysis *analysis) {
+	AttributeDirectory *directoryAttribute = (AttributeDirectory *) FindAttribute(directory, ESFS_ATTRIBUTE_DIRECTORY);
+	uint64_t indexDepth = AnalyzeIndexDepth(directoryAttribute->indexRootBlock, 0);
+
+	analysis->directories++;
+
+	if (indexDepth > analysis->deepestIndex) {
+		analysis->deepestIndex = indexDepth;
+
+		if (isRoot) strcpy(analysis->deepestIndexName, "/");
+		else AnalyzeCopyName(directory, analysis->deepestIndexName, sizeof(analysis->deepestIndexName));
+	}
+
+	if (directoryAttribute->childNodes > analysis->largestDirectory) {
+		analysis->largestDirectory = directoryAttribute->childNodes;
+	}
+
+	for (uintptr_t i = 0; i < directoryAttribute->childNodes; i++) {
+		DirectoryEntry child;
+
+		if (!AccessNode(directory, &child, sizeof(DirectoryEntry) * i, sizeof(DirectoryEntry), NULL, true)) {
+			return false;
+		}
+
+		if (child.nodeType == ESFS_NODE_TYPE_DIRECTORY) {
+			if (!AnalyzeDirectory(&child, false, analysis)) return false;
+			continue;
+		}
+
+		AttributeData *data = (AttributeData *) FindAttribute(&child, ESFS_ATTRIBUTE_DATA);
+		uint64_t extents = AnalyzeExtentCount(data);
+
+		analysis->files++;
+		analysis->extents += extents;
+		if (data->indirection == ESFS_INDIRECTION_DIRECT) analysis->inlineFiles++;
+		if (data->indirection == ESFS_INDIRECTION_L2) analysis->indexedFiles++;
+		if (extents > 1) analysis->fragmentedFiles++;
+
+		if (extents > analysis->mostExtents) {
+			analysis->mostExtents = extents;
+			AnalyzeCopyName(&child, analysis->mostExtentsName, sizeof(analysis->mostExtentsName));
+		}
+	}
+
+	return true;
+}
+
+void AnalyzeFreeSpace(VolumeAnalysis *analysis) {
+	uint8_t bitmap[superblock.blocksPerGroupBlockBitmap * superblock.blockSize];
+
+	for (uint64_t i = 0; i < superblock.groupCount; i++) {
+		GroupDescriptor *group = groupDescriptorTable + i;
+		uint64_t blocksInGroup = superblock.blockCount - i * superblock.blocksPerGroup;
+		if (blocksInGroup > superblock.blocksPerGroup) blocksInGroup = superblock.blocksPerGroup;
+
+		if (group->blockBitmap) {
+			if (!ReadBlock(group->blockBitmap, superblock.blocksPerGroupBlockBitmap, bitmap)) return;
+		} else {
+			// The group hasn't been used yet, so only the space for its bitmap will be taken.
+			memset(bitmap, 0, sizeof(bitmap));
+			for (uint64_t j = 0; j < superblock.blocksPerGroupBlockBitmap; j++) bitmap[j / 8] |= 1 << (j % 8);
+		}
+
+		for (uint64_t j = 0; j < blocksInGroup; ) {
+			if (bitmap[j / 8] & (1 << (j % 8))) {
+				j++;
+				continue;
+			}
+
+			uint64_t count = 0;
+			while (j < blocksInGroup && (~bitmap[j / 8] & (1 << (j % 8)))) count++, j++;
+
+			analysis->freeBlocks += count;
+			analysis->freeExtents++;
+			if (count > analysis->largestFreeExtent) analysis->largestFreeExtent = count;
+			analysis->freeExtentSizes[count == 1 ? 0 : count < 16 ? 1 : count < 256 ? 2 : count < 4096 ? 3 : 4]++;
+		}
+	}
+}
+
+bool Analyze() {
+	// Read the volume without mounting it, so that the image isn't modified.
+
+	blockSize = ESFS_BOOT_SUPER_BLOCK_SIZE;
+
+	if (!ReadBlock(1, 1, &superblock)) {
+		return false;
+	}
+
+	if (memcmp(superblock.signature, ESFS_SIGNATURE_STRING, 16)) {
+		Log("Error: The drive does not contain an EsFS volume.\n");
+		return false;
+	}
+
+	if (superblock.mounted) {
+		Log("Warning: The volume was not unmounted, so the results may be inaccurate.\n");
+	}
+
+	blockSize = superblock.blockSize;
+	groupDescriptorTable = (GroupDescriptor *) malloc(superblock.groupCount * sizeof(GroupDescriptor) + superblock.blockSize - 1);
+
+	if (!ReadBlock(superblock.gdtFirstBlock, (superblock.groupCount * sizeof(GroupDescriptor) + superblock.blockSize - 1) / superblock.blockSize, groupDescriptorTable)) {
+		free(groupDescriptorTable);
+		return false;
+	}
+
+	VolumeAnalysis analysis = {};
+	DirectoryEntry root;
+	bool success = ReadDirectoryEntryReference(superblock.root, &root) && AnalyzeDirectory(&root, true, &analysis);
+	AnalyzeFreeSpace(&analysis);
+	free(groupDescriptorTable);
+
+	if (!success) {
+		Log("Error: Could not read the directory tree.\n");
+		return false;
+	}
+
+	uint64_t filesWithBlocks = analysis.files - analysis.inlineFiles;
+
+	Log("Volume '%.*s': %lu blocks of %lu bytes, %lu used (%lu%%).\n", (int) strnlen(superblock.volumeName, ESFS_MAXIMUM_VOLUME_NAME_LENGTH), superblock.volumeName,
+			superblock.blockCount, superblock.blockSize, superblock.blocksUsed, superblock.blocksUsed * 100 / superblock.blockCount);
+	Log("Files: %lu (%lu stored in their directory entry, %lu with an extent index). Directories: %lu.\n",
+			analysis.files, analysis.inlineFiles, analysis.indexedFiles, analysis.directories);
+	Log("Extents: %lu, %lu.%02lu per file with data blocks. Fragmented files: %lu (%lu%%).\n", analysis.extents,
+			filesWithBlocks ? analysis.extents / filesWithBlocks : 0, filesWithBlocks ? analysis.extents * 100 / filesWithBlocks % 100 : 0,
+			analysis.fragmentedFiles, filesWithBlocks ? analysis.fragmentedFiles * 100 / filesWithBlocks : 0);
+	if (analysis.mostExtents > 1) Log("Most fragmented file: '%s', with %lu extents.\n", analysis.mostExtentsName, analysis.mostExtents);
+	Log("Free space: %lu blocks in %lu extents; the largest is %lu blocks (%lu%% of the free space).\n",
+			analysis.freeBlocks, analysis.freeExtents, analysis.largestFreeExtent, 
+			analysis.freeBlocks ? analysis.largestFreeExtent * 100 / analysis.freeBlocks : 0);
+	Log("Free extent sizes: 1: %lu, 2-15: %lu, 16-255: %lu, 256-4095: %lu, 4096+: %lu.\n", analysis.freeExtentSizes[0], 
+			analysis.freeExtentSizes[1], analysis.freeExtentSizes[2], analysis.freeExtentSizes[3], analysis.freeExtentSizes[4]);
+	Log("Directory indices: the deepest has %lu levels ('%s'); the largest directory has %lu entries.\n", 
+			analysis.deepestIndex, analysis.deepestIndexName, analysis.largestDirectory);
+
+	return true;
+}
 #endif
 
 bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osInstallation,
@@ -1118,6 +1542,7 @@ bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osIns
 
 		superblock.requiredReadVersion = ESFS_DRIVER_VERSION;
 		superblock.requiredWriteVersion = ESFS_DRIVER_VERSION;
+		superblock.flags = ESFS_SUPERBLOCK_FLAG_CRC32C; // Requires version 13.
 
 		if (driveSize < 2048ll * 1024 * 1024) { // < 2GB
 			superblock.blockSize = 2048; // Must be >= sizeof(DirectoryEntry).
@@ -1141,6 +1566,17 @@ bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osIns
 		uint64_t blockCoreNodes = blockGroup0Bitmap + superblock.blocksPerGroupBlockBitmap;
 		uint64_t end = blockCoreNodes + ((ESFS_CORE_NODE_COUNT + superblock.directoryEntriesPerBlock - 1) / superblock.directoryEntriesPerBlock);
 
+		// Reserve space for the metadata journal after the core nodes.
+
+		uint64_t journalBlocks = superblock.blockCount / 256;
+		if (journalBlocks > 2048) journalBlocks = 2048;
+		if (journalBlocks < 64) journalBlocks = 64;
+		if (end + journalBlocks > superblock.blocksPerGroup / 2) journalBlocks = 0;
+
+		superblock.journalFirstBlock = journalBlocks ? end : 0;
+		superblock.journalBlockCount = journalBlocks;
+		end += journalBlocks;
+
 		superblock.blocksUsed = end;
 		superblock.gdtFirstBlock = blockGDT;
 
@@ -1170,13 +1606,23 @@ bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osIns
 			data->size = sizeof(DirectoryEntry) - ESFS_ATTRIBUTE_OFFSET - directory->size;
 			data->indirection = ESFS_INDIRECTION_L1;
 			data->dataOffset = ESFS_ATTRIBUTE_OFFSET;
-			entry->checksum = CalculateCRC32(entry, sizeof(DirectoryEntry), 0);
+			entry->checksum = ChecksumMetadata(&superblock, entry, sizeof(DirectoryEntry));
 		}
 
 		if (!WriteBytes(blockCoreNodes * superblock.blockSize, sizeof(coreNodes), &coreNodes)) {
 			return false;
 		}
 
+		if (superblock.journalBlockCount) {
+			// Make sure the journal doesn't start with a valid transaction.
+			uint8_t zero[superblock.blockSize];
+			memset(zero, 0, superblock.blockSize);
+
+			if (!WriteBytes(superblock.journalFirstBlock * superblock.blockSize, superblock.blockSize, zero)) {
+				return false;
+			}
+		}
+
 		superblock.checksum = CalculateCRC32(&superblock, sizeof(Superblock), 0);
 
 		if (!WriteBytes(ESFS_BOOT_SUPER_BLOCK_SIZE, ESFS_BOOT_SUPER_BLOCK_SIZE, &superblock)) {
@@ -1197,7 +1643,7 @@ bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osIns
 					for (uint64_t i = 0; i < superblock.blocksUsed; i++) firstGroupBitmap[i / 8] |= 1 << (i % 8);
 					buffer[i].blocksUsed = superblock.blocksUsed;
 					buffer[i].blockBitmap = blockGroup0Bitmap;
-					buffer[i].bitmapChecksum = CalculateCRC32(firstGroupBitmap, sizeof(firstGroupBitmap), 0);
+					buffer[i].bitmapChecksum = ChecksumMetadata(&superblock, firstGroupBitmap, sizeof(firstGroupBitmap));
 					buffer[i].largestExtent = superblock.blocksPerGroup - superblock.blocksUsed;
 
 					if (!WriteBytes(blockGroup0Bitmap * superblock.blockSize, sizeof(firstGroupBitmap), &firstGroupBitmap)) {
@@ -1205,7 +1651,7 @@ bool Format(uint64_t driveSize, const char *volumeName, EsUniqueIdentifier osIns
 					}
 				}
 
-				buffer[i].checksum = CalculateCRC32(buffer + i, sizeof(GroupDescriptor), 0);
+				buffer[i].checksum = ChecksumMetadata(&superblock, buffer + i, sizeof(GroupDescriptor));
 			}
 
 			if (!WriteBytes(superblock.gdtFirstBlock * superblock.blockSize, superblock.groupCount * sizeof(GroupDescriptor), buffer)) {
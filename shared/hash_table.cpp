@@ -2,8 +2,6 @@
 // It is released under the terms of the MIT license -- see LICENSE.md.
 // Written by: nakst.
 
-// TODO Test deleting values in hash stores with variable length keys.
-
 //////////////////////////////////////////
 
 struct HashTableKey {
@@ -305,40 +303,70 @@ void *HashStorePut(HashTable *table, HashStoreOptions *options, const void *key,
 		uint8_t *value = table->storage + index * (options->keyBytes + options->valueBytes);
 		uint8_t *keyDestination = value + options->valueBytes;
 
-		if (!variableLengthKeys) {
+		if (variableLengthKeys) {
+			// Variable length keys are copied to the heap, and a pointer to the copy is kept in the storage.
+			// The copy is prefixed with the key's length, so that HashStoreDelete can find the slot of the item it moves.
+			EsAssert(options->keyBytes == sizeof(void *));
+			size_t *keyCopy = (size_t *) EsHeapAllocate(sizeof(size_t) + keyBytes, false);
+			if (!keyCopy) return nullptr;
+			keyCopy[0] = keyBytes;
+			EsMemoryCopy(keyCopy + 1, key, keyBytes);
+			k.longKey = keyCopy + 1;
+			EsMemoryCopy(keyDestination, &k.longKey, sizeof(void *));
+		} else {
 			EsMemoryCopy(keyDestination, key, keyBytes);
 			k.longKey = keyDestination;
 		}
 
-		if (!_HashTablePutSlot(table, slot, k, value, true, variableLengthKeys)) {
-			return nullptr;
-		}
-
-		if (variableLengthKeys) {
-			EsAssert(options->keyBytes == sizeof(void *));
-			EsMemoryCopy(keyDestination, slot->key.longKey, sizeof(void *));
-		}
+		_HashTablePutSlot(table, slot, k, value, true, false);
 	}
 
 	return slot->value;
 }
 
 bool HashStoreDelete(HashTable *table, HashStoreOptions *options, const void *key, size_t keyBytes = 0) {
+	bool variableLengthKeys = keyBytes;
 	if (!keyBytes) keyBytes = options->keyBytes;
 	uint8_t *value = (uint8_t *) HashTableGetLong(table, key, keyBytes);
 	if (!value) return false;
+	void *keyCopy = nullptr;
+	if (variableLengthKeys) EsMemoryCopy(&keyCopy, value + options->valueBytes, sizeof(void *));
 	bool success = HashTableDeleteLong(table, key, keyBytes);
 	EsAssert(success);
+	if (keyCopy) EsHeapFree((size_t *) keyCopy - 1);
+
+	// Move the last item into the deleted item's place in the storage, and update its slot.
+
 	uint8_t *end = table->storage + (options->keyBytes + options->valueBytes) * table->itemCount;
 	if (value == end) return true;
 	EsMemoryCopy(value, end, options->keyBytes + options->valueBytes);
 	HashTableKey k;
-	k.longKey = value + options->valueBytes, k.longKeyBytes = keyBytes;
+
+	if (variableLengthKeys) {
+		EsMemoryCopy(&k.longKey, value + options->valueBytes, sizeof(void *));
+		k.longKeyBytes = ((size_t *) k.longKey)[-1];
+	} else {
+		k.longKey = value + options->valueBytes;
+		k.longKeyBytes = keyBytes;
+	}
+
 	success = HashTablePut(table, k, value, true, false);
 	EsAssert(success);
 	return true;
 }
 
+void HashStoreFree(HashTable *table, bool variableLengthKeys) {
+	if (variableLengthKeys) {
+		for (uintptr_t i = 0; i < table->slotCount; i++) {
+			if (table->slots[i].key.used) {
+				EsHeapFree((size_t *) table->slots[i].key.longKey - 1);
+			}
+		}
+	}
+
+	HashTableFree(table, false);
+}
+
 //////////////////////////////////////////
 
 template <class K /* set to char for long keys */, class V>
@@ -386,7 +414,7 @@ struct HashStore {
 	}
 
 	inline void Free() {
-		HashTableFree(&table, sizeof(K) == 1);
+		HashStoreFree(&table, sizeof(K) == 1);
 	}
 };
 
@@ -478,7 +506,7 @@ int main() {
 			assert(!HashStoreGet(&store, &options, &key));
 		}
 
-		HashTableFree(&store, true);
+		HashStoreFree(&store, false);
 	}
 
 #if 0
@@ -420,6 +420,11 @@ typedef struct
 STBIDEF stbi_uc *stbi_load_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels);
 
+// Essence: like stbi_load_from_memory, but the decoder may return a reduced-resolution image,
+// provided it still covers the image scaled to fit within fit_x by fit_y.
+// JPEGs are scaled by 1/2, 1/4 or 1/8 by running a 4-, 2- or 1-point IDCT on the low frequency coefficients, and interlaced PNGs skip the Adam7 passes that aren't needed.
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, int fit_x, int fit_y);
+
 #ifndef STBI_NO_STDIO
 STBIDEF stbi_uc *stbi_load            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
@@ -812,6 +817,8 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi__uint32 fit_x, fit_y; // Essence: 0 to decode at full resolution.
 } stbi__context;
 
 
@@ -825,6 +832,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->fit_x = s->fit_y = 0;
 }
 
 // initialize a callback-based context
@@ -836,6 +844,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
+   s->fit_x = s->fit_y = 0;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
 }
@@ -1411,6 +1420,17 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int fit_x, int fit_y)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   if (fit_x > 0 && fit_y > 0) {
+      s.fit_x = fit_x;
+      s.fit_y = fit_y;
+   }
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1972,6 +1992,8 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   int scale_shift; // Essence: blocks are decoded to (8 >> scale_shift) pixels square.
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2910,6 +2932,59 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// Essence: c(u) * cos((2x+1) * u * pi / 2n) in 4.12 fixed point, where c(0) = 1 and c(u) = sqrt(2) otherwise,
+// indexed [x][u], for the n-point inverse DCTs used when decoding at 1/2 and 1/4 scale.
+static const int stbi__idct_reduced_4[16] = {
+   4096,  5352,  4096,  2217,
+   4096,  2217, -4096, -5352,
+   4096, -2217, -4096,  5352,
+   4096, -5352,  4096, -2217,
+};
+
+static const int stbi__idct_reduced_2[4] = {
+   4096,  4096,
+   4096, -4096,
+};
+
+// Essence: the inverse DCT of the top-left size x size coefficients gives the block scaled down to size x size pixels,
+// without computing the full resolution block first.
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], int size, const int *table)
+{
+   int i,j,k, tmp[16];
+   for (j=0; j < size; ++j) {
+      for (i=0; i < size; ++i) {
+         int sum = 0;
+         for (k=0; k < size; ++k)
+            sum += data[j*8+k] * table[i*size+k];
+         tmp[j*size+i] = (sum + 2048) >> 12;
+      }
+   }
+   for (j=0; j < size; ++j) {
+      for (i=0; i < size; ++i) {
+         long long sum = 0;
+         for (k=0; k < size; ++k)
+            sum += (long long) tmp[k*size+i] * table[j*size+k];
+         // the 8-point coefficients carry a factor of 8 relative to the pixel values
+         out[j*out_stride+i] = stbi__clamp((int) ((sum + (1 << 14)) >> 15) + 128);
+      }
+   }
+}
+
+static void stbi__jpeg_idct(stbi__jpeg *z, stbi_uc *out, int out_stride, short data[64])
+{
+   int shift = z->scale_shift;
+   if (shift == 0) {
+      z->idct_block_kernel(out, out_stride, data);
+   } else if (shift == 1) {
+      stbi__idct_reduced(out, out_stride, data, 4, stbi__idct_reduced_4);
+   } else if (shift == 2) {
+      stbi__idct_reduced(out, out_stride, data, 2, stbi__idct_reduced_2);
+   } else {
+      // only the DC coefficient contributes to the average of the block
+      out[0] = stbi__clamp((data[0] + 1028) >> 3);
+   }
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
@@ -2928,7 +3003,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, z->img_comp[n].data+(z->img_comp[n].w2*j+i)*(8 >> z->scale_shift), z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2952,11 +3027,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*(8 >> z->scale_shift);
+                        int y2 = (j*z->img_comp[n].v + y)*(8 >> z->scale_shift);
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        stbi__jpeg_idct(z, z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -3053,7 +3128,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, z->img_comp[n].data+(z->img_comp[n].w2*j+i)*(8 >> z->scale_shift), z->img_comp[n].w2, data);
             }
          }
       }
@@ -3281,6 +3356,12 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   // pick the largest DCT scaling that still covers the requested fit
+   z->scale_shift = 0;
+   if (s->fit_x && s->fit_y)
+      while (z->scale_shift < 3 && ((s->img_x >> (z->scale_shift+1)) >= s->fit_x || (s->img_y >> (z->scale_shift+1)) >= s->fit_y))
+         ++z->scale_shift;
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3292,8 +3373,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3303,10 +3384,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one block of coefficients per 8x8 block, regardless of scaling
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3817,6 +3898,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   if (z->scale_shift) {
+      // the components were decoded at reduced resolution, so shrink the image to match
+      z->s->img_x = (z->s->img_x + (1 << z->scale_shift) - 1) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + (1 << z->scale_shift) - 1) >> z->scale_shift;
+      for (n=0; n < z->s->img_n; ++n) {
+         z->img_comp[n].x = (z->s->img_x * z->img_comp[n].h + z->img_h_max-1) / z->img_h_max;
+         z->img_comp[n].y = (z->s->img_y * z->img_comp[n].v + z->img_v_max-1) / z->img_v_max;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -4806,14 +4897,24 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
-   int p;
+   int p, passes, scale_shift = 0;
+   stbi__uint32 final_x, final_y;
    if (!interlaced)
       return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
 
+   // Essence: passes 1, 1-3 and 1-5 together give every 8th, 4th and 2nd pixel,
+   // so when a reduced-resolution image is acceptable the remaining passes can be skipped
+   while (a->s->fit_x && a->s->fit_y && scale_shift < 3
+         && ((a->s->img_x >> (scale_shift+1)) >= a->s->fit_x || (a->s->img_y >> (scale_shift+1)) >= a->s->fit_y))
+      ++scale_shift;
+   final_x = (a->s->img_x + (1 << scale_shift) - 1) >> scale_shift;
+   final_y = (a->s->img_y + (1 << scale_shift) - 1) >> scale_shift;
+   passes = scale_shift == 3 ? 1 : scale_shift == 2 ? 3 : scale_shift == 1 ? 5 : 7;
+
    // de-interlacing
-   final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+   final = (stbi_uc *) stbi__malloc_mad3(final_x, final_y, out_bytes, 0);
    if (!final) return stbi__err("outofmem", "Out of memory");
-   for (p=0; p < 7; ++p) {
+   for (p=0; p < passes; ++p) {
       int xorig[] = { 0,4,0,2,0,1,0 };
       int yorig[] = { 0,0,4,0,2,0,1 };
       int xspc[]  = { 8,8,4,4,2,2,1 };
@@ -4830,9 +4931,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
-               int out_y = j*yspc[p]+yorig[p];
-               int out_x = i*xspc[p]+xorig[p];
-               EsCRTmemcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
+               int out_y = (j*yspc[p]+yorig[p]) >> scale_shift;
+               int out_x = (i*xspc[p]+xorig[p]) >> scale_shift;
+               EsCRTmemcpy(final + out_y*final_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
          }
@@ -4842,6 +4943,8 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       }
    }
    a->out = final;
+   a->s->img_x = final_x;
+   a->s->img_y = final_y;
 
    return 1;
 }
@@ -49,6 +49,9 @@
 #define ColorHighlight "\033[0;36m"
 #define ColorNormal "\033[0m"
 
+// The script engine keeps bytecode images of the scripts it runs, so that running them again skips compilation.
+#define SCRIPT_ENGINE "bin/script --image-cache=bin/script_images "
+
 bool acceptedLicense;
 bool automatedBuild;
 bool foundValidCrossCompiler;
@@ -168,18 +171,18 @@ bool BuildAPIDependencies() {
 		ParseDependencies("bin/dependency_files/api_header.d", "API Header", false);
 	}
 
-	if (CallSystem("bin/script ports/port.script portName=musl targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
+	if (CallSystem(SCRIPT_ENGINE "ports/port.script portName=musl targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
 
 	if (CallSystem(TOOLCHAIN_PREFIX "-gcc -c desktop/crt1.c -o cross/lib/gcc/" TOOLCHAIN_PREFIX "/" GCC_VERSION "/crt1.o")) return false;
 	if (CallSystem(TOOLCHAIN_PREFIX "-gcc -c desktop/crtglue.c -o cross/lib/gcc/" TOOLCHAIN_PREFIX "/" GCC_VERSION "/crtglue.o")) return false;
 
 	if (IsOptionEnabled("Dependency.FreeTypeAndHarfBuzz")) {
-		if (CallSystem("bin/script ports/port.script portName=freetype targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
-		if (CallSystem("bin/script ports/port.script portName=harfbuzz targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
+		if (CallSystem(SCRIPT_ENGINE "ports/port.script portName=freetype targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
+		if (CallSystem(SCRIPT_ENGINE "ports/port.script portName=harfbuzz targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
 	}
 
 	if (IsOptionEnabled("Flag.ENABLE_POSIX_SUBSYSTEM")) {
-		if (CallSystem("bin/script ports/port.script portName=busybox targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
+		if (CallSystem(SCRIPT_ENGINE "ports/port.script portName=busybox targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX)) return false;
 	}
 
 	if (CallSystem("cp -p kernel/module.h root/Applications/POSIX/include")) return false;
@@ -1143,7 +1146,7 @@ void DoCommand(const char *l) {
 		LoadOptions();
 		Compile(COMPILE_FOR_EMULATOR, atoi(GetOptionString("Emulator.PrimaryDriveMB")), NULL);
 	} else if (0 == strcmp(l, "build-cross")) {
-		CallSystem("bin/script ports/port.script portName=gcc buildCross=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
+		CallSystem(SCRIPT_ENGINE "ports/port.script portName=gcc buildCross=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
 		printf("Please restart the build system.\n");
 		exit(0);
 	} else if (0 == strcmp(l, "build-utilities") || 0 == strcmp(l, "u")) {
@@ -1316,7 +1319,7 @@ void DoCommand(const char *l) {
 
 		printf("\n");
 	} else if (0 == strcmp(l, "build-optional-ports")) {
-		CallSystemF("bin/script ports/port.script portName=all targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
+		CallSystemF(SCRIPT_ENGINE "ports/port.script portName=all targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
 	} else if (0 == memcmp(l, "do ", 3)) {
 		CallSystem(l + 3);
 	} else if (0 == memcmp(l, "live ", 5) || 0 == strcmp(l, "live")) {
@@ -1388,6 +1391,8 @@ void DoCommand(const char *l) {
 		}
 
 		printf("Created " ColorHighlight "bin/essence.iso" ColorNormal ".\n");
+	} else if (0 == strcmp(l, "analyze-drive")) {
+		CallSystem("bin/build_core analyze bin/drive");
 	} else if (0 == strcmp(l, "line-count")) {
 		FILE *f = fopen("bin/count.tmp", "wb");
 		fprintf(f, "0");
@@ -1434,7 +1439,7 @@ void DoCommand(const char *l) {
 
 		if (!alreadyNamedPort) {
 			printf("\n");
-			CallSystem("bin/script ports/port.script");
+			CallSystem(SCRIPT_ENGINE "ports/port.script");
 
 			LoadOptions();
 
@@ -1451,7 +1456,7 @@ void DoCommand(const char *l) {
 			l2 = (char *) l + 11;
 		}
 
-		int status = CallSystemF("bin/script ports/port.script portName=%s targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX, l2);
+		int status = CallSystemF(SCRIPT_ENGINE "ports/port.script portName=%s targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX, l2);
 
 		if (!alreadyNamedPort) {
 			free(l2);
@@ -1512,15 +1517,15 @@ void DoCommand(const char *l) {
 	} else if (0 == strcmp(l, "get-toolchain")) {
 #if defined(__linux__) && defined(__x86_64__)
 		fprintf(stderr, "Downloading the compiler toolchain...\n");
-		CallSystem("bin/script util/get_source.script checksum=700205f81c7a5ca3279ae7b1fdb24e025d33b36a9716b81a71125bf0fec0de50 "
+		CallSystem(SCRIPT_ENGINE "util/get_source.script checksum=700205f81c7a5ca3279ae7b1fdb24e025d33b36a9716b81a71125bf0fec0de50 "
 				"directoryName=prefix url=https://github.com/nakst/build-gcc/releases/download/gcc-11.1.0/gcc-x86_64-essence.tar.xz");
 		DoCommand("setup-pre-built-toolchain");
 		AddCompilerToPath();
 #else
 		if (automatedBuild) {
-			CallSystem("bin/script ports/port.script portName=gcc buildCross=true skipYesChecks=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
+			CallSystem(SCRIPT_ENGINE "ports/port.script portName=gcc buildCross=true skipYesChecks=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
 		} else {
-			CallSystem("bin/script ports/port.script portName=gcc buildCross=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
+			CallSystem(SCRIPT_ENGINE "ports/port.script portName=gcc buildCross=true targetName=" TARGET_NAME " toolchainPrefix=" TOOLCHAIN_PREFIX);
 		}
 
 		exit(0);
@@ -1547,6 +1552,7 @@ void DoCommand(const char *l) {
 		printf(ColorHighlight "\n=== Utilities ===\n" ColorNormal);
 		printf("designer2                         - Open the interface style designer.\n");
 		printf("line-count                        - Count lines of code.\n");
+		printf("analyze-drive                     - Report fragmentation of the files and free space in bin/drive.\n");
 		printf("ascii <string>                    - Convert a string to a list of ASCII codepoints.\n");
 		printf("a2l <executable>                  - Translate addresses to lines.\n");
 		printf("make-crash-report                 - Make a crash report.\n");
@@ -1518,6 +1518,23 @@ int main(int argc, char **argv) {
 		}
 
 		arrput(applicationManifests, argv[2]);
+	} else if (0 == strcmp(argv[1], "analyze")) {
+		if (argc != 3 && argc != 4) {
+			Log("Usage: analyze <drive> <partition offset>\n");
+			return 1;
+		}
+
+		_drive = FileOpen(argv[2], 'r');
+
+		if (_drive.error) {
+			Log("Error: Could not open drive '%s'.\n", argv[2]);
+			return 1;
+		}
+
+		_partitionOffset = argc == 4 ? strtoull(argv[3], NULL, 0) : 1048576;
+		bool success = Analyze();
+		FileClose(_drive);
+		return success ? 0 : 1;
 	} else if (0 == strcmp(argv[1], "headers")) {
 		MakeDirectory("bin");
 		return HeaderGeneratorMain(argc - 1, argv + 1);
@@ -1,5 +1,5 @@
 // TODO Basic missing features:
-// 	- Maps: T[int], T[str].
+// 	- Iterating over maps with for-in.
 // 	- Control flow: break, continue.
 // 	- Other operators: remainder, ternary.
 // 	- Named optional arguments with default values.
@@ -38,6 +38,14 @@
 
 #define FUNCTION_MAX_ARGUMENTS (20) // Also the maximum number of return values in a tuple.
 
+#define HEAP_NURSERY_ENTRIES (4096) // Allocations between minor collections.
+#define HEAP_INCREMENTAL_WORK (128) // Entries marked or swept per allocation while a major collection is in progress.
+#define HEAP_MAJOR_MINIMUM (16384) // Old entries needed before the first major collection.
+
+#define HEAP_PHASE_IDLE (0)
+#define HEAP_PHASE_MARK (1)
+#define HEAP_PHASE_SWEEP (2)
+
 #define EXTCALL_NO_RETURN            (1)
 #define EXTCALL_RETURN_UNMANAGED     (2)
 #define EXTCALL_RETURN_MANAGED       (3)
@@ -112,6 +120,7 @@
 #define T_ERR_CAST            (91)
 #define T_IF_ERR              (92)
 #define T_INTTYPE_CONSTANT    (93)
+#define T_MAP                 (94)
 
 #define T_EXIT_SCOPE          (100)
 #define T_END_FUNCTION        (101)
@@ -143,6 +152,8 @@
 #define T_EQUALS_DOT          (133)
 #define T_EQUALS_LIST         (134)
 #define T_INDEX_LIST          (135)
+#define T_EQUALS_MAP          (136)
+#define T_INDEX_MAP           (137)
 
 #define T_OP_RESIZE           (140)
 #define T_OP_ADD              (141)
@@ -167,6 +178,10 @@
 #define T_OP_SUCCESS          (160)
 #define T_OP_ERROR            (161)
 #define T_OP_DEFAULT          (162)
+#define T_OP_HAS              (163)
+#define T_OP_DELETE_KEY       (164)
+#define T_OP_KEYS             (165)
+#define T_OP_VALUES           (166)
 
 #define T_IF                  (170)
 #define T_WHILE               (171)
@@ -198,6 +213,47 @@
 #define T_RETERR              (197)
 #define T_INTTYPE             (198)
 
+// Superinstructions formed by the function builder.
+#define T_IF_GREATER_THAN     (200)
+#define T_IF_LESS_THAN        (201)
+#define T_IF_GT_OR_EQUAL      (202)
+#define T_IF_LT_OR_EQUAL      (203)
+#define T_IF_DOUBLE_EQUALS    (204)
+#define T_IF_NOT_EQUALS       (205)
+#define T_ADD_VARIABLE        (206)
+#define T_ADD_LITERAL         (207)
+#define T_IF_LOCAL_GREATER_THAN_LITERAL (208) // Compare a local variable with a literal, and branch.
+#define T_IF_LOCAL_LESS_THAN_LITERAL    (209)
+#define T_IF_LOCAL_GT_OR_EQUAL_LITERAL  (210)
+#define T_IF_LOCAL_LT_OR_EQUAL_LITERAL  (211)
+#define T_IF_LOCAL_DOUBLE_EQUALS_LITERAL (212)
+#define T_IF_LOCAL_NOT_EQUALS_LITERAL   (213)
+#define T_IF_LOCAL_GREATER_THAN_LOCAL   (214) // Compare two local variables, and branch.
+#define T_IF_LOCAL_LESS_THAN_LOCAL      (215)
+#define T_IF_LOCAL_GT_OR_EQUAL_LOCAL    (216)
+#define T_IF_LOCAL_LT_OR_EQUAL_LOCAL    (217)
+#define T_IF_LOCAL_DOUBLE_EQUALS_LOCAL  (218)
+#define T_IF_LOCAL_NOT_EQUALS_LOCAL     (219)
+#define T_LOCAL_ADD_LITERAL   (220) // Add a literal to a local variable in place.
+#define T_LOCAL_ADD_LOCAL     (221) // Add a local variable to another in place.
+
+// Instruction handlers in ScriptExecuteFunction are either labels reached through a table of handler addresses,
+// or the cases of a switch statement if the compiler does not support labels as values.
+// INSTRUCTION(x) ends the previous handler by dispatching the next instruction, and then starts the handler for x.
+#ifdef __GNUC__
+#define SCRIPT_THREADED_DISPATCH
+#endif
+
+#ifdef SCRIPT_THREADED_DISPATCH
+#define OPCODE(x) op_ ## x:
+#define DISPATCH() command = functionData[instructionPointer++]; goto *dispatch[command]
+#define INSTRUCTION(x) DISPATCH(); op_ ## x:
+#else
+#define OPCODE(x) case x:
+#define DISPATCH() break
+#define INSTRUCTION(x) DISPATCH(); case x:
+#endif
+
 #define STACK_READ_STRING(textVariable, bytesVariable, stackIndex) \
 	if (context->c->stackPointer < stackIndex) return -1; \
 	if (!context->c->stackIsManaged[context->c->stackPointer - stackIndex]) return -1; \
@@ -280,6 +336,12 @@ typedef struct LineNumber {
 	Token *function;
 } LineNumber;
 
+typedef struct StringLiteral {
+	uint32_t offset, bytes; // Into literalText.
+	uint32_t hash;
+	uintptr_t heapIndex; // Created the first time the literal is executed, and never freed.
+} StringLiteral;
+
 typedef struct FunctionBuilder {
 	uint8_t *data;
 	size_t dataBytes;
@@ -288,10 +350,20 @@ typedef struct FunctionBuilder {
 	size_t lineNumberCount;
 	size_t lineNumbersAllocated;
 	int32_t scopeIndex;
-	bool isPersistentVariable, isDotAssignment, isListAssignment;
+	bool isPersistentVariable, isDotAssignment, isListAssignment, isMapAssignment;
 	uintptr_t globalVariableOffset;
 	struct ImportData *importData; // Only valid during script loading.
 	Node *replResultType;
+	uintptr_t fusable[3]; // The most recent instructions that could be fused with the next, latest first; each directly follows the one after it.
+	size_t fusableCount;
+	uintptr_t fusableEnd; // Where the latest fusable instruction ends.
+	uintptr_t lastJumpTarget;
+	StringLiteral *literals; // Each string literal is only stored once, so that they can share a heap entry.
+	size_t literalCount, literalsAllocated;
+	char *literalText;
+	size_t literalTextBytes, literalTextAllocated;
+	uint32_t *literalLookup; // Open addressing table of indices into literals, plus one.
+	size_t literalLookupCapacity;
 } FunctionBuilder;
 
 typedef struct BackTraceItem {
@@ -301,10 +373,19 @@ typedef struct BackTraceItem {
 	int32_t variableBase : 30;
 } BackTraceItem;
 
+typedef struct MapSlot {
+	Value key, value;
+	uint32_t hash;
+	bool used;
+} MapSlot;
+
 typedef struct HeapEntry {
 	uint8_t type;
-	bool gcMark;
+	bool gcMark, gcScanned; // Reached and traced by the current collection.
+	bool gcYoung; // Allocated since the last minor collection.
+	bool gcRemembered; // In the remembered set, because it was modified while old.
 	bool internalValuesAreManaged;
+	bool internalKeysAreManaged; // For maps with str keys.
 
 	union {
 		struct {
@@ -323,6 +404,12 @@ typedef struct HeapEntry {
 			Value *list;
 		};
 
+		struct {
+			// Open addressing with linear probing.
+			uint32_t mapCount, mapCapacity; // mapCapacity is zero or a power of two.
+			MapSlot *mapSlots;
+		};
+
 		struct {
 			uintptr_t nextUnusedEntry;
 		};
@@ -382,11 +469,22 @@ typedef struct ExecutionContext {
 	HeapEntry *heap;
 	uintptr_t heapFirstUnusedEntry;
 	size_t heapEntriesAllocated;
+	uintptr_t *heapNursery; // Entries allocated since the last minor collection.
+	size_t heapNurseryCount;
+	uintptr_t *heapRemembered; // Old entries that may reference young entries.
+	size_t heapRememberedCount, heapRememberedAllocated;
+	uintptr_t *heapMarkStack;
+	size_t heapMarkStackCount, heapMarkStackAllocated;
+	uint8_t heapPhase;
+	uintptr_t heapSweepPosition;
+	size_t heapOldCount, heapMajorThreshold;
 
 	FunctionBuilder *functionData; // Cleanup the relations between ExecutionContext, FunctionBuilder, Tokenizer and ImportData.
 	Node *rootNode; // Only valid during script loading.
 	char *scriptPersistFile;
 	struct ImportData *mainModule;
+	void *image; // If the script was loaded from a bytecode image, the bytecode and literal text point into it.
+	size_t imageBytes;
 
 	CoroutineState *c; // Active coroutine.
 	CoroutineState *allCoroutines;
@@ -418,6 +516,8 @@ Node globalExpressionTypeBool = { .type = T_BOOL };
 Node globalExpressionTypeStr = { .type = T_STR };
 Node globalExpressionTypeIntList = { .type = T_LIST, .firstChild = &globalExpressionTypeInt };
 Node globalExpressionTypeErrVoid = { .type = T_ERR, .firstChild = &globalExpressionTypeVoid };
+Node globalExpressionTypeNoArguments = { .type = T_ARGUMENTS, .sibling = &globalExpressionTypeVoid };
+Node globalExpressionTypeVoidFunction = { .type = T_FUNCPTR, .firstChild = &globalExpressionTypeNoArguments };
 
 // Global variables:
 const char *startFunction = "Start";
@@ -426,6 +526,7 @@ char **options;
 bool *optionsMatched;
 size_t optionCount;
 int debugBytecodeLevel;
+const char *scriptImagePath; // If set, the compiled script is cached here.
 ImportData *importedModules;
 ImportData **importedModulesLink = &importedModules;
 
@@ -457,6 +558,9 @@ void PrintError3(const char *format, ...);
 void PrintError4(ExecutionContext *context, uint32_t instructionPointer, const char *format, ...);
 void PrintBackTrace(ExecutionContext *context, uint32_t instructionPointer, CoroutineState *c, const char *prefix);
 void *FileLoad(const char *path, size_t *length);
+void *FileMap(const char *path, size_t *length);
+void FileUnmap(void *data, size_t length);
+bool FileSave(const char *path, const void *data, size_t length);
 CoroutineState *ExternalCoroutineWaitAny(ExecutionContext *context);
 void ExternalPassREPLResult(ExecutionContext *context, Value value);
 
@@ -1193,6 +1297,18 @@ Node *ParseType(Tokenizer *tokenizer, bool maybe, bool allowVoid, bool allowTupl
 				list->type = T_LIST;
 				list->token = TokenNext(tokenizer);
 
+				// A map type has the key type between the square brackets.
+				// The value type is the first child, and the key type is its sibling.
+				Node *key = NULL;
+				token = TokenPeek(tokenizer);
+
+				if (token.type == T_INT || token.type == T_STR) {
+					key = (Node *) AllocateFixed(sizeof(Node));
+					key->token = TokenNext(tokenizer);
+					key->type = key->token.type;
+					list->type = T_MAP;
+				}
+
 				if (first) {
 					list->firstChild = node;
 					first = false;
@@ -1201,16 +1317,18 @@ Node *ParseType(Tokenizer *tokenizer, bool maybe, bool allowVoid, bool allowTupl
 					Node *end = node;
 					while (end->firstChild->firstChild) end = end->firstChild;
 					list->firstChild = end->firstChild;
+					list->sibling = end->firstChild->sibling;
 					end->firstChild = list;
 				}
 
+				list->firstChild->sibling = key;
 				token = TokenNext(tokenizer);
 
 				if (token.type == T_ERROR) {
 					return NULL;
 				} else if (token.type != T_RIGHT_SQUARE) {
 					if (!maybe) {
-						PrintError2(tokenizer, node, "Expected a ']' after the '[' in an list type.\n");
+						PrintError2(tokenizer, node, "Expected a ']' after the '[' in an list or map type.\n");
 					}
 
 					return NULL;
@@ -2545,9 +2663,9 @@ bool ASTMatching(Node *left, Node *right) {
 		return true;
 	} else if (!left || !right) {
 		return false;
-	} else if (left->type == T_NULL && (right->type == T_STRUCT || right->type == T_LIST)) {
+	} else if (left->type == T_NULL && (right->type == T_STRUCT || right->type == T_LIST || right->type == T_MAP)) {
 		return true;
-	} else if (right->type == T_NULL && (left->type == T_STRUCT || left->type == T_LIST)) {
+	} else if (right->type == T_NULL && (left->type == T_STRUCT || left->type == T_LIST || left->type == T_MAP)) {
 		return true;
 	} else if (left->type != right->type) {
 		return false;
@@ -2579,7 +2697,7 @@ bool ASTIsIntType(Node *node) {
 }
 
 bool ASTIsManagedType(Node *node) {
-	return node->type == T_STR || node->type == T_LIST || node->type == T_STRUCT 
+	return node->type == T_STR || node->type == T_LIST || node->type == T_MAP || node->type == T_STRUCT 
 		|| node->type == T_FUNCPTR || node->type == T_FUNCPTR || node->type == T_ERR;
 }
 
@@ -2615,7 +2733,7 @@ bool ASTLookupTypeIdentifiers(Tokenizer *tokenizer, Node *node) {
 		}
 	}
 
-	if (node->type == T_DECLARE || node->type == T_ARGUMENT || node->type == T_NEW || node->type == T_LIST) {
+	if (node->type == T_DECLARE || node->type == T_ARGUMENT || node->type == T_NEW || node->type == T_LIST || node->type == T_MAP) {
 		Node *type = node->firstChild;
 
 		if (type->type == T_IDENTIFIER) {
@@ -2794,7 +2912,7 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 
 	if (node->type == T_ROOT || node->type == T_BLOCK
 			|| node->type == T_INT || node->type == T_FLOAT || node->type == T_STR 
-			|| node->type == T_LIST || node->type == T_TUPLE || node->type == T_ERR
+			|| node->type == T_LIST || node->type == T_MAP || node->type == T_TUPLE || node->type == T_ERR
 			|| node->type == T_BOOL || node->type == T_VOID || node->type == T_IDENTIFIER
 			|| node->type == T_ARGUMENTS || node->type == T_ARGUMENT
 			|| node->type == T_STRUCT || node->type == T_FUNCTYPE || node->type == T_IMPORT || node->type == T_IMPORT_PATH || node->type == T_INTTYPE
@@ -2879,6 +2997,7 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 					&& !ASTMatching(node->firstChild->expressionType, &globalExpressionTypeStr)
 					&& !ASTMatching(node->firstChild->expressionType, &globalExpressionTypeBool)
 					&& (!node->firstChild->expressionType || node->firstChild->expressionType->type != T_LIST)
+					&& (!node->firstChild->expressionType || node->firstChild->expressionType->type != T_MAP)
 					&& (!node->firstChild->expressionType || node->firstChild->expressionType->type != T_STRUCT)) {
 				PrintError2(tokenizer, node, "These types cannot be compared.\n");
 				return false;
@@ -3136,12 +3255,18 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 		}
 	} else if (node->type == T_INDEX) {
 		if (!ASTMatching(node->firstChild->expressionType, &globalExpressionTypeStr)
-				&& node->firstChild->expressionType->type != T_LIST) {
-			PrintError2(tokenizer, node, "The expression being indexed must be a string or list.\n");
+				&& node->firstChild->expressionType->type != T_LIST
+				&& node->firstChild->expressionType->type != T_MAP) {
+			PrintError2(tokenizer, node, "The expression being indexed must be a string, list or map.\n");
 			return false;
 		}
 
-		if (!ASTMatching(node->firstChild->sibling->expressionType, &globalExpressionTypeInt)) {
+		if (node->firstChild->expressionType->type == T_MAP) {
+			if (!ASTMatching(node->firstChild->sibling->expressionType, node->firstChild->expressionType->firstChild->sibling)) {
+				PrintError2(tokenizer, node, "The key does not match the key type of the map.\n");
+				return false;
+			}
+		} else if (!ASTMatching(node->firstChild->sibling->expressionType, &globalExpressionTypeInt)) {
 			PrintError2(tokenizer, node, "The index must be a integer.\n");
 			return false;
 		}
@@ -3152,8 +3277,8 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 			node->expressionType = node->firstChild->expressionType->firstChild;
 		}
 	} else if (node->type == T_NEW) {
-		if (node->firstChild->type != T_STRUCT && node->firstChild->type != T_LIST && node->firstChild->type != T_ERR) {
-			PrintError2(tokenizer, node, "This type is not a struct, list or error. 'new' is used to create new instances of structs, lists and errors.\n");
+		if (node->firstChild->type != T_STRUCT && node->firstChild->type != T_LIST && node->firstChild->type != T_MAP && node->firstChild->type != T_ERR) {
+			PrintError2(tokenizer, node, "This type is not a struct, list, map or error. 'new' is used to create new instances of structs, lists, maps and errors.\n");
 			return false;
 		}
 
@@ -3206,11 +3331,12 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 		Node *expressionType = node->firstChild->expressionType;
 
 		bool isList = expressionType->type == T_LIST;
+		bool isMap = expressionType->type == T_MAP;
 		bool isStr = expressionType->type == T_STR;
 		bool isFuncPtr = expressionType->type == T_FUNCPTR;
 		bool isErr = expressionType->type == T_ERR;
 
-		if (!isList && !isStr & !isFuncPtr && !isErr) {
+		if (!isList && !isMap && !isStr & !isFuncPtr && !isErr) {
 			PrintError2(tokenizer, node, "This type does not have any ':' operations.\n");
 			return false;
 		}
@@ -3218,6 +3344,7 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 		Token token = node->token;
 		Node *arguments[2] = { 0 };
 		bool returnsItem = false, returnsInt = false, returnsBool = false, returnsStr = false, simple = true;
+		Node *returnsListOf = NULL;
 		uint8_t op;
 
 		if (isList && KEYWORD("resize")) arguments[0] = &globalExpressionTypeInt, op = T_OP_RESIZE;
@@ -3229,10 +3356,14 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 		else if (isList && KEYWORD("find")) arguments[0] = expressionType->firstChild, op = T_OP_FIND, returnsInt = true;
 		else if (isList && KEYWORD("delete_many")) arguments[0] = &globalExpressionTypeInt, arguments[1] = &globalExpressionTypeInt, op = T_OP_DELETE_MANY;
 		else if (isList && KEYWORD("delete_last")) op = T_OP_DELETE_LAST;
-		else if (isList && KEYWORD("delete_all")) op = T_OP_DELETE_ALL;
+		else if ((isList || isMap) && KEYWORD("delete_all")) op = T_OP_DELETE_ALL;
 		else if (isList && KEYWORD("first")) returnsItem = true, op = T_OP_FIRST;
 		else if (isList && KEYWORD("last")) returnsItem = true, op = T_OP_LAST;
-		else if ((isList || isStr) && KEYWORD("len")) returnsInt = true, op = T_OP_LEN;
+		else if ((isList || isMap || isStr) && KEYWORD("len")) returnsInt = true, op = T_OP_LEN;
+		else if (isMap && KEYWORD("has")) arguments[0] = expressionType->firstChild->sibling, op = T_OP_HAS, returnsBool = true;
+		else if (isMap && KEYWORD("delete")) arguments[0] = expressionType->firstChild->sibling, op = T_OP_DELETE_KEY, returnsBool = true;
+		else if (isMap && KEYWORD("keys")) returnsListOf = expressionType->firstChild->sibling, op = T_OP_KEYS;
+		else if (isMap && KEYWORD("values")) returnsListOf = expressionType->firstChild, op = T_OP_VALUES;
 		else if (isErr && KEYWORD("success")) returnsBool = true, op = T_OP_SUCCESS;
 		else if (isErr && KEYWORD("assert")) returnsItem = true, op = T_OP_ASSERT_ERR;
 		else if (isErr && KEYWORD("error")) returnsStr = true, op = T_OP_ERROR;
@@ -3358,6 +3489,15 @@ bool ASTSetTypes(Tokenizer *tokenizer, Node *node) {
 				: returnsInt ? &globalExpressionTypeInt 
 				: returnsStr ? &globalExpressionTypeStr 
 				: returnsBool ? &globalExpressionTypeBool : NULL;
+
+			if (returnsListOf) {
+				node->expressionType = (Node *) AllocateFixed(sizeof(Node));
+				node->expressionType->type = T_LIST;
+				Node *copy = (Node *) AllocateFixed(sizeof(Node));
+				*copy = *returnsListOf;
+				copy->sibling = NULL;
+				node->expressionType->firstChild = copy;
+			}
 		}
 
 		node->operationType = op;
@@ -3474,6 +3614,17 @@ bool ASTCheckForReturnStatements(Tokenizer *tokenizer, Node *node) {
 
 // --------------------------------- Code generation.
 
+uint32_t ScriptHashBytes(const void *data, size_t bytes) {
+	// FNV-1a.
+	uint32_t hash = 2166136261;
+
+	for (uintptr_t i = 0; i < bytes; i++) {
+		hash = (hash ^ ((const uint8_t *) data)[i]) * 16777619;
+	}
+
+	return hash;
+}
+
 void FunctionBuilderAppend(FunctionBuilder *builder, const void *buffer, size_t bytes) {
 	if (builder->dataBytes + bytes > builder->dataAllocated) {
 		builder->dataAllocated = 2 * builder->dataAllocated + bytes;
@@ -3487,6 +3638,133 @@ void FunctionBuilderAppend(FunctionBuilder *builder, const void *buffer, size_t
 	builder->dataBytes += bytes;
 }
 
+void FunctionBuilderMarkFusable(FunctionBuilder *builder, uintptr_t instruction) {
+	// Only a run of adjacent instructions with no jump landing inside it can be fused together.
+	if (builder->fusableEnd != instruction || builder->lastJumpTarget == instruction) builder->fusableCount = 0;
+	builder->fusable[2] = builder->fusable[1];
+	builder->fusable[1] = builder->fusable[0];
+	builder->fusable[0] = instruction;
+	if (builder->fusableCount < 3) builder->fusableCount++;
+	builder->fusableEnd = builder->dataBytes;
+}
+
+uint8_t FunctionBuilderFusable(FunctionBuilder *builder, uintptr_t i) {
+	// The i-th most recent fusable instruction can only be fused with the next if nothing has been appended after the run,
+	// and no jump lands between the two.
+	if (i >= builder->fusableCount || builder->fusableEnd != builder->dataBytes || builder->lastJumpTarget == builder->dataBytes) return 0;
+	return builder->data[builder->fusable[i]];
+}
+
+int32_t FunctionBuilderFusableOperand(FunctionBuilder *builder, uintptr_t i) {
+	int32_t operand;
+	MemoryCopy(&operand, builder->data + builder->fusable[i] + 1, sizeof(operand));
+	return operand;
+}
+
+void FunctionBuilderFuse(FunctionBuilder *builder, uintptr_t i, uint8_t superinstruction) {
+	// The i-th most recent fusable instruction becomes the superinstruction, and absorbs the instructions after it.
+	// Their operands stay in place; the superinstruction's handler skips over their opcodes.
+	builder->data[builder->fusable[i]] = superinstruction;
+	builder->fusableCount -= i;
+
+	for (uintptr_t j = 0; j < builder->fusableCount; j++) {
+		builder->fusable[j] = builder->fusable[j + i];
+	}
+}
+
+void FunctionBuilderAppendIf(FunctionBuilder *builder) {
+	uint8_t previous = FunctionBuilderFusable(builder, 0);
+
+	if (previous >= T_GREATER_THAN && previous <= T_NOT_EQUALS) {
+		uint8_t left = FunctionBuilderFusable(builder, 2), right = FunctionBuilderFusable(builder, 1);
+		bool leftIsLocal = left == T_VARIABLE && FunctionBuilderFusableOperand(builder, 2) < 0;
+
+		if (leftIsLocal && right == T_NUMERIC_LITERAL) {
+			FunctionBuilderFuse(builder, 2, previous - T_GREATER_THAN + T_IF_LOCAL_GREATER_THAN_LITERAL);
+		} else if (leftIsLocal && right == T_VARIABLE && FunctionBuilderFusableOperand(builder, 1) < 0) {
+			FunctionBuilderFuse(builder, 2, previous - T_GREATER_THAN + T_IF_LOCAL_GREATER_THAN_LOCAL);
+		} else {
+			FunctionBuilderFuse(builder, 0, previous - T_GREATER_THAN + T_IF_GREATER_THAN);
+		}
+	} else {
+		uint8_t b = T_IF;
+		FunctionBuilderAppend(builder, &b, sizeof(b));
+	}
+}
+
+bool FunctionBuilderFuseAssignment(FunctionBuilder *builder, int32_t scopeIndex) {
+	// Assigning a local variable the sum of itself and a literal or another local variable becomes an in-place addition.
+	if (scopeIndex >= 0 || FunctionBuilderFusable(builder, 1) != T_VARIABLE || FunctionBuilderFusableOperand(builder, 1) != scopeIndex) return false;
+	uint8_t add = FunctionBuilderFusable(builder, 0);
+
+	if (add == T_ADD_LITERAL) {
+		FunctionBuilderFuse(builder, 1, T_LOCAL_ADD_LITERAL);
+	} else if (add == T_ADD_VARIABLE && FunctionBuilderFusableOperand(builder, 0) < 0) {
+		FunctionBuilderFuse(builder, 1, T_LOCAL_ADD_LOCAL);
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+void FunctionBuilderPatchJump(FunctionBuilder *builder, uintptr_t writeOffset) {
+	int32_t delta = builder->dataBytes - writeOffset;
+	MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+	builder->lastJumpTarget = builder->dataBytes;
+}
+
+uint32_t FunctionBuilderInternString(FunctionBuilder *builder, const char *text, size_t bytes) {
+	// Returns the index of the literal, adding it if this is the first time the text has been seen.
+
+	if (builder->literalCount * 2 >= builder->literalLookupCapacity) {
+		builder->literalLookupCapacity = builder->literalLookupCapacity ? builder->literalLookupCapacity * 2 : 64;
+		AllocateResize(builder->literalLookup, 0);
+		builder->literalLookup = (uint32_t *) AllocateResize(NULL, builder->literalLookupCapacity * sizeof(uint32_t));
+		for (uintptr_t i = 0; i < builder->literalLookupCapacity; i++) builder->literalLookup[i] = 0;
+
+		for (uintptr_t i = 0; i < builder->literalCount; i++) {
+			uintptr_t slot = builder->literals[i].hash & (builder->literalLookupCapacity - 1);
+			while (builder->literalLookup[slot]) slot = (slot + 1) & (builder->literalLookupCapacity - 1);
+			builder->literalLookup[slot] = i + 1;
+		}
+	}
+
+	uint32_t hash = ScriptHashBytes(text, bytes);
+	uintptr_t slot = hash & (builder->literalLookupCapacity - 1);
+
+	while (builder->literalLookup[slot]) {
+		StringLiteral *literal = &builder->literals[builder->literalLookup[slot] - 1];
+
+		if (literal->hash == hash && literal->bytes == bytes 
+				&& 0 == MemoryCompare(builder->literalText + literal->offset, text, bytes)) {
+			return builder->literalLookup[slot] - 1;
+		}
+
+		slot = (slot + 1) & (builder->literalLookupCapacity - 1);
+	}
+
+	if (builder->literalCount == builder->literalsAllocated) {
+		builder->literalsAllocated = builder->literalsAllocated * 2 + 16;
+		builder->literals = (StringLiteral *) AllocateResize(builder->literals, builder->literalsAllocated * sizeof(StringLiteral));
+	}
+
+	if (builder->literalTextBytes + bytes > builder->literalTextAllocated) {
+		builder->literalTextAllocated = builder->literalTextAllocated * 2 + bytes;
+		builder->literalText = (char *) AllocateResize(builder->literalText, builder->literalTextAllocated);
+	}
+
+	StringLiteral *literal = &builder->literals[builder->literalCount];
+	literal->offset = builder->literalTextBytes;
+	literal->bytes = bytes;
+	literal->hash = hash;
+	literal->heapIndex = 0;
+	MemoryCopy(builder->literalText + builder->literalTextBytes, text, bytes);
+	builder->literalTextBytes += bytes;
+	builder->literalLookup[slot] = builder->literalCount + 1;
+	return builder->literalCount++;
+}
+
 void FunctionBuilderAddLineNumber(FunctionBuilder *builder, Node *node) {
 	if (builder->lineNumberCount == builder->lineNumbersAllocated) {
 		builder->lineNumbersAllocated = 2 * builder->lineNumbersAllocated + 4;
@@ -3494,6 +3772,7 @@ void FunctionBuilderAddLineNumber(FunctionBuilder *builder, Node *node) {
 	}
 
 	Node *ancestor = node;
+	builder->lineNumbers[builder->lineNumberCount].function = NULL;
 
 	while (ancestor) {
 		if (ancestor->type == T_FUNCTION) {
@@ -3571,9 +3850,11 @@ bool FunctionBuilderVariable(Tokenizer *tokenizer, FunctionBuilder *builder, Nod
 	FunctionBuilderAddLineNumber(builder, node);
 
 	if (isIntConstant) {
+		uintptr_t instruction = builder->dataBytes;
 		uint8_t b = T_NUMERIC_LITERAL;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
 		FunctionBuilderAppend(builder, &intConstantValue, sizeof(intConstantValue));
+		FunctionBuilderMarkFusable(builder, instruction);
 	} else {
 		if (index >= (int32_t) rootScope->variableEntryCount && !inlineImport) {
 			index = rootScope->variableEntryCount - index - 1;
@@ -3585,9 +3866,12 @@ bool FunctionBuilderVariable(Tokenizer *tokenizer, FunctionBuilder *builder, Nod
 			builder->scopeIndex = index;
 			builder->isDotAssignment = false;
 			builder->isListAssignment = false;
+			builder->isMapAssignment = false;
 		} else {
+			uintptr_t instruction = builder->dataBytes;
 			FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
 			FunctionBuilderAppend(builder, &index, sizeof(index));
+			FunctionBuilderMarkFusable(builder, instruction);
 		}
 	}
 
@@ -3611,9 +3895,13 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		}
 
 		uint16_t entryCount = node->scope->variableEntryCount;
-		FunctionBuilderAddLineNumber(builder, node);
-		FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
-		FunctionBuilderAppend(builder, &entryCount, sizeof(entryCount));
+
+		if (node->type == T_FUNCBODY || entryCount) {
+			// Blocks that do not declare any variables do not need to enter a scope.
+			FunctionBuilderAddLineNumber(builder, node);
+			FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
+			FunctionBuilderAppend(builder, &entryCount, sizeof(entryCount));
+		}
 
 		for (uintptr_t i = 0; i < node->scope->entryCount; i++) {
 			Node *entry = node->scope->entries[i];
@@ -3653,11 +3941,17 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 				}
 
 				FunctionBuilderAddLineNumber(builder, node);
-				uint8_t b = builder->isListAssignment ? T_EQUALS_LIST : builder->isDotAssignment ? T_EQUALS_DOT : T_EQUALS;
-				FunctionBuilderAppend(builder, &b, sizeof(b));
+				uint8_t b = builder->isListAssignment ? T_EQUALS_LIST : builder->isMapAssignment ? T_EQUALS_MAP 
+					: builder->isDotAssignment ? T_EQUALS_DOT : T_EQUALS;
+
+				if (b == T_EQUALS && !builder->isPersistentVariable && FunctionBuilderFuseAssignment(builder, builder->scopeIndex)) {
+					// The addition was fused with the assignment.
+				} else {
+					FunctionBuilderAppend(builder, &b, sizeof(b));
 
-				if (!builder->isListAssignment) {
-					FunctionBuilderAppend(builder, &builder->scopeIndex, sizeof(builder->scopeIndex));
+					if (!builder->isListAssignment && !builder->isMapAssignment) {
+						FunctionBuilderAppend(builder, &builder->scopeIndex, sizeof(builder->scopeIndex));
+					}
 				}
 
 				if (builder->isPersistentVariable) {
@@ -3692,20 +3986,19 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		return true;
 	} else if (node->type == T_WHILE) {
 		int32_t start = builder->dataBytes;
+		builder->lastJumpTarget = start;
 		if (!FunctionBuilderRecurse(tokenizer, node->firstChild, builder, false)) return false;
 		FunctionBuilderAddLineNumber(builder, node);
-		uint8_t b = T_IF;
-		FunctionBuilderAppend(builder, &b, sizeof(b));
+		FunctionBuilderAppendIf(builder);
 		uintptr_t writeOffset = builder->dataBytes;
 		uint32_t zero = 0;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
 		if (!FunctionBuilderRecurse(tokenizer, node->firstChild->sibling, builder, false)) return false;
-		b = T_BRANCH;
+		uint8_t b = T_BRANCH;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
 		int32_t delta = start - builder->dataBytes;
 		FunctionBuilderAppend(builder, &delta, sizeof(delta));
-		delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 		return true;
 	} else if (node->type == T_FOR) {
 		Node *declare = node->firstChild;
@@ -3720,10 +4013,10 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 
 		if (!FunctionBuilderRecurse(tokenizer, declare, builder, false)) return false;
 		int32_t start = builder->dataBytes;
+		builder->lastJumpTarget = start;
 		if (!FunctionBuilderRecurse(tokenizer, condition, builder, false)) return false;
 		FunctionBuilderAddLineNumber(builder, node);
-		uint8_t b = T_IF;
-		FunctionBuilderAppend(builder, &b, sizeof(b));
+		FunctionBuilderAppendIf(builder);
 		uintptr_t writeOffset = builder->dataBytes;
 		uint32_t zero = 0;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
@@ -3743,12 +4036,11 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			}
 		}
 
-		b = T_BRANCH;
+		uint8_t b = T_BRANCH;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
 		int32_t delta = start - builder->dataBytes;
 		FunctionBuilderAppend(builder, &delta, sizeof(delta));
-		delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 		return true;
 	} else if (node->type == T_FOR_EACH) {
 		Node *declare = node->firstChild;
@@ -3775,6 +4067,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		if (!FunctionBuilderRecurse(tokenizer, list, builder, false)) return false;
 
 		int32_t start = builder->dataBytes;
+		builder->lastJumpTarget = start;
 
 		// Check whether the index is less than the list length.
 		// Stack: list, index, ...
@@ -3801,8 +4094,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		// Stack: comparison, list, index, ...
 
 		FunctionBuilderAddLineNumber(builder, node);
-		b = T_IF;
-		FunctionBuilderAppend(builder, &b, sizeof(b));
+		FunctionBuilderAppendIf(builder);
 		uintptr_t writeOffset = builder->dataBytes;
 		uint32_t zero = 0;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
@@ -3863,8 +4155,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		FunctionBuilderAppend(builder, &b, sizeof(b));
 		int32_t delta = start - builder->dataBytes;
 		FunctionBuilderAppend(builder, &delta, sizeof(delta));
-		delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 
 		// Pop the list and index.
 		b = T_POP;
@@ -3881,7 +4172,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		}
 
 		FunctionBuilderAddLineNumber(builder, node);
-		FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
+		FunctionBuilderAppendIf(builder);
 		uintptr_t writeOffset = builder->dataBytes, writeOffsetElse = 0;
 		uint32_t zero = 0;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
@@ -3894,13 +4185,11 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			FunctionBuilderAppend(builder, &zero, sizeof(zero));
 		}
 
-		int32_t delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 
 		if (node->firstChild->sibling->sibling) {
 			if (!FunctionBuilderRecurse(tokenizer, node->firstChild->sibling->sibling, builder, false)) return false;
-			delta = builder->dataBytes - writeOffsetElse;
-			MemoryCopy(builder->data + writeOffsetElse, &delta, sizeof(delta));
+			FunctionBuilderPatchJump(builder, writeOffsetElse);
 		}
 
 		return true;
@@ -3938,8 +4227,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		writeOffsetElse = builder->dataBytes;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
 
-		int32_t delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 
 		b = T_POP;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
@@ -3948,8 +4236,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			if (!FunctionBuilderRecurse(tokenizer, node->firstChild->sibling->sibling->sibling, builder, false)) return false;
 		}
 
-		delta = builder->dataBytes - writeOffsetElse;
-		MemoryCopy(builder->data + writeOffsetElse, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffsetElse);
 
 		return true;
 	} else if (node->type == T_LOGICAL_OR || node->type == T_LOGICAL_AND) {
@@ -3959,8 +4246,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		uint32_t zero = 0;
 		FunctionBuilderAppend(builder, &zero, sizeof(zero));
 		if (!FunctionBuilderRecurse(tokenizer, node->firstChild->sibling, builder, false)) return false;
-		int32_t delta = builder->dataBytes - writeOffset;
-		MemoryCopy(builder->data + writeOffset, &delta, sizeof(delta));
+		FunctionBuilderPatchJump(builder, writeOffset);
 		return true;
 	} else if (node->type == T_NEW) {
 		if (node->firstChild->type == T_ERR) {
@@ -3973,6 +4259,9 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 
 		if (node->firstChild->type == T_LIST) {
 			fieldCount = ASTIsManagedType(node->firstChild->firstChild) ? -2 : -1;
+		} else if (node->firstChild->type == T_MAP) {
+			fieldCount = (node->firstChild->firstChild->sibling->type == T_STR ? -7 : -5) 
+				- (ASTIsManagedType(node->firstChild->firstChild) ? 1 : 0);
 		} else if (node->firstChild->type == T_ERR) {
 			fieldCount = ASTIsManagedType(node->firstChild->firstChild) ? -4 : -3;
 		} else {
@@ -4059,7 +4348,8 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		if (node->type == T_BLOCK && child->expressionType && child->expressionType->type != T_VOID) {
 			if (child->type == T_CALL || child->type == T_AWAIT 
 					|| (child->type == T_COLON && child->operationType == T_OP_FIND_AND_DELETE)
-					|| (child->type == T_COLON && child->operationType == T_OP_FIND_AND_DEL_STR)) {
+					|| (child->type == T_COLON && child->operationType == T_OP_FIND_AND_DEL_STR)
+					|| (child->type == T_COLON && child->operationType == T_OP_DELETE_KEY)) {
 				uint8_t b = T_POP;
 
 				for (int i = 0; i < ASTGetTypePopCount(child->expressionType); i++) {
@@ -4078,9 +4368,13 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 	if (node->type == T_FUNCBODY || node->type == T_BLOCK) {
 		uint8_t b = T_EXIT_SCOPE;
 		uint16_t entryCount = node->scope->variableEntryCount;
-		FunctionBuilderAddLineNumber(builder, node);
-		FunctionBuilderAppend(builder, &b, sizeof(b));
-		FunctionBuilderAppend(builder, &entryCount, sizeof(entryCount));
+
+		if (node->type == T_FUNCBODY || entryCount) {
+			FunctionBuilderAddLineNumber(builder, node);
+			FunctionBuilderAppend(builder, &b, sizeof(b));
+			FunctionBuilderAppend(builder, &entryCount, sizeof(entryCount));
+		}
+
 		b = T_END_FUNCTION;
 		if (node->type == T_FUNCBODY) FunctionBuilderAppend(builder, &b, sizeof(b));
 	} else if (node->type == T_DECLARE_GROUP) {
@@ -4109,6 +4403,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 		FunctionBuilderAppend(builder, &newType, sizeof(newType));
 		b = T_END_FUNCTION;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
+		builder->lastJumpTarget = builder->dataBytes;
 		b = T_POP;
 		FunctionBuilderAppend(builder, &b, sizeof(b));
 	} else if (node->type == T_NULL || node->type == T_LOGICAL_NOT || node->type == T_AWAIT || node->type == T_ERR_CAST) {
@@ -4130,8 +4425,24 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			|| node->type == T_BITWISE_OR || node->type == T_BITWISE_AND || node->type == T_BITWISE_XOR) {
 		uint8_t b = node->expressionType->type == T_FLOAT ? node->type - T_ADD + T_FLOAT_ADD 
 			: node->expressionType->type == T_STR ? T_CONCAT : node->type;
-		FunctionBuilderAddLineNumber(builder, node);
-		FunctionBuilderAppend(builder, &b, sizeof(b));
+		uint8_t previous = b == T_ADD || b == T_MINUS ? FunctionBuilderFusable(builder, 0) : 0;
+
+		if (previous == T_VARIABLE && b == T_ADD) {
+			FunctionBuilderFuse(builder, 0, T_ADD_VARIABLE);
+		} else if (previous == T_NUMERIC_LITERAL) {
+			if (b == T_MINUS) {
+				// Subtracting a literal is adding its negation.
+				Value v;
+				MemoryCopy(&v, builder->data + builder->fusable[0] + 1, sizeof(v));
+				v.i = (int64_t) -(uint64_t) v.i;
+				MemoryCopy(builder->data + builder->fusable[0] + 1, &v, sizeof(v));
+			}
+
+			FunctionBuilderFuse(builder, 0, T_ADD_LITERAL);
+		} else {
+			FunctionBuilderAddLineNumber(builder, node);
+			FunctionBuilderAppend(builder, &b, sizeof(b));
+		}
 	} else if (node->type == T_STR_INTERPOLATE) {
 		Node *type = node->firstChild->sibling->expressionType;
 		uint8_t b = type->type == T_STR ? T_INTERPOLATE_STR
@@ -4146,8 +4457,10 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			|| node->type == T_DOUBLE_EQUALS || node->type == T_NOT_EQUALS) {
 		uint8_t b = node->firstChild->expressionType->type == T_STR ? node->type - T_DOUBLE_EQUALS + T_STR_DOUBLE_EQUALS 
 			: node->firstChild->expressionType->type == T_FLOAT ? node->type - T_GREATER_THAN + T_FLOAT_GREATER_THAN : node->type;
+		uintptr_t instruction = builder->dataBytes;
 		FunctionBuilderAddLineNumber(builder, node);
 		FunctionBuilderAppend(builder, &b, sizeof(b));
+		FunctionBuilderMarkFusable(builder, instruction);
 	} else if (node->type == T_VARIABLE) {
 		if (!FunctionBuilderVariable(tokenizer, builder, node, forAssignment)) {
 			return false;
@@ -4158,11 +4471,13 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 				PrintError2(tokenizer, node->firstChild, "Strings cannot be modified.\n");
 				return false;
 			} else {
-				builder->isListAssignment = true;
+				builder->isListAssignment = node->firstChild->expressionType->type == T_LIST;
+				builder->isMapAssignment = node->firstChild->expressionType->type == T_MAP;
 				builder->isDotAssignment = false;
 			}
 		} else {
-			uint8_t b = node->firstChild->expressionType->type == T_STR ? T_INDEX : T_INDEX_LIST;
+			uint8_t b = node->firstChild->expressionType->type == T_STR ? T_INDEX 
+				: node->firstChild->expressionType->type == T_MAP ? T_INDEX_MAP : T_INDEX_LIST;
 			FunctionBuilderAddLineNumber(builder, node);
 			FunctionBuilderAppend(builder, &b, sizeof(b));
 		}
@@ -4191,6 +4506,7 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 				builder->scopeIndex = fieldIndex;
 				builder->isDotAssignment = true;
 				builder->isListAssignment = false;
+				builder->isMapAssignment = false;
 			} else {
 				FunctionBuilderAddLineNumber(builder, node);
 				FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
@@ -4214,16 +4530,17 @@ bool FunctionBuilderRecurse(Tokenizer *tokenizer, Node *node, FunctionBuilder *b
 			}
 		}
 	} else if (node->type == T_NUMERIC_LITERAL) {
+		uintptr_t instruction = builder->dataBytes;
 		FunctionBuilderAddLineNumber(builder, node);
 		FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
 		Value v = ASTNumericLiteralToValue(node);
 		FunctionBuilderAppend(builder, &v, sizeof(v));
+		FunctionBuilderMarkFusable(builder, instruction);
 	} else if (node->type == T_STRING_LITERAL) {
 		FunctionBuilderAddLineNumber(builder, node);
 		FunctionBuilderAppend(builder, &node->type, sizeof(node->type));
-		uint32_t textBytes = node->token.textBytes;
-		FunctionBuilderAppend(builder, &textBytes, sizeof(textBytes));
-		FunctionBuilderAppend(builder, node->token.text, textBytes);
+		uint32_t literal = FunctionBuilderInternString(builder, node->token.text, node->token.textBytes);
+		FunctionBuilderAppend(builder, &literal, sizeof(literal));
 	} else if (node->type == T_TRUE || node->type == T_FALSE) {
 		FunctionBuilderAddLineNumber(builder, node);
 		uint8_t b = T_NUMERIC_LITERAL;
@@ -4329,53 +4646,111 @@ bool ASTGenerate(Tokenizer *tokenizer, Node *root, ExecutionContext *context) {
 
 // --------------------------------- Main script execution.
 
-void HeapGarbageCollectMark(ExecutionContext *context, uintptr_t index) {
-	start:;
+// The heap is collected generationally.
+// Newly allocated entries are young, and are placed in the nursery. When the nursery fills up, a minor collection
+// traces the young entries reachable from the roots and the remembered set; the survivors are promoted, and the rest are freed.
+// Once enough entries have been promoted, a major collection traces the whole heap a little at a time on each allocation.
+// It uses a snapshot-at-the-beginning invariant: the roots are marked when it starts, HeapWriteBarrier traces an entry
+// before any of its references are overwritten, and entries allocated while it is in progress are treated as already traced.
+
+void HeapIndexListAppend(uintptr_t **list, size_t *count, size_t *allocated, uintptr_t index) {
+	if (*count == *allocated) {
+		*allocated = *allocated * 2 + 64;
+		*list = (uintptr_t *) AllocateResize(*list, *allocated * sizeof(uintptr_t)); // TODO Handling allocation failures.
+	}
+
+	(*list)[(*count)++] = index;
+}
+
+void HeapMarkPush(ExecutionContext *context, uintptr_t index, bool youngOnly) {
+	if (!index) return;
 	Assert(index < context->heapEntriesAllocated);
-	if (context->heap[index].gcMark) return;
-	context->heap[index].gcMark = true;
+	HeapEntry *entry = &context->heap[index];
+	if (entry->gcMark || (youngOnly && !entry->gcYoung)) return;
+	entry->gcMark = true;
+	HeapIndexListAppend(&context->heapMarkStack, &context->heapMarkStackCount, &context->heapMarkStackAllocated, index);
+}
+
+size_t HeapScanChildren(ExecutionContext *context, uintptr_t index, bool youngOnly) {
+	// Returns the number of references visited.
+	HeapEntry *entry = &context->heap[index];
 
-	if (context->heap[index].type == T_EOF || context->heap[index].type == T_STR || context->heap[index].type == T_FUNCPTR) {
+	if (entry->type == T_EOF || entry->type == T_STR || entry->type == T_FUNCPTR) {
 		// Nothing else to mark.
-	} else if (context->heap[index].type == T_STRUCT) {
-		for (uintptr_t i = 0; i < context->heap[index].fieldCount; i++) {
-			if (((uint8_t *) context->heap[index].fields)[-1 - i]) {
-				HeapGarbageCollectMark(context, context->heap[index].fields[i].i);
-			}
-		}
-	} else if (context->heap[index].type == T_LIST) {
-		if (context->heap[index].internalValuesAreManaged) {
-			for (uintptr_t i = 0; i < context->heap[index].length; i++) {
-				HeapGarbageCollectMark(context, context->heap[index].list[i].i);
+		return 0;
+	} else if (entry->type == T_STRUCT) {
+		for (uintptr_t i = 0; i < entry->fieldCount; i++) {
+			if (((uint8_t *) entry->fields)[-1 - i]) {
+				HeapMarkPush(context, entry->fields[i].i, youngOnly);
 			}
 		}
-	} else if (context->heap[index].type == T_CONCAT) {
-		uintptr_t index1 = context->heap[index].concat1;
-		uintptr_t index2 = context->heap[index].concat2;
 
-		if (context->heap[index1].type == T_CONCAT) {
-			HeapGarbageCollectMark(context, index2);
-			index = index1;
-		} else {
-			HeapGarbageCollectMark(context, index1);
-			index = index2;
+		return entry->fieldCount;
+	} else if (entry->type == T_LIST) {
+		if (!entry->internalValuesAreManaged) return 0;
+
+		for (uintptr_t i = 0; i < entry->length; i++) {
+			HeapMarkPush(context, entry->list[i].i, youngOnly);
 		}
 
-		goto start;
-	} else if (context->heap[index].type == T_OP_DISCARD || context->heap[index].type == T_OP_ASSERT) {
-		HeapGarbageCollectMark(context, context->heap[index].lambdaID);
-	} else if (context->heap[index].type == T_OP_CURRY) {
-		HeapGarbageCollectMark(context, context->heap[index].lambdaID);
+		return entry->length;
+	} else if (entry->type == T_MAP) {
+		if (!entry->internalKeysAreManaged && !entry->internalValuesAreManaged) return 0;
 
-		if (context->heap[index].internalValuesAreManaged) {
-			HeapGarbageCollectMark(context, context->heap[index].curryValue.i);
-		}
-	} else if (context->heap[index].type == T_ERR) {
-		if (context->heap[index].internalValuesAreManaged) {
-			HeapGarbageCollectMark(context, context->heap[index].errorValue.i);
+		for (uintptr_t i = 0; i < entry->mapCapacity; i++) {
+			if (!entry->mapSlots[i].used) continue;
+			if (entry->internalKeysAreManaged) HeapMarkPush(context, entry->mapSlots[i].key.i, youngOnly);
+			if (entry->internalValuesAreManaged) HeapMarkPush(context, entry->mapSlots[i].value.i, youngOnly);
 		}
+
+		return entry->mapCapacity;
+	} else if (entry->type == T_CONCAT) {
+		HeapMarkPush(context, entry->concat1, youngOnly);
+		HeapMarkPush(context, entry->concat2, youngOnly);
+		return 2;
+	} else if (entry->type == T_OP_DISCARD || entry->type == T_OP_ASSERT) {
+		HeapMarkPush(context, entry->lambdaID, youngOnly);
+		return 1;
+	} else if (entry->type == T_OP_CURRY) {
+		HeapMarkPush(context, entry->lambdaID, youngOnly);
+		if (entry->internalValuesAreManaged) HeapMarkPush(context, entry->curryValue.i, youngOnly);
+		return 2;
+	} else if (entry->type == T_ERR) {
+		if (entry->internalValuesAreManaged) HeapMarkPush(context, entry->errorValue.i, youngOnly);
+		return 1;
 	} else {
 		Assert(false);
+		return 0;
+	}
+}
+
+void HeapMarkRoots(ExecutionContext *context, bool youngOnly) {
+	for (uintptr_t i = 0; i < context->globalVariableCount; i++) {
+		if (context->globalVariableIsManaged[i]) {
+			HeapMarkPush(context, context->globalVariables[i].i, youngOnly);
+		}
+	}
+
+	CoroutineState *c = context->allCoroutines;
+
+	while (c) {
+		for (uintptr_t i = 0; i < c->localVariableCount; i++) {
+			if (c->localVariableIsManaged[i]) {
+				HeapMarkPush(context, c->localVariables[i].i, youngOnly);
+			}
+		}
+
+		for (uintptr_t i = 0; i < c->stackPointer; i++) {
+			if (c->stackIsManaged[i]) {
+				HeapMarkPush(context, c->stack[i].i, youngOnly);
+			}
+		}
+
+		c = c->nextCoroutine;
+	}
+
+	for (uintptr_t i = 0; i < context->functionData->literalCount; i++) {
+		HeapMarkPush(context, context->functionData->literals[i].heapIndex, youngOnly);
 	}
 }
 
@@ -4386,6 +4761,8 @@ void HeapFreeEntry(ExecutionContext *context, uintptr_t i) {
 		AllocateResize((uint8_t *) context->heap[i].fields - context->heap[i].fieldCount, 0);
 	} else if (context->heap[i].type == T_LIST) {
 		AllocateResize(context->heap[i].list, 0);
+	} else if (context->heap[i].type == T_MAP) {
+		AllocateResize(context->heap[i].mapSlots, 0);
 	} else if (context->heap[i].type == T_OP_DISCARD || context->heap[i].type == T_OP_ASSERT 
 			|| context->heap[i].type == T_FUNCPTR || context->heap[i].type == T_OP_CURRY
 			|| context->heap[i].type == T_CONCAT || context->heap[i].type == T_ERR) {
@@ -4396,76 +4773,189 @@ void HeapFreeEntry(ExecutionContext *context, uintptr_t i) {
 	context->heap[i].type = T_ERROR;
 }
 
-uintptr_t HeapAllocate(ExecutionContext *context) {
-	if (!context->heapFirstUnusedEntry) {
-		// All heapEntriesAllocated entries are in use.
+void HeapReleaseEntry(ExecutionContext *context, uintptr_t i) {
+	if (context->heap[i].type != T_ERROR) HeapFreeEntry(context, i);
+	context->heap[i].nextUnusedEntry = context->heapFirstUnusedEntry;
+	context->heapFirstUnusedEntry = i;
+}
+
+void HeapGrow(ExecutionContext *context) {
+	// PrintDebug("\033[0;32mDoubling heap size from %d entries...\033[0m\n", context->heapEntriesAllocated);
+	uintptr_t oldSize = context->heapEntriesAllocated;
+	context->heapEntriesAllocated *= 2;
+	context->heap = (HeapEntry *) AllocateResize(context->heap, context->heapEntriesAllocated * sizeof(HeapEntry));
+
+	for (uintptr_t i = context->heapEntriesAllocated - 1; i >= oldSize; i--) {
+		context->heap[i].type = T_ERROR;
+		context->heap[i].nextUnusedEntry = context->heapFirstUnusedEntry;
+		context->heapFirstUnusedEntry = i;
+	}
+}
 
-		for (uintptr_t i = 0; i < context->heapEntriesAllocated; i++) {
-			context->heap[i].gcMark = false;
+void HeapWriteBarrier(ExecutionContext *context, uintptr_t index) {
+	// Call before modifying the managed values of a list or struct.
+	HeapEntry *entry = &context->heap[index];
+
+	if (context->heapPhase == HEAP_PHASE_MARK) {
+		if (!entry->gcScanned) {
+			// Trace the values the entry had when the collection started before they can be overwritten.
+			entry->gcMark = entry->gcScanned = true;
+			HeapScanChildren(context, index, false);
 		}
+	} else if (context->heapPhase == HEAP_PHASE_IDLE && !entry->gcYoung && !entry->gcRemembered) {
+		entry->gcRemembered = true;
+		HeapIndexListAppend(&context->heapRemembered, &context->heapRememberedCount, &context->heapRememberedAllocated, index);
+	}
+}
 
-		for (uintptr_t i = 0; i < context->globalVariableCount; i++) {
-			if (context->globalVariableIsManaged[i]) {
-				HeapGarbageCollectMark(context, context->globalVariables[i].i);
-			}
+void HeapMajorStart(ExecutionContext *context) {
+	Assert(context->heapPhase == HEAP_PHASE_IDLE && !context->heapNurseryCount && !context->heapRememberedCount);
+
+	if (context->heapEntriesAllocated - context->heapOldCount < context->heapEntriesAllocated / 4) {
+		// Leave enough free entries for the collection to finish incrementally.
+		HeapGrow(context);
+	}
+
+	context->heapPhase = HEAP_PHASE_MARK;
+	HeapMarkRoots(context, false);
+}
+
+uintptr_t HeapMajorStep(ExecutionContext *context, size_t work) {
+	// Returns the number of entries reclaimed.
+	uintptr_t reclaimed = 0;
+
+	while (work && context->heapPhase == HEAP_PHASE_MARK) {
+		if (!context->heapMarkStackCount) {
+			context->heapPhase = HEAP_PHASE_SWEEP;
+			context->heapSweepPosition = 1;
+			break;
 		}
 
-		CoroutineState *c = context->allCoroutines;
+		uintptr_t index = context->heapMarkStack[--context->heapMarkStackCount];
+		HeapEntry *entry = &context->heap[index];
+		if (entry->gcScanned) continue;
+		entry->gcScanned = true;
+		size_t cost = 1 + HeapScanChildren(context, index, false);
+		work = cost > work ? 0 : work - cost;
+	}
 
-		while (c) {
-			for (uintptr_t i = 0; i < c->localVariableCount; i++) {
-				if (c->localVariableIsManaged[i]) {
-					HeapGarbageCollectMark(context, c->localVariables[i].i);
-				}
-			}
+	while (work && context->heapPhase == HEAP_PHASE_SWEEP) {
+		if (context->heapSweepPosition == context->heapEntriesAllocated) {
+			// PrintDebug("\033[0;32mMajor collection finished with %d old entries.\033[0m\n", context->heapOldCount);
+			context->heapPhase = HEAP_PHASE_IDLE;
+			context->heapMajorThreshold = context->heapOldCount * 2;
+			if (context->heapMajorThreshold < HEAP_MAJOR_MINIMUM) context->heapMajorThreshold = HEAP_MAJOR_MINIMUM;
+			break;
+		}
 
-			for (uintptr_t i = 0; i < c->stackPointer; i++) {
-				if (c->stackIsManaged[i]) {
-					HeapGarbageCollectMark(context, c->stack[i].i);
-				}
-			}
+		uintptr_t index = context->heapSweepPosition++;
+		HeapEntry *entry = &context->heap[index];
 
-			c = c->nextCoroutine;
+		if (entry->type != T_ERROR && !entry->gcMark) {
+			HeapReleaseEntry(context, index);
+			context->heapOldCount--;
+			reclaimed++;
+		} else {
+			entry->gcMark = entry->gcScanned = false;
 		}
-		
-		uintptr_t *link = &context->heapFirstUnusedEntry;
-		uintptr_t reclaimed = 0;
 
-		for (uintptr_t i = 1; i < context->heapEntriesAllocated; i++) {
-			if (!context->heap[i].gcMark) {
-				// PrintDebug("\033[0;32mFreeing index %d...\033[0m\n", i);
-				HeapFreeEntry(context, i);
-				*link = i;
-				link = &context->heap[i].nextUnusedEntry;
-				reclaimed++;
-			}
+		work--;
+	}
+
+	return reclaimed;
+}
+
+uintptr_t HeapMinorCollection(ExecutionContext *context) {
+	// Returns the number of entries reclaimed.
+	Assert(context->heapPhase == HEAP_PHASE_IDLE);
+	HeapMarkRoots(context, true);
+
+	for (uintptr_t i = 0; i < context->heapRememberedCount; i++) {
+		uintptr_t index = context->heapRemembered[i];
+		context->heap[index].gcRemembered = false;
+		HeapScanChildren(context, index, true);
+	}
+
+	context->heapRememberedCount = 0;
+
+	while (context->heapMarkStackCount) {
+		HeapScanChildren(context, context->heapMarkStack[--context->heapMarkStackCount], true);
+	}
+
+	uintptr_t reclaimed = 0;
+
+	for (uintptr_t i = 0; i < context->heapNurseryCount; i++) {
+		uintptr_t index = context->heapNursery[i];
+		HeapEntry *entry = &context->heap[index];
+
+		if (entry->gcMark) {
+			entry->gcMark = entry->gcYoung = false;
+			context->heapOldCount++;
+		} else {
+			entry->gcYoung = false;
+			HeapReleaseEntry(context, index);
+			reclaimed++;
 		}
+	}
 
-		if (reclaimed <= context->heapEntriesAllocated / 5) {
-			// PrintDebug("\033[0;32mFreed only %d/%d entries. Doubling heap size...\033[0m\n", reclaimed, context->heapEntriesAllocated);
+	// PrintDebug("\033[0;32mMinor collection freed %d/%d entries.\033[0m\n", reclaimed, context->heapNurseryCount);
+	context->heapNurseryCount = 0;
+
+	if (context->heapOldCount >= context->heapMajorThreshold) {
+		HeapMajorStart(context);
+	}
+
+	return reclaimed;
+}
+
+uintptr_t HeapAllocate(ExecutionContext *context) {
+	if (context->heapPhase != HEAP_PHASE_IDLE) {
+		HeapMajorStep(context, HEAP_INCREMENTAL_WORK);
+	} else if (context->heapNurseryCount == HEAP_NURSERY_ENTRIES) {
+		HeapMinorCollection(context);
+	}
+
+	if (!context->heapFirstUnusedEntry) {
+		// All heapEntriesAllocated entries are in use.
+		// Finish any collection in progress, or run a full collection, and grow the heap if too few entries were freed.
+		uintptr_t reclaimed = 0;
 
-			intptr_t linkIndex = link == &context->heapFirstUnusedEntry ? -1 
-				: ((intptr_t) link - (intptr_t) context->heap) / (intptr_t) sizeof(HeapEntry);
-			uintptr_t oldSize = context->heapEntriesAllocated;
-			context->heapEntriesAllocated *= 2;
-			context->heap = (HeapEntry *) AllocateResize(context->heap, context->heapEntriesAllocated * sizeof(HeapEntry));
-			link = linkIndex == -1 ? &context->heapFirstUnusedEntry : &context->heap[linkIndex].nextUnusedEntry;
+		if (context->heapPhase == HEAP_PHASE_IDLE) {
+			reclaimed += HeapMinorCollection(context);
 
-			for (uintptr_t i = oldSize; i < context->heapEntriesAllocated; i++) {
-				context->heap[i].type = T_ERROR;
-				*link = i;
-				link = &context->heap[i].nextUnusedEntry;
+			if (context->heapPhase == HEAP_PHASE_IDLE && reclaimed <= context->heapEntriesAllocated / 5) {
+				HeapMajorStart(context);
 			}
-		} else {
-			// PrintDebug("\033[0;32mFreed %d/%d entries.\033[0m\n", reclaimed, context->heapEntriesAllocated);
 		}
 
-		*link = 0;
+		reclaimed += HeapMajorStep(context, SIZE_MAX);
+
+		if (reclaimed <= context->heapEntriesAllocated / 5) {
+			HeapGrow(context);
+		}
 	}
 
 	uintptr_t index = context->heapFirstUnusedEntry;
 	Assert(index);
-	context->heapFirstUnusedEntry = context->heap[index].nextUnusedEntry;
+	HeapEntry *entry = &context->heap[index];
+	context->heapFirstUnusedEntry = entry->nextUnusedEntry;
+	entry->gcRemembered = false;
+
+	if (context->heapPhase == HEAP_PHASE_IDLE) {
+		if (!context->heapNursery) {
+			context->heapNursery = (uintptr_t *) AllocateResize(NULL, HEAP_NURSERY_ENTRIES * sizeof(uintptr_t)); // TODO Handling allocation failures.
+		}
+
+		entry->gcYoung = true;
+		entry->gcMark = entry->gcScanned = false;
+		context->heapNursery[context->heapNurseryCount++] = index;
+	} else {
+		// Anything the entry will reference was either reachable when the major collection started, or allocated after it.
+		entry->gcYoung = false;
+		entry->gcMark = entry->gcScanned = context->heapPhase == HEAP_PHASE_MARK || index >= context->heapSweepPosition;
+		context->heapOldCount++;
+	}
+
 	return index;
 }
 
@@ -4560,6 +5050,139 @@ void ScriptHeapEntryToString(ExecutionContext *context, HeapEntry *entry, const
 	}
 }
 
+uint32_t MapHashKey(ExecutionContext *context, HeapEntry *map, Value key) {
+	if (map->internalKeysAreManaged) {
+		const char *text;
+		size_t bytes;
+		ScriptHeapEntryToString(context, &context->heap[key.i], &text, &bytes);
+		return ScriptHashBytes(text, bytes);
+	} else {
+		return ((uint64_t) key.i * 0x9E3779B97F4A7C15) >> 32;
+	}
+}
+
+bool MapKeysEqual(ExecutionContext *context, HeapEntry *map, Value key1, Value key2) {
+	if (key1.i == key2.i) {
+		// Includes string literals, which are interned.
+		return true;
+	} else if (!map->internalKeysAreManaged) {
+		return false;
+	}
+
+	const char *text1, *text2;
+	size_t bytes1, bytes2;
+	ScriptHeapEntryToString(context, &context->heap[key1.i], &text1, &bytes1);
+	ScriptHeapEntryToString(context, &context->heap[key2.i], &text2, &bytes2);
+	return bytes1 == bytes2 && 0 == MemoryCompare(text1, text2, bytes1);
+}
+
+MapSlot *MapFind(ExecutionContext *context, HeapEntry *map, Value key, uint32_t hash) {
+	if (!map->mapCapacity) return NULL;
+	uint32_t mask = map->mapCapacity - 1;
+
+	for (uint32_t i = hash & mask; map->mapSlots[i].used; i = (i + 1) & mask) {
+		MapSlot *slot = &map->mapSlots[i];
+		if (slot->hash == hash && MapKeysEqual(context, map, slot->key, key)) return slot;
+	}
+
+	return NULL;
+}
+
+void MapResize(HeapEntry *map, uint32_t capacity) {
+	MapSlot *oldSlots = map->mapSlots;
+	uint32_t oldCapacity = map->mapCapacity;
+	map->mapSlots = (MapSlot *) AllocateResize(NULL, capacity * sizeof(MapSlot)); // TODO Handling allocation failures.
+	map->mapCapacity = capacity;
+
+	for (uintptr_t i = 0; i < capacity; i++) {
+		map->mapSlots[i].used = false;
+	}
+
+	for (uintptr_t i = 0; i < oldCapacity; i++) {
+		if (!oldSlots[i].used) continue;
+		uint32_t j = oldSlots[i].hash & (capacity - 1);
+		while (map->mapSlots[j].used) j = (j + 1) & (capacity - 1);
+		map->mapSlots[j] = oldSlots[i];
+	}
+
+	AllocateResize(oldSlots, 0);
+}
+
+void MapInsert(ExecutionContext *context, HeapEntry *map, Value key, Value value) {
+	uint32_t hash = MapHashKey(context, map, key);
+	MapSlot *slot = MapFind(context, map, key, hash);
+
+	if (slot) {
+		slot->value = value;
+		return;
+	}
+
+	if ((map->mapCount + 1) * 4 > map->mapCapacity * 3) {
+		// Keep the load factor below 3/4, so that probe sequences stay short and always end.
+		MapResize(map, map->mapCapacity ? map->mapCapacity * 2 : 8);
+	}
+
+	uint32_t mask = map->mapCapacity - 1;
+	uint32_t i = hash & mask;
+	while (map->mapSlots[i].used) i = (i + 1) & mask;
+	slot = &map->mapSlots[i];
+	slot->key = key;
+	slot->value = value;
+	slot->hash = hash;
+	slot->used = true;
+	map->mapCount++;
+}
+
+void MapRemove(HeapEntry *map, MapSlot *slot) {
+	// Shift the following entries in the probe sequence back, instead of leaving a tombstone.
+	uint32_t mask = map->mapCapacity - 1;
+	uint32_t hole = slot - map->mapSlots;
+
+	for (uint32_t i = (hole + 1) & mask; map->mapSlots[i].used; i = (i + 1) & mask) {
+		uint32_t home = map->mapSlots[i].hash & mask;
+
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			map->mapSlots[hole] = map->mapSlots[i];
+			hole = i;
+		}
+	}
+
+	map->mapSlots[hole].used = false;
+	map->mapCount--;
+}
+
+// Compares a local variable with a literal or a second local variable, and branches.
+// The operands are left in place from the fused T_VARIABLE, T_NUMERIC_LITERAL or T_VARIABLE, comparison and T_IF instructions.
+#define IF_LOCAL_COMPARE(comparison, rightIsLocal) \
+	{ \
+		CoroutineState *c = context->c; \
+		int32_t scopeIndex; \
+		MemoryCopy(&scopeIndex, &functionData[instructionPointer], sizeof(scopeIndex)); \
+		uintptr_t left = variableBase - scopeIndex; \
+		if (left >= c->localVariableCount) return -1; \
+		int64_t right; \
+		\
+		if (rightIsLocal) { \
+			MemoryCopy(&scopeIndex, &functionData[instructionPointer + 5], sizeof(scopeIndex)); \
+			uintptr_t index = variableBase - scopeIndex; \
+			if (index >= c->localVariableCount) return -1; \
+			right = c->localVariables[index].i; \
+			instructionPointer += 10; \
+		} else { \
+			MemoryCopy(&right, &functionData[instructionPointer + 5], sizeof(right)); \
+			instructionPointer += 14; \
+		} \
+		\
+		int32_t delta; \
+		MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta)); \
+		instructionPointer += c->localVariables[left].i comparison right ? (int32_t) sizeof(delta) : delta; \
+	}
+
+void ScriptTraceInstruction(ExecutionContext *context, uint8_t command, uintptr_t instructionPointer) {
+	PrintDebug("--> %d, %ld, %ld, %ld\n", command, instructionPointer, context->c->id, context->c->stackPointer);
+	if (debugBytecodeLevel >= 2) PrintBackTrace(context, instructionPointer, context->c, "");
+}
+
 int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *context) {
 	// TODO Things to verify if loading untrusted scripts -- is this a feature we will need?
 	// 	Checking we don't go off the end of the function body.
@@ -4568,18 +5191,79 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 	uintptr_t variableBase = context->c->localVariableCount - 1;
 	uint8_t *functionData = context->functionData->data;
+	uint8_t command;
 
-	while (true) {
-		uint8_t command = functionData[instructionPointer++];
+#ifdef SCRIPT_THREADED_DISPATCH
+	void *handlers[256], *tracers[256];
+	void **dispatch = handlers;
 
-		if (debugBytecodeLevel >= 1) {
-			PrintDebug("--> %d, %ld, %ld, %ld\n", command, instructionPointer - 1, context->c->id, context->c->stackPointer);
-			if (debugBytecodeLevel >= 2) PrintBackTrace(context, instructionPointer - 1, context->c, "");
-		}
+	for (uintptr_t i = 0; i < 256; i++) {
+		handlers[i] = &&opUnknown;
+	}
 
-		if (command == T_BLOCK || command == T_FUNCBODY) {
-			uint16_t newVariableCount = functionData[instructionPointer + 0] + (functionData[instructionPointer + 1] << 8); 
-			instructionPointer += 2;
+#define REGISTER_OPCODE(x) handlers[x] = &&op_ ## x;
+	REGISTER_OPCODE(T_BLOCK) REGISTER_OPCODE(T_FUNCBODY) REGISTER_OPCODE(T_EXIT_SCOPE)
+	REGISTER_OPCODE(T_NUMERIC_LITERAL) REGISTER_OPCODE(T_NULL) REGISTER_OPCODE(T_STRING_LITERAL)
+	REGISTER_OPCODE(T_CONCAT) REGISTER_OPCODE(T_INTERPOLATE_STR) REGISTER_OPCODE(T_INTERPOLATE_BOOL)
+	REGISTER_OPCODE(T_INTERPOLATE_INT) REGISTER_OPCODE(T_INTERPOLATE_FLOAT) REGISTER_OPCODE(T_INTERPOLATE_ILIST)
+	REGISTER_OPCODE(T_VARIABLE) REGISTER_OPCODE(T_EQUALS) REGISTER_OPCODE(T_EQUALS_DOT) REGISTER_OPCODE(T_EQUALS_LIST)
+	REGISTER_OPCODE(T_INDEX_LIST) REGISTER_OPCODE(T_EQUALS_MAP) REGISTER_OPCODE(T_INDEX_MAP) REGISTER_OPCODE(T_OP_HAS)
+	REGISTER_OPCODE(T_OP_DELETE_KEY) REGISTER_OPCODE(T_OP_KEYS) REGISTER_OPCODE(T_OP_VALUES) REGISTER_OPCODE(T_OP_FIRST)
+	REGISTER_OPCODE(T_OP_LAST) REGISTER_OPCODE(T_DOT)
+	REGISTER_OPCODE(T_BIT_SHIFT_LEFT) REGISTER_OPCODE(T_BIT_SHIFT_RIGHT) REGISTER_OPCODE(T_BITWISE_OR)
+	REGISTER_OPCODE(T_BITWISE_AND) REGISTER_OPCODE(T_BITWISE_XOR) REGISTER_OPCODE(T_ADD)
+	REGISTER_OPCODE(T_ADD_VARIABLE) REGISTER_OPCODE(T_ADD_LITERAL) REGISTER_OPCODE(T_MINUS) REGISTER_OPCODE(T_ASTERISK)
+	REGISTER_OPCODE(T_SLASH) REGISTER_OPCODE(T_NEGATE) REGISTER_OPCODE(T_BITWISE_NOT) REGISTER_OPCODE(T_FLOAT_ADD)
+	REGISTER_OPCODE(T_FLOAT_MINUS) REGISTER_OPCODE(T_FLOAT_ASTERISK) REGISTER_OPCODE(T_FLOAT_SLASH)
+	REGISTER_OPCODE(T_FLOAT_NEGATE) REGISTER_OPCODE(T_LESS_THAN) REGISTER_OPCODE(T_GREATER_THAN)
+	REGISTER_OPCODE(T_LT_OR_EQUAL) REGISTER_OPCODE(T_GT_OR_EQUAL) REGISTER_OPCODE(T_DOUBLE_EQUALS)
+	REGISTER_OPCODE(T_NOT_EQUALS) REGISTER_OPCODE(T_LOGICAL_NOT) REGISTER_OPCODE(T_FLOAT_LESS_THAN)
+	REGISTER_OPCODE(T_FLOAT_GREATER_THAN) REGISTER_OPCODE(T_FLOAT_LT_OR_EQUAL) REGISTER_OPCODE(T_FLOAT_GT_OR_EQUAL)
+	REGISTER_OPCODE(T_FLOAT_DOUBLE_EQUALS) REGISTER_OPCODE(T_FLOAT_NOT_EQUALS) REGISTER_OPCODE(T_STR_DOUBLE_EQUALS)
+	REGISTER_OPCODE(T_STR_NOT_EQUALS) REGISTER_OPCODE(T_OP_LEN) REGISTER_OPCODE(T_INDEX) REGISTER_OPCODE(T_CALL)
+	REGISTER_OPCODE(T_IF) REGISTER_OPCODE(T_IF_GREATER_THAN) REGISTER_OPCODE(T_IF_LESS_THAN)
+	REGISTER_OPCODE(T_IF_GT_OR_EQUAL) REGISTER_OPCODE(T_IF_LT_OR_EQUAL) REGISTER_OPCODE(T_IF_DOUBLE_EQUALS)
+	REGISTER_OPCODE(T_IF_NOT_EQUALS) REGISTER_OPCODE(T_IF_LOCAL_GREATER_THAN_LITERAL) REGISTER_OPCODE(T_IF_LOCAL_LESS_THAN_LITERAL)
+	REGISTER_OPCODE(T_IF_LOCAL_GT_OR_EQUAL_LITERAL) REGISTER_OPCODE(T_IF_LOCAL_LT_OR_EQUAL_LITERAL)
+	REGISTER_OPCODE(T_IF_LOCAL_DOUBLE_EQUALS_LITERAL) REGISTER_OPCODE(T_IF_LOCAL_NOT_EQUALS_LITERAL)
+	REGISTER_OPCODE(T_IF_LOCAL_GREATER_THAN_LOCAL) REGISTER_OPCODE(T_IF_LOCAL_LESS_THAN_LOCAL)
+	REGISTER_OPCODE(T_IF_LOCAL_GT_OR_EQUAL_LOCAL) REGISTER_OPCODE(T_IF_LOCAL_LT_OR_EQUAL_LOCAL)
+	REGISTER_OPCODE(T_IF_LOCAL_DOUBLE_EQUALS_LOCAL) REGISTER_OPCODE(T_IF_LOCAL_NOT_EQUALS_LOCAL)
+	REGISTER_OPCODE(T_LOCAL_ADD_LITERAL) REGISTER_OPCODE(T_LOCAL_ADD_LOCAL)
+	REGISTER_OPCODE(T_LOGICAL_OR) REGISTER_OPCODE(T_LOGICAL_AND)
+	REGISTER_OPCODE(T_BRANCH) REGISTER_OPCODE(T_POP) REGISTER_OPCODE(T_DUP) REGISTER_OPCODE(T_SWAP)
+	REGISTER_OPCODE(T_ROT3) REGISTER_OPCODE(T_ASSERT) REGISTER_OPCODE(T_ERR_CAST) REGISTER_OPCODE(T_OP_SUCCESS)
+	REGISTER_OPCODE(T_OP_ASSERT_ERR) REGISTER_OPCODE(T_OP_ERROR) REGISTER_OPCODE(T_OP_DEFAULT)
+	REGISTER_OPCODE(T_PERSIST) REGISTER_OPCODE(T_NEW) REGISTER_OPCODE(T_OP_RESIZE) REGISTER_OPCODE(T_OP_ADD)
+	REGISTER_OPCODE(T_OP_INSERT) REGISTER_OPCODE(T_OP_INSERT_MANY) REGISTER_OPCODE(T_OP_DELETE)
+	REGISTER_OPCODE(T_OP_DELETE_MANY) REGISTER_OPCODE(T_OP_DELETE_ALL) REGISTER_OPCODE(T_OP_FIND_AND_DELETE)
+	REGISTER_OPCODE(T_OP_FIND) REGISTER_OPCODE(T_OP_FIND_AND_DEL_STR) REGISTER_OPCODE(T_OP_FIND_STR)
+	REGISTER_OPCODE(T_OP_DISCARD) REGISTER_OPCODE(T_OP_ASSERT) REGISTER_OPCODE(T_OP_CURRY) REGISTER_OPCODE(T_OP_ASYNC)
+	REGISTER_OPCODE(T_AWAIT) REGISTER_OPCODE(T_REPL_RESULT) REGISTER_OPCODE(T_END_FUNCTION) REGISTER_OPCODE(T_EXTCALL)
+#undef REGISTER_OPCODE
+
+	if (debugBytecodeLevel >= 1) {
+		// Route every instruction through traceInstruction, so that the handlers themselves don't need to check.
+		for (uintptr_t i = 0; i < 256; i++) tracers[i] = &&traceInstruction;
+		dispatch = tracers;
+	}
+
+	DISPATCH();
+
+	traceInstruction:;
+	ScriptTraceInstruction(context, command, instructionPointer - 1);
+	goto *handlers[command];
+#else
+	while (true) {
+		command = functionData[instructionPointer++];
+		if (debugBytecodeLevel >= 1) ScriptTraceInstruction(context, command, instructionPointer - 1);
+
+		switch (command) {
+#endif
+
+		OPCODE(T_BLOCK) OPCODE(T_FUNCBODY) {
+			uint16_t newVariableCount = functionData[instructionPointer + 0] + (functionData[instructionPointer + 1] << 8); 
+			instructionPointer += 2;
 
 			if (context->c->localVariableCount + newVariableCount > context->c->localVariablesAllocated) {
 				// TODO Handling memory errors here.
@@ -4602,12 +5286,12 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			}
 
 			context->c->localVariableCount += newVariableCount;
-		} else if (command == T_EXIT_SCOPE) {
+		} INSTRUCTION(T_EXIT_SCOPE) {
 			uint16_t count = functionData[instructionPointer + 0] + (functionData[instructionPointer + 1] << 8); 
 			instructionPointer += 2;
 			if (context->c->localVariableCount < count) return -1;
 			context->c->localVariableCount -= count;
-		} else if (command == T_NUMERIC_LITERAL) {
+		} INSTRUCTION(T_NUMERIC_LITERAL) {
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
 				PrintError4(context, instructionPointer - 1, "Stack overflow.\n");
 				return 0;
@@ -4616,7 +5300,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stackIsManaged[context->c->stackPointer] = false;
 			MemoryCopy(&context->c->stack[context->c->stackPointer++], &functionData[instructionPointer], sizeof(Value));
 			instructionPointer += sizeof(Value);
-		} else if (command == T_NULL) {
+		} INSTRUCTION(T_NULL) {
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
 				PrintError4(context, instructionPointer - 1, "Stack overflow.\n");
 				return 0;
@@ -4624,29 +5308,33 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stackIsManaged[context->c->stackPointer] = true;
 			context->c->stack[context->c->stackPointer++].i = 0;
-		} else if (command == T_STRING_LITERAL) {
+		} INSTRUCTION(T_STRING_LITERAL) {
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
 				PrintError4(context, instructionPointer - 1, "Stack overflow.\n");
 				return 0;
 			}
 
-			uint32_t textBytes;
-			MemoryCopy(&textBytes, &functionData[instructionPointer], sizeof(textBytes));
-			instructionPointer += sizeof(textBytes);
+			uint32_t literalIndex;
+			MemoryCopy(&literalIndex, &functionData[instructionPointer], sizeof(literalIndex));
+			instructionPointer += sizeof(literalIndex);
+			if (literalIndex >= context->functionData->literalCount) return -1;
+			StringLiteral *literal = &context->functionData->literals[literalIndex];
 
-			// TODO Handle memory allocation failures here.
-			uintptr_t index = HeapAllocate(context);
-			context->heap[index].type = T_STR;
-			context->heap[index].text = (char *) AllocateResize(NULL, textBytes);
-			context->heap[index].bytes = textBytes;
-			MemoryCopy(context->heap[index].text, &functionData[instructionPointer], textBytes);
-			instructionPointer += textBytes;
+			if (!literal->heapIndex) {
+				// TODO Handle memory allocation failures here.
+				uintptr_t index = HeapAllocate(context);
+				context->heap[index].type = T_STR;
+				context->heap[index].text = (char *) AllocateResize(NULL, literal->bytes);
+				context->heap[index].bytes = literal->bytes;
+				MemoryCopy(context->heap[index].text, context->functionData->literalText + literal->offset, literal->bytes);
+				literal->heapIndex = index;
+			}
 
 			Value v;
-			v.i = index;
+			v.i = literal->heapIndex;
 			context->c->stackIsManaged[context->c->stackPointer] = true;
 			context->c->stack[context->c->stackPointer++] = v;
-		} else if (command == T_CONCAT) {
+		} INSTRUCTION(T_CONCAT) {
 			if (context->c->stackPointer < 2) return -1;
 			uint64_t index1 = context->c->stack[context->c->stackPointer - 2].i;
 			uint64_t index2 = context->c->stack[context->c->stackPointer - 1].i;
@@ -4670,9 +5358,8 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 2].i = index;
 			context->c->stackPointer--;
-		} else if (command == T_INTERPOLATE_STR || command == T_INTERPOLATE_BOOL 
-				|| command == T_INTERPOLATE_INT || command == T_INTERPOLATE_FLOAT
-				|| command == T_INTERPOLATE_ILIST) {
+		} INSTRUCTION(T_INTERPOLATE_STR) OPCODE(T_INTERPOLATE_BOOL) 
+				OPCODE(T_INTERPOLATE_INT) OPCODE(T_INTERPOLATE_FLOAT) OPCODE(T_INTERPOLATE_ILIST) {
 			STACK_READ_STRING(text1, bytes1, 3);
 			STACK_READ_STRING(text3, bytes3, 1);
 
@@ -4745,7 +5432,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			if (freeText) AllocateResize(freeText, 0);
 
 			context->c->stackPointer -= 2;
-		} else if (command == T_VARIABLE) {
+		} INSTRUCTION(T_VARIABLE) {
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
 				PrintDebug("Stack overflow.\n");
 				return -1;
@@ -4765,7 +5452,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				context->c->stackIsManaged[context->c->stackPointer] = context->c->localVariableIsManaged[scopeIndex];
 				context->c->stack[context->c->stackPointer++] = context->c->localVariables[scopeIndex];
 			}
-		} else if (command == T_EQUALS) {
+		} INSTRUCTION(T_EQUALS) {
 			if (!context->c->stackPointer) return -1;
 			int32_t scopeIndex;
 			MemoryCopy(&scopeIndex, &functionData[instructionPointer], sizeof(scopeIndex));
@@ -4781,7 +5468,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				if (context->c->localVariableIsManaged[scopeIndex] != context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 				context->c->localVariables[scopeIndex] = context->c->stack[--context->c->stackPointer];
 			}
-		} else if (command == T_EQUALS_DOT) {
+		} INSTRUCTION(T_EQUALS_DOT) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 
@@ -4803,12 +5490,13 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			if (isManaged) fieldIndex = -fieldIndex - 1;
 			if (fieldIndex < 0 || fieldIndex >= entry->fieldCount) return -1;
 
+			HeapWriteBarrier(context, index);
 			entry->fields[fieldIndex] = context->c->stack[context->c->stackPointer - 2];
 			if (isManaged != context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 			((uint8_t *) entry->fields - 1)[-fieldIndex] = isManaged;
 
 			context->c->stackPointer -= 2;
-		} else if (command == T_EQUALS_LIST) {
+		} INSTRUCTION(T_EQUALS_LIST) {
 			if (context->c->stackPointer < 3) return -1;
 			if (context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
@@ -4831,11 +5519,12 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, context->c->stack[context->c->stackPointer - 2].i);
 			entry->list[index] = context->c->stack[context->c->stackPointer - 3];
 			if (entry->internalValuesAreManaged != context->c->stackIsManaged[context->c->stackPointer - 3]) return -1;
 
 			context->c->stackPointer -= 3;
-		} else if (command == T_INDEX_LIST) {
+		} INSTRUCTION(T_INDEX_LIST) {
 			if (context->c->stackPointer < 2) return -1;
 			if (context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
@@ -4861,7 +5550,100 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stack[context->c->stackPointer - 2] = entry->list[index];
 			context->c->stackIsManaged[context->c->stackPointer - 2] = entry->internalValuesAreManaged;
 			context->c->stackPointer--;
-		} else if (command == T_OP_FIRST || command == T_OP_LAST) {
+		} INSTRUCTION(T_EQUALS_MAP) {
+			if (context->c->stackPointer < 3) return -1;
+			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
+
+			uint64_t index = context->c->stack[context->c->stackPointer - 2].i;
+
+			if (!index) {
+				PrintError4(context, instructionPointer - 1, "The map is null.\n");
+				return 0;
+			}
+
+			if (context->heapEntriesAllocated <= index) return -1;
+			HeapEntry *entry = &context->heap[index];
+			if (entry->type != T_MAP) return -1;
+			if (entry->internalKeysAreManaged != context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
+			if (entry->internalValuesAreManaged != context->c->stackIsManaged[context->c->stackPointer - 3]) return -1;
+
+			HeapWriteBarrier(context, index);
+			MapInsert(context, entry, context->c->stack[context->c->stackPointer - 1], context->c->stack[context->c->stackPointer - 3]);
+			context->c->stackPointer -= 3;
+		} INSTRUCTION(T_INDEX_MAP) OPCODE(T_OP_HAS) OPCODE(T_OP_DELETE_KEY) {
+			if (context->c->stackPointer < 2) return -1;
+			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
+
+			uint64_t index = context->c->stack[context->c->stackPointer - 2].i;
+
+			if (!index) {
+				PrintError4(context, instructionPointer - 1, "The map is null.\n");
+				return 0;
+			}
+
+			if (context->heapEntriesAllocated <= index) return -1;
+			HeapEntry *entry = &context->heap[index];
+			if (entry->type != T_MAP) return -1;
+			if (entry->internalKeysAreManaged != context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
+
+			Value key = context->c->stack[context->c->stackPointer - 1];
+			MapSlot *slot = MapFind(context, entry, key, MapHashKey(context, entry, key));
+
+			if (command == T_INDEX_MAP) {
+				if (!slot) {
+					if (entry->internalKeysAreManaged) {
+						STACK_READ_STRING(keyText, keyBytes, 1);
+						PrintError4(context, instructionPointer - 1, "The key '%.*s' is not in the map.\n", (int) keyBytes, keyText);
+					} else {
+						PrintError4(context, instructionPointer - 1, "The key %ld is not in the map.\n", key.i);
+					}
+
+					return 0;
+				}
+
+				context->c->stack[context->c->stackPointer - 2] = slot->value;
+				context->c->stackIsManaged[context->c->stackPointer - 2] = entry->internalValuesAreManaged;
+			} else {
+				if (slot && command == T_OP_DELETE_KEY) {
+					HeapWriteBarrier(context, index);
+					MapRemove(entry, slot);
+				}
+
+				context->c->stack[context->c->stackPointer - 2].i = slot != NULL;
+				context->c->stackIsManaged[context->c->stackPointer - 2] = false;
+			}
+
+			context->c->stackPointer--;
+		} INSTRUCTION(T_OP_KEYS) OPCODE(T_OP_VALUES) {
+			if (context->c->stackPointer < 1) return -1;
+			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
+
+			uint64_t index = context->c->stack[context->c->stackPointer - 1].i;
+
+			if (!index) {
+				PrintError4(context, instructionPointer - 1, "The map is null.\n");
+				return 0;
+			}
+
+			if (context->heapEntriesAllocated <= index) return -1;
+			if (context->heap[index].type != T_MAP) return -1;
+
+			// The map stays on the stack, so it cannot be freed by the allocation.
+			uintptr_t listIndex = HeapAllocate(context);
+			HeapEntry *entry = &context->heap[index];
+			HeapEntry *list = &context->heap[listIndex];
+			list->type = T_LIST;
+			list->internalValuesAreManaged = command == T_OP_KEYS ? entry->internalKeysAreManaged : entry->internalValuesAreManaged;
+			list->length = list->allocated = entry->mapCount;
+			list->list = (Value *) AllocateResize(NULL, entry->mapCount * sizeof(Value)); // TODO Handling allocation failures.
+
+			for (uintptr_t i = 0, j = 0; i < entry->mapCapacity; i++) {
+				if (!entry->mapSlots[i].used) continue;
+				list->list[j++] = command == T_OP_KEYS ? entry->mapSlots[i].key : entry->mapSlots[i].value;
+			}
+
+			context->c->stack[context->c->stackPointer - 1].i = listIndex;
+		} INSTRUCTION(T_OP_FIRST) OPCODE(T_OP_LAST) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 
@@ -4883,7 +5665,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 1] = entry->list[command == T_OP_FIRST ? 0 : entry->length - 1];
 			context->c->stackIsManaged[context->c->stackPointer - 1] = entry->internalValuesAreManaged;
-		} else if (command == T_DOT) {
+		} INSTRUCTION(T_DOT) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 
@@ -4910,39 +5692,80 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 1] = entry->fields[fieldIndex];
 			context->c->stackIsManaged[context->c->stackPointer - 1] = isManaged;
-		} else if (command == T_BIT_SHIFT_LEFT) {
+		} INSTRUCTION(T_BIT_SHIFT_LEFT) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i << context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_BIT_SHIFT_RIGHT) {
+		} INSTRUCTION(T_BIT_SHIFT_RIGHT) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i >> context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_BITWISE_OR) {
+		} INSTRUCTION(T_BITWISE_OR) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i | context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_BITWISE_AND) {
+		} INSTRUCTION(T_BITWISE_AND) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i & context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_BITWISE_XOR) {
+		} INSTRUCTION(T_BITWISE_XOR) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i ^ context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_ADD) {
+		} INSTRUCTION(T_ADD) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i + context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_MINUS) {
+		} INSTRUCTION(T_ADD_VARIABLE) {
+			if (context->c->stackPointer < 1) return -1;
+			int32_t scopeIndex;
+			MemoryCopy(&scopeIndex, &functionData[instructionPointer], sizeof(scopeIndex));
+			instructionPointer += sizeof(scopeIndex);
+
+			if (scopeIndex >= 0) {
+				if ((uintptr_t) scopeIndex >= context->globalVariableCount) return -1;
+				context->c->stack[context->c->stackPointer - 1].i += context->globalVariables[scopeIndex].i;
+			} else {
+				scopeIndex = variableBase - scopeIndex;
+				if ((uintptr_t) scopeIndex >= context->c->localVariableCount) return -1;
+				context->c->stack[context->c->stackPointer - 1].i += context->c->localVariables[scopeIndex].i;
+			}
+		} INSTRUCTION(T_ADD_LITERAL) {
+			if (context->c->stackPointer < 1) return -1;
+			Value literal;
+			MemoryCopy(&literal, &functionData[instructionPointer], sizeof(literal));
+			instructionPointer += sizeof(literal);
+			context->c->stack[context->c->stackPointer - 1].i += literal.i;
+		} INSTRUCTION(T_LOCAL_ADD_LITERAL) {
+			// The operands are left in place from the fused T_VARIABLE and T_ADD_LITERAL instructions.
+			CoroutineState *c = context->c;
+			int32_t scopeIndex;
+			Value literal;
+			MemoryCopy(&scopeIndex, &functionData[instructionPointer], sizeof(scopeIndex));
+			MemoryCopy(&literal, &functionData[instructionPointer + 5], sizeof(literal));
+			instructionPointer += 13;
+			uintptr_t index = variableBase - scopeIndex;
+			if (index >= c->localVariableCount) return -1;
+			c->localVariables[index].i += literal.i;
+		} INSTRUCTION(T_LOCAL_ADD_LOCAL) {
+			// The operands are left in place from the fused T_VARIABLE and T_ADD_VARIABLE instructions.
+			CoroutineState *c = context->c;
+			int32_t scopeIndex, otherScopeIndex;
+			MemoryCopy(&scopeIndex, &functionData[instructionPointer], sizeof(scopeIndex));
+			MemoryCopy(&otherScopeIndex, &functionData[instructionPointer + 5], sizeof(otherScopeIndex));
+			instructionPointer += 9;
+			uintptr_t index = variableBase - scopeIndex, otherIndex = variableBase - otherScopeIndex;
+			if (index >= c->localVariableCount || otherIndex >= c->localVariableCount) return -1;
+			c->localVariables[index].i += c->localVariables[otherIndex].i;
+		} INSTRUCTION(T_MINUS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i - context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_ASTERISK) {
+		} INSTRUCTION(T_ASTERISK) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i * context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_SLASH) {
+		} INSTRUCTION(T_SLASH) {
 			if (context->c->stackPointer < 2) return -1;
 
 			if (0 == context->c->stack[context->c->stackPointer - 1].i) {
@@ -4952,90 +5775,91 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f / context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_NEGATE) {
+		} INSTRUCTION(T_NEGATE) {
 			if (context->c->stackPointer < 1) return -1;
 			context->c->stack[context->c->stackPointer - 1].i = -context->c->stack[context->c->stackPointer - 1].i;
-		} else if (command == T_BITWISE_NOT) {
+		} INSTRUCTION(T_BITWISE_NOT) {
 			if (context->c->stackPointer < 1) return -1;
 			context->c->stack[context->c->stackPointer - 1].i = ~context->c->stack[context->c->stackPointer - 1].i;
-		} else if (command == T_FLOAT_ADD) {
+		} INSTRUCTION(T_FLOAT_ADD) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].f = context->c->stack[context->c->stackPointer - 2].f + context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_MINUS) {
+		} INSTRUCTION(T_FLOAT_MINUS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].f = context->c->stack[context->c->stackPointer - 2].f - context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_ASTERISK) {
+		} INSTRUCTION(T_FLOAT_ASTERISK) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].f = context->c->stack[context->c->stackPointer - 2].f * context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_SLASH) {
+		} INSTRUCTION(T_FLOAT_SLASH) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].f = context->c->stack[context->c->stackPointer - 2].f / context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_NEGATE) {
+		} INSTRUCTION(T_FLOAT_NEGATE) {
 			if (context->c->stackPointer < 1) return -1;
 			context->c->stack[context->c->stackPointer - 1].f = -context->c->stack[context->c->stackPointer - 1].f;
-		} else if (command == T_LESS_THAN) {
+		} INSTRUCTION(T_LESS_THAN) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i < context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_GREATER_THAN) {
+		} INSTRUCTION(T_GREATER_THAN) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i > context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_LT_OR_EQUAL) {
+		} INSTRUCTION(T_LT_OR_EQUAL) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i <= context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_GT_OR_EQUAL) {
+		} INSTRUCTION(T_GT_OR_EQUAL) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i >= context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_DOUBLE_EQUALS) {
+		} INSTRUCTION(T_DOUBLE_EQUALS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i == context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_NOT_EQUALS) {
+		} INSTRUCTION(T_NOT_EQUALS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].i != context->c->stack[context->c->stackPointer - 1].i;
 			context->c->stackPointer--;
-		} else if (command == T_LOGICAL_NOT) {
+		} INSTRUCTION(T_LOGICAL_NOT) {
 			if (context->c->stackPointer < 1) return -1;
 			context->c->stack[context->c->stackPointer - 1].i = !context->c->stack[context->c->stackPointer - 1].i;
-		} else if (command == T_FLOAT_LESS_THAN) {
+		} INSTRUCTION(T_FLOAT_LESS_THAN) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f < context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_GREATER_THAN) {
+		} INSTRUCTION(T_FLOAT_GREATER_THAN) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f > context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_LT_OR_EQUAL) {
+		} INSTRUCTION(T_FLOAT_LT_OR_EQUAL) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f <= context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_GT_OR_EQUAL) {
+		} INSTRUCTION(T_FLOAT_GT_OR_EQUAL) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f >= context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_DOUBLE_EQUALS) {
+		} INSTRUCTION(T_FLOAT_DOUBLE_EQUALS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f == context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_FLOAT_NOT_EQUALS) {
+		} INSTRUCTION(T_FLOAT_NOT_EQUALS) {
 			if (context->c->stackPointer < 2) return -1;
 			context->c->stack[context->c->stackPointer - 2].i = context->c->stack[context->c->stackPointer - 2].f != context->c->stack[context->c->stackPointer - 1].f;
 			context->c->stackPointer--;
-		} else if (command == T_STR_DOUBLE_EQUALS || command == T_STR_NOT_EQUALS) {
+		} INSTRUCTION(T_STR_DOUBLE_EQUALS) OPCODE(T_STR_NOT_EQUALS) {
 			STACK_READ_STRING(text1, bytes1, 2);
 			STACK_READ_STRING(text2, bytes2, 1);
-			bool equal = bytes1 == bytes2 && 0 == MemoryCompare(text1, text2, bytes1);
+			bool equal = context->c->stack[context->c->stackPointer - 2].i == context->c->stack[context->c->stackPointer - 1].i
+				|| (bytes1 == bytes2 && 0 == MemoryCompare(text1, text2, bytes1));
 			context->c->stack[context->c->stackPointer - 2].i = command == T_STR_NOT_EQUALS ? !equal : equal;
 			context->c->stackIsManaged[context->c->stackPointer - 2] = false;
 			context->c->stackPointer--;
-		} else if (command == T_OP_LEN) {
+		} INSTRUCTION(T_OP_LEN) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			uint64_t index = context->c->stack[context->c->stackPointer - 1].i;
@@ -5044,13 +5868,15 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			if (entry->type == T_LIST) {
 				context->c->stack[context->c->stackPointer - 1].i = entry->length;
+			} else if (entry->type == T_MAP) {
+				context->c->stack[context->c->stackPointer - 1].i = entry->mapCount;
 			} else {
 				STACK_READ_STRING(stringText, stringBytes, 1);
 				context->c->stack[context->c->stackPointer - 1].i = stringBytes;
 			}
 
 			context->c->stackIsManaged[context->c->stackPointer - 1] = false;
-		} else if (command == T_INDEX) {
+		} INSTRUCTION(T_INDEX) {
 			if (context->c->stackPointer < 2) return -1;
 			STACK_READ_STRING(text, bytes, 2);
 			if (context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
@@ -5071,7 +5897,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stack[context->c->stackPointer - 2].i = index;
 			context->c->stackIsManaged[context->c->stackPointer - 2] = true;
 			context->c->stackPointer--;
-		} else if (command == T_CALL) {
+		} INSTRUCTION(T_CALL) {
 			callCommand:;
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
@@ -5124,34 +5950,100 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			link->assertResult = assertResult;
 			instructionPointer = newBody.i;
 			variableBase = context->c->localVariableCount - 1;
-		} else if (command == T_IF) {
+		} INSTRUCTION(T_IF) {
 			if (context->c->stackPointer < 1) return -1;
 			Value condition = context->c->stack[--context->c->stackPointer];
 			int32_t delta;
 			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
 			instructionPointer += condition.i ? (int32_t) sizeof(delta) : delta; 
-		} else if (command == T_LOGICAL_OR) {
+		} INSTRUCTION(T_IF_GREATER_THAN) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i > context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_LESS_THAN) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i < context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_GT_OR_EQUAL) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i >= context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_LT_OR_EQUAL) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i <= context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_DOUBLE_EQUALS) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i == context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_NOT_EQUALS) {
+			if (context->c->stackPointer < 2) return -1;
+			context->c->stackPointer -= 2;
+			bool condition = context->c->stack[context->c->stackPointer].i != context->c->stack[context->c->stackPointer + 1].i;
+			int32_t delta;
+			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
+			instructionPointer += condition ? (int32_t) sizeof(delta) : delta; 
+		} INSTRUCTION(T_IF_LOCAL_GREATER_THAN_LITERAL) {
+			IF_LOCAL_COMPARE(>, false);
+		} INSTRUCTION(T_IF_LOCAL_LESS_THAN_LITERAL) {
+			IF_LOCAL_COMPARE(<, false);
+		} INSTRUCTION(T_IF_LOCAL_GT_OR_EQUAL_LITERAL) {
+			IF_LOCAL_COMPARE(>=, false);
+		} INSTRUCTION(T_IF_LOCAL_LT_OR_EQUAL_LITERAL) {
+			IF_LOCAL_COMPARE(<=, false);
+		} INSTRUCTION(T_IF_LOCAL_DOUBLE_EQUALS_LITERAL) {
+			IF_LOCAL_COMPARE(==, false);
+		} INSTRUCTION(T_IF_LOCAL_NOT_EQUALS_LITERAL) {
+			IF_LOCAL_COMPARE(!=, false);
+		} INSTRUCTION(T_IF_LOCAL_GREATER_THAN_LOCAL) {
+			IF_LOCAL_COMPARE(>, true);
+		} INSTRUCTION(T_IF_LOCAL_LESS_THAN_LOCAL) {
+			IF_LOCAL_COMPARE(<, true);
+		} INSTRUCTION(T_IF_LOCAL_GT_OR_EQUAL_LOCAL) {
+			IF_LOCAL_COMPARE(>=, true);
+		} INSTRUCTION(T_IF_LOCAL_LT_OR_EQUAL_LOCAL) {
+			IF_LOCAL_COMPARE(<=, true);
+		} INSTRUCTION(T_IF_LOCAL_DOUBLE_EQUALS_LOCAL) {
+			IF_LOCAL_COMPARE(==, true);
+		} INSTRUCTION(T_IF_LOCAL_NOT_EQUALS_LOCAL) {
+			IF_LOCAL_COMPARE(!=, true);
+		} INSTRUCTION(T_LOGICAL_OR) {
 			if (context->c->stackPointer < 1) return -1;
 			Value condition = context->c->stack[context->c->stackPointer - 1];
 			int32_t delta;
 			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
 			instructionPointer += condition.i ? delta : (int32_t) sizeof(delta); 
 			if (!condition.i) context->c->stackPointer--;
-		} else if (command == T_LOGICAL_AND) {
+		} INSTRUCTION(T_LOGICAL_AND) {
 			if (context->c->stackPointer < 1) return -1;
 			Value condition = context->c->stack[context->c->stackPointer - 1];
 			int32_t delta;
 			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
 			instructionPointer += condition.i ? (int32_t) sizeof(delta) : delta; 
 			if (condition.i) context->c->stackPointer--;
-		} else if (command == T_BRANCH) {
+		} INSTRUCTION(T_BRANCH) {
 			int32_t delta;
 			MemoryCopy(&delta, &functionData[instructionPointer], sizeof(delta));
 			instructionPointer += delta; 
-		} else if (command == T_POP) {
+		} INSTRUCTION(T_POP) {
 			if (context->c->stackPointer < 1) return -1;
 			context->c->stackPointer--;
-		} else if (command == T_DUP) {
+		} INSTRUCTION(T_DUP) {
 			if (context->c->stackPointer < 1) return -1;
 
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
@@ -5162,7 +6054,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stack[context->c->stackPointer] = context->c->stack[context->c->stackPointer - 1];
 			context->c->stackIsManaged[context->c->stackPointer] = context->c->stackIsManaged[context->c->stackPointer - 1];
 			context->c->stackPointer++;
-		} else if (command == T_SWAP) {
+		} INSTRUCTION(T_SWAP) {
 			if (context->c->stackPointer < 2) return -1;
 			Value v1 = context->c->stack[context->c->stackPointer - 1];
 			Value v2 = context->c->stack[context->c->stackPointer - 2];
@@ -5172,7 +6064,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stack[context->c->stackPointer - 2] = v1;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = m2;
 			context->c->stackIsManaged[context->c->stackPointer - 2] = m1;
-		} else if (command == T_ROT3) {
+		} INSTRUCTION(T_ROT3) {
 			if (context->c->stackPointer < 3) return -1;
 			Value v1 = context->c->stack[context->c->stackPointer - 1];
 			Value v2 = context->c->stack[context->c->stackPointer - 2];
@@ -5186,7 +6078,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stackIsManaged[context->c->stackPointer - 1] = m3;
 			context->c->stackIsManaged[context->c->stackPointer - 2] = m1;
 			context->c->stackIsManaged[context->c->stackPointer - 3] = m2;
-		} else if (command == T_ASSERT) {
+		} INSTRUCTION(T_ASSERT) {
 			if (context->c->stackPointer < 1) return -1;
 			Value condition = context->c->stack[--context->c->stackPointer];
 
@@ -5194,7 +6086,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				PrintError4(context, instructionPointer - 1, "Assertion failed.\n");
 				return 0;
 			}
-		} else if (command == T_ERR_CAST) {
+		} INSTRUCTION(T_ERR_CAST) {
 			if (context->c->stackPointer < 1) return -1;
 
 			// TODO Handle memory allocation failures here.
@@ -5208,7 +6100,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			v.i = index;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = true;
 			context->c->stack[context->c->stackPointer - 1] = v;
-		} else if (command == T_OP_SUCCESS) {
+		} INSTRUCTION(T_OP_SUCCESS) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			uintptr_t index = context->c->stack[context->c->stackPointer - 1].i;
@@ -5223,7 +6115,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 1].i = success;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = false;
-		} else if (command == T_OP_ASSERT_ERR) {
+		} INSTRUCTION(T_OP_ASSERT_ERR) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			uintptr_t index = context->c->stack[context->c->stackPointer - 1].i;
@@ -5248,7 +6140,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				context->c->stack[context->c->stackPointer - 1] = entry->errorValue;
 				context->c->stackIsManaged[context->c->stackPointer - 1] = entry->internalValuesAreManaged;
 			}
-		} else if (command == T_OP_ERROR) {
+		} INSTRUCTION(T_OP_ERROR) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			uintptr_t index = context->c->stack[context->c->stackPointer - 1].i;
@@ -5269,7 +6161,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stack[context->c->stackPointer - 1].i = index;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = true;
-		} else if (command == T_OP_DEFAULT) {
+		} INSTRUCTION(T_OP_DEFAULT) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 			uintptr_t index = context->c->stack[context->c->stackPointer - 2].i;
@@ -5289,11 +6181,11 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stack[context->c->stackPointer - 2] = context->c->stack[context->c->stackPointer - 1];
 			context->c->stackIsManaged[context->c->stackPointer - 2] = context->c->stackIsManaged[context->c->stackPointer - 1];
 			context->c->stackPointer--;
-		} else if (command == T_PERSIST) {
+		} INSTRUCTION(T_PERSIST) {
 			if (!ExternalPersistWrite(context, NULL)) {
 				return 0;
 			}
-		} else if (command == T_NEW) {
+		} INSTRUCTION(T_NEW) {
 			if (context->c->stackPointer == context->c->stackEntriesAllocated) {
 				PrintError4(context, instructionPointer - 1, "Stack overflow.\n");
 				return 0;
@@ -5302,7 +6194,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			int16_t fieldCount = functionData[instructionPointer + 0] + (functionData[instructionPointer + 1] << 8); 
 			instructionPointer += 2;
 			uintptr_t index = HeapAllocate(context);
-			context->heap[index].type = fieldCount >= 0 ? T_STRUCT : fieldCount >= -2 ? T_LIST : T_ERR;
+			context->heap[index].type = fieldCount >= 0 ? T_STRUCT : fieldCount >= -2 ? T_LIST : fieldCount >= -4 ? T_ERR : T_MAP;
 
 			if (fieldCount >= 0) {
 				context->heap[index].fields = (Value *) ((uint8_t *) AllocateResize(NULL, fieldCount * (1 + sizeof(Value))) + fieldCount);
@@ -5319,6 +6211,11 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				context->heap[index].internalValuesAreManaged = fieldCount == -2;
 				context->heap[index].length = context->heap[index].allocated = 0;
 				context->heap[index].list = NULL;
+			} else if (fieldCount <= -5) {
+				context->heap[index].internalKeysAreManaged = fieldCount <= -7;
+				context->heap[index].internalValuesAreManaged = fieldCount == -6 || fieldCount == -8;
+				context->heap[index].mapCount = context->heap[index].mapCapacity = 0;
+				context->heap[index].mapSlots = NULL;
 			} else {
 				context->heap[index].internalValuesAreManaged = true;
 				context->heap[index].success = false;
@@ -5333,7 +6230,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			v.i = index;
 			context->c->stackIsManaged[context->c->stackPointer] = true;
 			context->c->stack[context->c->stackPointer++] = v;
-		} else if (command == T_OP_RESIZE) {
+		} INSTRUCTION(T_OP_RESIZE) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 
@@ -5355,6 +6252,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, index);
 			uint32_t oldLength = context->heap[index].length;
 			context->heap[index].length = newLength;
 			context->heap[index].allocated = newLength;
@@ -5367,7 +6265,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			}
 
 			context->c->stackPointer -= 2;
-		} else if (command == T_OP_ADD) {
+		} INSTRUCTION(T_OP_ADD) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 
@@ -5389,6 +6287,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, index);
 			uint32_t oldLength = context->heap[index].length;
 			entry->length = newLength;
 
@@ -5403,7 +6302,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			entry->list[oldLength] = context->c->stack[context->c->stackPointer - 1];
 
 			context->c->stackPointer -= 2;
-		} else if (command == T_OP_INSERT) {
+		} INSTRUCTION(T_OP_INSERT) {
 			if (context->c->stackPointer < 3) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 3]) return -1;
 
@@ -5425,6 +6324,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, index);
 			uint32_t oldLength = context->heap[index].length;
 			entry->length = newLength;
 
@@ -5452,7 +6352,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			entry->list[insertIndex] = context->c->stack[context->c->stackPointer - 2];
 
 			context->c->stackPointer -= 3;
-		} else if (command == T_OP_INSERT_MANY) {
+		} INSTRUCTION(T_OP_INSERT_MANY) {
 			if (context->c->stackPointer < 3) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 3]) return -1;
 
@@ -5480,6 +6380,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, index);
 			uint32_t oldLength = context->heap[index].length;
 			entry->length = newLength;
 
@@ -5509,7 +6410,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			}
 
 			context->c->stackPointer -= 3;
-		} else if (command == T_OP_DELETE || command == T_OP_DELETE_MANY) {
+		} INSTRUCTION(T_OP_DELETE) OPCODE(T_OP_DELETE_MANY) {
 			int stackIndexList = command == T_OP_DELETE ? 2 : 3;
 			int stackIndexIndex = command == T_OP_DELETE ? 1 : 2;
 			if (context->c->stackPointer < (uintptr_t) stackIndexList) return -1;
@@ -5549,13 +6450,15 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				return 0;
 			}
 
+			HeapWriteBarrier(context, index);
+
 			for (int64_t i = deleteIndex; i < newLength; i++) {
 				entry->list[i] = entry->list[i + deleteCount];
 			}
 
 			entry->length = newLength;
 			context->c->stackPointer -= command == T_OP_DELETE ? 2 : 3;
-		} else if (command == T_OP_DELETE_ALL) {
+		} INSTRUCTION(T_OP_DELETE_ALL) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 
@@ -5568,13 +6471,20 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			if (context->heapEntriesAllocated <= index) return -1;
 			HeapEntry *entry = &context->heap[index];
-			if (entry->type != T_LIST) return -1;
+			if (entry->type != T_LIST && entry->type != T_MAP) return -1;
+
+			HeapWriteBarrier(context, index);
+
+			if (entry->type == T_MAP) {
+				entry->mapCount = entry->mapCapacity = 0;
+				entry->mapSlots = (MapSlot *) AllocateResize(entry->mapSlots, 0);
+			} else {
+				entry->length = entry->allocated = 0;
+				entry->list = (Value *) AllocateResize(entry->list, 0);
+			}
 
-			context->heap[index].length = context->heap[index].allocated = 0;
-			context->heap[index].list = (Value *) AllocateResize(context->heap[index].list, 0);
 			context->c->stackPointer--;
-		} else if (command == T_OP_FIND_AND_DELETE || command == T_OP_FIND
-				|| command == T_OP_FIND_AND_DEL_STR || command == T_OP_FIND_STR) {
+		} INSTRUCTION(T_OP_FIND_AND_DELETE) OPCODE(T_OP_FIND) OPCODE(T_OP_FIND_AND_DEL_STR) OPCODE(T_OP_FIND_STR) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 
@@ -5609,6 +6519,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 					context->c->stack[context->c->stackPointer - 2].i = i;
 				} else {
 					context->c->stack[context->c->stackPointer - 2].i = 1;
+					HeapWriteBarrier(context, index);
 					entry->length--;
 
 					for (uintptr_t j = i; j < entry->length; j++) {
@@ -5621,7 +6532,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 
 			context->c->stackIsManaged[context->c->stackPointer - 2] = false;
 			context->c->stackPointer--;
-		} else if (command == T_OP_DISCARD || command == T_OP_ASSERT) {
+		} INSTRUCTION(T_OP_DISCARD) OPCODE(T_OP_ASSERT) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			int64_t id = context->c->stack[context->c->stackPointer - 1].i;
@@ -5630,7 +6541,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->heap[index].lambdaID = id;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = true;
 			context->c->stack[context->c->stackPointer - 1].i = index;
-		} else if (command == T_OP_CURRY) {
+		} INSTRUCTION(T_OP_CURRY) {
 			if (context->c->stackPointer < 2) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 2]) return -1;
 			bool valueIsManaged = context->c->stackIsManaged[context->c->stackPointer - 1];
@@ -5644,7 +6555,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->c->stackIsManaged[context->c->stackPointer - 2] = true;
 			context->c->stack[context->c->stackPointer - 2].i = index;
 			context->c->stackPointer--;
-		} else if (command == T_OP_ASYNC) {
+		} INSTRUCTION(T_OP_ASYNC) {
 			if (context->c->stackPointer < 1) return -1;
 			if (!context->c->stackIsManaged[context->c->stackPointer - 1]) return -1;
 			CoroutineState *c = (CoroutineState *) AllocateResize(NULL, sizeof(CoroutineState)); // TODO Handle allocation failure.
@@ -5668,7 +6579,7 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 			context->unblockedCoroutines = c;
 			context->c->stackIsManaged[context->c->stackPointer - 1] = false;
 			context->c->stack[context->c->stackPointer - 1].i = c->id;
-		} else if (command == T_AWAIT) {
+		} INSTRUCTION(T_AWAIT) {
 			awaitCommand:;
 			if (context->c->stackPointer < 1 && !context->c->externalCoroutine) return -1;
 
@@ -5811,10 +6722,10 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 				instructionPointer = 1; // There is a T_AWAIT command at address 1.
 				goto callCommand;
 			}
-		} else if (command == T_REPL_RESULT) {
+		} INSTRUCTION(T_REPL_RESULT) {
 			if (context->c->stackPointer < 1) return -1;
 			ExternalPassREPLResult(context, context->c->stack[--context->c->stackPointer]);
-		} else if (command == T_END_FUNCTION || command == T_EXTCALL) {
+		} INSTRUCTION(T_END_FUNCTION) OPCODE(T_EXTCALL) {
 			if (command == T_EXTCALL) {
 				uint16_t index = functionData[instructionPointer + 0] + (functionData[instructionPointer + 1] << 8); 
 				instructionPointer += 2;
@@ -5908,13 +6819,26 @@ int ScriptExecuteFunction(uintptr_t instructionPointer, ExecutionContext *contex
 					variableBase = item->variableBase;
 				}
 			} else {
-				break;
+				goto finished;
 			}
-		} else {
+		} DISPATCH();
+
+#ifdef SCRIPT_THREADED_DISPATCH
+		opUnknown:;
+#else
+		default:
+#endif
+		{
 			PrintDebug("Unknown command %d.\n", command);
 			return -1;
 		}
+
+#ifndef SCRIPT_THREADED_DISPATCH
+		}
 	}
+#endif
+
+	finished:;
 
 	if (context->allCoroutines->nextCoroutine || context->allCoroutines->startedByAsync) {
 		PrintError3("Script ended with unfinished tasks.\n");
@@ -6075,16 +6999,7 @@ int ScriptExecute(ExecutionContext *context, ImportData *mainModule) {
 		return 1;
 	}
 
-	Node mainFunctionArguments = { 0 };
-	mainFunctionArguments.type = T_ARGUMENTS;
-	Node mainFunctionReturn = { 0 };
-	mainFunctionReturn.type = T_VOID;
-	Node mainFunctionType = { 0 };
-	mainFunctionType.type = T_FUNCPTR;
-	mainFunctionType.firstChild = &mainFunctionArguments;
-	mainFunctionArguments.sibling = &mainFunctionReturn;
-
-	if (!ASTMatching(&mainFunctionType, mainModule->rootNode->scope->entries[ScopeLookupIndex(&n, mainModule->rootNode->scope, false, true)]->expressionType)) {
+	if (!ASTMatching(&globalExpressionTypeVoidFunction, mainModule->rootNode->scope->entries[ScopeLookupIndex(&n, mainModule->rootNode->scope, false, true)]->expressionType)) {
 		PrintError3("The start function '%.*s' should take no arguments and return 'void'.\n", startFunctionBytes, startFunction);
 		return 1;
 	}
@@ -6098,7 +7013,7 @@ int ScriptExecute(ExecutionContext *context, ImportData *mainModule) {
 		intptr_t index = ScopeLookupIndex(&n, module->rootNode->scope, true, false);
 
 		if (index != -1) {
-			if (!ASTMatching(&mainFunctionType, module->rootNode->scope->entries[ScopeLookupIndex(&n, module->rootNode->scope, false, true)]->expressionType)) {
+			if (!ASTMatching(&globalExpressionTypeVoidFunction, module->rootNode->scope->entries[ScopeLookupIndex(&n, module->rootNode->scope, false, true)]->expressionType)) {
 				PrintError3("The 'Initialise' function in the module '%s' should take no arguments and return 'void'.\n", module->path);
 				return 1;
 			}
@@ -6165,11 +7080,573 @@ void ScriptFree(ExecutionContext *context) {
 	}
 
 	AllocateResize(context->heap, 0);
+	AllocateResize(context->heapNursery, 0);
+	AllocateResize(context->heapRemembered, 0);
+	AllocateResize(context->heapMarkStack, 0);
 	AllocateResize(context->globalVariables, 0);
 	AllocateResize(context->globalVariableIsManaged, 0);
 	AllocateResize(context->functionData->lineNumbers, 0);
-	AllocateResize(context->functionData->data, 0);
+	AllocateResize(context->functionData->literals, 0);
+	AllocateResize(context->functionData->literalLookup, 0);
 	AllocateResize(context->scriptPersistFile, 0);
+
+	if (context->image) {
+		FileUnmap(context->image, context->imageBytes);
+	} else {
+		AllocateResize(context->functionData->data, 0);
+		AllocateResize(context->functionData->literalText, 0);
+	}
+}
+
+// --------------------------------- Bytecode images.
+
+// A bytecode image stores the output of the front end for a script and all of its imports, so that later runs
+// can map it and start executing straight away. Each module is stamped with the size and hash of its source;
+// if any of them have changed, or the image was written by a different build of the engine, it is ignored
+// and the script is compiled again. Only what execution needs is kept from the root scopes: the names of the
+// entries (for the start function, options and persistent variables) and the types of the global variables.
+
+#define SCRIPT_IMAGE_SIGNATURE (0x49425345) // "ESBI"
+#define SCRIPT_IMAGE_VERSION (2) // Increment when the layout of the image or the bytecode changes.
+
+#define SCRIPT_IMAGE_ENTRY_PERSISTENT (1 << 0)
+#define SCRIPT_IMAGE_ENTRY_VOID_FUNCTION (1 << 1) // The type matches globalExpressionTypeVoidFunction.
+
+typedef struct ScriptImageHeader {
+	uint32_t signature, version;
+	uint64_t engineStamp;
+	uint64_t imageBytes, imageHash; // The hash covers the whole image, with this field zeroed.
+	uint32_t moduleCount, mainModule;
+	uint32_t globalVariableCount, dataBytes;
+	uint32_t literalCount, literalTextBytes;
+	uint32_t functionCount, lineNumberCount;
+} ScriptImageHeader;
+
+typedef struct ScriptImageModule {
+	uint64_t sourceBytes, sourceHash;
+	uint32_t pathBytes, globalVariableOffset;
+	// Followed by the path.
+} ScriptImageModule;
+
+typedef struct ScriptImageScope {
+	uint32_t entryCount, variableEntryCount;
+	// Followed by the entries.
+} ScriptImageScope;
+
+typedef struct ScriptImageEntry {
+	uint32_t nameBytes;
+	uint8_t type, valueType, flags, unused;
+	// Followed by the name.
+} ScriptImageEntry;
+
+typedef struct ScriptImageGlobal {
+	uint32_t lambdaID; // Zero if the variable is not a function.
+	uint8_t isManaged, unused[3];
+} ScriptImageGlobal;
+
+typedef struct ScriptImageLiteral {
+	uint32_t offset, bytes, hash;
+} ScriptImageLiteral;
+
+typedef struct ScriptImageLineNumber {
+	uint32_t module, instructionPointer, lineNumber;
+	uint32_t function; // Index into the function names, plus one.
+} ScriptImageLineNumber;
+
+typedef struct ScriptImageWriter {
+	uint8_t *data;
+	size_t bytes, allocated;
+} ScriptImageWriter;
+
+typedef struct ScriptImageReader {
+	const uint8_t *data;
+	size_t bytes, position;
+} ScriptImageReader;
+
+uint64_t ScriptHashBytes64Continue(uint64_t hash, const void *data, size_t bytes) {
+	// FNV-1a.
+	for (uintptr_t i = 0; i < bytes; i++) {
+		hash = (hash ^ ((const uint8_t *) data)[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+uint64_t ScriptHashBytes64(const void *data, size_t bytes) {
+	return ScriptHashBytes64Continue(14695981039346656037ULL, data, bytes);
+}
+
+uint64_t ScriptImageEngineStamp() {
+	// The bytecode is only meaningful to the build of the engine that generated it.
+	const char build[] = __DATE__ " " __TIME__;
+	return ScriptHashBytes64(build, sizeof(build) - 1);
+}
+
+void ScriptImageWrite(ScriptImageWriter *writer, const void *data, size_t bytes) {
+	if (writer->bytes + bytes > writer->allocated) {
+		writer->allocated = writer->allocated * 2 + bytes;
+		writer->data = (uint8_t *) AllocateResize(writer->data, writer->allocated);
+	}
+
+	MemoryCopy(writer->data + writer->bytes, data, bytes);
+	writer->bytes += bytes;
+}
+
+uint64_t ScriptImageHash(const uint8_t *image, size_t imageBytes) {
+	ScriptImageHeader header;
+	MemoryCopy(&header, image, sizeof(header));
+	header.imageHash = 0;
+	uint64_t hash = ScriptHashBytes64(&header, sizeof(header));
+	return ScriptHashBytes64Continue(hash, image + sizeof(header), imageBytes - sizeof(header));
+}
+
+const uint8_t *ScriptImageRead(ScriptImageReader *reader, size_t bytes) {
+	// Returns NULL if the image is too short.
+	if (reader->bytes - reader->position < bytes) return NULL;
+	const uint8_t *data = reader->data + reader->position;
+	reader->position += bytes;
+	return data;
+}
+
+bool ScriptImageCheckLayout(const uint8_t *image, size_t imageBytes, const ScriptImageHeader *header) {
+	// Walk the image before anything is created from it, checking that the sizes and counts it contains fit inside it,
+	// and that its indices are in range. The image can then be loaded without further checks.
+	// The bytecode itself is not verified; see ScriptExecuteFunction.
+
+	ScriptImageReader reader = { 0 };
+	reader.data = image;
+	reader.bytes = imageBytes;
+	reader.position = sizeof(*header);
+	const uint8_t *data;
+
+	for (uintptr_t i = 0; i < header->moduleCount; i++) {
+		ScriptImageModule record;
+		if (!(data = ScriptImageRead(&reader, sizeof(record)))) return false;
+		MemoryCopy(&record, data, sizeof(record));
+		if (record.globalVariableOffset > header->globalVariableCount) return false;
+		if (!ScriptImageRead(&reader, record.pathBytes)) return false;
+	}
+
+	for (uintptr_t i = 0; i < header->moduleCount; i++) {
+		ScriptImageScope record;
+		if (!(data = ScriptImageRead(&reader, sizeof(record)))) return false;
+		MemoryCopy(&record, data, sizeof(record));
+		if (record.variableEntryCount > record.entryCount) return false;
+
+		for (uintptr_t j = 0; j < record.entryCount; j++) {
+			ScriptImageEntry entry;
+			if (!(data = ScriptImageRead(&reader, sizeof(entry)))) return false;
+			MemoryCopy(&entry, data, sizeof(entry));
+			if (!ScriptImageRead(&reader, entry.nameBytes)) return false;
+		}
+	}
+
+	for (uintptr_t i = 0; i < header->globalVariableCount; i++) {
+		ScriptImageGlobal global;
+		if (!(data = ScriptImageRead(&reader, sizeof(global)))) return false;
+		MemoryCopy(&global, data, sizeof(global));
+		if (global.lambdaID >= header->dataBytes) return false;
+	}
+
+	if (!ScriptImageRead(&reader, header->dataBytes)) return false;
+
+	for (uintptr_t i = 0; i < header->literalCount; i++) {
+		ScriptImageLiteral literal;
+		if (!(data = ScriptImageRead(&reader, sizeof(literal)))) return false;
+		MemoryCopy(&literal, data, sizeof(literal));
+		if ((uint64_t) literal.offset + literal.bytes > header->literalTextBytes) return false;
+	}
+
+	if (!ScriptImageRead(&reader, header->literalTextBytes)) return false;
+
+	for (uintptr_t i = 0; i < header->functionCount; i++) {
+		uint32_t nameBytes;
+		if (!(data = ScriptImageRead(&reader, sizeof(nameBytes)))) return false;
+		MemoryCopy(&nameBytes, data, sizeof(nameBytes));
+		if (!ScriptImageRead(&reader, nameBytes)) return false;
+	}
+
+	for (uintptr_t i = 0; i < header->lineNumberCount; i++) {
+		ScriptImageLineNumber lineNumber;
+		if (!(data = ScriptImageRead(&reader, sizeof(lineNumber)))) return false;
+		MemoryCopy(&lineNumber, data, sizeof(lineNumber));
+		if (lineNumber.module >= header->moduleCount || lineNumber.function > header->functionCount) return false;
+	}
+
+	return reader.position == reader.bytes;
+}
+
+void ScriptImageSave(ExecutionContext *context, ImportData *mainModule, const char *imagePath) {
+	FunctionBuilder *builder = context->functionData;
+	ScriptImageWriter writer = { 0 };
+	ScriptImageHeader header = { 0 };
+	ScriptImageWrite(&writer, &header, sizeof(header)); // Filled in at the end.
+
+	ImportData **modules = NULL;
+	size_t moduleCount = 0;
+
+	for (ImportData *module = importedModules; module; module = module->nextImport) {
+		if (module == mainModule) {
+			header.mainModule = moduleCount;
+		}
+
+		modules = (ImportData **) AllocateResize(modules, sizeof(ImportData *) * (moduleCount + 1));
+		modules[moduleCount++] = module;
+
+		ScriptImageModule record = { 0 };
+		record.sourceBytes = module->fileDataBytes;
+		record.sourceHash = ScriptHashBytes64(module->fileData, module->fileDataBytes);
+		record.pathBytes = module->pathBytes;
+		record.globalVariableOffset = module->globalVariableOffset;
+		ScriptImageWrite(&writer, &record, sizeof(record));
+		ScriptImageWrite(&writer, module->path, module->pathBytes);
+	}
+
+	for (uintptr_t i = 0; i < moduleCount; i++) {
+		Scope *scope = modules[i]->rootNode->scope;
+		ScriptImageScope record = { 0 };
+		record.entryCount = scope->entryCount;
+		record.variableEntryCount = scope->variableEntryCount;
+		ScriptImageWrite(&writer, &record, sizeof(record));
+
+		for (uintptr_t j = 0; j < scope->entryCount; j++) {
+			Node *node = scope->entries[j];
+			ScriptImageEntry entry = { 0 };
+			entry.nameBytes = node->token.textBytes;
+			entry.type = node->type;
+
+			if (node->expressionType) {
+				entry.valueType = node->expressionType->type;
+			}
+
+			if (node->isPersistentVariable) {
+				entry.flags |= SCRIPT_IMAGE_ENTRY_PERSISTENT;
+			}
+
+			if (node->expressionType && ASTMatching(&globalExpressionTypeVoidFunction, node->expressionType)) {
+				entry.flags |= SCRIPT_IMAGE_ENTRY_VOID_FUNCTION;
+			}
+
+			ScriptImageWrite(&writer, &entry, sizeof(entry));
+			ScriptImageWrite(&writer, node->token.text, node->token.textBytes);
+		}
+	}
+
+	for (uintptr_t i = 0; i < context->globalVariableCount; i++) {
+		// The only global variables initialised by the front end are functions, and options (which are parsed again on loading).
+		ScriptImageGlobal global = { 0 };
+		global.isManaged = context->globalVariableIsManaged[i];
+		uint64_t heapIndex = context->globalVariables[i].i;
+
+		if (global.isManaged && heapIndex && context->heap[heapIndex].type == T_FUNCPTR) {
+			global.lambdaID = context->heap[heapIndex].lambdaID;
+		}
+
+		ScriptImageWrite(&writer, &global, sizeof(global));
+	}
+
+	ScriptImageWrite(&writer, builder->data, builder->dataBytes);
+
+	for (uintptr_t i = 0; i < builder->literalCount; i++) {
+		ScriptImageLiteral literal = { 0 };
+		literal.offset = builder->literals[i].offset;
+		literal.bytes = builder->literals[i].bytes;
+		literal.hash = builder->literals[i].hash;
+		ScriptImageWrite(&writer, &literal, sizeof(literal));
+	}
+
+	ScriptImageWrite(&writer, builder->literalText, builder->literalTextBytes);
+
+	Token **functions = NULL;
+	size_t functionCount = 0;
+	uint32_t *lineNumberFunctions = (uint32_t *) AllocateResize(NULL, sizeof(uint32_t) * builder->lineNumberCount);
+
+	for (uintptr_t i = 0; i < builder->lineNumberCount; i++) {
+		Token *function = builder->lineNumbers[i].function;
+		uintptr_t index = functionCount;
+
+		if (!function) {
+			lineNumberFunctions[i] = 0;
+			continue;
+		} else if (i && builder->lineNumbers[i - 1].function == function) {
+			lineNumberFunctions[i] = lineNumberFunctions[i - 1];
+			continue;
+		}
+
+		for (uintptr_t j = 0; j < functionCount; j++) {
+			if (functions[j] == function) {
+				index = j;
+				break;
+			}
+		}
+
+		if (index == functionCount) {
+			functions = (Token **) AllocateResize(functions, sizeof(Token *) * (functionCount + 1));
+			functions[functionCount++] = function;
+
+			uint32_t nameBytes = function->textBytes;
+			ScriptImageWrite(&writer, &nameBytes, sizeof(nameBytes));
+			ScriptImageWrite(&writer, function->text, nameBytes);
+		}
+
+		lineNumberFunctions[i] = index + 1;
+	}
+
+	for (uintptr_t i = 0; i < builder->lineNumberCount; i++) {
+		ScriptImageLineNumber lineNumber = { 0 };
+		lineNumber.module = moduleCount;
+
+		for (uintptr_t j = 0; j < moduleCount; j++) {
+			if (modules[j] == builder->lineNumbers[i].importData) {
+				lineNumber.module = j;
+				break;
+			}
+		}
+
+		Assert(lineNumber.module != moduleCount);
+		lineNumber.instructionPointer = builder->lineNumbers[i].instructionPointer;
+		lineNumber.lineNumber = builder->lineNumbers[i].lineNumber;
+		lineNumber.function = lineNumberFunctions[i];
+		ScriptImageWrite(&writer, &lineNumber, sizeof(lineNumber));
+	}
+
+	header.signature = SCRIPT_IMAGE_SIGNATURE;
+	header.version = SCRIPT_IMAGE_VERSION;
+	header.engineStamp = ScriptImageEngineStamp();
+	header.imageBytes = writer.bytes;
+	header.moduleCount = moduleCount;
+	header.globalVariableCount = context->globalVariableCount;
+	header.dataBytes = builder->dataBytes;
+	header.literalCount = builder->literalCount;
+	header.literalTextBytes = builder->literalTextBytes;
+	header.functionCount = functionCount;
+	header.lineNumberCount = builder->lineNumberCount;
+	MemoryCopy(writer.data, &header, sizeof(header));
+	header.imageHash = ScriptImageHash(writer.data, writer.bytes);
+	MemoryCopy(writer.data, &header, sizeof(header));
+
+	// If the image cannot be saved, the script will be compiled again next time.
+	FileSave(imagePath, writer.data, writer.bytes);
+
+	AllocateResize(writer.data, 0);
+	AllocateResize(modules, 0);
+	AllocateResize(functions, 0);
+	AllocateResize(lineNumberFunctions, 0);
+}
+
+bool ScriptImageLoad(ExecutionContext *context, ImportData *mainModule, const char *imagePath) {
+	size_t imageBytes;
+	uint8_t *image = (uint8_t *) FileMap(imagePath, &imageBytes);
+
+	if (!image) {
+		return false;
+	}
+
+	ScriptImageHeader header;
+
+	if (imageBytes < sizeof(header)) {
+		FileUnmap(image, imageBytes);
+		return false;
+	}
+
+	MemoryCopy(&header, image, sizeof(header));
+
+	if (header.signature != SCRIPT_IMAGE_SIGNATURE || header.version != SCRIPT_IMAGE_VERSION
+			|| header.engineStamp != ScriptImageEngineStamp() || header.imageBytes != imageBytes
+			|| header.mainModule >= header.moduleCount || header.imageHash != ScriptImageHash(image, imageBytes)
+			|| !ScriptImageCheckLayout(image, imageBytes, &header)) {
+		FileUnmap(image, imageBytes);
+		return false;
+	}
+
+	// Check the dependency stamps before modifying the context, so that the script can still be compiled if they are out of date.
+
+	ScriptImageReader reader = { 0 };
+	reader.data = image;
+	reader.bytes = imageBytes;
+	reader.position = sizeof(header);
+
+	ImportData **modules = (ImportData **) AllocateResize(NULL, sizeof(ImportData *) * header.moduleCount);
+	size_t moduleCount = 0;
+	bool valid = true;
+
+	while (moduleCount < header.moduleCount) {
+		ScriptImageModule record;
+		MemoryCopy(&record, ScriptImageRead(&reader, sizeof(record)), sizeof(record));
+		const char *path = (const char *) ScriptImageRead(&reader, record.pathBytes);
+		ImportData *module;
+
+		if (moduleCount == header.mainModule) {
+			module = mainModule;
+			valid = module->pathBytes == record.pathBytes && 0 == MemoryCompare(module->path, path, record.pathBytes);
+		} else {
+			module = (ImportData *) AllocateFixed(sizeof(ImportData));
+			module->path = (char *) AllocateFixed(record.pathBytes + 1);
+			module->pathBytes = record.pathBytes;
+			MemoryCopy(module->path, path, record.pathBytes);
+			module->path[record.pathBytes] = 0;
+
+			if (record.pathBytes == 15 && 0 == MemoryCompare(path, "__base_module__", record.pathBytes)) {
+				module->fileData = baseModuleSource;
+				module->fileDataBytes = sizeof(baseModuleSource) - 1;
+			} else {
+				module->fileData = FileLoad(module->path, &module->fileDataBytes);
+			}
+		}
+
+		module->globalVariableOffset = record.globalVariableOffset;
+		modules[moduleCount++] = module;
+
+		valid = valid && module->fileData && module->fileDataBytes == record.sourceBytes
+			&& record.sourceHash == ScriptHashBytes64(module->fileData, module->fileDataBytes);
+
+		if (!valid) {
+			break;
+		}
+	}
+
+	if (!valid) {
+		for (uintptr_t i = 0; i < moduleCount; i++) {
+			if (modules[i] != mainModule && modules[i]->fileData != baseModuleSource) {
+				AllocateResize(modules[i]->fileData, 0);
+			}
+		}
+
+		AllocateResize(modules, 0);
+		FileUnmap(image, imageBytes);
+		return false;
+	}
+
+	// Rebuild the root scopes.
+
+	for (uintptr_t i = 0; i < moduleCount; i++) {
+		ScriptImageScope record;
+		MemoryCopy(&record, ScriptImageRead(&reader, sizeof(record)), sizeof(record));
+
+		Node *rootNode = (Node *) AllocateFixed(sizeof(Node));
+		rootNode->type = T_ROOT;
+		rootNode->importData = modules[i];
+		Scope *scope = rootNode->scope = (Scope *) AllocateFixed(sizeof(Scope));
+		scope->isRoot = true;
+		scope->entryCount = scope->entriesAllocated = record.entryCount;
+		scope->variableEntryCount = record.variableEntryCount;
+		scope->entries = (Node **) AllocateResize(NULL, sizeof(Node *) * record.entryCount);
+
+		for (uintptr_t j = 0; j < record.entryCount; j++) {
+			ScriptImageEntry entry;
+			MemoryCopy(&entry, ScriptImageRead(&reader, sizeof(entry)), sizeof(entry));
+
+			Node *node = (Node *) AllocateFixed(sizeof(Node));
+			node->type = entry.type;
+			node->isPersistentVariable = entry.flags & SCRIPT_IMAGE_ENTRY_PERSISTENT;
+			node->token.module = modules[i];
+			node->token.text = (const char *) ScriptImageRead(&reader, entry.nameBytes);
+			node->token.textBytes = entry.nameBytes;
+			node->parent = rootNode;
+			node->scope = scope;
+			node->importData = modules[i];
+
+			if (entry.flags & SCRIPT_IMAGE_ENTRY_VOID_FUNCTION) {
+				node->expressionType = &globalExpressionTypeVoidFunction;
+			} else if (entry.valueType) {
+				node->expressionType = (Node *) AllocateFixed(sizeof(Node));
+				node->expressionType->type = entry.valueType;
+			}
+
+			scope->entries[j] = node;
+		}
+
+		modules[i]->rootNode = rootNode;
+		*importedModulesLink = modules[i];
+		importedModulesLink = &modules[i]->nextImport;
+	}
+
+	// Create the global variables.
+
+	context->globalVariableCount = header.globalVariableCount;
+	context->globalVariables = (Value *) AllocateResize(NULL, sizeof(Value) * context->globalVariableCount);
+	context->globalVariableIsManaged = (bool *) AllocateResize(NULL, sizeof(bool) * context->globalVariableCount);
+
+	for (uintptr_t i = 0; i < context->globalVariableCount; i++) {
+		context->globalVariables[i].i = 0;
+		context->globalVariableIsManaged[i] = false;
+	}
+
+	for (uintptr_t i = 0; i < context->globalVariableCount; i++) {
+		ScriptImageGlobal global;
+		MemoryCopy(&global, ScriptImageRead(&reader, sizeof(global)), sizeof(global));
+		context->globalVariableIsManaged[i] = global.isManaged;
+
+		if (global.lambdaID) {
+			uintptr_t heapIndex = HeapAllocate(context);
+			context->heap[heapIndex].type = T_FUNCPTR;
+			context->heap[heapIndex].lambdaID = global.lambdaID;
+			context->globalVariables[i].i = heapIndex;
+		}
+	}
+
+	// The bytecode and the literal text are used directly from the image.
+
+	FunctionBuilder *builder = context->functionData;
+	builder->data = (uint8_t *) ScriptImageRead(&reader, header.dataBytes);
+	builder->dataBytes = builder->dataAllocated = header.dataBytes;
+	builder->literalCount = builder->literalsAllocated = header.literalCount;
+	builder->literals = (StringLiteral *) AllocateResize(NULL, sizeof(StringLiteral) * header.literalCount);
+
+	for (uintptr_t i = 0; i < header.literalCount; i++) {
+		ScriptImageLiteral literal;
+		MemoryCopy(&literal, ScriptImageRead(&reader, sizeof(literal)), sizeof(literal));
+		builder->literals[i].offset = literal.offset;
+		builder->literals[i].bytes = literal.bytes;
+		builder->literals[i].hash = literal.hash;
+		builder->literals[i].heapIndex = 0;
+	}
+
+	builder->literalText = (char *) ScriptImageRead(&reader, header.literalTextBytes);
+	builder->literalTextBytes = builder->literalTextAllocated = header.literalTextBytes;
+
+	Token *functions = (Token *) AllocateFixed(sizeof(Token) * header.functionCount);
+
+	for (uintptr_t i = 0; i < header.functionCount; i++) {
+		uint32_t nameBytes;
+		MemoryCopy(&nameBytes, ScriptImageRead(&reader, sizeof(nameBytes)), sizeof(nameBytes));
+		functions[i].text = (const char *) ScriptImageRead(&reader, nameBytes);
+		functions[i].textBytes = nameBytes;
+	}
+
+	builder->lineNumberCount = builder->lineNumbersAllocated = header.lineNumberCount;
+	builder->lineNumbers = (LineNumber *) AllocateResize(NULL, sizeof(LineNumber) * header.lineNumberCount);
+
+	for (uintptr_t i = 0; i < header.lineNumberCount; i++) {
+		ScriptImageLineNumber lineNumber;
+		MemoryCopy(&lineNumber, ScriptImageRead(&reader, sizeof(lineNumber)), sizeof(lineNumber));
+		builder->lineNumbers[i].importData = modules[lineNumber.module];
+		builder->lineNumbers[i].instructionPointer = lineNumber.instructionPointer;
+		builder->lineNumbers[i].lineNumber = lineNumber.lineNumber;
+		builder->lineNumbers[i].function = lineNumber.function ? &functions[lineNumber.function - 1] : NULL;
+	}
+
+	Assert(reader.position == reader.bytes);
+	builder->globalVariableOffset = mainModule->globalVariableOffset;
+	context->image = image;
+	context->imageBytes = imageBytes;
+	AllocateResize(modules, 0);
+	return true;
+}
+
+bool ScriptImageParseOptions(ExecutionContext *context) {
+	// ScriptLoad parses the options as each module is generated; do the same for the modules in the image.
+	bool success = true;
+
+	for (ImportData *module = importedModules; module && success; module = module->nextImport) {
+		context->rootNode = module->rootNode;
+		context->functionData->globalVariableOffset = module->globalVariableOffset;
+		success = ScriptParseOptions(context);
+	}
+
+	context->rootNode = NULL;
+	context->functionData->globalVariableOffset = context->mainModule->globalVariableOffset;
+	return success;
 }
 
 // --------------------------------- Helpers.
@@ -6257,6 +7734,7 @@ int ScriptExecuteFromFile(char *scriptPath, size_t scriptPathBytes, char *fileDa
 	context.heap[1].type = T_ERROR;
 	context.heap[1].nextUnusedEntry = 0;
 	context.heapFirstUnusedEntry = 1;
+	context.heapMajorThreshold = HEAP_MAJOR_MINIMUM;
 	context.c = (CoroutineState *) AllocateResize(0, sizeof(CoroutineState));
 	CoroutineState empty = { 0 };
 	*context.c = empty;
@@ -6264,7 +7742,19 @@ int ScriptExecuteFromFile(char *scriptPath, size_t scriptPathBytes, char *fileDa
 	context.c->previousCoroutineLink = &context.allCoroutines;
 	context.allCoroutines = context.c;
 
-	int result = ScriptLoad(tokenizer, &context, &importData, replMode) ? ScriptExecute(&context, &importData) : 1;
+	bool loaded;
+
+	if (!replMode && scriptImagePath && ScriptImageLoad(&context, &importData, scriptImagePath)) {
+		loaded = ScriptImageParseOptions(&context);
+	} else {
+		loaded = ScriptLoad(tokenizer, &context, &importData, replMode);
+
+		if (loaded && !replMode && scriptImagePath) {
+			ScriptImageSave(&context, &importData, scriptImagePath);
+		}
+	}
+
+	int result = loaded ? ScriptExecute(&context, &importData) : 1;
 	ScriptFree(&context);
 
 	importedModules = NULL;
@@ -6305,14 +7795,18 @@ int ExternalCharacterToByte(ExecutionContext *context, Value *returnValue) {
 
 #ifdef _WIN32
 #include <direct.h>
+#include <process.h>
 #include <windows.h>
 #define getcwd _getcwd
 #define popen _popen
 #define pclose _pclose
+#define getpid _getpid
 #define setenv(x, y, z) !SetEnvironmentVariable(x, y)
 #else
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <pthread.h>
@@ -7283,6 +8777,57 @@ void *FileLoad(const char *path, size_t *length) {
 	return buffer;
 }
 
+void *FileMap(const char *path, size_t *length) {
+#ifdef _WIN32
+	return FileLoad(path, length);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return NULL;
+	struct stat s;
+	void *data = NULL;
+
+	if (fstat(fd, &s) == 0 && s.st_size > 0) {
+		data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) data = NULL;
+		else *length = s.st_size;
+	}
+
+	close(fd);
+	return data;
+#endif
+}
+
+void FileUnmap(void *data, size_t length) {
+#ifdef _WIN32
+	(void) length;
+	free(data);
+#else
+	munmap(data, length);
+#endif
+}
+
+bool FileSave(const char *path, const void *data, size_t length) {
+	// Write to a temporary file and rename it, so that other processes never see a partially written file.
+	char *temporary = (char *) malloc(strlen(path) + 32);
+	if (!temporary) return false;
+	sprintf(temporary, "%s.%d.tmp", path, (int) getpid());
+	FILE *file = fopen(temporary, "wb");
+	bool success = false;
+
+	if (file) {
+		success = fwrite(data, 1, length, file) == length;
+		success = fclose(file) == 0 && success;
+#ifdef _WIN32
+		if (success) remove(path);
+#endif
+		success = success && rename(temporary, path) == 0;
+		if (!success) remove(temporary);
+	}
+
+	free(temporary);
+	return success;
+}
+
 int main(int argc, char **argv) {
 	if (argc < 2) {
 		fprintf(stderr, "Usage: %s <engine options...> <path to script> <script options...>\n", argv[0]);
@@ -7294,6 +8839,7 @@ int main(int argc, char **argv) {
 	sem_init(&externalCoroutineSemaphore, 0, 0);
 
 	char *scriptPath = NULL;
+	char *imageCacheDirectory = NULL;
 
 	for (int i = 1; i < argc; i++) {
 		if (argv[i][0] != '-') {
@@ -7307,6 +8853,8 @@ int main(int argc, char **argv) {
 			startFunctionBytes = strlen(argv[i]) - 8;
 		} else if (0 == memcmp(argv[i], "--debug-bytecode=", 17)) {
 			debugBytecodeLevel = atoi(argv[i] + 17);
+		} else if (0 == memcmp(argv[i], "--image-cache=", 14)) {
+			imageCacheDirectory = argv[i] + 14;
 		} else {
 			fprintf(stderr, "Unrecognised engine option: '%s'.\n", argv[i]);
 			return 1;
@@ -7319,6 +8867,16 @@ int main(int argc, char **argv) {
 	if (lastSlash) *lastSlash = 0;
 	else strcpy(scriptSourceDirectory, ".");
 
+	char *imagePath = NULL;
+
+	if (imageCacheDirectory) {
+		// Images are named after the hash of the script's path, so that scripts with the same name in different directories do not collide.
+		mkdir(imageCacheDirectory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+		imagePath = (char *) malloc(strlen(imageCacheDirectory) + 32);
+		sprintf(imagePath, "%s/%016llx.image", imageCacheDirectory, (unsigned long long) ScriptHashBytes64(scriptPath, strlen(scriptPath)));
+		scriptImagePath = imagePath;
+	}
+
 	size_t dataBytes;
 	void *data = FileLoad(scriptPath, &dataBytes);
 
@@ -7337,6 +8895,7 @@ int main(int argc, char **argv) {
 
 	free(scriptSourceDirectory);
 	free(optionsMatched);
+	free(imagePath);
 
 	return result;
 }